@@ -0,0 +1,99 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+
+#include "./Arena.h"
+
+namespace hw4 {
+
+// static
+const size_t Arena::kDefaultBlockSize = 4096;
+
+Arena::Arena(size_t block_size)
+  : blocks_(nullptr), cur_(nullptr), end_(nullptr),
+    block_size_(block_size), allocated_(0) {
+  AddBlock(block_size_);
+}
+
+Arena::~Arena() {
+  FreeBlocks();
+}
+
+void Arena::Reset() {
+  // If everything fit in one block, just rewind it.  Otherwise trade
+  // all the blocks in for one that's big enough for the lot.
+  size_t needed = allocated_;
+  if (blocks_->next != nullptr) {
+    FreeBlocks();
+    AddBlock(needed + needed / 4);
+  }
+  cur_ = reinterpret_cast<char *>(blocks_ + 1);
+  end_ = cur_ + blocks_->size;
+  allocated_ = 0;
+}
+
+size_t Arena::num_blocks() const {
+  size_t n = 0;
+  for (Block *b = blocks_; b != nullptr; b = b->next)
+    n++;
+  return n;
+}
+
+size_t Arena::capacity() const {
+  size_t n = 0;
+  for (Block *b = blocks_; b != nullptr; b = b->next)
+    n += b->size;
+  return n;
+}
+
+void Arena::Trim() {
+  FreeBlocks();
+  AddBlock(block_size_);
+  allocated_ = 0;
+}
+
+void *Arena::do_allocate(size_t bytes, size_t alignment) {
+  uintptr_t p = reinterpret_cast<uintptr_t>(cur_);
+  uintptr_t aligned = (p + alignment - 1) & ~(alignment - 1);
+  if (aligned + bytes > reinterpret_cast<uintptr_t>(end_)) {
+    AddBlock(bytes + alignment);
+    p = reinterpret_cast<uintptr_t>(cur_);
+    aligned = (p + alignment - 1) & ~(alignment - 1);
+  }
+  cur_ = reinterpret_cast<char *>(aligned + bytes);
+  allocated_ += bytes;
+  return reinterpret_cast<void *>(aligned);
+}
+
+void Arena::FreeBlocks() {
+  while (blocks_ != nullptr) {
+    Block *next = blocks_->next;
+    free(blocks_);
+    blocks_ = next;
+  }
+}
+
+void Arena::AddBlock(size_t bytes) {
+  size_t size = (bytes > block_size_) ? bytes : block_size_;
+  Block *b = static_cast<Block *>(malloc(sizeof(Block) + size));
+  if (b == nullptr)
+    throw std::bad_alloc();
+  b->next = blocks_;
+  b->size = size;
+  blocks_ = b;
+  cur_ = reinterpret_cast<char *>(b + 1);
+  end_ = cur_ + size;
+}
+
+}  // namespace hw4
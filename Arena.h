@@ -0,0 +1,96 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_ARENA_H_
+#define HW4_ARENA_H_
+
+#include <stddef.h>
+#include <memory_resource>
+
+namespace hw4 {
+
+// An Arena is a bump allocator for objects that all die at the same
+// time, such as everything allocated while handling one HTTP
+// request.  Allocation just advances a pointer through a block of
+// memory; deallocation is a no-op; Reset() frees everything at once.
+//
+// Arena is a std::pmr::memory_resource, so the standard containers
+// can live in it, e.g.:
+//
+//   Arena arena;
+//   std::pmr::vector<std::pmr::string> v(&arena);
+//
+// After a Reset() the arena keeps a single block big enough for
+// everything that was allocated since the previous Reset(), so once
+// it has seen a typical request, later requests cause no mallocs.
+//
+// An Arena is not thread-safe; each connection should have its own.
+class Arena : public std::pmr::memory_resource {
+ public:
+  // "block_size" is the size of the first block, and the minimum
+  // size of every block after it.
+  explicit Arena(size_t block_size = kDefaultBlockSize);
+  virtual ~Arena();
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  // Frees everything allocated from the arena.  Any objects still
+  // using arena memory must be gone (or never touched again).
+  void Reset();
+
+  // The number of bytes handed out since the last Reset().
+  size_t bytes_allocated() const { return allocated_; }
+
+  // The number of blocks currently held, and their total size.
+  size_t num_blocks() const;
+  size_t capacity() const;
+
+  // Like Reset(), but also gives back all but a single block of the
+  // initial size, e.g., after a huge request.
+  void Trim();
+
+  static const size_t kDefaultBlockSize;
+
+ private:
+  // Blocks are malloc'ed with this header in front of their memory.
+  struct Block {
+    Block *next;
+    size_t size;  // usable bytes after the header
+  };
+
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *, size_t, size_t) override { }
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+    noexcept override {
+    return this == &other;
+  }
+
+  // Pushes a new block with room for at least "bytes" bytes.
+  void AddBlock(size_t bytes);
+
+  // Frees every block.
+  void FreeBlocks();
+
+  // The most recently added block is first.
+  Block *blocks_;
+
+  // The unused part of the current block.
+  char *cur_;
+  char *end_;
+
+  size_t block_size_;
+  size_t allocated_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_ARENA_H_
@@ -0,0 +1,78 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "./AsyncIo.h"
+
+namespace hw4 {
+
+const size_t kFileChunkBytes = 65536;
+
+Task<bool> AsyncSendAll(IoLoop *loop, int fd, const char *data,
+                        size_t len) {
+  while (len > 0) {
+    int res = co_await AsyncSend(loop, fd, data, len);
+    if (res <= 0)
+      co_return false;
+    data += res;
+    len -= res;
+  }
+  co_return true;
+}
+
+Task<bool> AsyncSendFile(IoLoop *loop, int fd, const std::string &path,
+                         uint64_t offset, uint64_t len) {
+  int file_fd = co_await AsyncOpenAt(loop, AT_FDCWD, path.c_str(),
+                                     O_RDONLY | O_CLOEXEC);
+  if (file_fd < 0)
+    co_return false;
+
+  // Only one piece is in memory at a time, however slowly the client
+  // takes it.
+  std::unique_ptr<char[]> buf(
+      new char[std::min<uint64_t>(len, kFileChunkBytes) + 1]);
+  bool ok = true;
+  while (ok && len > 0) {
+    size_t want = std::min<uint64_t>(len, kFileChunkBytes);
+    int n = co_await AsyncRead(loop, file_fd, buf.get(), want, offset);
+    if (n <= 0) {
+      // The file shrank (or can't be read) after the headers promised
+      // all of it, so the connection is unusable.
+      ok = false;
+      break;
+    }
+    ok = co_await AsyncSendAll(loop, fd, buf.get(), n);
+    offset += n;
+    len -= n;
+  }
+  close(file_fd);
+  co_return ok;
+}
+
+void ResumeOn::await_suspend(std::coroutine_handle<> h) {
+  handle_ = h;
+  if (pool_ != nullptr) {
+    pool_->Dispatch(this);
+  } else {
+    loop_->Post([h]() { h.resume(); });
+  }
+}
+
+void ResumeOn::Run(ThreadPool::Task *t) {
+  static_cast<ResumeOn *>(t)->handle_.resume();
+}
+
+}  // namespace hw4
@@ -0,0 +1,170 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_ASYNCIO_H_
+#define HW4_ASYNCIO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <coroutine>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "./IoLoop.h"
+#include "./Task.h"
+#include "./ThreadPool.h"
+
+namespace hw4 {
+
+// Awaitable versions of the IoLoop operations, for Tasks (see Task.h)
+// running on the loop's thread:
+//
+//   int n = co_await AsyncSend(loop, fd, data, len);
+//
+// starts the Send() and suspends the Task, which the loop resumes
+// with the operation's result once it completes.  Results are as for
+// the corresponding IoLoop method.  A Task that hops to another
+// thread with ResumeOn() must hop back before using any of these.
+
+namespace asyncio_internal {
+
+// Starts an IoLoop operation by calling "start" with the callback
+// that resumes the awaiting coroutine.
+template <typename Start>
+class CallbackAwaiter {
+ public:
+  explicit CallbackAwaiter(Start start) : start_(std::move(start)) { }
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> h) {
+    // The coroutine may finish, freeing this awaiter, before the
+    // callback returns, so the callback mustn't touch it after
+    // resuming.
+    start_([this, h](int result) {
+      result_ = result;
+      h.resume();
+    });
+  }
+  int await_resume() const noexcept { return result_; }
+
+ private:
+  Start start_;
+  int result_ = 0;
+};
+
+template <typename Start>
+CallbackAwaiter<Start> MakeAwaiter(Start start) {
+  return CallbackAwaiter<Start>(std::move(start));
+}
+
+}  // namespace asyncio_internal
+
+// The outcome of AsyncRecv().  "data" holds the "result" bytes
+// received, and is only valid until the coroutine next suspends.
+struct RecvResult {
+  int result;
+  std::string_view data;
+};
+
+// Receives from socket "fd" once (see IoLoop::Recv()).
+class AsyncRecv {
+ public:
+  AsyncRecv(IoLoop *loop, int fd) : loop_(loop), fd_(fd) { }
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> h) {
+    loop_->Recv(fd_, false, [this, h](int result, std::string_view data) {
+      result_.result = result;
+      result_.data = data;
+      h.resume();
+    });
+  }
+  RecvResult await_resume() const noexcept { return result_; }
+
+ private:
+  IoLoop *loop_;
+  int fd_;
+  RecvResult result_ = {0, std::string_view()};
+};
+
+inline auto AsyncSend(IoLoop *loop, int fd, const char *data, size_t len) {
+  return asyncio_internal::MakeAwaiter([=](IoLoop::Callback cb) {
+    loop->Send(fd, data, len, std::move(cb));
+  });
+}
+
+inline auto AsyncPollIn(IoLoop *loop, int fd) {
+  return asyncio_internal::MakeAwaiter([=](IoLoop::Callback cb) {
+    loop->PollIn(fd, std::move(cb));
+  });
+}
+
+inline auto AsyncRead(IoLoop *loop, int fd, char *buf, size_t len,
+                      off_t offset) {
+  return asyncio_internal::MakeAwaiter([=](IoLoop::Callback cb) {
+    loop->Read(fd, buf, len, offset, std::move(cb));
+  });
+}
+
+inline auto AsyncOpenAt(IoLoop *loop, int dirfd, const char *path,
+                        int flags) {
+  return asyncio_internal::MakeAwaiter([=](IoLoop::Callback cb) {
+    loop->OpenAt(dirfd, path, flags, std::move(cb));
+  });
+}
+
+inline auto AsyncStatx(IoLoop *loop, int dirfd, const char *path,
+                       unsigned int mask, struct statx *stx) {
+  return asyncio_internal::MakeAwaiter([=](IoLoop::Callback cb) {
+    loop->Statx(dirfd, path, mask, stx, std::move(cb));
+  });
+}
+
+// Sends all "len" bytes at "data" to socket "fd", a Send() at a
+// time.  Returns false if the connection failed first.
+Task<bool> AsyncSendAll(IoLoop *loop, int fd, const char *data, size_t len);
+
+// Sends the "len" bytes of the file at "path" starting at "offset"
+// to socket "fd", reading it through the loop a kFileChunkBytes piece
+// at a time.  Returns false if the file couldn't be read or the
+// connection failed.
+Task<bool> AsyncSendFile(IoLoop *loop, int fd, const std::string &path,
+                         uint64_t offset, uint64_t len);
+extern const size_t kFileChunkBytes;
+
+// Moves the awaiting coroutine to a thread of "pool" (to do something
+// that blocks, or takes a while, without holding up a loop), or back
+// to "loop"'s thread, which picks it up in its next RunOnce().
+class ResumeOn : public ThreadPool::Task {
+ public:
+  explicit ResumeOn(ThreadPool *pool)
+    : ThreadPool::Task(&ResumeOn::Run), pool_(pool), loop_(nullptr) { }
+  explicit ResumeOn(IoLoop *loop)
+    : ThreadPool::Task(&ResumeOn::Run), pool_(nullptr), loop_(loop) { }
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> h);
+  void await_resume() const noexcept { }
+
+ private:
+  static void Run(ThreadPool::Task *t);
+
+  ThreadPool *pool_;
+  IoLoop *loop_;
+  std::coroutine_handle<> handle_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_ASYNCIO_H_
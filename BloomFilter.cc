@@ -0,0 +1,75 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include "./BloomFilter.h"
+#include "./HashMix.h"
+
+namespace hw4 {
+
+// static
+const int BloomFilter::kDefaultBitsPerKey = 10;
+
+// A block is a cache line: 8 words, 512 bits.
+static const size_t kWordsPerBlock = 8;
+static const uint32_t kBitsPerBlock = 512;
+
+BloomFilter::BloomFilter(size_t num_keys, int bits_per_key) {
+  if (bits_per_key < 1)
+    bits_per_key = 1;
+  // The best number of probes is ln(2) times the bits per key.
+  num_probes_ = static_cast<int>(bits_per_key * 69 / 100);
+  if (num_probes_ < 1)
+    num_probes_ = 1;
+  if (num_probes_ > 16)
+    num_probes_ = 16;
+
+  size_t bits = num_keys * bits_per_key;
+  num_blocks_ = (bits + kBitsPerBlock - 1) / kBitsPerBlock;
+  if (num_blocks_ == 0)
+    num_blocks_ = 1;
+  bits_.assign(num_blocks_ * kWordsPerBlock, 0);
+}
+
+size_t BloomFilter::Block(uint64_t h) const {
+  // The high half of "h" picks the block (scaled to the number of
+  // blocks, rather than taken modulo it), and the low half the bits.
+  return static_cast<size_t>(((h >> 32) * num_blocks_) >> 32)
+    * kWordsPerBlock;
+}
+
+void BloomFilter::Add(uint64_t key) {
+  uint64_t h = MixHash(key);
+  uint64_t *block = &bits_[Block(h)];
+  // The probes are double hashing within the block.
+  uint32_t probe = static_cast<uint32_t>(h);
+  uint32_t delta = (probe >> 17) | (probe << 15);
+  for (int i = 0; i < num_probes_; i++) {
+    uint32_t bit = probe % kBitsPerBlock;
+    block[bit / 64] |= 1ULL << (bit % 64);
+    probe += delta;
+  }
+}
+
+bool BloomFilter::MayContain(uint64_t key) const {
+  uint64_t h = MixHash(key);
+  const uint64_t *block = &bits_[Block(h)];
+  uint32_t probe = static_cast<uint32_t>(h);
+  uint32_t delta = (probe >> 17) | (probe << 15);
+  for (int i = 0; i < num_probes_; i++) {
+    uint32_t bit = probe % kBitsPerBlock;
+    if ((block[bit / 64] & (1ULL << (bit % 64))) == 0)
+      return false;
+    probe += delta;
+  }
+  return true;
+}
+
+}  // namespace hw4
@@ -0,0 +1,61 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_BLOOMFILTER_H_
+#define HW4_BLOOMFILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace hw4 {
+
+// A BloomFilter answers "might this key be in the set?" for a set of
+// 64-bit keys (e.g., FNVHash64() hashes of words) in a few bits per
+// key.  It never says no for a key that was added, and says yes for a
+// key that wasn't with a small probability (about 1% at the default
+// 10 bits per key).
+//
+// The filter is "blocked": all of a key's bits are in the same
+// 64-byte block, so a lookup touches a single cache line.
+class BloomFilter {
+ public:
+  // A filter with room for "num_keys" keys at "bits_per_key" bits
+  // each.  Adding more keys than that works, but raises the false
+  // positive rate.
+  explicit BloomFilter(size_t num_keys,
+                       int bits_per_key = kDefaultBitsPerKey);
+  virtual ~BloomFilter() { }
+
+  // Adds "key" to the set.
+  void Add(uint64_t key);
+
+  // Returns false if "key" was definitely never added, and true if it
+  // might have been.
+  bool MayContain(uint64_t key) const;
+
+  // The size of the filter, in bits.
+  size_t num_bits() const { return bits_.size() * 64; }
+
+  static const int kDefaultBitsPerKey;
+
+ private:
+  // Returns the block of "bits_" that "h" (a mixed key) belongs in.
+  size_t Block(uint64_t h) const;
+
+  std::vector<uint64_t> bits_;
+  size_t num_blocks_;
+  int num_probes_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_BLOOMFILTER_H_
@@ -0,0 +1,139 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <zlib.h>
+#if defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "./Checksum.h"
+#include "./ThreadPool.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+const uint32_t kChecksumMagic = 0xC5C32C01;
+const uint32_t kChecksumBlockBytes = 64 * 1024;
+const uint32_t kTrailerWordPositions = 1;
+
+#if !defined(__SSE4_2__)
+// The tables for slicing-by-8: tables[0][b] is the CRC of byte "b",
+// and tables[k][b] that of "b" followed by k zero bytes.
+static const uint32_t (*Crc32cTables())[256] {
+  static uint32_t tables[8][256];
+  static bool made = [] {
+    for (uint32_t b = 0; b < 256; b++) {
+      uint32_t crc = b;
+      for (int bit = 0; bit < 8; bit++)
+        crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+      tables[0][b] = crc;
+    }
+    for (int k = 1; k < 8; k++) {
+      for (int b = 0; b < 256; b++) {
+        uint32_t prev = tables[k - 1][b];
+        tables[k][b] = (prev >> 8) ^ tables[0][prev & 0xff];
+      }
+    }
+    return true;
+  }();
+  (void) made;
+  return tables;
+}
+#endif
+
+uint32_t Crc32c(const void *data, size_t len, uint32_t crc) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  crc = ~crc;
+#if defined(__SSE4_2__)
+  uint64_t crc64 = crc;
+  for (; len >= 8; p += 8, len -= 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  crc = static_cast<uint32_t>(crc64);
+  for (; len > 0; p++, len--)
+    crc = _mm_crc32_u8(crc, *p);
+#else
+  const uint32_t (*t)[256] = Crc32cTables();
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  for (; len >= 8; p += 8, len -= 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    word ^= crc;
+    crc = t[7][word & 0xff] ^ t[6][(word >> 8) & 0xff] ^
+      t[5][(word >> 16) & 0xff] ^ t[4][(word >> 24) & 0xff] ^
+      t[3][(word >> 32) & 0xff] ^ t[2][(word >> 40) & 0xff] ^
+      t[1][(word >> 48) & 0xff] ^ t[0][word >> 56];
+  }
+#endif
+  for (; len > 0; p++, len--)
+    crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+#endif
+  return ~crc;
+}
+
+uint32_t Crc32(const void *data, size_t len, uint32_t crc) {
+  const Bytef *p = static_cast<const Bytef *>(data);
+  // zlib takes at most a uInt of bytes at a time.
+  while (len > 0) {
+    uInt n = std::min<size_t>(len, 1U << 30);
+    crc = crc32(crc, p, n);
+    p += n;
+    len -= n;
+  }
+  return crc;
+}
+
+uint32_t Crc32Combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+  return crc32_combine(crc1, crc2, static_cast<z_off_t>(len2));
+}
+
+void ComputeBlockChecksums(const char *data, size_t len,
+                           uint32_t block_bytes, int num_threads,
+                           vector<uint32_t> *crcs) {
+  crcs->assign((len + block_bytes - 1) / block_bytes, 0);
+  ParallelFor(crcs->size(), 1, num_threads,
+              [&](size_t begin, size_t end) {
+                for (size_t block = begin; block < end; block++) {
+                  size_t start = block * block_bytes;
+                  (*crcs)[block] = Crc32c(
+                    data + start, std::min<size_t>(block_bytes, len - start));
+                }
+              });
+}
+
+string EncodeBlockChecksums(const vector<uint32_t> &crcs,
+                            uint32_t block_bytes, uint32_t flags) {
+  string out;
+  for (uint32_t crc : crcs) {
+    uint32_t disk = htonl(crc);
+    out.append(reinterpret_cast<char *>(&disk), sizeof(disk));
+  }
+  ChecksumTrailer trailer;
+  trailer.magic = htonl(kChecksumMagic);
+  trailer.flags = htonl(flags);
+  trailer.block_bytes = htonl(block_bytes);
+  trailer.num_blocks = htonl(crcs.size());
+  trailer.crc = htonl(Crc32c(out.data(), out.size()));
+  out.append(reinterpret_cast<char *>(&trailer), sizeof(trailer));
+  return out;
+}
+
+}  // namespace hw4
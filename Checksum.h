@@ -0,0 +1,77 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_CHECKSUM_H_
+#define HW4_CHECKSUM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace hw4 {
+
+// Returns the CRC-32C (Castagnoli) of the "len" bytes at "data",
+// continuing from "crc", the CRC-32C of the bytes before them (or 0).
+// Uses the SSE4.2 crc32 instruction when the compiler targets it
+// (-msse4.2), and tables 8 bytes at a time otherwise.
+uint32_t Crc32c(const void *data, size_t len, uint32_t crc = 0);
+
+// Returns the CRC-32 (the one of zlib, and of hw3's CRC32) of the
+// "len" bytes at "data", continuing from "crc" as Crc32c() does.  An
+// index file's header has the CRC-32 of the sections after it.
+uint32_t Crc32(const void *data, size_t len, uint32_t crc = 0);
+
+// Returns the CRC-32 of two runs of bytes, one after the other, from
+// "crc1", the CRC-32 of the first, and "crc2", that of the second,
+// which is "len2" bytes long.
+uint32_t Crc32Combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
+// Index files written by WriteIndexFile() end with a trailer, after
+// the sections that hw3 reads, which says what their positions count,
+// and usually with block checksums before it: the CRC-32C of each
+// block of the file before them.  A reader can then check just the
+// blocks it reads, as it reads them, rather than the whole file
+// against its header's checksum.  (hw3's readers expect the file to
+// end with the sections, so they can't read these.)
+//
+// On disk, in network byte order, like hw3's layout:
+//   uint32_t crcs[num_blocks];
+//   ChecksumTrailer trailer;
+struct ChecksumTrailer {
+  uint32_t magic;        // kChecksumMagic
+  uint32_t flags;        // kTrailerWordPositions, if they count words
+  uint32_t block_bytes;  // of every block but the last, or zero if
+                         // there are no blocks
+  uint32_t num_blocks;
+  uint32_t crc;          // the CRC-32C of "crcs"
+};
+
+extern const uint32_t kChecksumMagic;
+extern const uint32_t kChecksumBlockBytes;
+extern const uint32_t kTrailerWordPositions;
+
+// Sets "crcs" to the CRC-32C of each "block_bytes" bytes of the "len"
+// bytes at "data" (the last block may be shorter), computing them on
+// "num_threads" threads.
+void ComputeBlockChecksums(const char *data, size_t len,
+                           uint32_t block_bytes, int num_threads,
+                           std::vector<uint32_t> *crcs);
+
+// Returns the block checksums "crcs" of blocks of "block_bytes", and
+// their trailer with "flags", as they are written after the sections.
+std::string EncodeBlockChecksums(const std::vector<uint32_t> &crcs,
+                                 uint32_t block_bytes, uint32_t flags);
+
+}  // namespace hw4
+
+#endif  // HW4_CHECKSUM_H_
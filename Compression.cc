@@ -0,0 +1,226 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <boost/algorithm/string.hpp>
+#include <iterator>
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+  #include "libhw1/HashTable.h"
+}
+
+#include "./Compression.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// Output is produced in pieces of this size.
+static const size_t kDeflateChunk = 16384;
+
+// gzip framing for deflateInit2(): 15 window bits, +16 for a gzip
+// header and trailer rather than a zlib one.
+static const int kGzipWindowBits = 15 + 16;
+
+bool AcceptsGzip(const string &accept_encoding) {
+  vector<string> codings;
+  boost::split(codings, accept_encoding, boost::is_any_of(","));
+
+  bool star = false, gzip = false, gzip_listed = false;
+  for (string &coding : codings) {
+    // Split off any ";q=..." parameter.
+    double q = 1.0;
+    size_t semi = coding.find(';');
+    if (semi != string::npos) {
+      string param = boost::trim_copy(coding.substr(semi + 1));
+      if (boost::istarts_with(param, "q="))
+        q = atof(param.c_str() + 2);
+      coding.erase(semi);
+    }
+    boost::trim(coding);
+
+    if (boost::iequals(coding, "gzip") || boost::iequals(coding, "x-gzip")) {
+      gzip_listed = true;
+      gzip = (q > 0);
+    } else if (coding == "*") {
+      star = (q > 0);
+    }
+  }
+  return gzip_listed ? gzip : star;
+}
+
+bool IsCompressibleType(const string &type) {
+  return boost::starts_with(type, "text/") ||
+         type == "application/javascript" ||
+         type == "application/json" ||
+         type == "application/xml" ||
+         type == "application/xhtml+xml" ||
+         type == "image/svg+xml" ||
+         boost::ends_with(type, "+json") ||
+         boost::ends_with(type, "+xml");
+}
+
+bool GzipCompress(const char *data, size_t len, string *out) {
+  GzipStream gz;
+  return gz.Write(data, len, false, out) && gz.Finish(out);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// GzipStream
+///////////////////////////////////////////////////////////////////////////////
+GzipStream::GzipStream() {
+  memset(&zs_, 0, sizeof(zs_));
+  ok_ = (deflateInit2(&zs_, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                      kGzipWindowBits, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+}
+
+GzipStream::~GzipStream() {
+  if (ok_)
+    deflateEnd(&zs_);
+}
+
+bool GzipStream::Write(const char *data, size_t len, bool flush,
+                       string *out) {
+  if (!ok_)
+    return false;
+  zs_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+  zs_.avail_in = len;
+  return Deflate(flush ? Z_SYNC_FLUSH : Z_NO_FLUSH, out);
+}
+
+bool GzipStream::Finish(string *out) {
+  if (!ok_)
+    return false;
+  zs_.next_in = nullptr;
+  zs_.avail_in = 0;
+  return Deflate(Z_FINISH, out);
+}
+
+bool GzipStream::Deflate(int flush_mode, string *out) {
+  // Keep deflating into the tail of "out" until zlib has consumed all
+  // of the input and, for a flush, has no more output pending.
+  while (true) {
+    size_t old_size = out->size();
+    out->resize(old_size + kDeflateChunk);
+    zs_.next_out = reinterpret_cast<Bytef *>(&(*out)[old_size]);
+    zs_.avail_out = kDeflateChunk;
+
+    int res = deflate(&zs_, flush_mode);
+    out->resize(old_size + kDeflateChunk - zs_.avail_out);
+    if (res == Z_STREAM_END)
+      return true;
+    if (res != Z_OK && res != Z_BUF_ERROR)
+      return false;
+    if (zs_.avail_in == 0 && zs_.avail_out != 0 && flush_mode != Z_FINISH)
+      return true;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// GzipCache
+///////////////////////////////////////////////////////////////////////////////
+GzipCache::GzipCache(size_t capacity) : capacity_(capacity), size_(0) {
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+}
+
+GzipCache::~GzipCache() {
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+// static
+uint64_t GzipCache::Key(const string &fname) {
+  return FNVHash64(reinterpret_cast<unsigned char *>(
+                     const_cast<char *>(fname.data())),
+                   static_cast<int>(fname.size()));
+}
+
+bool GzipCache::Lookup(const string &fname, const string &etag,
+                       string *gzipped, string *content_type) {
+  // Files whose keys collide are simply not both cached.
+  EntryPtr entry;
+  if (!entries_.Find(Key(fname), &entry) || entry->fname != fname)
+    return false;
+  if (entry->etag != etag) {
+    // The file has changed since we compressed it.
+    Verify333(pthread_mutex_lock(&lock_) == 0);
+    Erase(entry);
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    return false;
+  }
+  entry->referenced.store(true, std::memory_order_relaxed);
+  *gzipped = entry->gzipped;
+  *content_type = entry->content_type;
+  return true;
+}
+
+void GzipCache::Insert(const string &fname, const string &etag,
+                       const string &gzipped, const string &content_type) {
+  if (gzipped.size() > capacity_)
+    return;
+  EntryPtr entry(new Entry());
+  entry->fname = fname;
+  entry->etag = etag;
+  entry->gzipped = gzipped;
+  entry->content_type = content_type;
+
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  EntryPtr old;
+  if (entries_.Find(Key(fname), &old))
+    Erase(old);
+
+  // Evict from the cold end until the new entry fits.  Entries hit
+  // since they were last here go back to the front instead, once.
+  // Hits don't take the lock, so they can keep marking entries as
+  // this goes; after two turns of the list, the entry isn't inserted.
+  size_t turns_left = 2 * lru_.size() + 1;
+  while (size_ + gzipped.size() > capacity_ && turns_left-- > 0) {
+    EntryPtr cold = lru_.back();
+    if (cold->referenced.exchange(false, std::memory_order_relaxed))
+      lru_.splice(lru_.begin(), lru_, std::prev(lru_.end()));
+    else
+      Erase(cold);
+  }
+  if (size_ + gzipped.size() > capacity_) {
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    return;
+  }
+
+  lru_.push_front(entry);
+  entry->pos = lru_.begin();
+  entry->cached = true;
+  entries_.Insert(Key(fname), entry, &old);
+  size_ += gzipped.size();
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+size_t GzipCache::size() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  size_t ret = size_;
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return ret;
+}
+
+void GzipCache::Erase(const EntryPtr &entry) {
+  if (!entry->cached)
+    return;
+  EntryPtr removed;
+  entries_.Remove(Key(entry->fname), &removed);
+  size_ -= entry->gzipped.size();
+  lru_.erase(entry->pos);
+  entry->cached = false;
+}
+
+}  // namespace hw4
@@ -0,0 +1,144 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_COMPRESSION_H_
+#define HW4_COMPRESSION_H_
+
+extern "C" {
+#include <pthread.h>  // for the pthread mutex functions
+}
+#include <stddef.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+
+#include "./ConcurrentHashTable.h"
+
+namespace hw4 {
+
+// Returns true if an Accept-Encoding header value (e.g.,
+// "gzip, deflate;q=0.5") says the client will take a gzip'ed
+// response, i.e., gzip (or "*") is listed with a nonzero q-value.
+bool AcceptsGzip(const std::string &accept_encoding);
+
+// Returns true if content of MIME type "type" is worth compressing.
+// Text, JSON, JavaScript, XML, and SVG are; images, audio, video, and
+// archives are already compressed and are not.
+bool IsCompressibleType(const std::string &type);
+
+// Gzips the "len" bytes at "data", appending the result to "out".
+// Returns false if zlib reports an error.
+bool GzipCompress(const char *data, size_t len, std::string *out);
+
+// A GzipStream compresses a response body that is produced
+// piecemeal, e.g., a query results page that is written out as it is
+// generated.  Each call to Write() appends whatever compressed bytes
+// zlib has ready to "out"; Finish() flushes the rest and the gzip
+// trailer.
+class GzipStream {
+ public:
+  GzipStream();
+  virtual ~GzipStream();
+
+  // Compresses the "len" bytes at "data".  If "flush" is true, all
+  // input so far is flushed out (at a small cost in ratio), so that
+  // the client can render what it has received.
+  bool Write(const char *data, size_t len, bool flush, std::string *out);
+
+  // Finishes the stream.  No more Write()s are allowed afterwards.
+  bool Finish(std::string *out);
+
+ private:
+  bool Deflate(int flush_mode, std::string *out);
+
+  z_stream zs_;
+  bool ok_;
+};
+
+// A GzipCache is a bounded, thread-safe cache of gzip'ed static
+// files, so that each file is compressed only once no matter how
+// often it is requested.  Entries are keyed by file name and stamped
+// with the file's ETag, so a stale entry is never served after the
+// file changes.  Entries are evicted to keep the total size of the
+// cached bytes under the capacity, oldest first, except that those hit
+// since they were last considered get a second chance.
+//
+// Entries are found through a ConcurrentHashTable, and a hit only
+// marks its entry as referenced, so lookups (and the copying of their
+// bytes) don't wait for each other.  Inserts take a lock.
+class GzipCache {
+ public:
+  // "capacity" is the most compressed bytes the cache will hold.
+  explicit GzipCache(size_t capacity);
+  virtual ~GzipCache();
+
+  // Looks up the gzip'ed copy of "fname".  On a hit whose ETag
+  // matches "etag", returns true and copies out the compressed
+  // bytes and the MIME type cached with them.
+  bool Lookup(const std::string &fname, const std::string &etag,
+              std::string *gzipped, std::string *content_type);
+
+  // Adds (or replaces) the gzip'ed copy of "fname".  Entries larger
+  // than the whole cache are not kept, nor are those that room can't
+  // be made for while other threads keep hitting the rest.
+  void Insert(const std::string &fname, const std::string &etag,
+              const std::string &gzipped, const std::string &content_type);
+
+  // The total number of compressed bytes currently cached.
+  size_t size();
+
+  // The most compressed bytes the cache will hold.
+  size_t capacity() const { return capacity_; }
+
+ private:
+  struct Entry;
+  typedef std::shared_ptr<Entry> EntryPtr;
+
+  struct Entry {
+    std::string fname;
+    std::string etag;
+    std::string gzipped;
+    std::string content_type;
+
+    // Set by each hit, and cleared when eviction passes it over.
+    std::atomic<bool> referenced{false};
+
+    // Where it is in lru_, while "cached"; guarded by lock_.
+    std::list<EntryPtr>::iterator pos;
+    bool cached = false;
+  };
+
+  // The key of "fname" in entries_.
+  static uint64_t Key(const std::string &fname);
+
+  // Removes "entry", if it is still cached, from both lru_ and
+  // entries_.  The caller must hold lock_.
+  void Erase(const EntryPtr &entry);
+
+  // Guards lru_ and size_, and changes to entries_.
+  pthread_mutex_t lock_;
+
+  // Entries from newest to oldest (but for second chances), and an
+  // index into them.
+  std::list<EntryPtr> lru_;
+  ConcurrentHashTable<EntryPtr> entries_;
+
+  size_t capacity_;
+  size_t size_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_COMPRESSION_H_
@@ -0,0 +1,295 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_CONCURRENTHASHTABLE_H_
+#define HW4_CONCURRENTHASHTABLE_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+#include "./HashMix.h"
+
+namespace hw4 {
+
+// A ConcurrentHashTable maps 64-bit keys (e.g., FNVHash64() hashes,
+// as with libhw1's HashTable) to values of type V, and unlike
+// HashTable it may be used by any number of threads at once.
+//
+// The table is split into kNumStripes independent stripes, each with
+// its own buckets and its own reader/writer lock, and every key
+// belongs to one stripe.  So threads only contend when they use the
+// same stripe, and then only if one of them is changing it: lookups
+// of a stripe share its lock.
+//
+// A stripe that gets too full grows without stopping the world: it
+// allocates a bucket array twice the size, and then each Insert() or
+// Remove() on the stripe moves a few of the old buckets' entries
+// across, while lookups check both arrays until the move is done.  No
+// single operation ever pays for rehashing the whole table (or even
+// a whole stripe).
+//
+// Values are copied in and out, so V should be cheap to copy (e.g., a
+// pointer or a shared_ptr) and must be default-constructible.
+template <typename V>
+class ConcurrentHashTable {
+ public:
+  // "num_buckets" is the initial number of buckets in all, spread
+  // over the stripes.
+  explicit ConcurrentHashTable(size_t num_buckets = 1024)
+    : stripes_(new Stripe[kNumStripes]) {
+    size_t per_stripe = 1;
+    while (per_stripe * kNumStripes < num_buckets)
+      per_stripe *= 2;
+    for (int i = 0; i < kNumStripes; i++) {
+      Verify333(pthread_rwlock_init(&stripes_[i].lock, nullptr) == 0);
+      stripes_[i].buckets.assign(per_stripe, nullptr);
+    }
+  }
+
+  virtual ~ConcurrentHashTable() {
+    for (int i = 0; i < kNumStripes; i++) {
+      Stripe &s = stripes_[i];
+      FreeChains(&s.buckets);
+      FreeChains(&s.old_buckets);
+      Verify333(pthread_rwlock_destroy(&s.lock) == 0);
+    }
+  }
+
+  ConcurrentHashTable(const ConcurrentHashTable &) = delete;
+  ConcurrentHashTable &operator=(const ConcurrentHashTable &) = delete;
+
+  // Maps "key" to "value".  If "key" was already present, returns
+  // true and returns the value it replaced through "old_value";
+  // otherwise returns false.
+  bool Insert(uint64_t key, const V &value, V *old_value) {
+    uint64_t hash = Mix(key);
+    Stripe &s = StripeFor(hash);
+    WriteLock lock(&s);
+    MigrateSome(&s);
+
+    Node *node = FindNode(s, key, hash);
+    if (node != nullptr) {
+      *old_value = std::move(node->value);
+      node->value = value;
+      return true;
+    }
+    Node **bucket = &s.buckets[hash & (s.buckets.size() - 1)];
+    *bucket = new Node{key, value, *bucket};
+    size_t count = s.count.load(std::memory_order_relaxed) + 1;
+    s.count.store(count, std::memory_order_relaxed);
+    if (count > s.buckets.size() * kMaxLoad && s.old_buckets.empty())
+      StartGrowing(&s);
+    return false;
+  }
+
+  // Looks up "key".  Returns true and its value through "value" if it
+  // is present, and false otherwise.
+  bool Find(uint64_t key, V *value) const {
+    uint64_t hash = Mix(key);
+    Stripe &s = StripeFor(hash);
+    ReadLock lock(&s);
+    const Node *node = FindNode(s, key, hash);
+    if (node == nullptr)
+      return false;
+    *value = node->value;
+    return true;
+  }
+
+  // Removes "key".  Returns true and the value it had through
+  // "value" if it was present, and false otherwise.
+  bool Remove(uint64_t key, V *value) {
+    uint64_t hash = Mix(key);
+    Stripe &s = StripeFor(hash);
+    WriteLock lock(&s);
+    MigrateSome(&s);
+
+    for (Node **link : {NewLink(s, hash), OldLink(s, hash)}) {
+      for (; link != nullptr && *link != nullptr; link = &(*link)->next) {
+        if ((*link)->key != key)
+          continue;
+        Node *node = *link;
+        *link = node->next;
+        *value = std::move(node->value);
+        delete node;
+        s.count.store(s.count.load(std::memory_order_relaxed) - 1,
+                      std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The number of keys in the table.  Other threads may change it at
+  // any moment, so it is only a snapshot.
+  size_t NumElements() const {
+    size_t total = 0;
+    for (int i = 0; i < kNumStripes; i++)
+      total += stripes_[i].count.load(std::memory_order_relaxed);
+    return total;
+  }
+
+  // The number of buckets in all, not counting ones being moved out
+  // of; for tests.
+  size_t NumBuckets() const {
+    size_t total = 0;
+    for (int i = 0; i < kNumStripes; i++) {
+      ReadLock lock(&stripes_[i]);
+      total += stripes_[i].buckets.size();
+    }
+    return total;
+  }
+
+  static constexpr int kNumStripes = 64;
+
+ private:
+  struct Node {
+    uint64_t key;
+    V value;
+    Node *next;
+  };
+
+  // Each stripe gets cache lines of its own, so that threads using
+  // neighboring stripes don't slow each other down.
+  struct alignas(64) Stripe {
+    mutable pthread_rwlock_t lock;
+
+    // The current bucket array, whose size is a power of two, and
+    // while the stripe is growing, the previous one, whose buckets
+    // below "migrated" have already been moved.
+    std::vector<Node *> buckets;
+    std::vector<Node *> old_buckets;
+    size_t migrated = 0;
+
+    // Written only under the write lock, but read by NumElements()
+    // without it.
+    std::atomic<size_t> count{0};
+  };
+
+  class ReadLock {
+   public:
+    explicit ReadLock(const Stripe *s) : s_(s) {
+      Verify333(pthread_rwlock_rdlock(&s_->lock) == 0);
+    }
+    ~ReadLock() { Verify333(pthread_rwlock_unlock(&s_->lock) == 0); }
+
+   private:
+    const Stripe *s_;
+  };
+
+  class WriteLock {
+   public:
+    explicit WriteLock(Stripe *s) : s_(s) {
+      Verify333(pthread_rwlock_wrlock(&s_->lock) == 0);
+    }
+    ~WriteLock() { Verify333(pthread_rwlock_unlock(&s_->lock) == 0); }
+
+   private:
+    Stripe *s_;
+  };
+
+  // A stripe grows when it averages more than this many entries per
+  // bucket.
+  static constexpr size_t kMaxLoad = 1;
+
+  // Old buckets moved by each Insert() or Remove() on a growing
+  // stripe.  Since the stripe grows by doubling, this finishes the
+  // move long before the new array fills up.
+  static constexpr size_t kMigrateBatch = 8;
+
+  // Keys are mixed (see MixHash()); the top bits of the result pick
+  // the stripe and the bottom ones the bucket.
+  static uint64_t Mix(uint64_t key) { return MixHash(key); }
+
+  Stripe &StripeFor(uint64_t hash) const {
+    return stripes_[hash >> 58];
+  }
+  static_assert(kNumStripes == 64, "StripeFor() uses the top 6 bits");
+
+  // The head of "hash"'s chain in the current buckets, and in the old
+  // ones if its entries haven't been moved yet (otherwise nullptr).
+  static Node **NewLink(Stripe &s, uint64_t hash) {
+    return &s.buckets[hash & (s.buckets.size() - 1)];
+  }
+  static Node **OldLink(Stripe &s, uint64_t hash) {
+    if (s.old_buckets.empty())
+      return nullptr;
+    size_t i = hash & (s.old_buckets.size() - 1);
+    return i < s.migrated ? nullptr : &s.old_buckets[i];
+  }
+
+  static Node *FindNode(Stripe &s, uint64_t key, uint64_t hash) {
+    for (Node **link : {NewLink(s, hash), OldLink(s, hash)}) {
+      for (Node *n = (link == nullptr) ? nullptr : *link; n != nullptr;
+           n = n->next) {
+        if (n->key == key)
+          return n;
+      }
+    }
+    return nullptr;
+  }
+
+  static void StartGrowing(Stripe *s) {
+    s->old_buckets.swap(s->buckets);
+    s->buckets.assign(s->old_buckets.size() * 2, nullptr);
+    s->migrated = 0;
+  }
+
+  // Moves the next kMigrateBatch old buckets' entries to the new
+  // array, and frees the old array once they're all moved.
+  static void MigrateSome(Stripe *s) {
+    if (s->old_buckets.empty())
+      return;
+    size_t end = std::min(s->migrated + kMigrateBatch,
+                          s->old_buckets.size());
+    size_t mask = s->buckets.size() - 1;
+    for (; s->migrated < end; s->migrated++) {
+      Node *n = s->old_buckets[s->migrated];
+      while (n != nullptr) {
+        Node *next = n->next;
+        Node **bucket = &s->buckets[Mix(n->key) & mask];
+        n->next = *bucket;
+        *bucket = n;
+        n = next;
+      }
+      s->old_buckets[s->migrated] = nullptr;
+    }
+    if (s->migrated == s->old_buckets.size()) {
+      std::vector<Node *>().swap(s->old_buckets);
+      s->migrated = 0;
+    }
+  }
+
+  static void FreeChains(std::vector<Node *> *buckets) {
+    for (Node *n : *buckets) {
+      while (n != nullptr) {
+        Node *next = n->next;
+        delete n;
+        n = next;
+      }
+    }
+  }
+
+  std::unique_ptr<Stripe[]> stripes_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_CONCURRENTHASHTABLE_H_
@@ -0,0 +1,243 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "./Crawler.h"
+#include "./ThreadPool.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// The first line of a manifest.
+static const char *kManifestHeader = "hw4-crawl";
+
+IndexDocument ParseDocument(const string &name, const string &contents,
+                            Tokenizer *tokenizer) {
+  IndexDocument doc;
+  doc.name = name;
+  tokenizer->Tokenize(contents.data(), contents.size());
+  const vector<Tokenizer::Word> &words = tokenizer->words();
+  string word;
+  for (size_t i = 0; i < words.size(); i++) {
+    word.assign(tokenizer->lowered(), words[i].offset, words[i].length);
+    doc.words[word].push_back(i);
+  }
+  return doc;
+}
+
+uint64_t HashContents(const string &contents) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : contents) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Appends the paths of the regular files under "dir" to "files".
+static bool ListFiles(const string &dir, vector<string> *files) {
+  DIR *d = opendir(dir.c_str());
+  if (d == nullptr)
+    return false;
+  vector<string> subdirs;
+  struct dirent *entry;
+  while ((entry = readdir(d)) != nullptr) {
+    string name = entry->d_name;
+    // (The manifest has a path per line.)
+    if (name == "." || name == ".." || name.find('\n') != string::npos)
+      continue;
+    string path = dir + "/" + name;
+    unsigned char type = entry->d_type;
+    if (type == DT_UNKNOWN || type == DT_LNK) {
+      // Follow links, as hw2 does, and ask when readdir doesn't say.
+      struct stat st;
+      if (stat(path.c_str(), &st) != 0)
+        continue;
+      type = S_ISDIR(st.st_mode) ? DT_DIR :
+        S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+    }
+    if (type == DT_DIR)
+      subdirs.push_back(path);
+    else if (type == DT_REG)
+      files->push_back(path);
+  }
+  closedir(d);
+  // Subdirectories that vanish (or can't be read) in the meantime
+  // are skipped.
+  for (const string &subdir : subdirs)
+    ListFiles(subdir, files);
+  return true;
+}
+
+namespace {
+
+// What a crawl thread found out about a file.
+struct Checked {
+  enum { kMissing, kUnreadable, kSame, kTouched, kChanged } status =
+    kMissing;
+  int64_t size;
+  int64_t mtime_ns;
+  uint64_t hash;
+  IndexDocument doc;  // if kChanged
+};
+
+// Checks the file "path", which "old" has what the last crawl found
+// out about (or nothing), into "checked", parsing it with "tokenizer"
+// if it changed.
+void CheckFile(const string &path,
+               const std::map<string, CrawledFile> &old_files,
+               Checked *checked, Tokenizer *tokenizer) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    return;
+  checked->size = st.st_size;
+  checked->mtime_ns =
+    static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+    st.st_mtim.tv_nsec;
+  auto old = old_files.find(path);
+  if (old != old_files.end() && old->second.size == checked->size &&
+      old->second.mtime_ns == checked->mtime_ns) {
+    checked->status = Checked::kSame;
+    checked->hash = old->second.hash;
+    return;
+  }
+
+  std::ifstream in(path, std::ios::binary);
+  string contents;
+  if (in) {
+    contents.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+  }
+  if (!in.is_open() || in.bad()) {
+    checked->status = Checked::kUnreadable;
+    return;
+  }
+  checked->hash = HashContents(contents);
+  if (old != old_files.end() && old->second.hash == checked->hash) {
+    checked->status = Checked::kTouched;
+    return;
+  }
+  checked->status = Checked::kChanged;
+  checked->doc = ParseDocument(path, contents, tokenizer);
+}
+
+}  // namespace
+
+Crawler::Crawler(SegmentIndex *index, const string &manifest_file,
+                 int num_threads)
+  : index_(index), manifest_file_(manifest_file),
+    num_threads_(std::max(num_threads, 1)) { }
+
+bool Crawler::Open() {
+  files_.clear();
+  struct stat st;
+  if (stat(manifest_file_.c_str(), &st) != 0)
+    return errno == ENOENT;
+  std::ifstream in(manifest_file_);
+  string line;
+  if (!std::getline(in, line) || line != kManifestHeader)
+    return false;
+  while (std::getline(in, line)) {
+    // "size mtime_ns hash path", with the path last, as it may have
+    // spaces in it.
+    CrawledFile info;
+    int path_start;
+    if (sscanf(line.c_str(), "%" SCNd64 " %" SCNd64 " %" SCNx64 " %n",
+               &info.size, &info.mtime_ns, &info.hash, &path_start) != 3)
+      return false;
+    files_[line.substr(path_start)] = info;
+  }
+  return in.eof();
+}
+
+bool Crawler::Crawl(const string &root, CrawlStats *stats) {
+  *stats = CrawlStats();
+  vector<string> files;
+  if (!ListFiles(root, &files))
+    return false;
+
+  vector<Checked> checked(files.size());
+  ParallelFor(files.size(), 1, num_threads_,
+              [&](size_t begin, size_t end) {
+                Tokenizer tokenizer;
+                for (size_t i = begin; i < end; i++)
+                  CheckFile(files[i], files_, &checked[i], &tokenizer);
+              });
+
+  // The new manifest, and what changed.
+  std::map<string, CrawledFile> crawled;
+  vector<IndexDocument> docs;
+  for (size_t i = 0; i < files.size(); i++) {
+    Checked &file = checked[i];
+    if (file.status == Checked::kMissing)
+      continue;
+    if (file.status == Checked::kUnreadable) {
+      // It's there, but not readable just now: an indexed one keeps
+      // its document (and its entry, so it's read again next time),
+      // rather than being deleted.
+      auto old = files_.find(files[i]);
+      if (old == files_.end())
+        continue;
+      stats->files++;
+      crawled[files[i]] = old->second;
+      continue;
+    }
+    stats->files++;
+    crawled[files[i]] = CrawledFile{file.size, file.mtime_ns, file.hash};
+    if (file.status == Checked::kTouched) {
+      stats->unchanged++;
+    } else if (file.status == Checked::kChanged) {
+      stats->parsed++;
+      docs.push_back(std::move(file.doc));
+    }
+  }
+  vector<string> deleted;
+  for (const auto &file : files_) {
+    if (crawled.count(file.first) == 0)
+      deleted.push_back(file.first);
+  }
+  stats->deleted = deleted.size();
+
+  // The index changes first, so that if the manifest can't be written
+  // the next crawl just parses these files again.
+  if (!index_->AddDocuments(docs) || !index_->DeleteDocuments(deleted))
+    return false;
+  files_.swap(crawled);
+  return WriteManifest();
+}
+
+bool Crawler::WriteManifest() const {
+  std::ostringstream out;
+  out << kManifestHeader << "\n";
+  char line[64];
+  for (const auto &file : files_) {
+    snprintf(line, sizeof(line), "%" PRId64 " %" PRId64 " %" PRIx64 " ",
+             file.second.size, file.second.mtime_ns, file.second.hash);
+    out << line << file.first << "\n";
+  }
+  return WriteFileAtomically(manifest_file_, out.str());
+}
+
+}  // namespace hw4
@@ -0,0 +1,99 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_CRAWLER_H_
+#define HW4_CRAWLER_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include "./IndexWriter.h"
+#include "./SegmentIndex.h"
+#include "./Tokenizer.h"
+
+namespace hw4 {
+
+// Returns the IndexDocument named "name" of the text "contents", split
+// into words by "tokenizer".  A word's positions count words from the
+// start of the text (rather than bytes, as in hw2), as phrase queries
+// expect.
+IndexDocument ParseDocument(const std::string &name,
+                            const std::string &contents,
+                            Tokenizer *tokenizer);
+
+// Returns the 64-bit FNV-1a hash of "contents", which is FNVHash64()'s
+// for contents it can take (under 2 GiB, as its length is an int).
+uint64_t HashContents(const std::string &contents);
+
+// What a crawl found.
+struct CrawlStats {
+  size_t files = 0;      // regular files in the tree
+  size_t parsed = 0;     // new or changed, and so parsed and indexed
+  size_t unchanged = 0;  // of those whose size or mtime changed,
+                         // the ones whose contents hadn't
+  size_t deleted = 0;    // no longer in the tree
+};
+
+// What a Crawler's manifest records of a file.
+struct CrawledFile {
+  int64_t size;
+  int64_t mtime_ns;
+  uint64_t hash;  // HashContents() of its contents
+};
+
+// A Crawler keeps a SegmentIndex up to date with a directory tree, as
+// hw2's CrawlFileTree builds an index of one, but without reading the
+// whole tree each time.  Its manifest records the size, modification
+// time, and a hash of the contents of every file it has indexed, by
+// path; a file's path is its document's name, which the SegmentIndex
+// maps to the document's segment and docID.
+//
+// A crawl lists the tree and stats every file, in parallel; only the
+// files that are new, or whose size or mtime changed (and then whose
+// contents did), are read and parsed, and they go into a single new
+// segment, replacing their old documents.  Documents of files that
+// are gone are deleted.  So a crawl costs about as much as the change
+// since the last one, plus a stat() per file.
+class Crawler {
+ public:
+  // Keeps "index" up to date, with its manifest in "manifest_file",
+  // using "num_threads" threads to stat and parse files.
+  Crawler(SegmentIndex *index, const std::string &manifest_file,
+          int num_threads = 8);
+  virtual ~Crawler() { }
+
+  // Reads the manifest; if there isn't one yet, nothing has been
+  // indexed.  Returns false if it can't be read.
+  bool Open();
+
+  // Crawls the tree under the directory "root", updating the index and
+  // the manifest, and fills in "stats".  Returns false if the tree
+  // couldn't be listed or the index or manifest couldn't be written.
+  // New files that can't be read are left out, as if they weren't
+  // there; indexed ones keep their documents until they can be.
+  bool Crawl(const std::string &root, CrawlStats *stats);
+
+ private:
+  bool WriteManifest() const;
+
+  SegmentIndex *index_;
+  std::string manifest_file_;
+  int num_threads_;
+
+  // By path.
+  std::map<std::string, CrawledFile> files_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_CRAWLER_H_
@@ -0,0 +1,285 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "./DocIterator.h"
+
+using std::unique_ptr;
+using std::vector;
+
+namespace hw4 {
+
+TermIterator::TermIterator(
+    std::shared_ptr<const vector<DocPosting>> postings)
+  : postings_(std::move(postings)), pos_(0) {
+  for (const DocPosting &posting : *postings_)
+    max_score_ = std::max(max_score_, posting.num_positions);
+}
+
+void TermIterator::Advance(uint64_t target, int min_score) {
+  const vector<DocPosting> &postings = *postings_;
+  size_t n = postings.size();
+  if (pos_ == n)
+    return;
+  if (max_score_ <= min_score) {
+    pos_ = n;
+    return;
+  }
+  if (postings[pos_].doc_id >= target)
+    return;
+
+  // Gallop ahead, doubling the step, until past "target", then binary
+  // search the last step; skipping far costs a logarithm of the
+  // distance, and skipping near is as cheap as stepping.
+  size_t lo = pos_ + 1, step = 1, hi = lo;
+  while (hi < n && postings[hi].doc_id < target) {
+    lo = hi + 1;
+    step *= 2;
+    hi = lo + step;
+  }
+  hi = std::min(hi, n);
+  pos_ = std::lower_bound(postings.begin() + lo, postings.begin() + hi,
+                          target,
+                          [](const DocPosting &posting, uint64_t doc_id) {
+                            return posting.doc_id < doc_id;
+                          }) - postings.begin();
+}
+
+AndIterator::AndIterator(vector<unique_ptr<DocIterator>> required,
+                         vector<unique_ptr<DocIterator>> excluded)
+  : required_(std::move(required)), excluded_(std::move(excluded)),
+    doc_(0) {
+  for (const auto &it : required_)
+    max_score_ += it->max_score();
+  if (required_.empty())
+    doc_ = kEnd;
+  else
+    Advance(0, kNoMinimum);
+}
+
+int AndIterator::score() const {
+  int score = 0;
+  for (const auto &it : required_)
+    score += it->score();
+  return score;
+}
+
+void AndIterator::Advance(uint64_t target, int min_score) {
+  if (doc_ == kEnd)
+    return;
+  uint64_t doc = std::max(target, doc_);
+
+  // Leapfrog: move each required iterator in turn up to "doc", which
+  // jumps ahead whenever one lands past it, until all of them agree.
+  // Each one only needs to find documents where it could make up the
+  // difference between "min_score" and what the others could score.
+  size_t n = required_.size(), agreed = 0, i = 0;
+  while (true) {
+    DocIterator &it = *required_[i];
+    it.Advance(doc, min_score - (max_score_ - it.max_score()));
+    if (it.doc() == kEnd) {
+      doc_ = kEnd;
+      return;
+    }
+    if (it.doc() > doc) {
+      doc = it.doc();
+      agreed = 1;
+    } else {
+      agreed++;
+    }
+    i = (i + 1) % n;
+    if (agreed < n)
+      continue;
+
+    bool is_excluded = false;
+    for (const auto &excluded : excluded_) {
+      excluded->Advance(doc, kNoMinimum);
+      if (excluded->doc() == doc) {
+        is_excluded = true;
+        break;
+      }
+    }
+    if (!is_excluded) {
+      doc_ = doc;
+      return;
+    }
+    doc++;
+    agreed = 0;
+  }
+}
+
+OrIterator::OrIterator(vector<unique_ptr<DocIterator>> children)
+  : children_(std::move(children)), doc_(0) {
+  for (const auto &it : children_)
+    max_score_ += it->max_score();
+  if (children_.empty())
+    doc_ = kEnd;
+  else
+    Advance(0, kNoMinimum);
+}
+
+int OrIterator::score() const {
+  int score = 0;
+  for (const auto &it : children_) {
+    if (it->doc() == doc_)
+      score += it->score();
+  }
+  return score;
+}
+
+void OrIterator::Advance(uint64_t target, int min_score) {
+  if (doc_ == kEnd)
+    return;
+  target = std::max(target, doc_);
+  for (const auto &it : children_) {
+    if (it->doc() < target)
+      it->Advance(target, min_score - (max_score_ - it->max_score()));
+  }
+
+  size_t n = children_.size();
+  while (true) {
+    std::sort(children_.begin(), children_.end(),
+              [](const unique_ptr<DocIterator> &a,
+                 const unique_ptr<DocIterator> &b) {
+                return a->doc() < b->doc();
+              });
+
+    // Find the pivot: the first child at which the upper bounds of it
+    // and the children before it add up to more than "min_score".  No
+    // document before the pivot's can qualify.
+    int bound = 0;
+    size_t pivot = 0;
+    for (; pivot < n && children_[pivot]->doc() != kEnd; pivot++) {
+      bound += children_[pivot]->max_score();
+      if (bound > min_score)
+        break;
+    }
+    if (pivot == n || children_[pivot]->doc() == kEnd) {
+      doc_ = kEnd;
+      return;
+    }
+
+    uint64_t doc = children_[pivot]->doc();
+    if (children_[0]->doc() == doc) {
+      doc_ = doc;
+      return;
+    }
+    for (size_t i = 0; i < pivot && children_[i]->doc() < doc; i++) {
+      DocIterator &it = *children_[i];
+      it.Advance(doc, min_score - (max_score_ - it.max_score()));
+    }
+  }
+}
+
+PhraseIterator::PhraseIterator(const IndexReader *reader,
+                               vector<unique_ptr<TermIterator>> words,
+                               int distance)
+  : reader_(reader), words_(std::move(words)), distance_(distance),
+    doc_(0), score_(0), positions_(words_.size()),
+    cursors_(words_.size()) {
+  if (words_.empty()) {
+    doc_ = kEnd;
+    return;
+  }
+  // A document has no more matches than it has of any one word.
+  max_score_ = words_[0]->max_score();
+  for (const auto &word : words_)
+    max_score_ = std::min(max_score_, word->max_score());
+  Advance(0, kNoMinimum);
+}
+
+void PhraseIterator::Advance(uint64_t target, int min_score) {
+  if (doc_ == kEnd)
+    return;
+  uint64_t doc = std::max(target, doc_);
+  if (doc == doc_ && score_ > 0) {
+    if (score_ > min_score)
+      return;
+    doc++;
+  }
+
+  // Leapfrog the words up to a document that has them all, as
+  // AndIterator does, and only then read their positions, if they are
+  // there often enough to make for enough matches.
+  size_t n = words_.size(), agreed = 0, i = 0;
+  while (true) {
+    TermIterator &word = *words_[i];
+    word.Advance(doc, min_score);
+    if (word.doc() == kEnd) {
+      doc_ = kEnd;
+      return;
+    }
+    if (word.doc() > doc) {
+      doc = word.doc();
+      agreed = 1;
+    } else {
+      agreed++;
+    }
+    i = (i + 1) % n;
+    if (agreed < n)
+      continue;
+
+    int bound = word.score();
+    for (const auto &other : words_)
+      bound = std::min(bound, other->score());
+    if (bound > min_score) {
+      int matches = CountMatches();
+      if (matches > 0 && matches > min_score) {
+        doc_ = doc;
+        score_ = matches;
+        return;
+      }
+    }
+    doc++;
+    agreed = 0;
+  }
+}
+
+int PhraseIterator::CountMatches() {
+  size_t n = words_.size();
+  for (size_t w = 0; w < n; w++) {
+    vector<int32_t> &positions = positions_[w];
+    if (!reader_->ReadPositions(words_[w]->posting(), &positions))
+      return 0;
+    if (!std::is_sorted(positions.begin(), positions.end()))
+      std::sort(positions.begin(), positions.end());
+    cursors_[w] = 0;
+  }
+
+  // For each position of the first word, in turn, move each other
+  // word's cursor up to the first position that could go with it;
+  // as the first word's positions increase, so do the cursors.
+  int matches = 0;
+  for (int32_t first : positions_[0]) {
+    bool match = true;
+    for (size_t w = 1; w < n && match; w++) {
+      const vector<int32_t> &positions = positions_[w];
+      size_t &j = cursors_[w];
+      int64_t low = distance_ == 0 ?
+        static_cast<int64_t>(first) + w :
+        static_cast<int64_t>(first) - distance_;
+      int64_t high = distance_ == 0 ? low :
+        static_cast<int64_t>(first) + distance_;
+      while (j < positions.size() && positions[j] < low)
+        j++;
+      match = j < positions.size() && positions[j] <= high;
+    }
+    if (match)
+      matches++;
+  }
+  return matches;
+}
+
+}  // namespace hw4
@@ -0,0 +1,159 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_DOCITERATOR_H_
+#define HW4_DOCITERATOR_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "./IndexReader.h"
+
+namespace hw4 {
+
+// A DocIterator walks the documents that match (part of) a query in
+// one index, in order of docID, for evaluating the query a document at
+// a time.  Each document has a score, the number of times the query's
+// words appear in it, and every iterator knows an upper bound on its
+// scores, so that an evaluator keeping only the best documents can
+// tell it to skip those that can't beat the worst one kept so far.
+class DocIterator {
+ public:
+  // doc() once the iterator is past the last document.
+  static constexpr uint64_t kEnd = UINT64_MAX;
+
+  // A "min_score" that skips nothing, as scores are never negative.
+  static constexpr int kNoMinimum = -1;
+
+  virtual ~DocIterator() { }
+
+  // The current document, or kEnd.  A new iterator is on its first
+  // matching document.
+  virtual uint64_t doc() const = 0;
+
+  // The current document's score.
+  virtual int score() const = 0;
+
+  // No document scores more than this.
+  int max_score() const { return max_score_; }
+
+  // Moves to the first document at or after "target" that could score
+  // more than "min_score"; documents that certainly can't are skipped.
+  // Never moves backwards, so it stays put if the current document
+  // qualifies.
+  virtual void Advance(uint64_t target, int min_score) = 0;
+
+ protected:
+  int max_score_ = 0;
+};
+
+// Walks a word's postings; a document's score is the number of times
+// the word appears in it.
+class TermIterator : public DocIterator {
+ public:
+  // "postings" must be sorted by docID.
+  explicit TermIterator(
+      std::shared_ptr<const std::vector<DocPosting>> postings);
+
+  uint64_t doc() const override {
+    return pos_ < postings_->size() ? (*postings_)[pos_].doc_id : kEnd;
+  }
+  int score() const override { return (*postings_)[pos_].num_positions; }
+  void Advance(uint64_t target, int min_score) override;
+
+  // The current document's posting.
+  const DocPosting &posting() const { return (*postings_)[pos_]; }
+
+ private:
+  std::shared_ptr<const std::vector<DocPosting>> postings_;
+  size_t pos_;
+};
+
+// Matches the documents that all of "required" match and none of
+// "excluded" do, scoring the total of "required"'s scores.  With no
+// "required" iterators, matches nothing.
+class AndIterator : public DocIterator {
+ public:
+  AndIterator(std::vector<std::unique_ptr<DocIterator>> required,
+              std::vector<std::unique_ptr<DocIterator>> excluded);
+
+  uint64_t doc() const override { return doc_; }
+  int score() const override;
+  void Advance(uint64_t target, int min_score) override;
+
+ private:
+  std::vector<std::unique_ptr<DocIterator>> required_;
+  std::vector<std::unique_ptr<DocIterator>> excluded_;
+  uint64_t doc_;
+};
+
+// Matches the documents that any of "children" match, scoring the
+// total of the scores of those that match.  Advance() uses WAND: with
+// the children ordered by their current documents, the first document
+// at which enough of their upper bounds add up to more than the
+// minimum is the first that can qualify, so the children before it
+// are moved straight there, skipping every document in between.
+class OrIterator : public DocIterator {
+ public:
+  explicit OrIterator(std::vector<std::unique_ptr<DocIterator>> children);
+
+  uint64_t doc() const override { return doc_; }
+  int score() const override;
+  void Advance(uint64_t target, int min_score) override;
+
+ private:
+  std::vector<std::unique_ptr<DocIterator>> children_;
+  uint64_t doc_;
+};
+
+// Matches the documents that have the words of "words" together: one
+// right after another, in order, if "distance" is zero (a phrase), or
+// otherwise with each of the others at most "distance" words away
+// from the first (a NEAR).  The positions in "reader" have to count
+// words (see IndexReader::has_word_positions()).  A document's score
+// is the number of times its first word is the start of a match.
+//
+// The words' docIDs are intersected first, as AndIterator does, and
+// only the documents that have all of them have their positions read
+// from "reader" and merged.  Position lists are increasing, so one
+// pass over each decides a document.
+class PhraseIterator : public DocIterator {
+ public:
+  PhraseIterator(const IndexReader *reader,
+                 std::vector<std::unique_ptr<TermIterator>> words,
+                 int distance);
+
+  uint64_t doc() const override { return doc_; }
+  int score() const override { return score_; }
+  void Advance(uint64_t target, int min_score) override;
+
+ private:
+  // Returns the number of matches in the document all of the words
+  // are on, reading their positions.
+  int CountMatches();
+
+  const IndexReader *reader_;
+  std::vector<std::unique_ptr<TermIterator>> words_;
+  int distance_;
+  uint64_t doc_;
+  int score_;
+
+  // The words' positions in the current document, and how far the
+  // merge is through each, kept to reuse their memory.
+  std::vector<std::vector<int32_t>> positions_;
+  std::vector<size_t> cursors_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_DOCITERATOR_H_
@@ -9,7 +9,10 @@
  * author.
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <unistd.h>
 #include <string>
 #include <cstdlib>
 #include <iostream>
@@ -63,4 +66,51 @@ bool FileReader::ReadFile(string *str) {
   return true;
 }
 
+bool FileReader::ReadRange(uint64_t offset, size_t len, string *str) {
+  string fullfile = basedir_ + "/" + fname_;
+
+  if (!IsPathSafe(basedir_, fullfile)) {
+    return false;
+  }
+  int fd = open(fullfile.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+
+  str->resize(len);
+  size_t got = 0;
+  while (got < len) {
+    ssize_t res = pread(fd, &(*str)[got], len - got, offset + got);
+    if (res == -1) {
+      if (errno == EINTR)
+        continue;
+      close(fd);
+      return false;
+    }
+    if (res == 0)
+      break;  // EOF
+    got += res;
+  }
+  close(fd);
+  str->resize(got);
+  return true;
+}
+
+bool FileReader::StatFile(struct stat *st) {
+  string fullfile = basedir_ + "/" + fname_;
+
+  if (!IsPathSafe(basedir_, fullfile)) {
+    return false;
+  }
+  // Opening the file, rather than just stat()ing it, checks that it
+  // can be read before a caller commits to sending it.
+  int fd = open(fullfile.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  bool ok = fstat(fd, st) == 0 && S_ISREG(st->st_mode);
+  close(fd);
+  return ok;
+}
+
 }  // namespace hw4
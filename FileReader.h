@@ -12,6 +12,8 @@
 #ifndef HW4_FILEREADER_H_
 #define HW4_FILEREADER_H_
 
+#include <stdint.h>
+#include <sys/stat.h>
 #include <string>
 
 namespace hw4 {
@@ -39,6 +41,22 @@ class FileReader {
   // returns true and also returns the file contents through "str".
   bool ReadFile(std::string *str);
 
+  // Applies the same checks as ReadFile(), but instead of reading the
+  // file just opens and stat()s it, returning its metadata through
+  // "st".  This lets callers answer conditional requests without
+  // touching the file's contents, and fails for a file that can't be
+  // read, so that it gets a 404 rather than a 200 with no body.
+  bool StatFile(struct stat *st);
+
+  // Like ReadFile(), but reads only the "len" bytes starting at byte
+  // "offset" of the file (fewer if the file ends first), using
+  // pread() so nothing else is read from disk.
+  bool ReadRange(uint64_t offset, size_t len, std::string *str);
+
+  // The path of the file, i.e., basedir/fname.  Only meaningful once
+  // one of the above has succeeded, since they check that it is safe.
+  std::string path() const { return basedir_ + "/" + fname_; }
+
  private:
   std::string basedir_;
   std::string fname_;
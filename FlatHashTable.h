@@ -0,0 +1,242 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_FLATHASHTABLE_H_
+#define HW4_FLATHASHTABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "./HashMix.h"
+
+namespace hw4 {
+
+// A FlatHashTable maps 64-bit keys (e.g., FNVHash64() hashes, as with
+// libhw1's HashTable) to values of type V, with the same operations
+// as HashTable, but without any per-entry allocations: the entries
+// are stored inline in one array, and found by open addressing
+// rather than by following a chain of list nodes.
+//
+// Collisions are resolved by Robin Hood linear probing: an entry
+// being inserted takes the slot of any entry it passes that is closer
+// to its home slot, so every entry ends up about equally far from
+// home.  Each slot's distance from home is kept in a separate array of
+// bytes, so a probe mostly reads consecutive bytes, and can stop as
+// soon as it reaches a slot whose entry is closer to home than the
+// key it's looking for would be.  Removal shifts the following
+// entries back, rather than leaving tombstones, so lookups don't slow
+// down as the table churns.
+//
+// V must be default-constructible and movable.  Not thread-safe; see
+// ConcurrentHashTable for a table that can be shared.
+template <typename V>
+class FlatHashTable {
+ public:
+  // The table starts with room for "num_elements" entries without
+  // growing.
+  explicit FlatHashTable(size_t num_elements = 0) : num_elements_(0) {
+    size_t capacity = kMinCapacity;
+    while (capacity * kMaxLoadNum < num_elements * kMaxLoadDen)
+      capacity *= 2;
+    Allocate(capacity);
+  }
+  virtual ~FlatHashTable() { }
+
+  FlatHashTable(const FlatHashTable &) = delete;
+  FlatHashTable &operator=(const FlatHashTable &) = delete;
+
+  // Maps "key" to "value".  If "key" was already present, returns
+  // true and returns the value it replaced through "old_value";
+  // otherwise returns false.
+  bool Insert(uint64_t key, V value, V *old_value) {
+    size_t i = FindSlot(key);
+    if (i != kNotFound) {
+      *old_value = std::move(slots_[i].value);
+      slots_[i].value = std::move(value);
+      return true;
+    }
+    if ((num_elements_ + 1) * kMaxLoadDen > capacity_ * kMaxLoadNum)
+      Grow();
+    Slot entry;
+    entry.key = key;
+    entry.value = std::move(value);
+    while (!Place(&entry))
+      Grow();
+    num_elements_++;
+    return false;
+  }
+
+  // Looks up "key".  Returns true and its value through "value" if it
+  // is present, and false otherwise.
+  bool Find(uint64_t key, V *value) const {
+    size_t i = FindSlot(key);
+    if (i == kNotFound)
+      return false;
+    *value = slots_[i].value;
+    return true;
+  }
+
+  // Like Find(), but returns a pointer to the value in the table (or
+  // nullptr), which stays valid until the table is next changed.
+  V *Lookup(uint64_t key) {
+    size_t i = FindSlot(key);
+    return i == kNotFound ? nullptr : &slots_[i].value;
+  }
+
+  // Removes "key".  Returns true and the value it had through
+  // "value" if it was present, and false otherwise.
+  bool Remove(uint64_t key, V *value) {
+    size_t i = FindSlot(key);
+    if (i == kNotFound)
+      return false;
+    *value = std::move(slots_[i].value);
+
+    // Shift the entries after it back a slot, until one is already
+    // home (or the slot is empty).
+    size_t next = (i + 1) & mask_;
+    while (dist_[next] > 1) {
+      slots_[i] = std::move(slots_[next]);
+      dist_[i] = dist_[next] - 1;
+      i = next;
+      next = (next + 1) & mask_;
+    }
+    slots_[i] = Slot();
+    dist_[i] = 0;
+    num_elements_--;
+    return true;
+  }
+
+  // The number of keys in the table.
+  size_t NumElements() const { return num_elements_; }
+
+  // The number of slots; for tests.
+  size_t capacity() const { return capacity_; }
+
+ private:
+  struct Slot {
+    uint64_t key = 0;
+    V value = V();
+  };
+
+  // The table grows by doubling when more than kMaxLoadNum /
+  // kMaxLoadDen of the slots are full.
+  static constexpr size_t kMinCapacity = 16;
+  static constexpr size_t kMaxLoadNum = 7;
+  static constexpr size_t kMaxLoadDen = 8;
+
+  // Distances are kept in a byte (as one more than the distance, so
+  // that 0 means empty); an insertion that would go further than this
+  // grows the table instead.
+  static constexpr uint8_t kMaxDist = 255;
+
+  static constexpr size_t kNotFound = SIZE_MAX;
+
+  // Keys are mixed (see MixHash()) to pick their home slot.
+  size_t Home(uint64_t key) const { return MixHash(key) & mask_; }
+
+  size_t FindSlot(uint64_t key) const {
+    size_t i = Home(key);
+    // An entry d slots past its home has dist_ d + 1.
+    for (unsigned int d = 1; d <= dist_[i]; d++) {
+      if (dist_[i] == d && slots_[i].key == key)
+        return i;
+      i = (i + 1) & mask_;
+    }
+    return kNotFound;
+  }
+
+  // Moves the new entry "*entry" into its place, displacing entries
+  // that are closer to home.  Returns false, leaving everything as it
+  // was, if some entry would end up too far from home.
+  bool Place(Slot *entry) {
+    // Check first.  Only the run of full slots from the entry's home
+    // changes, and an entry in it moves at most to the empty slot
+    // just past the run.
+    size_t i = Home(entry->key);
+    size_t run = 0;
+    while (dist_[(i + run) & mask_] != 0) {
+      if (++run >= kMaxDist)
+        return false;
+    }
+    for (size_t o = 0; o < run; o++) {
+      if (dist_[(i + o) & mask_] + (run - o) > kMaxDist)
+        return false;
+    }
+
+    Slot slot = std::move(*entry);
+    unsigned int d = 1;
+    while (dist_[i] != 0) {
+      if (dist_[i] < d) {
+        std::swap(slot, slots_[i]);
+        uint8_t tmp = dist_[i];
+        dist_[i] = d;
+        d = tmp;
+      }
+      d++;
+      i = (i + 1) & mask_;
+    }
+    slots_[i] = std::move(slot);
+    dist_[i] = d;
+    return true;
+  }
+
+  void Allocate(size_t capacity) {
+    capacity_ = capacity;
+    mask_ = capacity - 1;
+    slots_.reset(new Slot[capacity]);
+    dist_.reset(new uint8_t[capacity]());
+  }
+
+  // Moves every entry into a table twice the size (or bigger, in the
+  // unlikely event that some run of keys still doesn't fit).
+  void Grow() {
+    std::vector<Slot> entries;
+    entries.reserve(num_elements_);
+    TakeAll(&entries);
+    size_t capacity = capacity_ * 2;
+    while (true) {
+      Allocate(capacity);
+      size_t placed = 0;
+      while (placed < entries.size() && Place(&entries[placed]))
+        placed++;
+      if (placed == entries.size())
+        return;
+      std::vector<Slot> rest;
+      rest.reserve(entries.size());
+      TakeAll(&rest);
+      for (size_t i = placed; i < entries.size(); i++)
+        rest.push_back(std::move(entries[i]));
+      entries.swap(rest);
+      capacity *= 2;
+    }
+  }
+
+  // Moves the entries out of the table into "entries".
+  void TakeAll(std::vector<Slot> *entries) {
+    for (size_t i = 0; i < capacity_; i++) {
+      if (dist_[i] != 0)
+        entries->push_back(std::move(slots_[i]));
+    }
+  }
+
+  std::unique_ptr<Slot[]> slots_;
+  std::unique_ptr<uint8_t[]> dist_;
+  size_t capacity_;
+  size_t mask_;
+  size_t num_elements_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_FLATHASHTABLE_H_
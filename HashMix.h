@@ -0,0 +1,36 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_HASHMIX_H_
+#define HW4_HASHMIX_H_
+
+#include <stdint.h>
+
+namespace hw4 {
+
+// Returns "key" put through MurmurHash3's 64-bit finalizer, so that
+// every bit of the result depends on every bit of "key".  Keys are
+// often hashes already (e.g., FNVHash64()'s), but not necessarily
+// good ones in every bit, so the hash tables, caches, and filters
+// here mix them again before picking buckets, shards, or bits with
+// some of their bits.
+inline uint64_t MixHash(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+}  // namespace hw4
+
+#endif  // HW4_HASHMIX_H_
@@ -0,0 +1,555 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./Hpack.h"
+
+namespace hw4 {
+
+namespace {
+
+struct StaticEntry {
+  const char *name;
+  const char *value;
+};
+
+struct HuffmanSym {
+  uint32_t code;
+  uint8_t len;
+};
+
+// The static table (RFC 7541 Appendix A).  Entry i is index i + 1.
+static const StaticEntry kStaticTable[] = {
+  {":authority", ""},
+  {":method", "GET"},
+  {":method", "POST"},
+  {":path", "/"},
+  {":path", "/index.html"},
+  {":scheme", "http"},
+  {":scheme", "https"},
+  {":status", "200"},
+  {":status", "204"},
+  {":status", "206"},
+  {":status", "304"},
+  {":status", "400"},
+  {":status", "404"},
+  {":status", "500"},
+  {"accept-charset", ""},
+  {"accept-encoding", "gzip, deflate"},
+  {"accept-language", ""},
+  {"accept-ranges", ""},
+  {"accept", ""},
+  {"access-control-allow-origin", ""},
+  {"age", ""},
+  {"allow", ""},
+  {"authorization", ""},
+  {"cache-control", ""},
+  {"content-disposition", ""},
+  {"content-encoding", ""},
+  {"content-language", ""},
+  {"content-length", ""},
+  {"content-location", ""},
+  {"content-range", ""},
+  {"content-type", ""},
+  {"cookie", ""},
+  {"date", ""},
+  {"etag", ""},
+  {"expect", ""},
+  {"expires", ""},
+  {"from", ""},
+  {"host", ""},
+  {"if-match", ""},
+  {"if-modified-since", ""},
+  {"if-none-match", ""},
+  {"if-range", ""},
+  {"if-unmodified-since", ""},
+  {"last-modified", ""},
+  {"link", ""},
+  {"location", ""},
+  {"max-forwards", ""},
+  {"proxy-authenticate", ""},
+  {"proxy-authorization", ""},
+  {"range", ""},
+  {"referer", ""},
+  {"refresh", ""},
+  {"retry-after", ""},
+  {"server", ""},
+  {"set-cookie", ""},
+  {"strict-transport-security", ""},
+  {"transfer-encoding", ""},
+  {"user-agent", ""},
+  {"vary", ""},
+  {"via", ""},
+  {"www-authenticate", ""},
+};
+
+// The Huffman code for each octet (RFC 7541 Appendix B), with the
+// code right-aligned in "code", and its length in bits.  The
+// 257th symbol, EOS, is only ever used for padding.
+static const HuffmanSym kHuffmanCodes[256] = {
+  {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+  {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+  {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+  {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+  {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+  {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+  {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+  {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+  {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6},
+  {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+  {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5},
+  {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6},
+  {0x1f, 6}, {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12},
+  {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7},
+  {0x60, 7}, {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7}, {0x65, 7},
+  {0x66, 7}, {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7},
+  {0x6c, 7}, {0x6d, 7}, {0x6e, 7}, {0x6f, 7}, {0x70, 7}, {0x71, 7},
+  {0x72, 7}, {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19},
+  {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6}, {0x7ffd, 15}, {0x3, 5}, {0x23, 6},
+  {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5},
+  {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6},
+  {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+  {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+  {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22},
+  {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22}, {0x3fffd4, 22},
+  {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+  {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23},
+  {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24}, {0xffffed, 24},
+  {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+  {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21},
+  {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22}, {0x7fffe6, 23},
+  {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+  {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23},
+  {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23}, {0x3fffdd, 22},
+  {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+  {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21},
+  {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23}, {0x3fffe1, 22},
+  {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+  {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22},
+  {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26}, {0x3ffffe1, 26},
+  {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+  {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26},
+  {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27}, {0x3ffffe5, 26},
+  {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+  {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26},
+  {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21}, {0x1fffe5, 21},
+  {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+  {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24},
+  {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22}, {0x1fffe7, 21},
+  {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+  {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24},
+  {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26}, {0x7ffffe6, 27},
+  {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+  {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28},
+  {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27}, {0x7ffffef, 27},
+  {0x7fffff0, 27}, {0x3ffffee, 26},
+};
+
+// EOS, which a Huffman string's padding must be a prefix of.
+const uint32_t kHuffmanEos = 0x3fffffff;
+const int kHuffmanEosLen = 30;
+
+// The static table as HeaderFields.
+const std::vector<HeaderField> &StaticFields() {
+  static const std::vector<HeaderField> fields = [] {
+    std::vector<HeaderField> v;
+    for (const StaticEntry &e : kStaticTable)
+      v.emplace_back(e.name, e.value);
+    return v;
+  }();
+  return fields;
+}
+
+// The Huffman code as a binary tree, for decoding a bit at a time.
+// Node 0 is the root; a leaf holds the symbol it decodes to (256 for
+// EOS).
+class HuffmanTree {
+ public:
+  HuffmanTree() {
+    nodes_.push_back(Node());
+    for (int sym = 0; sym < 256; sym++)
+      Add(kHuffmanCodes[sym].code, kHuffmanCodes[sym].len, sym);
+    Add(kHuffmanEos, kHuffmanEosLen, 256);
+  }
+
+  struct Node {
+    int16_t child[2] = {-1, -1};
+    int16_t sym = -1;
+  };
+  const Node &node(int i) const { return nodes_[i]; }
+
+ private:
+  void Add(uint32_t code, int len, int sym) {
+    int n = 0;
+    for (int bit = len - 1; bit >= 0; bit--) {
+      int b = (code >> bit) & 1;
+      if (nodes_[n].child[b] < 0) {
+        nodes_[n].child[b] = static_cast<int16_t>(nodes_.size());
+        nodes_.push_back(Node());
+      }
+      n = nodes_[n].child[b];
+    }
+    nodes_[n].sym = static_cast<int16_t>(sym);
+  }
+
+  std::vector<Node> nodes_;
+};
+
+const HuffmanTree &Tree() {
+  static const HuffmanTree tree;
+  return tree;
+}
+
+// Header fields whose values are (nearly) unique to each response, so
+// aren't worth a dynamic table entry.
+bool IsVolatile(const std::string &name) {
+  static const char *const kVolatile[] = {
+    ":path", "content-length", "content-range", "etag", "last-modified",
+    "date", "set-cookie", "authorization", "cookie",
+  };
+  for (const char *v : kVolatile) {
+    if (name == v)
+      return true;
+  }
+  return false;
+}
+
+// Appends a string literal, Huffman coded if that makes it shorter.
+void EncodeString(std::string_view s, std::string *out) {
+  size_t hlen = HuffmanEncodedLength(s);
+  if (hlen < s.size()) {
+    HpackEncodeInteger(hlen, 7, 0x80, out);
+    HuffmanEncode(s, out);
+  } else {
+    HpackEncodeInteger(s.size(), 7, 0x00, out);
+    out->append(s.data(), s.size());
+  }
+}
+
+// Decodes a string literal at "*data" into "out", advancing "*data".
+bool DecodeString(const uint8_t **data, const uint8_t *end,
+                  std::string *out) {
+  if (*data >= end)
+    return false;
+  bool huffman = (**data & 0x80) != 0;
+  uint64_t len;
+  if (!HpackDecodeInteger(data, end, 7, &len) ||
+      len > static_cast<uint64_t>(end - *data))
+    return false;
+  out->clear();
+  bool ok = true;
+  if (huffman)
+    ok = HuffmanDecode(*data, len, out);
+  else
+    out->assign(reinterpret_cast<const char *>(*data), len);
+  *data += len;
+  return ok;
+}
+
+}  // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// Primitives
+///////////////////////////////////////////////////////////////////////////////
+
+void HpackEncodeInteger(uint64_t value, int prefix_bits,
+                        uint8_t first_byte_flags, std::string *out) {
+  uint64_t max_prefix = (1u << prefix_bits) - 1;
+  if (value < max_prefix) {
+    out->push_back(static_cast<char>(first_byte_flags | value));
+    return;
+  }
+  out->push_back(static_cast<char>(first_byte_flags | max_prefix));
+  value -= max_prefix;
+  while (value >= 128) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+bool HpackDecodeInteger(const uint8_t **data, const uint8_t *end,
+                        int prefix_bits, uint64_t *value) {
+  const uint8_t *p = *data;
+  if (p >= end)
+    return false;
+  uint64_t max_prefix = (1u << prefix_bits) - 1;
+  uint64_t v = *p++ & max_prefix;
+  if (v == max_prefix) {
+    // Continuation bytes, 7 bits at a time, least significant first.
+    // Nothing we accept needs more than 32 bits.
+    int shift = 0;
+    while (true) {
+      if (p >= end || shift > 28)
+        return false;
+      uint8_t b = *p++;
+      v += static_cast<uint64_t>(b & 0x7f) << shift;
+      shift += 7;
+      if ((b & 0x80) == 0)
+        break;
+    }
+    if (v > UINT32_MAX)
+      return false;
+  }
+  *value = v;
+  *data = p;
+  return true;
+}
+
+size_t HuffmanEncodedLength(std::string_view in) {
+  uint64_t bits = 0;
+  for (unsigned char c : in)
+    bits += kHuffmanCodes[c].len;
+  return (bits + 7) / 8;
+}
+
+void HuffmanEncode(std::string_view in, std::string *out) {
+  // Codes are at most 30 bits, so a 64-bit accumulator never holds
+  // more than 7 + 30 pending bits.
+  uint64_t acc = 0;
+  int nbits = 0;
+  for (unsigned char c : in) {
+    const HuffmanSym &sym = kHuffmanCodes[c];
+    acc = (acc << sym.len) | sym.code;
+    nbits += sym.len;
+    while (nbits >= 8) {
+      nbits -= 8;
+      out->push_back(static_cast<char>(acc >> nbits));
+    }
+  }
+  if (nbits > 0) {
+    // Pad with the high bits of EOS, which are all ones.
+    acc = (acc << (8 - nbits)) | ((1u << (8 - nbits)) - 1);
+    out->push_back(static_cast<char>(acc));
+  }
+}
+
+bool HuffmanDecode(const uint8_t *data, size_t len, std::string *out) {
+  const HuffmanTree &tree = Tree();
+  int n = 0;
+  int pad_bits = 0;      // bits since the last complete symbol
+  bool pad_ones = true;  // and whether they were all ones
+  for (size_t i = 0; i < len; i++) {
+    for (int bit = 7; bit >= 0; bit--) {
+      int b = (data[i] >> bit) & 1;
+      n = tree.node(n).child[b];
+      if (n < 0)
+        return false;
+      pad_bits++;
+      pad_ones = pad_ones && b;
+      int sym = tree.node(n).sym;
+      if (sym >= 0) {
+        if (sym == 256)
+          return false;  // EOS mustn't appear in the string
+        out->push_back(static_cast<char>(sym));
+        n = 0;
+        pad_bits = 0;
+        pad_ones = true;
+      }
+    }
+  }
+  return pad_bits <= 7 && pad_ones;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// HpackTable
+///////////////////////////////////////////////////////////////////////////////
+
+// static
+const uint64_t HpackTable::kNumStaticEntries =
+  sizeof(kStaticTable) / sizeof(kStaticTable[0]);
+
+bool HpackTable::Lookup(uint64_t index, const HeaderField **field) const {
+  if (index == 0)
+    return false;
+  if (index <= kNumStaticEntries) {
+    *field = &StaticFields()[index - 1];
+    return true;
+  }
+  index -= kNumStaticEntries + 1;
+  if (index >= entries_.size())
+    return false;
+  *field = &entries_[index];
+  return true;
+}
+
+uint64_t HpackTable::Find(std::string_view name, std::string_view value,
+                          bool *value_matches) const {
+  uint64_t name_index = 0;
+  const std::vector<HeaderField> &fields = StaticFields();
+  for (uint64_t i = 0; i < fields.size(); i++) {
+    if (fields[i].first != name)
+      continue;
+    if (fields[i].second == value) {
+      *value_matches = true;
+      return i + 1;
+    }
+    if (name_index == 0)
+      name_index = i + 1;
+  }
+  for (uint64_t i = 0; i < entries_.size(); i++) {
+    if (entries_[i].first != name)
+      continue;
+    if (entries_[i].second == value) {
+      *value_matches = true;
+      return kNumStaticEntries + 1 + i;
+    }
+    if (name_index == 0)
+      name_index = kNumStaticEntries + 1 + i;
+  }
+  *value_matches = false;
+  return name_index;
+}
+
+void HpackTable::Insert(const HeaderField &field) {
+  size_t size = EntrySize(field);
+  if (size > max_size_) {
+    EvictTo(0);
+    return;
+  }
+  EvictTo(max_size_ - size);
+  entries_.push_front(field);
+  size_ += size;
+}
+
+void HpackTable::SetMaxSize(uint32_t max_size) {
+  max_size_ = max_size;
+  EvictTo(max_size_);
+}
+
+void HpackTable::EvictTo(size_t size) {
+  while (size_ > size) {
+    size_ -= EntrySize(entries_.back());
+    entries_.pop_back();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// HpackDecoder
+///////////////////////////////////////////////////////////////////////////////
+
+// static
+const uint32_t HpackDecoder::kDefaultTableSize = 4096;
+const size_t HpackDecoder::kMaxHeaderListBytes = 65536;
+
+bool HpackDecoder::Decode(const uint8_t *data, size_t len,
+                          HeaderList *headers) {
+  const uint8_t *p = data;
+  const uint8_t *end = data + len;
+  size_t list_bytes = 0;
+  bool seen_field = false;
+
+  while (p < end) {
+    uint8_t b = *p;
+    uint64_t index;
+    HeaderField field;
+    bool index_it = false;
+
+    if (b & 0x80) {
+      // Indexed header field.
+      const HeaderField *f;
+      if (!HpackDecodeInteger(&p, end, 7, &index) ||
+          !table_.Lookup(index, &f))
+        return false;
+      field = *f;
+    } else if ((b & 0xe0) == 0x20) {
+      // Dynamic table size update, only allowed before any field.
+      uint64_t size;
+      if (seen_field || !HpackDecodeInteger(&p, end, 5, &size) ||
+          size > limit_)
+        return false;
+      table_.SetMaxSize(static_cast<uint32_t>(size));
+      continue;
+    } else {
+      // Literal, with incremental indexing (01), without indexing
+      // (0000), or never indexed (0001); the last two differ only in
+      // what proxies may do with them.
+      index_it = (b & 0xc0) == 0x40;
+      if (!HpackDecodeInteger(&p, end, index_it ? 6 : 4, &index))
+        return false;
+      if (index != 0) {
+        const HeaderField *f;
+        if (!table_.Lookup(index, &f))
+          return false;
+        field.first = f->first;
+      } else if (!DecodeString(&p, end, &field.first)) {
+        return false;
+      }
+      if (!DecodeString(&p, end, &field.second))
+        return false;
+    }
+
+    seen_field = true;
+    list_bytes += HpackTable::EntrySize(field);
+    if (list_bytes > kMaxHeaderListBytes)
+      return false;
+    if (index_it)
+      table_.Insert(field);
+    headers->push_back(std::move(field));
+  }
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// HpackEncoder
+///////////////////////////////////////////////////////////////////////////////
+
+// static
+const uint32_t HpackEncoder::kDefaultTableSize = 4096;
+
+void HpackEncoder::SetMaxTableSize(uint32_t max_size) {
+  max_size = std::min(max_size, kDefaultTableSize);
+  if (max_size == table_.max_size())
+    return;
+  // The table may have shrunk (evicting entries) and then grown again
+  // since the last block; the peer must hear of both.
+  if (!pending_size_update_ || max_size < min_table_size_)
+    min_table_size_ = max_size;
+  table_.SetMaxSize(max_size);
+  pending_size_update_ = true;
+}
+
+void HpackEncoder::Encode(const HeaderList &headers, std::string *out) {
+  if (pending_size_update_) {
+    if (min_table_size_ < table_.max_size())
+      HpackEncodeInteger(min_table_size_, 5, 0x20, out);
+    HpackEncodeInteger(table_.max_size(), 5, 0x20, out);
+    pending_size_update_ = false;
+  }
+
+  for (const HeaderField &field : headers) {
+    bool value_matches;
+    uint64_t index = table_.Find(field.first, field.second, &value_matches);
+    if (value_matches) {
+      HpackEncodeInteger(index, 7, 0x80, out);
+      continue;
+    }
+
+    bool index_it = !IsVolatile(field.first);
+    if (index_it)
+      HpackEncodeInteger(index, 6, 0x40, out);
+    else
+      HpackEncodeInteger(index, 4, 0x00, out);
+    if (index == 0)
+      EncodeString(field.first, out);
+    EncodeString(field.second, out);
+    if (index_it)
+      table_.Insert(field);
+  }
+}
+
+}  // namespace hw4
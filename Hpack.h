@@ -0,0 +1,165 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_HPACK_H_
+#define HW4_HPACK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace hw4 {
+
+// HPACK (RFC 7541) is the header compression HTTP/2 uses.  A header
+// block is a sequence of header fields, each of which is either an
+// index into a table of fields seen before or a literal name and
+// value (optionally Huffman coded).  The table is the 61-entry static
+// table of common fields followed by a dynamic table of recently sent
+// fields, which the encoder and decoder on either end of a connection
+// keep in lockstep; so there is one HpackEncoder and one HpackDecoder
+// per connection, and header blocks must be processed in the order
+// they are sent.
+
+// A header field: (name, value).  HTTP/2 header names are lower case.
+typedef std::pair<std::string, std::string> HeaderField;
+typedef std::vector<HeaderField> HeaderList;
+
+// The dynamic table of one end of a connection: the most recently
+// inserted fields, newest first, whose total size (by HPACK's
+// accounting, each field's name and value plus 32 bytes) stays within
+// max_size().
+class HpackTable {
+ public:
+  explicit HpackTable(uint32_t max_size) : size_(0), max_size_(max_size) { }
+  virtual ~HpackTable() { }
+
+  // Looks up "index" in the combined static and dynamic index space,
+  // where 1 to 61 are the static table.  Returns false if there is no
+  // such entry.
+  bool Lookup(uint64_t index, const HeaderField **field) const;
+
+  // Returns the index of an entry matching "name" and "value", or
+  // failing that one matching just "name" (and sets "*value_matches"
+  // accordingly), or 0 if there is none.
+  uint64_t Find(std::string_view name, std::string_view value,
+                bool *value_matches) const;
+
+  // Adds "field" as the newest entry, evicting the oldest ones to
+  // make room.  A field bigger than max_size() just empties the table.
+  void Insert(const HeaderField &field);
+
+  // Changes the maximum size, evicting entries if it shrank.
+  void SetMaxSize(uint32_t max_size);
+
+  size_t num_entries() const { return entries_.size(); }
+  size_t size() const { return size_; }
+  uint32_t max_size() const { return max_size_; }
+
+  // The size a field counts for.
+  static size_t EntrySize(const HeaderField &field) {
+    return field.first.size() + field.second.size() + 32;
+  }
+
+  // The number of entries in the static table.
+  static const uint64_t kNumStaticEntries;
+
+ private:
+  void EvictTo(size_t size);
+
+  std::deque<HeaderField> entries_;  // newest first
+  size_t size_;
+  uint32_t max_size_;
+};
+
+// Decodes the header blocks a peer sends.
+class HpackDecoder {
+ public:
+  // "max_table_size" is the SETTINGS_HEADER_TABLE_SIZE we advertise,
+  // the most the peer may grow our copy of its dynamic table to.
+  explicit HpackDecoder(uint32_t max_table_size = kDefaultTableSize)
+    : table_(max_table_size), limit_(max_table_size) { }
+  virtual ~HpackDecoder() { }
+
+  // Decodes the complete header block of "len" bytes at "data",
+  // appending its fields to "headers".  Returns false if the block is
+  // malformed, or decodes to more than kMaxHeaderListBytes, in which
+  // case the connection has to be torn down (the table can no longer
+  // be trusted to match the peer's).
+  bool Decode(const uint8_t *data, size_t len, HeaderList *headers);
+
+  const HpackTable &table() const { return table_; }
+
+  static const uint32_t kDefaultTableSize;
+  static const size_t kMaxHeaderListBytes;
+
+ private:
+  HpackTable table_;
+  uint32_t limit_;
+};
+
+// Encodes the header blocks we send.  Fields are added to the dynamic
+// table, so that repeating them in later responses costs a byte or
+// two, except for those whose values rarely repeat (e.g., ETags and
+// lengths), which would only push more useful entries out.
+class HpackEncoder {
+ public:
+  HpackEncoder()
+    : table_(kDefaultTableSize), pending_size_update_(false),
+      min_table_size_(kDefaultTableSize) { }
+  virtual ~HpackEncoder() { }
+
+  // Appends the encoding of "headers" to "out".
+  void Encode(const HeaderList &headers, std::string *out);
+
+  // Called when the peer's SETTINGS_HEADER_TABLE_SIZE changes.  We
+  // never use more than kDefaultTableSize, even if it allows more.
+  void SetMaxTableSize(uint32_t max_size);
+
+  const HpackTable &table() const { return table_; }
+
+  static const uint32_t kDefaultTableSize;
+
+ private:
+  HpackTable table_;
+
+  // True if the next block must start by announcing table_.max_size(),
+  // after min_table_size_, the smallest the table was since the last
+  // block, if that was smaller (RFC 7541, section 4.2).
+  bool pending_size_update_;
+  uint32_t min_table_size_;
+};
+
+// The primitive encodings, exposed for testing.  An integer with an
+// "prefix_bits"-bit prefix goes into the low bits of the first byte,
+// whose high bits are "first_byte_flags".
+void HpackEncodeInteger(uint64_t value, int prefix_bits,
+                        uint8_t first_byte_flags, std::string *out);
+bool HpackDecodeInteger(const uint8_t **data, const uint8_t *end,
+                        int prefix_bits, uint64_t *value);
+
+// Appends the Huffman coding of "in" to "out".
+void HuffmanEncode(std::string_view in, std::string *out);
+
+// The length in bytes of the Huffman coding of "in".
+size_t HuffmanEncodedLength(std::string_view in);
+
+// Appends the decoding of the "len" Huffman coded bytes at "data" to
+// "out".  Returns false if they aren't a valid coding, including if
+// the padding isn't (at most 7) 1 bits.
+bool HuffmanDecode(const uint8_t *data, size_t len, std::string *out);
+
+}  // namespace hw4
+
+#endif  // HW4_HPACK_H_
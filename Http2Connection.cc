@@ -0,0 +1,870 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <strings.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "./Http2Connection.h"
+
+namespace hw4 {
+
+namespace {
+
+// Frame types (RFC 7540 section 6).
+enum FrameType : uint8_t {
+  kData = 0x0,
+  kHeaders = 0x1,
+  kPriority = 0x2,
+  kRstStream = 0x3,
+  kSettings = 0x4,
+  kPushPromise = 0x5,
+  kPing = 0x6,
+  kGoAway = 0x7,
+  kWindowUpdate = 0x8,
+  kContinuation = 0x9,
+};
+
+// Frame flags.  END_STREAM and ACK share a bit, on different frames.
+const uint8_t kFlagEndStream = 0x1;
+const uint8_t kFlagAck = 0x1;
+const uint8_t kFlagEndHeaders = 0x4;
+const uint8_t kFlagPadded = 0x8;
+const uint8_t kFlagPriority = 0x20;
+
+// Error codes (RFC 7540 section 7).
+const uint32_t kNoError = 0x0;
+const uint32_t kProtocolError = 0x1;
+const uint32_t kInternalError = 0x2;
+const uint32_t kFlowControlError = 0x3;
+const uint32_t kStreamClosed = 0x5;
+const uint32_t kFrameSizeError = 0x6;
+const uint32_t kRefusedStream = 0x7;
+const uint32_t kCompressionError = 0x9;
+const uint32_t kEnhanceYourCalm = 0xb;
+
+// Settings identifiers.
+const uint16_t kSettingsHeaderTableSize = 0x1;
+const uint16_t kSettingsEnablePush = 0x2;
+const uint16_t kSettingsMaxConcurrentStreams = 0x3;
+const uint16_t kSettingsInitialWindowSize = 0x4;
+const uint16_t kSettingsMaxFrameSize = 0x5;
+
+const size_t kFrameHeaderSize = 9;
+const int64_t kDefaultWindow = 65535;
+const int64_t kMaxWindow = 0x7fffffff;
+const uint32_t kMaxAllowedFrameSize = 0xffffff;
+
+// The connection preface a client sends, and the part of it that is
+// left after GetNextRequest() has read it as a request.
+const std::string_view kPreface("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+const std::string_view kPrefaceRest("SM\r\n\r\n");
+
+// Once this much is queued, it is written out before queueing more.
+const size_t kFlushBytes = 65536;
+
+uint32_t Get16(std::string_view s, size_t pos) {
+  return (static_cast<uint8_t>(s[pos]) << 8) | static_cast<uint8_t>(s[pos + 1]);
+}
+
+uint32_t Get32(std::string_view s, size_t pos) {
+  return (Get16(s, pos) << 16) | Get16(s, pos + 2);
+}
+
+void Put16(uint32_t v, std::string *out) {
+  out->push_back(static_cast<char>(v >> 8));
+  out->push_back(static_cast<char>(v));
+}
+
+void Put32(uint32_t v, std::string *out) {
+  Put16(v >> 16, out);
+  Put16(v, out);
+}
+
+void AppendFrameHeader(uint32_t len, uint8_t type, uint8_t flags,
+                       uint32_t stream_id, std::string *out) {
+  out->push_back(static_cast<char>(len >> 16));
+  Put16(len, out);
+  out->push_back(static_cast<char>(type));
+  out->push_back(static_cast<char>(flags));
+  Put32(stream_id & 0x7fffffff, out);
+}
+
+// Removes the padding (and the pad length) from the payload of a
+// frame with the PADDED flag.  Returns false if it is malformed.
+bool StripPadding(uint8_t flags, std::string_view *payload) {
+  if ((flags & kFlagPadded) == 0)
+    return true;
+  if (payload->empty())
+    return false;
+  size_t pad = static_cast<uint8_t>((*payload)[0]);
+  if (pad >= payload->size())
+    return false;
+  *payload = payload->substr(1, payload->size() - 1 - pad);
+  return true;
+}
+
+// Decodes base64url without padding (RFC 4648 section 5), as used by
+// the HTTP2-Settings header.
+bool DecodeBase64Url(std::string_view in, std::string *out) {
+  while (!in.empty() && in.back() == '=')
+    in.remove_suffix(1);
+  uint32_t acc = 0;
+  int nbits = 0;
+  for (char c : in) {
+    int v;
+    if (c >= 'A' && c <= 'Z')
+      v = c - 'A';
+    else if (c >= 'a' && c <= 'z')
+      v = c - 'a' + 26;
+    else if (c >= '0' && c <= '9')
+      v = c - '0' + 52;
+    else if (c == '-')
+      v = 62;
+    else if (c == '_')
+      v = 63;
+    else
+      return false;
+    acc = (acc << 6) | v;
+    nbits += 6;
+    if (nbits >= 8) {
+      nbits -= 8;
+      out->push_back(static_cast<char>(acc >> nbits));
+    }
+  }
+  return true;
+}
+
+// Headers that only mean something to an HTTP/1.x connection, and
+// mustn't appear in HTTP/2.
+bool IsConnectionSpecific(const std::string &name) {
+  return name == "connection" || name == "keep-alive" ||
+         name == "proxy-connection" || name == "transfer-encoding" ||
+         name == "upgrade";
+}
+
+}  // namespace
+
+// static
+const uint32_t Http2Connection::kMaxConcurrentStreams = 100;
+const uint32_t Http2Connection::kMaxFrameSize = 16384;
+
+// A request, and the part of its response that hasn't been sent yet.
+struct Http2Connection::Stream {
+  Stream(uint32_t id, int64_t send_window)
+    : id(id), send_window(send_window) { }
+  ~Stream() {
+    if (file_fd != -1)
+      close(file_fd);
+  }
+
+  // Body bytes still to send: first data, then the file.
+  uint64_t pending() const {
+    return data.size() - data_pos + file_remaining;
+  }
+
+  uint32_t id;
+  HttpRequest request;
+
+  bool remote_closed = false;  // the request is complete
+  bool headers_sent = false;
+  bool body_done = false;      // all of the body has been queued
+  bool closed = false;         // done; forget the stream
+
+  int64_t send_window;
+
+  std::string data;
+  size_t data_pos = 0;
+  int file_fd = -1;
+  uint64_t file_offset = 0;
+  uint64_t file_remaining = 0;
+};
+
+// The ResponseWriter for a stream.  Headers are queued right away;
+// the body is left for the scheduler.
+class Http2Connection::StreamWriter : public ResponseWriter {
+ public:
+  StreamWriter(Http2Connection *h2, Stream *stream)
+    : h2_(h2), stream_(stream) { }
+
+  bool WriteResponse(const HttpResponse &response) override {
+    bool has_file = !response.body_file().empty();
+    uint64_t length = has_file ? response.body_file_length() :
+                                 response.body().size();
+    bool not_modified = (response.response_code() == 304);
+    if (not_modified)
+      length = 0;
+
+    if (has_file && length > 0) {
+      // Open the file before promising its length.
+      stream_->file_fd = open(response.body_file().c_str(), O_RDONLY);
+      if (stream_->file_fd == -1) {
+        h2_->ResetStream(stream_->id, kInternalError);
+        return true;
+      }
+      stream_->file_offset = response.body_file_offset();
+      stream_->file_remaining = length;
+    } else if (length > 0) {
+      stream_->data = response.body();
+    }
+
+    h2_->QueueHeaders(stream_, response,
+                      not_modified ? -1 : static_cast<int64_t>(length),
+                      length == 0);
+    stream_->body_done = true;
+    return true;
+  }
+
+  bool WriteChunkedHeader(const HttpResponse &response) override {
+    h2_->QueueHeaders(stream_, response, -1, false);
+    return true;
+  }
+
+  bool WriteChunk(const char *data, size_t len) override {
+    if (len == 0 || stream_->closed)
+      return true;
+    stream_->data.append(data, len);
+    // Start sending it now, so the client sees the first part of the
+    // body while the rest is still being produced.
+    return h2_->SendData();
+  }
+
+  bool WriteLastChunk() override {
+    stream_->body_done = true;
+    return true;
+  }
+
+ private:
+  Http2Connection *h2_;
+  Stream *stream_;
+};
+
+Http2Connection::Http2Connection(HttpConnection *conn, Handler handler)
+  : conn_(conn), handler_(handler), next_stream_(0), last_stream_id_(0),
+    continuation_stream_(0), header_block_end_stream_(false),
+    send_window_(kDefaultWindow), peer_initial_window_(kDefaultWindow),
+    peer_max_frame_size_(kMaxFrameSize), goaway_received_(false) {
+  // Our half of the connection preface: our SETTINGS.
+  std::string settings;
+  Put16(kSettingsMaxConcurrentStreams, &settings);
+  Put32(kMaxConcurrentStreams, &settings);
+  QueueFrame(kSettings, 0, 0, settings);
+}
+
+Http2Connection::~Http2Connection() { }
+
+// static
+bool Http2Connection::IsPreface(const HttpRequest &request) {
+  return request.uri() == "*" && request.protocol() == "HTTP/2.0";
+}
+
+// static
+bool Http2Connection::WantsUpgrade(const HttpRequest &request) {
+  if (request.protocol() != "HTTP/1.1")
+    return false;
+
+  // "Upgrade" is a list of protocols, e.g., "h2c, websocket".
+  std::string upgrade = request.GetHeaderValue("upgrade");
+  bool h2c = false;
+  size_t start = 0;
+  while (start <= upgrade.size() && !h2c) {
+    size_t end = upgrade.find(',', start);
+    if (end == std::string::npos)
+      end = upgrade.size();
+    std::string token = upgrade.substr(start, end - start);
+    size_t first = token.find_first_not_of(" \t");
+    size_t last = token.find_last_not_of(" \t");
+    if (first != std::string::npos)
+      h2c = strcasecmp(token.substr(first, last - first + 1).c_str(),
+                       "h2c") == 0;
+    start = end + 1;
+  }
+
+  // The client's SETTINGS have to come along (RFC 7540 section 3.2.1).
+  std::string settings;
+  return h2c &&
+         DecodeBase64Url(request.GetHeaderValue("http2-settings"),
+                         &settings) &&
+         settings.size() % 6 == 0;
+}
+
+bool Http2Connection::ServePriorKnowledge() {
+  std::string_view rest;
+  if (!conn_->ReadBytes(kPrefaceRest.size(), &rest) || rest != kPrefaceRest)
+    return false;
+  conn_->ConsumeBytes(kPrefaceRest.size());
+  return Run();
+}
+
+bool Http2Connection::ServeUpgrade(const HttpRequest &request) {
+  std::string settings;
+  DecodeBase64Url(request.GetHeaderValue("http2-settings"), &settings);
+  if (ApplySettings(settings) != kNoError)
+    return false;
+
+  static const char k101[] =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Connection: Upgrade\r\n"
+    "Upgrade: h2c\r\n"
+    "\r\n";
+  if (!conn_->WriteAll(k101, sizeof(k101) - 1))
+    return false;
+
+  // The request becomes stream 1, which the client has already
+  // half-closed, so it can be answered before the client's preface
+  // arrives.
+  HttpRequest req;
+  req = request;
+  req.set_protocol("HTTP/2.0");
+  last_stream_id_ = 1;
+  if (!OpenStream(1, req, true) || !SendData())
+    return false;
+
+  std::string_view preface;
+  if (!conn_->ReadBytes(kPreface.size(), &preface) || preface != kPreface)
+    return false;
+  conn_->ConsumeBytes(kPreface.size());
+  return Run();
+}
+
+bool Http2Connection::Run() {
+  while (true) {
+    if (!SendData())
+      return false;
+    if (goaway_received_ && streams_.empty())
+      return true;
+
+    // Frame header: 24-bit length, type, flags, 31-bit stream ID.
+    std::string_view header;
+    if (!conn_->ReadBytes(kFrameHeaderSize, &header))
+      return true;  // the client hung up
+    uint32_t len = (static_cast<uint8_t>(header[0]) << 16) | Get16(header, 1);
+    uint8_t type = header[3];
+    uint8_t flags = header[4];
+    uint32_t stream_id = Get32(header, 5) & 0x7fffffff;
+    conn_->ConsumeBytes(kFrameHeaderSize);
+
+    if (len > kMaxFrameSize) {
+      GoAway(kFrameSizeError);
+      return false;
+    }
+    std::string_view payload;
+    if (len > 0 && !conn_->ReadBytes(len, &payload))
+      return true;
+    uint32_t error = HandleFrame(type, flags, stream_id, payload);
+    conn_->ConsumeBytes(len);
+    if (error != kNoError) {
+      GoAway(error);
+      return false;
+    }
+  }
+}
+
+uint32_t Http2Connection::HandleFrame(uint8_t type, uint8_t flags,
+                                      uint32_t stream_id,
+                                      std::string_view payload) {
+  // Nothing may come between a header block's frames.
+  if (continuation_stream_ != 0 && type != kContinuation)
+    return kProtocolError;
+
+  switch (type) {
+    case kData:
+      return HandleData(flags, stream_id, payload);
+
+    case kHeaders:
+      return HandleHeaders(flags, stream_id, payload);
+
+    case kContinuation:
+      return HandleContinuation(flags, stream_id, payload);
+
+    case kPriority:
+      // Every stream gets an equal share, so priorities are ignored.
+      if (stream_id == 0)
+        return kProtocolError;
+      return (payload.size() == 5) ? kNoError : kFrameSizeError;
+
+    case kRstStream:
+      if (stream_id == 0 || stream_id > last_stream_id_)
+        return kProtocolError;
+      if (payload.size() != 4)
+        return kFrameSizeError;
+      if (streams_.count(stream_id) > 0)
+        streams_[stream_id]->closed = true;
+      return kNoError;
+
+    case kSettings:
+      if (stream_id != 0)
+        return kProtocolError;
+      return HandleSettings(flags, payload);
+
+    case kPushPromise:
+      // Only servers push.
+      return kProtocolError;
+
+    case kPing:
+      if (stream_id != 0)
+        return kProtocolError;
+      if (payload.size() != 8)
+        return kFrameSizeError;
+      if ((flags & kFlagAck) == 0)
+        QueueFrame(kPing, kFlagAck, 0, payload);
+      return kNoError;
+
+    case kGoAway:
+      if (stream_id != 0)
+        return kProtocolError;
+      // Finish the streams already open, then hang up.
+      goaway_received_ = true;
+      return kNoError;
+
+    case kWindowUpdate:
+      return HandleWindowUpdate(stream_id, payload);
+
+    default:
+      // Unknown frame types must be ignored.
+      return kNoError;
+  }
+}
+
+uint32_t Http2Connection::HandleHeaders(uint8_t flags, uint32_t stream_id,
+                                        std::string_view payload) {
+  if (stream_id == 0 || stream_id % 2 == 0)
+    return kProtocolError;
+  if (!StripPadding(flags, &payload))
+    return kProtocolError;
+  if (flags & kFlagPriority) {
+    if (payload.size() < 5)
+      return kProtocolError;
+    payload.remove_prefix(5);
+  }
+
+  header_block_.assign(payload.data(), payload.size());
+  header_block_end_stream_ = (flags & kFlagEndStream) != 0;
+  if ((flags & kFlagEndHeaders) == 0) {
+    continuation_stream_ = stream_id;
+    return kNoError;
+  }
+  return EndHeaderBlock(stream_id, header_block_end_stream_);
+}
+
+uint32_t Http2Connection::HandleContinuation(uint8_t flags,
+                                             uint32_t stream_id,
+                                             std::string_view payload) {
+  if (continuation_stream_ == 0 || stream_id != continuation_stream_)
+    return kProtocolError;
+  if (header_block_.size() + payload.size() >
+      HpackDecoder::kMaxHeaderListBytes)
+    return kEnhanceYourCalm;
+
+  header_block_.append(payload.data(), payload.size());
+  if ((flags & kFlagEndHeaders) == 0)
+    return kNoError;
+  continuation_stream_ = 0;
+  return EndHeaderBlock(stream_id, header_block_end_stream_);
+}
+
+uint32_t Http2Connection::EndHeaderBlock(uint32_t stream_id,
+                                         bool end_stream) {
+  // The block has to be decoded even if the stream is then refused,
+  // to keep our copy of the client's HPACK table in step.
+  HeaderList headers;
+  bool ok = decoder_.Decode(
+    reinterpret_cast<const uint8_t *>(header_block_.data()),
+    header_block_.size(), &headers);
+  header_block_.clear();
+  if (!ok)
+    return kCompressionError;
+
+  auto it = streams_.find(stream_id);
+  if (it != streams_.end() && !it->second->closed) {
+    // Trailers, which must end the request.  We don't use them.
+    Stream *stream = it->second.get();
+    if (stream->remote_closed) {
+      ResetStream(stream_id, kStreamClosed);
+      return kNoError;
+    }
+    if (!end_stream)
+      return kProtocolError;
+    return Dispatch(stream) ? kNoError : kInternalError;
+  }
+  if (stream_id <= last_stream_id_)
+    return kStreamClosed;
+  last_stream_id_ = stream_id;
+
+  if (streams_.size() >= kMaxConcurrentStreams) {
+    QueueRstStream(stream_id, kRefusedStream);
+    return kNoError;
+  }
+
+  // Turn the pseudo-headers back into a request line.  They must all
+  // come before the regular headers, which must be lower case.
+  HttpRequest req;
+  std::string path, authority;
+  bool has_method = false;
+  bool regular_seen = false;
+  bool malformed = false;
+  for (const HeaderField &h : headers) {
+    const std::string &name = h.first;
+    if (!name.empty() && name[0] == ':') {
+      if (regular_seen)
+        malformed = true;
+      else if (name == ":method")
+        has_method = true;
+      else if (name == ":path")
+        path = h.second;
+      else if (name == ":authority")
+        authority = h.second;
+      else if (name != ":scheme")
+        malformed = true;
+      continue;
+    }
+
+    regular_seen = true;
+    if (IsConnectionSpecific(name) ||
+        std::any_of(name.begin(), name.end(),
+                    [](char c) { return isupper(c); })) {
+      malformed = true;
+    } else if (name == "cookie" && !req.GetHeaderValue("cookie").empty()) {
+      // Cookies may be split into several fields, to compress better.
+      req.AddHeader(name, req.GetHeaderValue("cookie") + "; " + h.second);
+    } else {
+      req.AddHeader(name, h.second);
+    }
+  }
+  if (malformed || !has_method || path.empty()) {
+    QueueRstStream(stream_id, kProtocolError);
+    return kNoError;
+  }
+  if (!authority.empty() && req.GetHeaderValue("host").empty())
+    req.AddHeader("host", authority);
+  req.set_uri(path);
+  req.set_protocol("HTTP/2.0");
+
+  return OpenStream(stream_id, req, end_stream) ? kNoError : kInternalError;
+}
+
+uint32_t Http2Connection::HandleData(uint8_t flags, uint32_t stream_id,
+                                     std::string_view payload) {
+  if (stream_id == 0)
+    return kProtocolError;
+
+  // The whole frame, padding and all, counts against the flow control
+  // windows.  We don't use request bodies, so hand the connection's
+  // share straight back.
+  uint32_t flow_len = payload.size();
+  if (flow_len > 0)
+    QueueWindowUpdate(0, flow_len);
+  if (!StripPadding(flags, &payload))
+    return kProtocolError;
+
+  auto it = streams_.find(stream_id);
+  if (it == streams_.end() || it->second->closed ||
+      it->second->remote_closed) {
+    if (stream_id > last_stream_id_)
+      return kProtocolError;  // the stream was never opened
+    ResetStream(stream_id, kStreamClosed);
+    return kNoError;
+  }
+
+  if (flags & kFlagEndStream)
+    return Dispatch(it->second.get()) ? kNoError : kInternalError;
+  if (flow_len > 0)
+    QueueWindowUpdate(stream_id, flow_len);
+  return kNoError;
+}
+
+uint32_t Http2Connection::HandleSettings(uint8_t flags,
+                                         std::string_view payload) {
+  if (flags & kFlagAck)
+    return payload.empty() ? kNoError : kFrameSizeError;
+  if (payload.size() % 6 != 0)
+    return kFrameSizeError;
+  uint32_t error = ApplySettings(payload);
+  if (error == kNoError)
+    QueueFrame(kSettings, kFlagAck, 0, std::string_view());
+  return error;
+}
+
+uint32_t Http2Connection::ApplySettings(std::string_view payload) {
+  for (size_t i = 0; i + 6 <= payload.size(); i += 6) {
+    uint32_t id = Get16(payload, i);
+    uint32_t value = Get32(payload, i + 2);
+    switch (id) {
+      case kSettingsHeaderTableSize:
+        encoder_.SetMaxTableSize(value);
+        break;
+
+      case kSettingsEnablePush:
+        if (value > 1)
+          return kProtocolError;
+        break;
+
+      case kSettingsInitialWindowSize: {
+        if (value > kMaxWindow)
+          return kFlowControlError;
+        // This changes the windows of the open streams, too, by the
+        // same amount (possibly making them negative).
+        int64_t delta = static_cast<int64_t>(value) - peer_initial_window_;
+        for (auto &entry : streams_) {
+          entry.second->send_window += delta;
+          if (entry.second->send_window > kMaxWindow)
+            return kFlowControlError;
+        }
+        peer_initial_window_ = value;
+        break;
+      }
+
+      case kSettingsMaxFrameSize:
+        if (value < kMaxFrameSize || value > kMaxAllowedFrameSize)
+          return kProtocolError;
+        peer_max_frame_size_ = value;
+        break;
+
+      default:
+        // Including SETTINGS_MAX_CONCURRENT_STREAMS, which limits
+        // pushes, and unknown settings, which must be ignored.
+        break;
+    }
+  }
+  return kNoError;
+}
+
+uint32_t Http2Connection::HandleWindowUpdate(uint32_t stream_id,
+                                             std::string_view payload) {
+  if (payload.size() != 4)
+    return kFrameSizeError;
+  uint32_t increment = Get32(payload, 0) & 0x7fffffff;
+
+  if (stream_id == 0) {
+    if (increment == 0)
+      return kProtocolError;
+    send_window_ += increment;
+    return (send_window_ > kMaxWindow) ? kFlowControlError : kNoError;
+  }
+
+  if (stream_id > last_stream_id_)
+    return kProtocolError;
+  auto it = streams_.find(stream_id);
+  if (it == streams_.end() || it->second->closed)
+    return kNoError;  // it may have just finished
+  if (increment == 0) {
+    ResetStream(stream_id, kProtocolError);
+    return kNoError;
+  }
+  it->second->send_window += increment;
+  if (it->second->send_window > kMaxWindow)
+    ResetStream(stream_id, kFlowControlError);
+  return kNoError;
+}
+
+bool Http2Connection::OpenStream(uint32_t stream_id,
+                                 const HttpRequest &request,
+                                 bool end_stream) {
+  Stream *stream = new Stream(stream_id, peer_initial_window_);
+  streams_[stream_id].reset(stream);
+  stream->request = request;
+  if (end_stream)
+    return Dispatch(stream);
+  return true;
+}
+
+bool Http2Connection::Dispatch(Stream *stream) {
+  stream->remote_closed = true;
+  StreamWriter writer(this, stream);
+  if (!handler_(stream->request, &writer))
+    return false;
+  if (!stream->headers_sent && !stream->closed)
+    ResetStream(stream->id, kInternalError);
+  return true;
+}
+
+void Http2Connection::QueueHeaders(Stream *stream,
+                                   const HttpResponse &response,
+                                   int64_t content_length,
+                                   bool end_stream) {
+  HeaderList headers;
+  headers.emplace_back(":status", std::to_string(response.response_code()));
+  if (!response.content_type().empty())
+    headers.emplace_back("content-type", response.content_type());
+  for (const auto &h : response.headers()) {
+    std::string name = h.first;
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (!IsConnectionSpecific(name))
+      headers.emplace_back(name, h.second);
+  }
+  if (content_length >= 0)
+    headers.emplace_back("content-length", std::to_string(content_length));
+
+  std::string block;
+  encoder_.Encode(headers, &block);
+
+  // A HEADERS frame, then as many CONTINUATIONs as the rest needs.
+  std::string_view rest(block);
+  uint8_t type = kHeaders;
+  uint8_t flags = end_stream ? kFlagEndStream : 0;
+  do {
+    std::string_view piece = rest.substr(0, peer_max_frame_size_);
+    rest.remove_prefix(piece.size());
+    QueueFrame(type, flags | (rest.empty() ? kFlagEndHeaders : 0),
+               stream->id, piece);
+    type = kContinuation;
+    flags = 0;
+  } while (!rest.empty());
+
+  stream->headers_sent = true;
+  if (end_stream)
+    stream->closed = true;
+}
+
+Http2Connection::Stream *Http2Connection::NextSendable() {
+  auto sendable = [this](const Stream *s) {
+    if (s->closed || !s->headers_sent)
+      return false;
+    if (s->pending() == 0)
+      return s->body_done;  // just END_STREAM, which is free
+    return s->send_window > 0 && send_window_ > 0;
+  };
+
+  // Start where the last turn left off, and wrap around.
+  auto start = streams_.lower_bound(next_stream_);
+  for (auto it = start; it != streams_.end(); it++) {
+    if (sendable(it->second.get()))
+      return it->second.get();
+  }
+  for (auto it = streams_.begin(); it != start; it++) {
+    if (sendable(it->second.get()))
+      return it->second.get();
+  }
+  return nullptr;
+}
+
+bool Http2Connection::SendData() {
+  while (Stream *stream = NextSendable()) {
+    next_stream_ = stream->id + 1;
+    uint64_t pending = stream->pending();
+    uint32_t n = static_cast<uint32_t>(
+      std::min<int64_t>({static_cast<int64_t>(std::min<uint64_t>(
+                           pending, peer_max_frame_size_)),
+                         send_window_, stream->send_window}));
+    if (pending == 0)
+      n = 0;
+    bool end = stream->body_done && n == pending;
+
+    size_t frame_start = out_.size();
+    AppendFrameHeader(n, kData, end ? kFlagEndStream : 0, stream->id, &out_);
+
+    // From the queued body bytes first...
+    size_t from_data = std::min<size_t>(n, stream->data.size() -
+                                           stream->data_pos);
+    out_.append(stream->data, stream->data_pos, from_data);
+    stream->data_pos += from_data;
+    if (stream->data_pos == stream->data.size()) {
+      stream->data.clear();
+      stream->data_pos = 0;
+    }
+
+    // ...then from the file.
+    size_t from_file = n - from_data;
+    bool ok = true;
+    if (from_file > 0) {
+      size_t pos = out_.size();
+      out_.resize(pos + from_file);
+      while (from_file > 0) {
+        ssize_t res = pread(stream->file_fd, &out_[pos], from_file,
+                            stream->file_offset);
+        if (res == -1 && errno == EINTR)
+          continue;
+        if (res <= 0) {
+          ok = false;
+          break;
+        }
+        pos += res;
+        from_file -= res;
+        stream->file_offset += res;
+        stream->file_remaining -= res;
+      }
+    }
+    if (!ok) {
+      // The file went away or got shorter, so the response can't be
+      // finished.
+      out_.resize(frame_start);
+      ResetStream(stream->id, kInternalError);
+      continue;
+    }
+
+    send_window_ -= n;
+    stream->send_window -= n;
+    if (end)
+      stream->closed = true;
+    if (out_.size() >= kFlushBytes && !Flush())
+      return false;
+  }
+
+  for (auto it = streams_.begin(); it != streams_.end(); ) {
+    if (it->second->closed)
+      it = streams_.erase(it);
+    else
+      it++;
+  }
+  return Flush();
+}
+
+bool Http2Connection::Flush() {
+  if (out_.empty())
+    return true;
+  bool ok = conn_->WriteAll(out_.data(), out_.size());
+  out_.clear();
+  return ok;
+}
+
+void Http2Connection::QueueFrame(uint8_t type, uint8_t flags,
+                                 uint32_t stream_id,
+                                 std::string_view payload) {
+  AppendFrameHeader(payload.size(), type, flags, stream_id, &out_);
+  out_.append(payload.data(), payload.size());
+}
+
+void Http2Connection::QueueRstStream(uint32_t stream_id, uint32_t error) {
+  std::string payload;
+  Put32(error, &payload);
+  QueueFrame(kRstStream, 0, stream_id, payload);
+}
+
+void Http2Connection::QueueWindowUpdate(uint32_t stream_id,
+                                        uint32_t increment) {
+  std::string payload;
+  Put32(increment, &payload);
+  QueueFrame(kWindowUpdate, 0, stream_id, payload);
+}
+
+void Http2Connection::ResetStream(uint32_t stream_id, uint32_t error) {
+  QueueRstStream(stream_id, error);
+  auto it = streams_.find(stream_id);
+  if (it != streams_.end())
+    it->second->closed = true;
+}
+
+void Http2Connection::GoAway(uint32_t error) {
+  std::string payload;
+  Put32(last_stream_id_, &payload);
+  Put32(error, &payload);
+  QueueFrame(kGoAway, 0, 0, payload);
+  Flush();
+}
+
+}  // namespace hw4
@@ -0,0 +1,186 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_HTTP2CONNECTION_H_
+#define HW4_HTTP2CONNECTION_H_
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "./Hpack.h"
+#include "./HttpConnection.h"
+#include "./HttpRequest.h"
+#include "./HttpResponse.h"
+
+namespace hw4 {
+
+// An Http2Connection speaks HTTP/2 (RFC 7540) to a client over an
+// HttpConnection, which it takes over once the client has shown that
+// it wants to: by starting with the HTTP/2 connection preface (which
+// GetNextRequest() reads as a "PRI * HTTP/2.0" request), either out of
+// prior knowledge or because TLS negotiated "h2", or by asking to
+// upgrade a plain HTTP/1.1 request with "Upgrade: h2c".
+//
+// Each request arrives on its own stream, and is answered by calling
+// the handler with a ResponseWriter for that stream.  Handlers run one
+// at a time on the thread that calls Serve*(), but their responses
+// don't go out one at a time: response headers are sent right away,
+// and the bodies are queued on their streams, from which a scheduler
+// sends DATA frames round-robin, one frame per stream per turn, as the
+// client's flow control windows allow.  So a large file doesn't hold
+// up a small one, and many requests share one connection (and its
+// socket buffers) instead of each needing its own.
+class Http2Connection {
+ public:
+  // Writes the response to "request" to "writer".  Returns false if
+  // the connection experienced an error and should be closed.
+  typedef std::function<bool(const HttpRequest &request,
+                             ResponseWriter *writer)> Handler;
+
+  Http2Connection(HttpConnection *conn, Handler handler);
+  virtual ~Http2Connection();
+
+  Http2Connection(const Http2Connection &) = delete;
+  Http2Connection &operator=(const Http2Connection &) = delete;
+
+  // True if "request" is how GetNextRequest() reads the start of the
+  // HTTP/2 connection preface, "PRI * HTTP/2.0\r\n\r\n".
+  static bool IsPreface(const HttpRequest &request);
+
+  // True if "request" asks to upgrade the connection to HTTP/2.
+  static bool WantsUpgrade(const HttpRequest &request);
+
+  // Serves the connection after IsPreface() returned true for the
+  // request just read, until the client is done with it.  Returns
+  // true if the connection ended cleanly, false if it ended with an
+  // error.  Either way, the caller should close it.
+  bool ServePriorKnowledge();
+
+  // Like ServePriorKnowledge(), but after WantsUpgrade() returned
+  // true for "request": switches protocols and answers "request" as
+  // stream 1.
+  bool ServeUpgrade(const HttpRequest &request);
+
+  // Our settings.  We advertise kMaxConcurrentStreams and otherwise
+  // stick to the protocol's defaults, including the maximum frame
+  // size and the flow control windows for request bodies (which we
+  // replenish as soon as they're received, since we ignore them).
+  static const uint32_t kMaxConcurrentStreams;
+  static const uint32_t kMaxFrameSize;
+
+ private:
+  struct Stream;
+  class StreamWriter;
+
+  // The common part of the Serve*() methods: reads and handles frames
+  // until the client goes away or something goes wrong.
+  bool Run();
+
+  // Handles one frame.  Returns 0, or the error code of a connection
+  // error.
+  uint32_t HandleFrame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                       std::string_view payload);
+  uint32_t HandleHeaders(uint8_t flags, uint32_t stream_id,
+                         std::string_view payload);
+  uint32_t HandleContinuation(uint8_t flags, uint32_t stream_id,
+                              std::string_view payload);
+  uint32_t HandleData(uint8_t flags, uint32_t stream_id,
+                      std::string_view payload);
+  uint32_t HandleSettings(uint8_t flags, std::string_view payload);
+  uint32_t HandleWindowUpdate(uint32_t stream_id, std::string_view payload);
+
+  // Applies the settings in "payload" (a sequence of 6-byte
+  // identifier/value pairs).  Returns 0, or the error code of a
+  // connection error.
+  uint32_t ApplySettings(std::string_view payload);
+
+  // Decodes the complete header block header_block_ of "stream_id",
+  // which starts a new stream or, if it exists, is its trailers.
+  uint32_t EndHeaderBlock(uint32_t stream_id, bool end_stream);
+
+  // Starts a stream for "request", and answers it if "end_stream".
+  // Returns false if the connection failed.
+  bool OpenStream(uint32_t stream_id, const HttpRequest &request,
+                  bool end_stream);
+
+  // Runs the handler for "stream", whose request is complete.
+  // Returns false if the connection failed.
+  bool Dispatch(Stream *stream);
+
+  // Queues a HEADERS frame (plus CONTINUATIONs, if needed) carrying
+  // "response" for "stream".  "content_length" is sent unless it is
+  // negative.
+  void QueueHeaders(Stream *stream, const HttpResponse &response,
+                    int64_t content_length, bool end_stream);
+
+  // The scheduler: queues as many DATA frames as the flow control
+  // windows allow, taking one frame from each stream with something
+  // to send in turn, then writes everything queued to the client.
+  // Streams that are finished are forgotten.  Returns false if the
+  // connection failed.
+  bool SendData();
+
+  // Returns the next stream (in round-robin order) that can send
+  // a DATA frame, or nullptr.
+  Stream *NextSendable();
+
+  // Writes out_ to the client.
+  bool Flush();
+
+  // Queues a frame.
+  void QueueFrame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                  std::string_view payload);
+  void QueueRstStream(uint32_t stream_id, uint32_t error);
+  void QueueWindowUpdate(uint32_t stream_id, uint32_t increment);
+
+  // Resets "stream_id" (if it exists) with "error", and forgets it.
+  void ResetStream(uint32_t stream_id, uint32_t error);
+
+  // Sends GOAWAY with "error", which ends the connection.
+  void GoAway(uint32_t error);
+
+  HttpConnection *conn_;
+  Handler handler_;
+  HpackDecoder decoder_;
+  HpackEncoder encoder_;
+
+  // The open streams, and the stream the scheduler looks at first.
+  std::map<uint32_t, std::unique_ptr<Stream>> streams_;
+  uint32_t next_stream_;
+
+  // The highest stream the client has opened.
+  uint32_t last_stream_id_;
+
+  // A header block that is waiting for its CONTINUATION frames:
+  // its stream (0 if there isn't one) and what has arrived so far.
+  uint32_t continuation_stream_;
+  std::string header_block_;
+  bool header_block_end_stream_;
+
+  // The connection's send window, and the client's settings.
+  int64_t send_window_;
+  uint32_t peer_initial_window_;
+  uint32_t peer_max_frame_size_;
+
+  // True once the client has sent GOAWAY.
+  bool goaway_received_;
+
+  // Frames waiting to be written.
+  std::string out_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_HTTP2CONNECTION_H_
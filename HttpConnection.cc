@@ -10,28 +10,56 @@
  */
 
 #include <stdint.h>
-#include <boost/algorithm/string.hpp>
-#include <boost/lexical_cast.hpp>
-#include <map>
+#include <stdio.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
 #include <string>
-#include <vector>
+#include <string_view>
 
 #include "./HttpRequest.h"
 #include "./HttpUtils.h"
 #include "./HttpConnection.h"
 
-using std::map;
 using std::string;
-using std::vector;
 
 namespace hw4 {
 
 static const char *kHeaderEnd = "\r\n\r\n";
-static const int kHeaderEndLen = 4;
+static const size_t kHeaderEndLen = 4;
+
+// static
+const size_t HttpConnection::kMaxIdleBytes = 65536;
+
+bool HttpConnection::StartTls(TlsContext *ctx) {
+  tls_.reset(new TlsTransport(ctx, tcp_.fd()));
+  if (!tls_->Handshake())
+    return false;
+  transport_ = tls_.get();
+  return true;
+}
+
+void HttpConnection::Close() {
+  if (tls_) {
+    tls_->Close();
+    tls_.reset();
+  }
+  transport_ = &tcp_;
+  tcp_.Close();
+
+  buffer_.Clear();
+  if (arena_.capacity() > kMaxIdleBytes)
+    arena_.Trim();
+  else
+    arena_.Reset();
+}
 
 bool HttpConnection::GetNextRequest(HttpRequest *request) {
-  // Use "WrappedRead" to read data into the buffer_
-  // instance variable.  Keep reading data until either the
+  // Read data into the buffer_ instance variable.
+  // Keep reading data until either the
   // connection drops or you see a "\r\n\r\n" that demarcates
   // the end of the request header.
   //
@@ -42,53 +70,152 @@ bool HttpConnection::GetNextRequest(HttpRequest *request) {
   // on the same socket.  So, you need to preserve everything
   // after the "\r\n\r\n" in buffer_ for the next time the
   // caller invokes GetNextRequest()!
+  //
+  // The transport reads straight into buffer_'s free space, and
+  // reading stops (the request is rejected) if a header doesn't
+  // fit in the biggest buffer it will grow to.
 
   // STEP 1:
-  size_t pos = buffer_.find(kHeaderEnd);
-  if (pos == std::string::npos) {
-    int byte_read;
-    unsigned char buf[1024];
-    while (true) {
-      byte_read = WrappedRead(fd_, buf, 1024);
-      if (byte_read == 0)
-        // eof. no bytes read
-        break;
-
-      if (byte_read == -1)
-        // fatal error
-        return false;
-
-      buffer_ += std::string(reinterpret_cast<char*>(buf), byte_read);
-
-      pos = buffer_.find(kHeaderEnd);
-      if (pos != std::string::npos)
-        break;
-    }
+  size_t pos = buffer_.Find(kHeaderEnd);
+  while (pos == RingBuffer::npos) {
+    // Only the new bytes (plus the last few old ones, in case the
+    // terminator straddles reads) need searching.
+    size_t from = (buffer_.size() < kHeaderEndLen - 1) ?
+                  0 : buffer_.size() - (kHeaderEndLen - 1);
+
+    ssize_t byte_read = Fill();
+    if (byte_read == 0)
+      // eof, or the header is too big
+      break;
+
+    if (byte_read == -1)
+      // fatal error
+      return false;
+
+    pos = buffer_.Find(kHeaderEnd, from);
   }
 
-  if (pos == std::string::npos)
+  if (pos == RingBuffer::npos)
     return false;
 
-  std::string str_req = buffer_.substr(0, pos + kHeaderEndLen);
+  TakeRequestAt(pos, request);
+  return true;  // You may want to change this.
+}
 
-  *request = ParseRequest(str_req);
-  buffer_ = buffer_.substr(pos + kHeaderEndLen);
+bool HttpConnection::TakeBufferedRequest(HttpRequest *request) {
+  size_t pos = buffer_.Find(kHeaderEnd);
+  if (pos == RingBuffer::npos)
+    return false;
+  TakeRequestAt(pos, request);
+  return true;
+}
 
-  return true;  // You may want to change this.
+void HttpConnection::TakeRequestAt(size_t pos, HttpRequest *request) {
+  size_t len = pos + kHeaderEndLen;
+  request->Clear();
+  ParseRequest(buffer_.Front(len), request);
+  buffer_.Consume(len);
+  buffer_.NoteMessageSize(len);
+}
+
+bool HttpConnection::ReadBytes(size_t n, std::string_view *bytes) {
+  while (buffer_.size() < n) {
+    if (Fill() <= 0)
+      return false;
+  }
+  *bytes = buffer_.Front(n);
+  return true;
+}
+
+bool HttpConnection::HasBufferedInput() const {
+  return buffer_.size() > 0 || transport_->HasPending();
+}
+
+bool HttpConnection::AppendInput(std::string_view data) {
+  while (!data.empty()) {
+    struct iovec iov[2];
+    int iovcnt = buffer_.GetFreeSpace(iov);
+    if (iovcnt == 0)
+      return false;
+    for (int i = 0; i < iovcnt && !data.empty(); i++) {
+      size_t n = std::min(iov[i].iov_len, data.size());
+      memcpy(iov[i].iov_base, data.data(), n);
+      buffer_.Commit(n);
+      data.remove_prefix(n);
+    }
+  }
+  return true;
+}
+
+ssize_t HttpConnection::Fill() {
+  struct iovec iov[2];
+  int iovcnt = buffer_.GetFreeSpace(iov);
+  if (iovcnt == 0)
+    return 0;
+  ssize_t res = transport_->Readv(iov, iovcnt);
+  if (res > 0)
+    buffer_.Commit(res);
+  return res;
 }
 
 bool HttpConnection::WriteResponse(const HttpResponse &response) {
   string str = response.GenerateResponseString();
-  int res = WrappedWrite(fd_,
-                         (unsigned char *) str.c_str(),
-                         str.length());
-  if (res != static_cast<int>(str.length()))
+  if (!WriteAll(str.data(), str.size()))
     return false;
-  return true;
+  if (response.body_file().empty())
+    return true;
+
+  // The headers promised body_file_length() bytes, so if they can't
+  // all be sent the connection is unusable.
+  int fd = open(response.body_file().c_str(), O_RDONLY);
+  if (fd == -1)
+    return false;
+  bool ok = transport_->SendFile(fd, response.body_file_offset(),
+                                 response.body_file_length());
+  close(fd);
+  return ok;
+}
+
+bool HttpConnection::WriteChunkedHeader(const HttpResponse &response) {
+  string str = response.GenerateChunkedHeaderString();
+  return WriteAll(str.data(), str.size());
+}
+
+bool HttpConnection::WriteChunk(const char *data, size_t len) {
+  if (len == 0)
+    return true;
+
+  // chunk-size in hex, CRLF, the data, CRLF
+  char size_line[32];
+  int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+  string chunk;
+  chunk.reserve(n + len + 2);
+  chunk.append(size_line, n);
+  chunk.append(data, len);
+  chunk.append("\r\n");
+  return WriteAll(chunk.data(), chunk.size());
+}
+
+bool HttpConnection::WriteLastChunk() {
+  return WriteAll("0\r\n\r\n", 5);
+}
+
+bool HttpConnection::WriteAll(const char *data, size_t len) {
+  return transport_->WriteAll(data, len);
+}
+
+// Returns "s" without any leading or trailing spaces or tabs.
+static std::string_view TrimView(std::string_view s) {
+  size_t first = s.find_first_not_of(" \t");
+  if (first == std::string_view::npos)
+    return std::string_view();
+  size_t last = s.find_last_not_of(" \t");
+  return s.substr(first, last - first + 1);
 }
 
-HttpRequest HttpConnection::ParseRequest(const string &request) {
-  HttpRequest req("/");  // by default, get "/".
+void HttpConnection::ParseRequest(std::string_view request,
+                                  HttpRequest *req) {
+  req->set_uri("/");  // by default, get "/".
 
   // Split the request into lines.  Extract the URI from the first line
   // and store it in req.URI.  For each additional line beyond the
@@ -97,39 +224,108 @@ HttpRequest HttpConnection::ParseRequest(const string &request) {
   // at HttpRequest.h for details about the HTTP header format that
   // you need to parse.
   //
-  // You'll probably want to look up boost functions for (a) splitting
-  // a string into lines on a "\r\n" delimiter, (b) trimming
-  // whitespace from the end of a string, and (c) converting a string
-  // to lowercase.
+  // This is the once-per-request hot path, so rather than splitting
+  // into temporary strings it walks the buffer with string_views and
+  // only copies the URI, protocol, and headers into *req.
 
   // STEP 2:
   if (request.empty())
-    return req;
+    return;
 
-  // split request into lines
-  vector<std::string> lines;
-  boost::iter_split(lines, request, boost::algorithm::first_finder("\r\n"));
-  for (std::string str : lines)
-    boost::trim(str);
+  size_t eol = request.find("\r\n");
+  std::string_view line = TrimView(request.substr(0, eol));
 
-  // URI from first line
-  vector<std::string> tokens;
-  boost::split(tokens, lines[0], boost::is_any_of(" "));
-  req.set_uri(tokens[1]);
+  // URI, and protocol if there is one, from the first line
+  size_t sp1 = line.find(' ');
+  if (sp1 != std::string_view::npos) {
+    std::string_view rest = line.substr(sp1 + 1);
+    size_t sp2 = rest.find(' ');
+    std::string_view uri = rest.substr(0, sp2);
+    if (!uri.empty())
+      req->set_uri(string(uri));
+    if (sp2 != std::string_view::npos)
+      req->set_protocol(string(TrimView(rest.substr(sp2 + 1))));
+  }
 
   // Headers
-  for (uint i = 1; i < lines.size(); i++) {
-    std::string currLine = lines[i];
-    size_t index = currLine.find(":");
-    if (index == std::string::npos) {
+  char name[256];
+  while (eol != std::string_view::npos) {
+    size_t start = eol + 2;
+    eol = request.find("\r\n", start);
+    line = request.substr(start, (eol == std::string_view::npos) ?
+                                 std::string_view::npos : eol - start);
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos)
       continue;
-    }
-    boost::algorithm::to_lower(currLine);
-    string key = currLine.substr(0, index);
-    string value = currLine.substr(index + 2);
-    req.AddHeader(key, value);
+
+    // Header names are case-insensitive (RFC 2616:4.2), so they're
+    // stored in lower case; values are kept verbatim.
+    std::string_view key = TrimView(line.substr(0, colon));
+    if (key.empty() || key.size() > sizeof(name))
+      continue;
+    for (size_t i = 0; i < key.size(); i++)
+      name[i] = tolower(static_cast<unsigned char>(key[i]));
+    req->AddHeader(std::string_view(name, key.size()),
+                   TrimView(line.substr(colon + 1)));
   }
-  return req;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// HttpResponseStream
+///////////////////////////////////////////////////////////////////////////////
+
+// static
+const size_t HttpResponseStream::kChunkBytes = 8192;
+
+HttpResponseStream::HttpResponseStream(ResponseWriter *conn,
+                                       bool chunked,
+                                       bool gzip)
+  : conn_(conn), chunked_(chunked), gzip_(gzip) { }
+
+bool HttpResponseStream::Start(const HttpResponse &response) {
+  response_ = response;
+  if (gzip_)
+    response_.AddHeader("Content-Encoding", "gzip");
+  if (!chunked_)
+    return true;
+  return conn_->WriteChunkedHeader(response_);
+}
+
+bool HttpResponseStream::Write(const string &data) {
+  if (gzip_) {
+    if (!gzstream_.Write(data.data(), data.size(), false, &pending_))
+      return false;
+  } else {
+    pending_ += data;
+  }
+  if (chunked_ && pending_.size() >= kChunkBytes)
+    return SendPending();
+  return true;
+}
+
+bool HttpResponseStream::Flush() {
+  if (!chunked_)
+    return true;
+  if (gzip_ && !gzstream_.Write(nullptr, 0, true, &pending_))
+    return false;
+  return SendPending();
+}
+
+bool HttpResponseStream::Finish() {
+  if (gzip_ && !gzstream_.Finish(&pending_))
+    return false;
+
+  if (!chunked_) {
+    response_.set_body(&pending_);
+    return conn_->WriteResponse(response_);
+  }
+  return SendPending() && conn_->WriteLastChunk();
+}
+
+bool HttpResponseStream::SendPending() {
+  bool ok = conn_->WriteChunk(pending_.data(), pending_.size());
+  pending_.clear();
+  return ok;
 }
 
 }  // namespace hw4
@@ -15,44 +15,212 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <map>
+#include <memory>
 #include <string>
+#include <string_view>
 
+#include "./Arena.h"
+#include "./Compression.h"
 #include "./HttpRequest.h"
 #include "./HttpResponse.h"
+#include "./RingBuffer.h"
+#include "./TlsTransport.h"
+#include "./Transport.h"
 
 namespace hw4 {
 
+// Where a request handler writes its response.  HttpConnection writes
+// it to the client as HTTP/1.x; an HTTP/2 stream (see
+// Http2Connection.h) frames it for its share of a multiplexed
+// connection.  Each method returns false if the connection
+// experiences an error and should be closed.
+class ResponseWriter {
+ public:
+  virtual ~ResponseWriter() { }
+
+  // Writes a complete response, whose body may be a file (see
+  // HttpResponse::set_body_file()).
+  virtual bool WriteResponse(const HttpResponse &response) = 0;
+
+  // The pieces of a response whose body is written a piece at a time:
+  // first the status and headers of "response" (its body is ignored),
+  // then any number of body chunks, then the end of the body.  Empty
+  // chunks are skipped.
+  virtual bool WriteChunkedHeader(const HttpResponse &response) = 0;
+  virtual bool WriteChunk(const char *data, size_t len) = 0;
+  virtual bool WriteLastChunk() = 0;
+};
+
 // The HttpConnection class represents a connection to a single client
-class HttpConnection {
+class HttpConnection : public ResponseWriter {
  public:
-  explicit HttpConnection(int fd) : fd_(fd) { }
-  virtual ~HttpConnection() {
-    close(fd_);
-    fd_ = -1;
+  explicit HttpConnection(int fd) : tcp_(fd), transport_(&tcp_) { }
+  virtual ~HttpConnection() { Close(); }
+
+  // A connection that isn't attached to a client yet, so that it can
+  // be kept in an ObjectPool and reused for one client after another.
+  HttpConnection() : HttpConnection(-1) { }
+
+  // Starts serving the client on "fd", which the connection now owns.
+  void Attach(int fd) { tcp_.Attach(fd); }
+
+  // The client's socket, and whether TLS is running over it.
+  int fd() const { return tcp_.fd(); }
+  bool is_tls() const { return tls_ != nullptr; }
+
+  // The application protocol that the TLS handshake agreed on with
+  // ALPN ("h2" or "http/1.1"), or "" if there was none.
+  std::string alpn_protocol() const {
+    return tls_ ? tls_->alpn_protocol() : "";
   }
 
-  // Read and parse the next request from the file descriptor fd_,
+  // Switches the connection to TLS, doing the server side of the
+  // handshake with settings from "ctx".  Returns false if the
+  // handshake failed, in which case the connection should be closed.
+  bool StartTls(TlsContext *ctx);
+
+  // Closes the client's socket, if there is one, and discards any
+  // unread data.  The read buffer and arena are kept for the next
+  // client unless the last one made them unusually big.
+  void Close();
+
+  // Read and parse the next request from the client,
   // storing the state in the output parameter "request."  Returns
   // true if a request could be read, false if the parsing failed
   // for some reason, in which case the caller should close the
   // connection.
   bool GetNextRequest(HttpRequest *request);
 
-  // Write the response to the file descriptor fd_.  Returns true
+  // Like GetNextRequest(), but never reads: parses the next request
+  // into "request" only if its header has already been read (see
+  // AppendInput()), and otherwise returns false.
+  bool TakeBufferedRequest(HttpRequest *request);
+
+  // True if some of the next request (or of anything else the client
+  // sent) has already been read, so there is no point waiting for
+  // the socket to become readable before calling GetNextRequest().
+  bool HasBufferedInput() const;
+
+  // Adds "data", which was received from the client's socket by other
+  // means (see IoLoop), to what GetNextRequest() and
+  // TakeBufferedRequest() read, as if it had been read here.  Only
+  // for plain TCP connections.  Returns false if there isn't room for
+  // it, in which case the connection should be closed.
+  bool AppendInput(std::string_view data);
+
+  // Write the response to the client.  If the response's body is a
+  // file (see HttpResponse::set_body_file()) it is sent with the
+  // transport's SendFile().  Returns true
   // if the response was successfully written, false if the
   // connection experiences an error and should be closed.
-  bool WriteResponse(const HttpResponse &response);
+  bool WriteResponse(const HttpResponse &response) override;
+
+  // The pieces of a response sent with chunked transfer encoding:
+  // first the status line and headers of "response" (its body is
+  // ignored), then any number of body chunks, then the terminating
+  // zero-length chunk.  Each returns false if the connection
+  // experiences an error and should be closed.  Empty chunks are
+  // skipped, since a zero-length chunk would end the body.
+  bool WriteChunkedHeader(const HttpResponse &response) override;
+  bool WriteChunk(const char *data, size_t len) override;
+  bool WriteLastChunk() override;
+
+  // Raw access to the connection, for protocols other than HTTP/1.x
+  // that take it over after GetNextRequest() (see Http2Connection).
+  // ReadBytes() waits until at least "n" unread bytes have arrived
+  // (n can be at most RingBuffer::kDefaultMaxCapacity), and returns
+  // the first "n" of them, which stay valid until ConsumeBytes()
+  // discards them.  It returns false if the client hung up first or
+  // there was an error.  WriteAll() writes all "len" bytes at "data"
+  // to the client.
+  bool ReadBytes(size_t n, std::string_view *bytes);
+  void ConsumeBytes(size_t n) { buffer_.Consume(n); }
+  bool WriteAll(const char *data, size_t len);
+
+  // An arena for objects that live only as long as the current
+  // request, e.g., the headers of an HttpRequest constructed with
+  // it.  The owner of the connection Reset()s it between requests.
+  Arena *arena() { return &arena_; }
 
  private:
+  // Reads whatever is available into buffer_.  Returns the number of
+  // bytes read, 0 on EOF or if buffer_ is full, or -1 on error.
+  ssize_t Fill();
+
+  // Parses the request whose header ends at "pos" in buffer_ into
+  // "request", and consumes the header.
+  void TakeRequestAt(size_t pos, HttpRequest *request);
+
   // A helper function to parse the contents of data read from
-  // the HTTP connection.
-  HttpRequest ParseRequest(const std::string &request);
+  // the HTTP connection into *req.
+  void ParseRequest(std::string_view request, HttpRequest *req);
+
+  // An arena bigger than this is shrunk by Close().
+  static const size_t kMaxIdleBytes;
+
+  // The socket associated with the client, and what is being used to
+  // talk over it: either the socket itself, or tls_ on top of it.
+  TcpTransport tcp_;
+  std::unique_ptr<TlsTransport> tls_;
+  Transport *transport_;
+
+  // A buffer storing data read from the client.  It adapts its size
+  // to the requests seen, up to a limit on the size of a request
+  // header.
+  RingBuffer buffer_;
+
+  // Memory for the per-request objects of this connection.
+  Arena arena_;
+};
+
+// An HttpResponseStream sends a response whose body is produced a
+// piece at a time, e.g., a query results page that is rendered while
+// the results are being generated.  If "chunked" is true the body is
+// sent with chunked transfer encoding: Write() buffers up to
+// kChunkBytes before sending a chunk, and Flush() sends whatever is
+// buffered right away, so the client can start rendering before the
+// response is complete and memory stays bounded no matter how big the
+// body gets.  Otherwise (e.g., for HTTP/1.0 clients, which don't
+// understand chunking) the whole body is buffered and sent with a
+// Content-length by Finish().  If "gzip" is true the body is
+// compressed as it streams, and Content-Encoding is set.
+class HttpResponseStream {
+ public:
+  HttpResponseStream(ResponseWriter *conn, bool chunked, bool gzip);
+  virtual ~HttpResponseStream() { }
+
+  // Sends the status line and headers of "response" (in chunked mode)
+  // or remembers them (otherwise).  Must be called first.
+  bool Start(const HttpResponse &response);
+
+  // Appends "data" to the body.
+  bool Write(const std::string &data);
+
+  // Sends everything written so far to the client.  A no-op when
+  // not chunked.
+  bool Flush();
+
+  // Ends the body.  No more writes are allowed afterwards.
+  bool Finish();
+
+  // Bytes of (possibly compressed) body buffered before a chunk is
+  // sent.
+  static const size_t kChunkBytes;
+
+ private:
+  // Sends pending_ as a chunk.
+  bool SendPending();
+
+  ResponseWriter *conn_;
+  bool chunked_;
+  bool gzip_;
+  GzipStream gzstream_;
 
-  // The file descriptor associated with the client.
-  int fd_;
+  // Used instead of the connection when not chunked.
+  HttpResponse response_;
 
-  // A buffer storing data read from the client.
-  std::string buffer_;
+  // Body bytes (compressed, if gzip_) not yet sent.
+  std::string pending_;
 };
 
 }  // namespace hw4
@@ -15,7 +15,9 @@
 #include <stdint.h>
 
 #include <map>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 
 namespace hw4 {
 
@@ -35,9 +37,16 @@ namespace hw4 {
 // GET /foo/bar?baz=bam HTTP/1.1\r\n
 // Host: www.news.com\r\n
 //
+//
+// The header map can be placed in a per-connection Arena (see
+// Arena.h) by passing it to the constructor, so that parsing a request
+// doesn't malloc for every header.  Such a request must not outlive
+// the next Reset() of the arena.
 class HttpRequest {
  public:
-  HttpRequest() { }
+  explicit HttpRequest(std::pmr::memory_resource *mr =
+                         std::pmr::get_default_resource())
+    : headers_(mr) { }
   explicit HttpRequest(const std::string &uri)
     : uri_(uri) { }
   virtual ~HttpRequest() { }
@@ -45,22 +54,31 @@ class HttpRequest {
   const std::string& uri() const { return uri_; }
   void set_uri(const std::string& uri) { uri_ = uri; }
 
+  // The protocol from the request line, e.g., "HTTP/1.1".
+  const std::string& protocol() const { return protocol_; }
+  void set_protocol(const std::string& protocol) { protocol_ = protocol; }
+
   // Returns the value associated with the passed-in header name, or empty
   // string if it does not exist in the header map.  The passed-in name must
   // be entirely lowercase to comply with our implementation of RFC 2616:4.2.
-  std::string GetHeaderValue(const std::string &name) const {
-    std::map<std::string, std::string>::const_iterator it = headers_.find(name);
+  std::string GetHeaderValue(std::string_view name) const {
+    HeaderMap::const_iterator it = headers_.find(name);
     if (it == headers_.end()) {
       return "";
     } else {
-      return it->second;
+      return std::string(it->second);
     }
   }
 
   // Adds a name -> value mapping to the header map, over-writing any existing
   // previous mapping for name.
-  void AddHeader(const std::string &name, const std::string &value) {
-    headers_[name] = value;
+  void AddHeader(std::string_view name, std::string_view value) {
+    HeaderMap::iterator it = headers_.find(name);
+    if (it == headers_.end()) {
+      headers_.emplace(name, value);
+    } else {
+      it->second.assign(value.data(), value.size());
+    }
   }
 
   // Returns the number of headers this HttpRequest contains
@@ -68,16 +86,37 @@ class HttpRequest {
     return headers_.size();
   }
 
+  // Removes the URI, protocol, and all headers.
+  void Clear() {
+    uri_.clear();
+    protocol_.clear();
+    headers_.clear();
+  }
+
  private:
+  // Orders header names, and lets them be looked up by any kind of
+  // string without first copying it into the map's allocator.
+  struct HeaderNameLess {
+    typedef void is_transparent;
+    bool operator()(std::string_view a, std::string_view b) const {
+      return a < b;
+    }
+  };
+  typedef std::pmr::map<std::pmr::string, std::pmr::string, HeaderNameLess>
+    HeaderMap;
+
   // Which URI did the client request?
   std::string uri_;
 
+  // Which protocol version did the client speak?
+  std::string protocol_;
+
   // A map from header name to header value, representing
   // all of the headers that the client supplied to us.  The
   // header names are converted to all lower case since RFC
   // 2616:4.2 states that header names are case-insensitive;
   // the header values are retained verbatim.
-  std::map<std::string, std::string> headers_;
+  HeaderMap headers_;
 };
 
 }  // namespace hw4
@@ -17,6 +17,8 @@
 #include <map>
 #include <string>
 #include <sstream>
+#include <utility>
+#include <vector>
 
 namespace hw4 {
 
@@ -52,27 +54,88 @@ class HttpResponse {
   void set_message(const std::string &msg) { message_ = msg; }
   void set_content_type(const std::string &type) { contentType_ = type; }
 
+  uint16_t response_code() const { return responseCode_; }
+  const std::string &content_type() const { return contentType_; }
+
+  // Adds an extra "name: value" header.  Extra headers are sent in
+  // the order they were added, after Content-type and before
+  // Content-length.
+  void AddHeader(const std::string &name, const std::string &value) {
+    headers_.push_back(std::make_pair(name, value));
+  }
+  const std::vector<std::pair<std::string, std::string>> &headers() const {
+    return headers_;
+  }
+
   void AppendToBody(const std::string &bodyFragment) { body_ += bodyFragment; }
 
+  const std::string &body() const { return body_; }
+
+  // Replaces the body with the contents of "body", which is left empty.
+  void set_body(std::string *body) { body_.swap(*body); body->clear(); }
+
+  // Makes the body the "length" bytes at "offset" of the file at
+  // "path", instead of the body string, so that HttpConnection can
+  // send them straight from the file without reading them in.
+  void set_body_file(const std::string &path, uint64_t offset,
+                     uint64_t length) {
+    bodyFile_ = path;
+    bodyFileOffset_ = offset;
+    bodyFileLength_ = length;
+  }
+  const std::string &body_file() const { return bodyFile_; }
+  uint64_t body_file_offset() const { return bodyFileOffset_; }
+  uint64_t body_file_length() const { return bodyFileLength_; }
+
   // A method to generate a std::string of the HTTP response, suitable
   // for writing back to the client.  We automatically generate the
   // "Content-length:" header, and make that be the last header
   // in the block.  The value of the Content-length header is the
-  // size of the response body (in bytes).
+  // size of the response body (in bytes).  A "304 Not Modified"
+  // response has no body, so it gets no Content-length either.  If
+  // the body is a file, only the status line and headers are
+  // generated, and the file must be sent after them.
   std::string GenerateResponseString() const {
     std::stringstream resp;
 
-    resp << protocol_ << " " << responseCode_ << " " << message_ << "\r\n";
-    if (!contentType_.empty()) {
-      resp << "Content-type: " << contentType_ << "\r\n";
+    GenerateStatusAndHeaders(&resp);
+    if (responseCode_ != 304) {
+      resp << "Content-length: "
+           << (bodyFile_.empty() ? body_.size() : bodyFileLength_) << "\r\n";
     }
-    resp << "Content-length: " << body_.size() << "\r\n";
     resp << "\r\n";
-    resp << body_;
+    if (bodyFile_.empty())
+      resp << body_;
+    return resp.str();
+  }
+
+  // Like GenerateResponseString(), but for a response whose body will
+  // be sent afterwards using chunked transfer encoding: generates just
+  // the status line and headers, ending with a
+  // "Transfer-Encoding: chunked" header in place of Content-length.
+  // The body set on this object (if any) is not included.
+  std::string GenerateChunkedHeaderString() const {
+    std::stringstream resp;
+
+    GenerateStatusAndHeaders(&resp);
+    resp << "Transfer-Encoding: chunked\r\n";
+    resp << "\r\n";
     return resp.str();
   }
 
  private:
+  // Writes the status line and all headers but the framing ones
+  // (Content-length or Transfer-Encoding) into "resp".
+  void GenerateStatusAndHeaders(std::stringstream *resp) const {
+    *resp << protocol_ << " " << responseCode_ << " " << message_ << "\r\n";
+    if (!contentType_.empty()) {
+      *resp << "Content-type: " << contentType_ << "\r\n";
+    }
+    for (const auto &h : headers_) {
+      *resp << h.first << ": " << h.second << "\r\n";
+    }
+  }
+
   // The HTTP protocol string to pass back in the header.
   std::string protocol_;
 
@@ -85,8 +148,16 @@ class HttpResponse {
   // The HTTP content type string to pass back in the header.  Optional .
   std::string contentType_;
 
+  // Any extra headers, in the order they should be sent.
+  std::vector<std::pair<std::string, std::string>> headers_;
+
   // The body of the response.
   std::string body_;
+
+  // Or, if bodyFile_ isn't empty, the part of that file that is.
+  std::string bodyFile_;
+  uint64_t bodyFileOffset_ = 0;
+  uint64_t bodyFileLength_ = 0;
 };
 
 }  // namespace hw4
@@ -9,20 +9,36 @@
  * author.
  */
 
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <boost/algorithm/string.hpp>
+#include <atomic>
 #include <iostream>
 #include <map>
-#include <memory>
 #include <vector>
 #include <string>
 #include <sstream>
 
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+#include "./AsyncIo.h"
+#include "./Compression.h"
 #include "./FileReader.h"
+#include "./Http2Connection.h"
 #include "./HttpConnection.h"
 #include "./HttpRequest.h"
 #include "./HttpUtils.h"
 #include "./HttpServer.h"
-#include "./libhw3/QueryProcessor.h"
+#include "./IoLoop.h"
+#include "./MimeTypes.h"
+#include "./QueryEngine.h"
+#include "./Task.h"
 
 using std::cerr;
 using std::cout;
@@ -31,7 +47,6 @@ using std::list;
 using std::map;
 using std::string;
 using std::stringstream;
-using std::unique_ptr;
 
 namespace hw4 {
 ///////////////////////////////////////////////////////////////////////////////
@@ -60,22 +75,137 @@ static const char *kThreegleStr =
 // static
 const int HttpServer::kNumThreads = 100;
 
+// static
+const uint32_t HttpServer::kNumPooledConnections = 2 * kNumThreads;
+
+// static
+const size_t HttpServer::kDefaultGzipCacheBytes = 64 * 1024 * 1024;
+
+// static
+const size_t HttpServer::kDefaultPostingCacheBytes = 64 * 1024 * 1024;
+
+// Query results are rendered and sent this many rows at a time.
+static const size_t kResultBatch = 100;
+
+// Queries with ORs or exclusions list only this many of their best
+// results.
+static const size_t kMaxBooleanResults = 100;
+
+// Files smaller than this aren't worth gzip'ing.
+static const off_t kMinGzipBytes = 256;
+
+// The threads per index file that check the indices' checksums in the
+// background, while queries are served.
+static const int kScrubThreads = 2;
+
+// Checks every block of the indices of the QueryEngine "query_engine",
+// reporting the ones that are corrupt.
+static void *ScrubIndices(void *query_engine);
+
+// How to serve a connection, as decided by ChooseProtocol().
+enum ConnectionProtocol {
+  kHttp1,
+  kHttp2PriorKnowledge,  // the request was the HTTP/2 preface
+  kHttp2Upgrade,         // the request asked to upgrade to h2c
+  kProtocolError,        // the request isn't in the agreed protocol
+};
+
+// Decides how to serve "conn", given "req", the next request read
+// from it.  Over TLS, the protocol is the one ALPN agreed on in the
+// handshake: a client that chose "h2" must start with the preface,
+// one that didn't must not, and there is no h2c upgrade (RFC 7540,
+// sections 3.2 and 3.3).
+static ConnectionProtocol ChooseProtocol(const HttpConnection &conn,
+                                         const HttpRequest &req);
+
 // This is the function that threads are dispatched into
 // in order to process new client connections.
 void HttpServer_ThrFn(ThreadPool::Task *t);
 
-// Given a request, produce a response.
-HttpResponse ProcessRequest(const HttpRequest &req,
-                            const string &basedir,
-                            const list<string> *indices);
+// Serves the plain HTTP client of "hst" on its IoLoop's thread,
+// suspending while it waits for the client rather than blocking.
+// Request handlers, which do blocking file and index I/O, are run on
+// the thread pool, and the coroutine hops back to the loop to send
+// what they produce.
+static Task<> ServeConnection(HttpServerTask *hst);
+
+// Sends "response" to the client on socket "fd" through "loop".
+// Returns false if the connection experienced an error and should be
+// closed.
+static Task<bool> SendResponse(IoLoop *loop, int fd,
+                               const HttpResponse &response);
+
+// Hands the TLS connection of "hst", which is between requests, to its
+// IoLoop, which dispatches it again when the client sends more (or
+// closes it if the client hangs up).  Returns right away.
+static void WaitForNextRequest(HttpServerTask *hst);
+
+// Hangs up on the client of "hst", and recycles the connection state
+// for the next client.
+static void CloseConnection(HttpServerTask *hst);
+
+// Given a request, produce a response and write it to "conn", which
+// is either the client's HttpConnection or, for HTTP/2, the request's
+// stream.  "hst" carries the server state and configuration the
+// handlers need.  Returns false if the connection experienced an
+// error and should be closed.
+bool ProcessRequest(const HttpRequest &req,
+                    const HttpServerTask &hst,
+                    ResponseWriter *conn);
 
 // Process a file request.
-HttpResponse ProcessFileRequest(const string &uri,
-                                const string &basedir);
-
-// Process a query request.
-HttpResponse ProcessQueryRequest(const string &uri,
-                                 const list<string> *indices);
+HttpResponse ProcessFileRequest(const HttpRequest &req,
+                                const HttpServerTask &hst);
+
+// Returns true if the validators in "req" (If-None-Match, or failing
+// that If-Modified-Since) show that the client's cached copy of a
+// file with the given "etag" and "mtime" is still current.
+static bool IsNotModified(const HttpRequest &req,
+                          const string &etag,
+                          time_t mtime);
+
+// Returns true if the request's If-Range header (if any) still
+// matches the file with the given "etag" and "mtime", i.e., if a
+// Range header should be honored rather than sending the whole file.
+static bool IfRangeMatches(const HttpRequest &req,
+                           const string &etag,
+                           time_t mtime);
+
+// Fills in "ret" as a 206 Partial Content response carrying the
+// given byte "ranges" of the file behind "freader", as a single part
+// or as multipart/byteranges.  Only the requested extents are read.
+// Returns false (leaving "ret" as it was) if the file could not be
+// read.
+static bool MakeRangeResponse(FileReader *freader,
+                              const string &content_type,
+                              uint64_t size,
+                              const std::vector<ByteRange> &ranges,
+                              HttpResponse *ret);
+
+// Reads the static file "fname" gzip'ed into "gzipped", returning
+// false if that isn't possible.  A sibling "fname.gz" is used if it is
+// at least as new as the file (whose metadata is "st"); otherwise
+// the compressed copy comes from, or is added to, "cache", where it
+// is kept along with its "content_type" and the file's "version".
+// The type to send is returned through "gzipped_type".
+static bool ReadGzippedFile(const string &basedir,
+                            const string &fname,
+                            const struct stat &st,
+                            const string &version,
+                            const string &content_type,
+                            GzipCache *cache,
+                            string *gzipped,
+                            string *gzipped_type);
+
+// Returns the longest entry in "cache_max_ages" that is a prefix
+// of "path", or cache_max_ages.end() if there is none.
+static map<string, int>::const_iterator
+FindCacheMaxAge(const map<string, int> &cache_max_ages, const string &path);
+
+// Process a query request, streaming the results page to "conn".
+bool ProcessQueryRequest(const HttpRequest &req,
+                         const HttpServerTask &hst,
+                         ResponseWriter *conn);
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -90,26 +220,107 @@ bool HttpServer::Run(void) {
     return false;
   }
 
+  // The indices are opened once, and shared by every query.
+  cout << "  opening the indices..." << endl;
+  QueryEngine query_engine(postingCacheBytes_, validateIndices_);
+  for (const string &index : indices_) {
+    struct stat st;
+    bool segments = stat(index.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    if (!(segments ? query_engine.AddSegments(index) :
+          query_engine.AddIndex(index)))
+      cerr << "  couldn't open " << index << "; skipping it" << endl;
+  }
+
+  // Queries only check the blocks of the indices that they read, so
+  // they can start right away; the rest are checked in the background.
+  pthread_t scrubber;
+  if (validateIndices_) {
+    Verify333(pthread_create(&scrubber, nullptr, &ScrubIndices,
+                             static_cast<void *>(&query_engine)) == 0);
+  }
+
+  // The I/O loop accepts connections, and waits for the next request
+  // on connections that are idle.
+  std::unique_ptr<IoLoop> loop = IoLoop::Create(useIoUring_);
+  if (!loop) {
+    cerr << endl << "Couldn't set up the I/O loop." << endl;
+    return false;
+  }
+
   // Spin, accepting connections and dispatching them.  Use a
   // threadpool to dispatch connections into their own thread.
-  cout << "  accepting connections..." << endl << endl;
+  cout << "  accepting connections (using " << loop->name() << ")..."
+       << endl << endl;
+  GzipCache gzip_cache(gzipCacheBytes_);
+  ObjectPool<HttpServerTask> pool(kNumPooledConnections);
   ThreadPool tp(kNumThreads);
-  while (1) {
-    HttpServerTask *hst = new HttpServerTask(HttpServer_ThrFn);
-    hst->basedir = staticfileDirpath_;
-    hst->indices = &indices_;
-    if (!ss_.Accept(&hst->client_fd,
-                    &hst->caddr,
-                    &hst->cport,
-                    &hst->cdns,
-                    &hst->saddr,
-                    &hst->sdns)) {
+  bool accepting = true;
+  loop->Accept(listen_fd, [&](int client_fd) {
+    if (client_fd < 0) {
       // The accept failed for some reason, so quit out of the server.
-      // (Will happen when kill command is used to shut down the server.)
-      break;
+      cerr << "accept() failed " << strerror(-client_fd) << endl;
+      accepting = false;
+      return;
     }
-    // The accept succeeded; dispatch it.
-    tp.Dispatch(hst);
+    HttpServerTask *hst = pool.Get();
+    hst->f_ = HttpServer_ThrFn;
+    hst->pool = &pool;
+    hst->basedir = &staticfileDirpath_;
+    hst->query_engine = &query_engine;
+    hst->cache_max_ages = &cacheMaxAges_;
+    hst->gzip_cache = &gzip_cache;
+    hst->gzip_queries = gzipQueries_;
+    hst->tls = tls_.get();
+    hst->loop = loop.get();
+    hst->tp = &tp;
+    hst->resumed = false;
+    hst->client_fd = client_fd;
+    if (!ss_.DescribeClient(client_fd,
+                            &hst->caddr,
+                            &hst->cport,
+                            &hst->cdns,
+                            &hst->saddr,
+                            &hst->sdns)) {
+      close(client_fd);
+      pool.Put(hst);
+      return;
+    }
+    // The accept succeeded; dispatch it.  A TLS connection needs a
+    // thread of its own for the handshake and OpenSSL's blocking
+    // reads; anything else is served right here, on the loop.
+    hst->conn.Attach(client_fd);
+    if (hst->tls != nullptr)
+      tp.Dispatch(hst);
+    else
+      Spawn(ServeConnection(hst));
+  });
+  while (accepting) {
+    if (loop->RunOnce(-1) < 0)
+      break;
+  }
+  if (validateIndices_)
+    Verify333(pthread_join(scrubber, nullptr) == 0);
+  return true;
+}
+
+static void *ScrubIndices(void *query_engine) {
+  std::vector<string> corrupt;
+  if (static_cast<QueryEngine *>(query_engine)->Scrub(kScrubThreads,
+                                                      &corrupt)) {
+    cout << "  checked the indices' checksums" << endl;
+  }
+  for (const string &index_file : corrupt) {
+    cerr << "  " << index_file << " is corrupt; queries that read its"
+         << " bad blocks skip it" << endl;
+  }
+  return nullptr;
+}
+
+bool HttpServer::EnableTls(const string &cert_file, const string &key_file) {
+  tls_.reset(new TlsContext());
+  if (!tls_->Init(cert_file, key_file)) {
+    tls_.reset();
+    return false;
   }
   return true;
 }
@@ -117,9 +328,11 @@ bool HttpServer::Run(void) {
 void HttpServer_ThrFn(ThreadPool::Task *t) {
   // Cast back our HttpServerTask structure with all of our new
   // client's information in it.
-  unique_ptr<HttpServerTask> hst(static_cast<HttpServerTask *>(t));
-  cout << "  client " << hst->cdns << ":" << hst->cport << " "
-       << "(IP address " << hst->caddr << ")" << " connected." << endl;
+  HttpServerTask *hst = static_cast<HttpServerTask *>(t);
+  if (!hst->resumed) {
+    cout << "  client " << hst->cdns << ":" << hst->cport << " "
+         << "(IP address " << hst->caddr << ")" << " connected." << endl;
+  }
 
   // Read in the next request, process it, write the response.
 
@@ -133,65 +346,220 @@ void HttpServer_ThrFn(ThreadPool::Task *t) {
   // creating/destroying the same connection repeatedly.
 
   // STEP 1:
-  bool done = false;
-  HttpConnection conn(hst->client_fd);
+  HttpConnection &conn = hst->conn;
+  bool done = (!hst->resumed && hst->tls != nullptr &&
+               !conn.StartTls(hst->tls));
 
   while (!done) {
-    HttpRequest req;
-    HttpResponse resp;
+    {
+      // The request lives in the connection's arena, so it must be
+      // gone before the arena is reset below.
+      HttpRequest req(conn.arena());
+
+      // read the next request
+      if (!conn.GetNextRequest(&req))
+        break;
+
+      // An HTTP/2 client takes over the connection, and its requests
+      // go through ProcessRequest() a stream at a time.
+      ConnectionProtocol protocol = ChooseProtocol(conn, req);
+      if (protocol == kProtocolError)
+        break;
+      bool h2 = protocol == kHttp2PriorKnowledge;
+      if (h2 || protocol == kHttp2Upgrade) {
+        Http2Connection h2conn(&conn,
+                               [hst](const HttpRequest &r,
+                                     ResponseWriter *w) {
+                                 return ProcessRequest(r, *hst, w);
+                               });
+        if (h2)
+          h2conn.ServePriorKnowledge();
+        else
+          h2conn.ServeUpgrade(req);
+        break;
+      }
 
-    // read the next request
-    if (!conn.GetNextRequest(&req)) {
-      close(hst->client_fd);
-      done = true;
-    }
+      // process next request, writing out the response
+      if (!ProcessRequest(req, *hst, &conn))
+        break;
 
-    // process next request
-    resp = ProcessRequest(req, hst->basedir, hst->indices);
-    if (!conn.WriteResponse(resp)) {
-      close(hst->client_fd);
-      done = true;
+      // close connection when "Connection: close\r\n"
+      if (strcasecmp(req.GetHeaderValue("connection").c_str(),
+                     "close") == 0) {
+        done = true;
+      }
     }
+    conn.arena()->Reset();
+
+    // Rather than keep this thread waiting for a next request that may
+    // be a long time coming, let the loop wait for it.  (If some of it
+    // has already arrived, e.g., because the client is pipelining,
+    // there's no need.)
+    if (!done && !conn.HasBufferedInput()) {
+      WaitForNextRequest(hst);
+      return;
+    }
+  }
 
-    // close connection when "Connection: close\r\n"
-    if (req.GetHeaderValue("connection").compare("close") == 0) {
-      close(hst->client_fd);
-      done = true;
+  CloseConnection(hst);
+}
+
+static ConnectionProtocol ChooseProtocol(const HttpConnection &conn,
+                                         const HttpRequest &req) {
+  bool preface = Http2Connection::IsPreface(req);
+  if (conn.is_tls()) {
+    bool h2 = conn.alpn_protocol() == "h2";
+    if (h2 != preface)
+      return kProtocolError;
+    return h2 ? kHttp2PriorKnowledge : kHttp1;
+  }
+  if (preface)
+    return kHttp2PriorKnowledge;
+  return Http2Connection::WantsUpgrade(req) ? kHttp2Upgrade : kHttp1;
+}
+
+static void WaitForNextRequest(HttpServerTask *hst) {
+  hst->resumed = true;
+  IoLoop *loop = hst->loop;
+  // Only the loop's thread may use it.  The loop can't decrypt, so it
+  // just waits for the socket to become readable.
+  loop->Post([hst, loop]() {
+    loop->PollIn(hst->conn.fd(), [hst](int result) {
+      if (result < 0) {
+        CloseConnection(hst);
+        return;
+      }
+      hst->tp->Dispatch(hst);
+    });
+  });
+}
+
+static Task<> ServeConnection(HttpServerTask *hst) {
+  cout << "  client " << hst->cdns << ":" << hst->cport << " "
+       << "(IP address " << hst->caddr << ")" << " connected." << endl;
+
+  HttpConnection &conn = hst->conn;
+  IoLoop *loop = hst->loop;
+  bool done = false;
+  while (!done) {
+    {
+      // The request lives in the connection's arena, so it must be
+      // gone before the arena is reset below.
+      HttpRequest req(conn.arena());
+
+      // Wait for the rest of the request header.  The loop receives
+      // into a buffer that io_uring only picks once there's something
+      // to read, so an idle client costs nothing but this coroutine.
+      bool have_request;
+      while (!(have_request = conn.TakeBufferedRequest(&req))) {
+        RecvResult r = co_await AsyncRecv(loop, conn.fd());
+        if (r.result <= 0 || !conn.AppendInput(r.data))
+          break;
+      }
+      if (!have_request)
+        break;
+
+      // An HTTP/2 client gets a thread for the rest of the
+      // connection, as in HttpServer_ThrFn().
+      ConnectionProtocol protocol = ChooseProtocol(conn, req);
+      if (protocol == kProtocolError)
+        break;
+      bool h2 = protocol == kHttp2PriorKnowledge;
+      if (h2 || protocol == kHttp2Upgrade) {
+        co_await ResumeOn(hst->tp);
+        Http2Connection h2conn(&conn,
+                               [hst](const HttpRequest &r,
+                                     ResponseWriter *w) {
+                                 return ProcessRequest(r, *hst, w);
+                               });
+        if (h2)
+          h2conn.ServePriorKnowledge();
+        else
+          h2conn.ServeUpgrade(req);
+        co_await ResumeOn(loop);
+        break;
+      }
+
+      // Static files are looked up on a worker, but sent from here, so
+      // a slow download doesn't hold up a thread.  Query results are
+      // produced and streamed out as the query runs, so that happens
+      // on the worker.
+      bool ok;
+      co_await ResumeOn(hst->tp);
+      if (req.uri().substr(0, 8) == "/static/") {
+        HttpResponse response = ProcessFileRequest(req, *hst);
+        co_await ResumeOn(loop);
+        ok = co_await SendResponse(loop, conn.fd(), response);
+      } else {
+        ok = ProcessQueryRequest(req, *hst, &conn);
+        co_await ResumeOn(loop);
+      }
+      if (!ok)
+        break;
+
+      // close connection when "Connection: close\r\n"
+      if (strcasecmp(req.GetHeaderValue("connection").c_str(),
+                     "close") == 0) {
+        done = true;
+      }
     }
+    conn.arena()->Reset();
   }
+
+  CloseConnection(hst);
+}
+
+static Task<bool> SendResponse(IoLoop *loop, int fd,
+                               const HttpResponse &response) {
+  string str = response.GenerateResponseString();
+  if (!co_await AsyncSendAll(loop, fd, str.data(), str.size()))
+    co_return false;
+  if (response.body_file().empty())
+    co_return true;
+  co_return co_await AsyncSendFile(loop, fd, response.body_file(),
+                                   response.body_file_offset(),
+                                   response.body_file_length());
+}
+
+static void CloseConnection(HttpServerTask *hst) {
+  hst->conn.Close();
+  hst->pool->Put(hst);
 }
 
-HttpResponse ProcessRequest(const HttpRequest &req,
-                            const string &basedir,
-                            const list<string> *indices) {
+bool ProcessRequest(const HttpRequest &req,
+                    const HttpServerTask &hst,
+                    ResponseWriter *conn) {
   // Is the user asking for a static file?
   if (req.uri().substr(0, 8) == "/static/") {
-    return ProcessFileRequest(req.uri(), basedir);
+    return conn->WriteResponse(ProcessFileRequest(req, hst));
   }
 
   // The user must be asking for a query.
-  return ProcessQueryRequest(req.uri(), indices);
+  return ProcessQueryRequest(req, hst, conn);
 }
 
-HttpResponse ProcessFileRequest(const string &uri,
-                                const string &basedir) {
+HttpResponse ProcessFileRequest(const HttpRequest &req,
+                                const HttpServerTask &hst) {
   // The response we'll build up.
   HttpResponse ret;
+  const string &uri = req.uri();
+  const string &basedir = *hst.basedir;
+  const map<string, int> &cache_max_ages = *hst.cache_max_ages;
 
   // Steps to follow:
   //  - use the URLParser class to figure out what filename
   //    the user is asking for.
   //
-  //  - use the FileReader class to read the file into memory
+  //  - stat the file, and if the client's cached copy is still
+  //    current answer 304 without reading it
+  //
+  //  - if the client asked for byte ranges, read and send only those
   //
-  //  - copy the file content into the ret.body
+  //  - otherwise send the whole file, straight from the file
+  //    rather than reading it into ret.body
   //
   //  - depending on the file name suffix, set the response
-  //    Content-type header as appropriate, e.g.,:
-  //      --> for ".html" or ".htm", set to "text/html"
-  //      --> for ".jpeg" or ".jpg", set to "image/jpeg"
-  //      --> for ".png", set to "image/png"
-  //      etc.
+  //    Content-type header as appropriate (see MimeTypes.h).
   //
   // be sure to set the response code, protocol, and message
   // in the HttpResponse as well.
@@ -203,53 +571,101 @@ HttpResponse ProcessFileRequest(const string &uri,
   // get the filename user is asking
   fname += parser.path().substr(8);
 
-  // read file to memory
+  // stat the file, then read it into memory
   FileReader freader(basedir, fname);
-  string contents;
+  struct stat st;
+  const char *content_type = MimeTypeForFile(fname);
 
-  // if succesfully read file,
-  if (freader.ReadFile(&contents)) {
+  bool found = freader.StatFile(&st);
+  if (found) {
+    ret.set_protocol("HTTP/1.1");
+
+    // the file's version is derived from the inode, size, and mtime,
+    // so it changes whenever the file is replaced or rewritten
+    char version[64];
+    snprintf(version, sizeof(version), "%lx-%lx-%lx",
+             static_cast<unsigned long>(st.st_ino),  // NOLINT(runtime/int)
+             static_cast<unsigned long>(st.st_size),  // NOLINT(runtime/int)
+             static_cast<unsigned long>(st.st_mtime));  // NOLINT(runtime/int)
+
+    // decide whether to send the file gzip'ed, before anything is said
+    // about the response, as it's only gzip'ed if a compressed copy
+    // can be had; range requests always get the identity encoding so
+    // that byte offsets mean the same thing on every request
+    string range = req.GetHeaderValue("range");
+    bool compressible = IsCompressibleType(content_type) &&
+                        st.st_size >= kMinGzipBytes;
+    string gzipped, gzipped_type;
+    bool gzip = compressible && range.empty() &&
+                AcceptsGzip(req.GetHeaderValue("accept-encoding")) &&
+                ReadGzippedFile(basedir, fname, st, version, content_type,
+                                hst.gzip_cache, &gzipped, &gzipped_type);
+
+    // validators and caching policy for what is sent, with both 200s
+    // and 304s; the gzip'ed representation gets its own ETag, and
+    // either may be sent for a compressible file, depending on the
+    // request's Accept-Encoding
+    string etag = string("\"") + version + (gzip ? "-gz" : "") + "\"";
+    ret.AddHeader("ETag", etag);
+    ret.AddHeader("Last-Modified", FormatHttpDate(st.st_mtime));
+    auto max_age = FindCacheMaxAge(cache_max_ages, parser.path());
+    if (max_age != cache_max_ages.end()) {
+      ret.AddHeader("Cache-Control",
+                    "max-age=" + std::to_string(max_age->second));
+    }
+    if (compressible)
+      ret.AddHeader("Vary", "Accept-Encoding");
+
+    if (IsNotModified(req, etag, st.st_mtime)) {
+      ret.set_response_code(304);
+      ret.set_message("Not Modified");
+      return ret;
+    }
+
+    if (gzip) {
+      ret.set_response_code(200);
+      ret.set_message("OK");
+      ret.set_content_type(gzipped_type);
+      ret.AddHeader("Content-Encoding", "gzip");
+      ret.AppendToBody(gzipped);
+      return ret;
+    }
+
+    ret.AddHeader("Accept-Ranges", "bytes");
+    std::vector<ByteRange> ranges;
+    if (!range.empty() && IfRangeMatches(req, etag, st.st_mtime) &&
+        ParseByteRanges(range, st.st_size, &ranges)) {
+      if (ranges.empty()) {
+        ret.set_response_code(416);
+        ret.set_message("Range Not Satisfiable");
+        ret.AddHeader("Content-Range",
+                      "bytes */" + std::to_string(st.st_size));
+        return ret;
+      }
+      if (MakeRangeResponse(&freader, content_type, st.st_size,
+                            ranges, &ret)) {
+        return ret;
+      }
+    }
+  }
+
+  // if the file is there, send all of it
+  if (found) {
     ret.set_protocol("HTTP/1.1");
     ret.set_response_code(200);
     ret.set_message("OK");
 
-    ret.AppendToBody(contents);
-
-    string suffix = fname.substr(fname.find_last_of(".") + 1);
+    ret.set_body_file(freader.path(), 0, st.st_size);
 
     // setting response content type
-    if (suffix.compare("html") == 0 || suffix.compare("htm") == 0)
-      ret.set_content_type("text/html");
-    else if (suffix.compare("csv") == 0)
-      ret.set_content_type("text/csv");
-    else if (suffix.compare("css") == 0)
-      ret.set_content_type("text/css");
-    else if (suffix.compare("ics") == 0)
-      ret.set_content_type("text/calendar");
-    else if (suffix.compare("js") == 0)
-      ret.set_content_type("text/javascript");
-    else if (suffix.compare("txt") == 0)
-      ret.set_content_type("text/plain");
-    else if (suffix.compare("jpg") == 0 || suffix.compare("jpeg") == 0)
-      ret.set_content_type("image/jpeg");
-    else if (suffix.compare("gif") == 0)
-      ret.set_content_type("image/gif");
-    else if (suffix.compare("png") == 0)
-      ret.set_content_type("image/png");
-    else if (suffix.compare("tiff") == 0)
-      ret.set_content_type("image/tiff");
-    else if (suffix.compare("xml") == 0)
-      ret.set_content_type("text/xml");
-    else if (suffix.compare("svg") == 0)
-      ret.set_content_type("image/svg+xml");
-    else
-      ret.set_content_type("application/octet-stream");
+    ret.set_content_type(content_type);
 
     return ret;
   }
 
 
   // If you couldn't find the file, return an HTTP 404 error.
+  ret = HttpResponse();
   ret.set_protocol("HTTP/1.1");
   ret.set_response_code(404);
   ret.set_message("Not Found");
@@ -259,10 +675,151 @@ HttpResponse ProcessFileRequest(const string &uri,
   return ret;
 }
 
-HttpResponse ProcessQueryRequest(const string &uri,
-                                 const list<string> *indices) {
-  // The response we're building up.
+static bool IsNotModified(const HttpRequest &req,
+                          const string &etag,
+                          time_t mtime) {
+  // If-None-Match takes precedence: it holds a list of entity tags
+  // (or "*"), any of which may carry a weak "W/" prefix.
+  string inm = req.GetHeaderValue("if-none-match");
+  if (!inm.empty()) {
+    std::vector<string> tags;
+    boost::split(tags, inm, boost::is_any_of(","));
+    for (string &tag : tags) {
+      boost::trim(tag);
+      if (boost::istarts_with(tag, "w/"))
+        tag = tag.substr(2);
+      if (tag == "*" || tag == etag)
+        return true;
+    }
+    return false;
+  }
+
+  string ims = req.GetHeaderValue("if-modified-since");
+  time_t since;
+  if (!ims.empty() && ParseHttpDate(boost::trim_copy(ims), &since))
+    return mtime <= since;
+  return false;
+}
+
+static bool IfRangeMatches(const HttpRequest &req,
+                           const string &etag,
+                           time_t mtime) {
+  string if_range = boost::trim_copy(req.GetHeaderValue("if-range"));
+  if (if_range.empty())
+    return true;
+
+  // Either a strong entity tag or an HTTP-date, which must match
+  // exactly.
+  if (if_range[0] == '"')
+    return if_range == etag;
+  time_t date;
+  return ParseHttpDate(if_range, &date) && date == mtime;
+}
+
+static bool MakeRangeResponse(FileReader *freader,
+                              const string &content_type,
+                              uint64_t size,
+                              const std::vector<ByteRange> &ranges,
+                              HttpResponse *ret) {
+  // Nothing goes into "ret" until every range has been read, so that
+  // if one can't be, the caller can still send the whole file.
+  string total = "/" + std::to_string(size);
+  string part, body;
+
+  if (ranges.size() == 1) {
+    const ByteRange &r = ranges[0];
+    if (!freader->ReadRange(r.first, r.second - r.first + 1, &body))
+      return false;
+    ret->set_response_code(206);
+    ret->set_message("Partial Content");
+    ret->set_content_type(content_type);
+    ret->AddHeader("Content-Range",
+                   "bytes " + std::to_string(r.first) + "-" +
+                   std::to_string(r.second) + total);
+    ret->set_body(&body);
+    return true;
+  }
+
+  // Several ranges go out as a multipart/byteranges body.  The
+  // boundary only has to be unlikely to appear in the file.
+  static std::atomic<uint64_t> boundary_seq(0);
+  char boundary[40];
+  snprintf(boundary, sizeof(boundary), "333gle-%016llx",
+           static_cast<unsigned long long>(  // NOLINT(runtime/int)
+             (boundary_seq++ + time(nullptr)) * 0x9E3779B97F4A7C15ULL));
+
+  for (const ByteRange &r : ranges) {
+    if (!freader->ReadRange(r.first, r.second - r.first + 1, &part))
+      return false;
+    body += string("\r\n--") + boundary + "\r\n";
+    body += "Content-type: " + content_type + "\r\n";
+    body += "Content-range: bytes " + std::to_string(r.first) + "-" +
+      std::to_string(r.second) + total + "\r\n\r\n";
+    body += part;
+  }
+  body += string("\r\n--") + boundary + "--\r\n";
+  ret->set_response_code(206);
+  ret->set_message("Partial Content");
+  ret->set_content_type(string("multipart/byteranges; boundary=") +
+                        boundary);
+  ret->set_body(&body);
+  return true;
+}
+
+static bool ReadGzippedFile(const string &basedir,
+                            const string &fname,
+                            const struct stat &st,
+                            const string &version,
+                            const string &content_type,
+                            GzipCache *cache,
+                            string *gzipped,
+                            string *gzipped_type) {
+  // A pre-compressed sibling wins, as long as it's fresh.
+  FileReader gzreader(basedir, fname + ".gz");
+  struct stat gzst;
+  if (gzreader.StatFile(&gzst) && gzst.st_mtime >= st.st_mtime &&
+      gzreader.ReadFile(gzipped)) {
+    *gzipped_type = content_type;
+    return true;
+  }
+
+  // Otherwise compress it once and remember the result.
+  if (cache->capacity() == 0)
+    return false;
+  if (cache->Lookup(fname, version, gzipped, gzipped_type))
+    return true;
+
+  FileReader freader(basedir, fname);
+  string contents;
+  if (!freader.ReadFile(&contents))
+    return false;
+  gzipped->clear();
+  if (!GzipCompress(contents.data(), contents.size(), gzipped))
+    return false;
+  cache->Insert(fname, version, *gzipped, content_type);
+  *gzipped_type = content_type;
+  return true;
+}
+
+static map<string, int>::const_iterator
+FindCacheMaxAge(const map<string, int> &cache_max_ages, const string &path) {
+  auto best = cache_max_ages.end();
+  for (auto it = cache_max_ages.begin(); it != cache_max_ages.end(); it++) {
+    if (path.compare(0, it->first.size(), it->first) == 0 &&
+        (best == cache_max_ages.end() ||
+         it->first.size() > best->first.size())) {
+      best = it;
+    }
+  }
+  return best;
+}
+
+bool ProcessQueryRequest(const HttpRequest &req,
+                         const HttpServerTask &hst,
+                         ResponseWriter *conn) {
+  // The response headers; the body is streamed out through "out".
   HttpResponse ret;
+  const string &uri = req.uri();
 
   // Your job here is to figure out how to present the user with
   // the same query interface as our solution_binaries/http333d server.
@@ -278,82 +835,144 @@ HttpResponse ProcessQueryRequest(const string &uri,
   //    search terms from a typed-in search query.  convert them
   //    to lower case.
   //
-  //  - you'll want to create and use a hw3::QueryProcessor to process
-  //    the query against the search indices
+  //  - the query is processed against the search indices by the
+  //    server's QueryEngine, which answers it like a
+  //    hw3::QueryProcessor would; queries with ORs, exclusions,
+  //    parentheses, phrases, or NEARs list just their
+  //    kMaxBooleanResults best results
   //
   //  - in your generated search results, see if you can figure out
   //    how to hyperlink results to the file contents, like we did
   //    in our solution_binaries/http333d.
 
+  //  - the page is streamed: the header goes out before the query
+  //    runs, and result rows are sent in batches of kResultBatch, so
+  //    neither time-to-first-byte nor memory grows with the number
+  //    of results.
+
   // STEP 3:
-  // always present 333gle logo and search box/button
-  ret.AppendToBody(string(kThreegleStr));
+  ret.set_response_code(200);
+  ret.set_message("OK");
+  ret.set_protocol("HTTP/1.1");
+  ret.set_content_type("text/html");
+
+  // results pages are very repetitive HTML, so they compress well
+  bool gzip = false;
+  if (hst.gzip_queries) {
+    ret.AddHeader("Vary", "Accept-Encoding");
+    gzip = AcceptsGzip(req.GetHeaderValue("accept-encoding"));
+  }
+  HttpResponseStream out(conn, req.protocol() != "HTTP/1.0", gzip);
+  if (!out.Start(ret))
+    return false;
+
+  // always present 333gle logo and search box/button, right away
+  if (!out.Write(kThreegleStr) || !out.Flush())
+    return false;
 
   // use URLParser to parse uri
   URLParser parser;
   parser.Parse(uri);
-  // Get the users' query, convert to lower case
-  string query = parser.args()["terms"];
-  boost::to_lower(query);
+  // Get the users' query; it is parsed before it is converted to
+  // lower case, as "OR" is only an operator in capitals
+  string query = parser.arg("terms");
   boost::trim(query);
+  QueryNode root;
+  bool parsed = ParseQuery(query, &root);
+  boost::to_lower(query);
 
   // Check if user has inputted a query previously.
   if (uri.find("query?terms=") != std::string::npos) {
+    // "explain=1" shows how the query was evaluated, too.  A plain
+    // list of words gets all of its results, as from hw3.
+    std::vector<QueryEngine::Result> results;
+    std::vector<QueryEngine::IndexPlan> plan;
+    bool explain = parser.arg("explain") == "1";
     std::vector<std::string> query_list;
-    boost::split(query_list, query,
-                 boost::is_any_of(" "), boost::token_compress_on);
-
-    // use HW3 QueryProcessor
-    hw3::QueryProcessor qp(*indices, true);
-    std::vector<hw3::QueryProcessor::QueryResult> results;
-    results = qp.ProcessQuery(query_list);
+    bool top = false;
+    if (parsed && IsConjunction(root, &query_list)) {
+      hst.query_engine->ProcessQuery(query_list, &results,
+                                     explain ? &plan : nullptr);
+    } else if (parsed) {
+      hst.query_engine->ProcessQuery(root, kMaxBooleanResults, &results,
+                                     explain ? &plan : nullptr);
+      top = results.size() == kMaxBooleanResults;
+    }
 
     // If there are matches in the query, list them out
+    string batch;
     if (results.size() != 0) {
       // prepare results
-      ret.AppendToBody("<p><br>\n");
-
-      if (results.size() == 1) {
-        ret.AppendToBody("1 result found for <b>");
+      batch += "<p><br>\n";
+
+      if (top) {
+        batch += "Top ";
+        batch += std::to_string(results.size());
+        batch += " results found for <b>";
+      } else if (results.size() == 1) {
+        batch += "1 result found for <b>";
       } else {
-        ret.AppendToBody(std::to_string(results.size()));
-        ret.AppendToBody(" results found for <b>");
+        batch += std::to_string(results.size());
+        batch += " results found for <b>";
       }
 
-      ret.AppendToBody(EscapeHTML(query));
-
-      ret.AppendToBody("</b>\n");
-      ret.AppendToBody("<p>\n\n");
-      ret.AppendToBody("<ul>\n");
-      // list out all the results
-      for (auto q : results) {
-        ret.AppendToBody(" <li> <a href=\"");
-        if (q.documentName.substr(0, 7).compare("http://") != 0)
-          ret.AppendToBody("/static/");
-        ret.AppendToBody(q.documentName);
-        ret.AppendToBody("\">");
-        ret.AppendToBody(EscapeHTML(q.documentName));
-        ret.AppendToBody("</a> [");
-        ret.AppendToBody(std::to_string(q.rank));
-        ret.AppendToBody("]<br>\n");
+      EscapeHTML(query.data(), query.size(), &batch);
+
+      batch += "</b>\n";
+      batch += "<p>\n\n";
+      batch += "<ul>\n";
+      // list out all the results, a batch at a time
+      size_t in_batch = 0;
+      for (const auto &q : results) {
+        batch += " <li> <a href=\"";
+        if (q.document_name.substr(0, 7).compare("http://") != 0)
+          batch += "/static/";
+        batch += q.document_name;
+        batch += "\">";
+        EscapeHTML(q.document_name.data(), q.document_name.size(), &batch);
+        batch += "</a> [";
+        batch += std::to_string(q.rank);
+        batch += "]<br>\n";
+
+        if (++in_batch == kResultBatch) {
+          if (!out.Write(batch) || !out.Flush())
+            return false;
+          batch.clear();
+          in_batch = 0;
+        }
       }
-      ret.AppendToBody("</ul>\n");
+      batch += "</ul>\n";
+    } else if (!parsed && !query.empty()) {
+      batch += "<p><br>\nCouldn't understand ";
+      batch += "<b>";
+      EscapeHTML(query.data(), query.size(), &batch);
+      batch += "</b>\n<p>\n\n";
     } else {
       // No match
-      ret.AppendToBody("<p><br>\nNo results found for ");
-      ret.AppendToBody("<b>");
-      ret.AppendToBody(EscapeHTML(query));
-      ret.AppendToBody("</b>\n<p>\n\n");
+      batch += "<p><br>\nNo results found for ";
+      batch += "<b>";
+      EscapeHTML(query.data(), query.size(), &batch);
+      batch += "</b>\n<p>\n\n";
     }
+    if (explain) {
+      string text = QueryEngine::ExplainPlan(plan);
+      PostingCache *cache = hst.query_engine->posting_cache();
+      if (cache != nullptr) {
+        PostingCache::Stats stats = cache->stats();
+        text += "posting cache: " + std::to_string(stats.hits) + " hits, "
+          + std::to_string(stats.misses) + " misses, "
+          + std::to_string(stats.entries) + " entries, "
+          + std::to_string(stats.bytes) + " bytes\n";
+      }
+      batch += "<pre>\n";
+      EscapeHTML(text.data(), text.size(), &batch);
+      batch += "</pre>\n";
+    }
+    if (!out.Write(batch))
+      return false;
   }
   // close the body
-  ret.AppendToBody("</body>\n</html>\n");
-
-  ret.set_response_code(200);
-  ret.set_message("OK");
-  ret.set_protocol("HTTP/1.1");
-
-  return ret;
+  return out.Write("</body>\n</html>\n") && out.Finish();
 }
 
 }  // namespace hw4
@@ -15,7 +15,14 @@
 #include <stdint.h>
 #include <string>
 #include <list>
+#include <map>
+#include <memory>
 
+#include "./Compression.h"
+#include "./HttpConnection.h"
+#include "./IoLoop.h"
+#include "./ObjectPool.h"
+#include "./QueryEngine.h"
 #include "./ThreadPool.h"
 #include "./ServerSocket.h"
 
@@ -32,7 +39,9 @@ class HttpServer {
                       const std::string &staticfileDirpath,
                       const std::list<std::string> &indices)
     : ss_(port), staticfileDirpath_(staticfileDirpath),
-      indices_(indices) { }
+      indices_(indices), gzipCacheBytes_(kDefaultGzipCacheBytes),
+      postingCacheBytes_(kDefaultPostingCacheBytes),
+      gzipQueries_(false), useIoUring_(true), validateIndices_(true) { }
 
   // The destructor closes the listening socket if it is open and
   // also kills off any threads in the threadpool.
@@ -45,23 +54,92 @@ class HttpServer {
   // a SIGTERM signal to the server process (i.e., kill pid).
   bool Run();
 
+  // Static files whose request path starts with "prefix" are sent
+  // with "Cache-Control: max-age=<max_age>".  When several prefixes
+  // match, the longest one wins.  Must be called before Run().
+  void SetCacheMaxAge(const std::string &prefix, int max_age) {
+    cacheMaxAges_[prefix] = max_age;
+  }
+
+  // Sets the most bytes of gzip'ed static files that are kept in
+  // memory.  Zero disables on-the-fly compression of static files
+  // (pre-compressed ".gz" siblings are still served).  Must be called
+  // before Run().
+  void SetGzipCacheBytes(size_t bytes) { gzipCacheBytes_ = bytes; }
+
+  // Sets the most bytes of index postings that are kept in memory
+  // for queries to share.  Zero disables the cache.  Must be called
+  // before Run().
+  void SetPostingCacheBytes(size_t bytes) { postingCacheBytes_ = bytes; }
+
+  // If "on", query result pages are gzip'ed for clients that accept
+  // it.  Must be called before Run().
+  void SetGzipQueries(bool on) { gzipQueries_ = on; }
+
+  // If "on" (the default), connections are accepted and idle ones
+  // waited on with io_uring when the kernel supports it; otherwise
+  // with epoll.  Must be called before Run().
+  void SetUseIoUring(bool on) { useIoUring_ = on; }
+
+  // If "on" (as it is by default), index files are checked against
+  // their checksums: hw3's as they are opened, as hw3 checks them, and
+  // the blocks of those with block checksums as queries read them, and
+  // all of them in the background.  Must be called before Run().
+  void SetValidateIndices(bool on) { validateIndices_ = on; }
+
+  // Serves HTTPS rather than HTTP, using the PEM certificate chain
+  // in "cert_file" and private key in "key_file".  Returns false if
+  // they couldn't be loaded.  Must be called before Run().
+  bool EnableTls(const std::string &cert_file, const std::string &key_file);
+
+  static const size_t kDefaultGzipCacheBytes;
+  static const size_t kDefaultPostingCacheBytes;
+
  private:
   ServerSocket ss_;
   std::string staticfileDirpath_;
   std::list<std::string> indices_;
+  std::map<std::string, int> cacheMaxAges_;
+  size_t gzipCacheBytes_;
+  size_t postingCacheBytes_;
+  bool gzipQueries_;
+  bool useIoUring_;
+  bool validateIndices_;
+  std::unique_ptr<TlsContext> tls_;
   static const int kNumThreads;
+  static const uint32_t kNumPooledConnections;
 };
 
+// The state of one client connection.  HttpServer keeps these in an
+// ObjectPool, so each one (and the buffers in its HttpConnection) is
+// reused for client after client; HttpServer_ThrFn Put()s it back in
+// "pool" when the client is done.
+//
+// A plain HTTP connection is served by a coroutine on "loop"'s thread,
+// which only moves to a thread of "tp" while a request handler runs.
+// A TLS connection is served on a thread of "tp", but between requests
+// it waits on "loop" with all of the other idle connections, and is
+// dispatched to "tp" again once the client sends more.
 class HttpServerTask : public ThreadPool::Task {
  public:
+  HttpServerTask() : ThreadPool::Task(nullptr) { }
   explicit HttpServerTask(ThreadPool::thread_task_fn f)
     : ThreadPool::Task(f) { }
 
+  ObjectPool<HttpServerTask> *pool;
+  HttpConnection conn;
   int client_fd;
   uint16_t cport;
   std::string caddr, cdns, saddr, sdns;
-  std::string basedir;
-  std::list<std::string> *indices;
+  const std::string *basedir;
+  const QueryEngine *query_engine;
+  const std::map<std::string, int> *cache_max_ages;
+  GzipCache *gzip_cache;
+  bool gzip_queries;
+  TlsContext *tls;  // nullptr for plain HTTP
+  IoLoop *loop;
+  ThreadPool *tp;
+  bool resumed;  // true once the connection has been idle
 };
 
 }  // namespace hw4
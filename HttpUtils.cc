@@ -16,21 +16,25 @@
 #include <errno.h>
 #include <limits.h>
 #include <netdb.h>
-#include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string.hpp>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include "./HttpUtils.h"
 
-using boost::algorithm::replace_all;
 using std::cerr;
 using std::endl;
 using std::map;
@@ -74,121 +78,346 @@ bool IsPathSafe(const string &rootdir, const string &testfile) {
   return true;  // You may want to change this.
 }
 
-string EscapeHTML(const string &from) {
-  string ret = from;
-  // Read through the passed in string, and replace any unsafe
-  // html tokens with the proper escape codes. The characters
-  // that need to be escaped in HTML are the same five as those
-  // that need to be escaped for XML documents. You can see an
-  // example in the comment for this function in HttpUtils.h and
-  // the rest of the characters that need to be replaced can be
-  // looked up online.
-
-  // STEP 2
-  // from wikipedia
-  replace_all(ret, "&", "&amp;");
-  replace_all(ret, "\"", "&quot;");
-  replace_all(ret, "\'", "&apos;");
-  replace_all(ret, "<", "&lt;");
-  replace_all(ret, ">", "&gt;");
+// Maps each byte to its index in kHTMLEscapes, or to 0 if the byte
+// can be copied through to the output unchanged.
+static const uint8_t kHTMLEscapeClass[256] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 2, 0, 0, 0, 1, 3, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 5, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const char *kHTMLEscapes[] = {
+  "", "&amp;", "&quot;", "&apos;", "&lt;", "&gt;"
+};
+static const size_t kHTMLEscapeLens[] = { 0, 5, 6, 6, 4, 4 };
+
+// Maps each byte to its hex digit value, or to XX if it isn't one.
+#define XX 0xFF
+static const uint8_t kHexValue[256] = {
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+   0,  1,  2,  3,  4,  5,  6,  7,  8,  9, XX, XX, XX, XX, XX, XX,
+  XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+};
+
+// Returns whether "b" is one of "stops".
+template <size_t N>
+static inline bool IsStop(char b, const char (&stops)[N]) {
+  for (char stop : stops) {
+    if (b == stop)
+      return true;
+  }
+  return false;
+}
+
+#if defined(__SSE2__)
+// Looks for the first of "stops" in [from, from+len), from "pos", 32
+// bytes at a time.  The Makefile targets baseline x86-64, which
+// doesn't have AVX2, so this is compiled for AVX2 on its own, and only
+// called where __builtin_cpu_supports() says the CPU has it.  Returns
+// true with "pos" at the byte if it finds one, and otherwise false,
+// with "pos" where fewer than 32 bytes are left.
+template <size_t N>
+__attribute__((target("avx2")))
+static bool FindStopAvx2(const char *from, size_t len,
+                         const char (&stops)[N], size_t *pos) {
+  __m256i wanted[N];
+  for (size_t i = 0; i < N; i++)
+    wanted[i] = _mm256_set1_epi8(stops[i]);
+  for (; *pos + 32 <= len; *pos += 32) {
+    __m256i v = _mm256_loadu_si256(
+                  reinterpret_cast<const __m256i *>(from + *pos));
+    __m256i hit = _mm256_cmpeq_epi8(v, wanted[0]);
+    for (size_t i = 1; i < N; i++)
+      hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, wanted[i]));
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+    if (mask != 0) {
+      *pos += __builtin_ctz(mask);
+      return true;
+    }
+  }
+  return false;
+}
+#endif
+
+// Returns the number of leading bytes in [from, from+len) that are
+// none of "stops".  Used to copy long runs of uninteresting
+// characters through in bulk rather than one byte at a time.
+template <size_t N>
+static size_t SkipSafeBytes(const char *from, size_t len,
+                            const char (&stops)[N]) {
+  size_t pos = 0;
+#if defined(__SSE2__)
+  if (__builtin_cpu_supports("avx2") &&
+      FindStopAvx2(from, len, stops, &pos))
+    return pos;
+  __m128i wanted[N];
+  for (size_t i = 0; i < N; i++)
+    wanted[i] = _mm_set1_epi8(stops[i]);
+  while (pos + 16 <= len) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(from + pos));
+    __m128i hit = _mm_cmpeq_epi8(v, wanted[0]);
+    for (size_t i = 1; i < N; i++)
+      hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, wanted[i]));
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hit));
+    if (mask != 0)
+      return pos + __builtin_ctz(mask);
+    pos += 16;
+  }
+#endif
+  while (pos < len && !IsStop(from[pos], stops))
+    pos++;
+  return pos;
+}
 
+// The bytes that EscapeHTML() and URIDecode() stop at.
+static const char kHTMLSpecials[] = {'&', '"', '\'', '<', '>'};
+static const char kURISpecials[] = {'+', '%'};
+
+string EscapeHTML(const string &from) {
+  string ret;
+  ret.reserve(from.size());
+  EscapeHTML(from.data(), from.size(), &ret);
   return ret;
 }
 
+void EscapeHTML(const char *from, size_t len, string *out) {
+  // The characters that need to be escaped in HTML are the same five
+  // as those that need to be escaped for XML documents.  Copy runs of
+  // safe bytes through in bulk, and look up the replacement for each
+  // unsafe byte in kHTMLEscapes.
+  size_t pos = 0;
+  while (pos < len) {
+    size_t run = SkipSafeBytes(from + pos, len - pos, kHTMLSpecials);
+    out->append(from + pos, run);
+    pos += run;
+    if (pos == len)
+      break;
+
+    uint8_t cls = kHTMLEscapeClass[static_cast<uint8_t>(from[pos])];
+    out->append(kHTMLEscapes[cls], kHTMLEscapeLens[cls]);
+    pos++;
+  }
+}
+
 // Look for a "%XY" token in the string, where XY is a
 // hex number.  Replace the token with the appropriate ASCII
 // character, but only if 32 <= dec(XY) <= 127.
 string URIDecode(const string &from) {
   string retstr;
+  retstr.reserve(from.size());
+  URIDecode(from.data(), from.size(), &retstr);
+  return retstr;
+}
 
-  // Loop through the characters in the string.
-  for (unsigned int pos = 0; pos < from.length(); pos++) {
-    // note: use pos+n<from.length() instead of pos<from.length-n
-    // to avoid overflow problems with unsigned int values
-    char c1 = from[pos];
-    char c2 = (pos+1 < from.length()) ? toupper(from[pos+1]) : ' ';
-    char c3 = (pos+2 < from.length()) ? toupper(from[pos+2]) : ' ';
+void URIDecode(const char *from, size_t len, string *out) {
+  size_t pos = 0;
+  while (pos < len) {
+    // Copy through everything up to the next '+' or '%'.
+    size_t run = SkipSafeBytes(from + pos, len - pos, kURISpecials);
+    out->append(from + pos, run);
+    pos += run;
+    if (pos == len)
+      break;
 
     // Special case the '+' for old encoders.
-    if (c1 == '+') {
-      retstr.append(1, ' ');
+    if (from[pos] == '+') {
+      out->push_back(' ');
+      pos++;
       continue;
     }
 
-    // Is this an escape sequence?
-    if (c1 != '%') {
-      retstr.append(1, c1);
+    // An escape sequence.  Are the next two characters hex digits?
+    // note: use pos+n<len instead of pos<len-n to avoid overflow
+    // problems with unsigned values
+    uint8_t hi = (pos+1 < len) ? kHexValue[static_cast<uint8_t>(from[pos+1])]
+                               : XX;
+    uint8_t lo = (pos+2 < len) ? kHexValue[static_cast<uint8_t>(from[pos+2])]
+                               : XX;
+    if (hi == XX || lo == XX) {
+      out->push_back('%');
+      pos++;
       continue;
     }
 
-    // Yes.  Are the next two characters hex digits?
-    if (!((('0' <= c2) && (c2 <= '9')) ||
-          (('A' <= c2) && (c2 <= 'F')))) {
-      retstr.append(1, c1);
-      continue;
-    }
-    if (!((('0' <= c3) && (c3 <= '9')) ||
-           (('A' <= c3) && (c3 <= 'F')))) {
-      retstr.append(1, c1);
-      continue;
-    }
-
-    // Yes.  Convert to a code.
-    uint8_t code = 0;
-    if (c2 >= 'A') {
-      code = 16 * (10 + (c2 - 'A'));
-    } else {
-      code = 16 * (c2 - '0');
-    }
-    if (c3 >= 'A') {
-      code += 10 + (c3 - 'A');
-    } else {
-      code += (c3 - '0');
-    }
-
-    // Is the code reasonable?
+    // Yes.  Is the code reasonable?
+    uint8_t code = 16 * hi + lo;
     if (!((code >= 32) && (code <= 127))) {
-      retstr.append(1, c1);
+      out->push_back('%');
+      pos++;
       continue;
     }
 
     // Great!  Convert and append.
-    retstr.append(1, static_cast<char>(code));
-    pos += 2;
+    out->push_back(static_cast<char>(code));
+    pos += 3;
   }
-  return retstr;
 }
+#undef XX
 
 void URLParser::Parse(const string &url) {
   url_ = url;
+  path_.clear();
+  args_.clear();
 
-  // Split the URL into the path and the args components.
-  vector<string> ps;
-  boost::split(ps, url, boost::is_any_of("?"));
-  if (ps.size() < 1)
-    return;
+  // Split the URL into the path and the args components, scanning in
+  // place rather than splitting into temporary strings.
+  const char *p = url.data();
+  const char *end = p + url.size();
+  const char *q = static_cast<const char *>(memchr(p, '?', end - p));
+  const char *path_end = (q == nullptr) ? end : q;
 
   // Store the URI-decoded path.
-  path_ = URIDecode(ps[0]);
-
-  if (ps.size() < 2)
+  URIDecode(p, path_end - p, &path_);
+  if (q == nullptr)
     return;
 
-  // Split the args into each field=val; chunk.
-  vector<string> vals;
-  boost::split(vals, ps[1], boost::is_any_of("&"));
-
-  // Iterate through the chunks.
-  for (unsigned int i = 0; i < vals.size(); i++) {
-    // Split the chunk into field, value.
-    string val = vals[i];
-    vector<string> fv;
-    boost::split(fv, val, boost::is_any_of("="));
-    if (fv.size() == 2) {
+  // Walk the args, one field=val chunk at a time.  Only the part
+  // up to any further '?' counts, and chunks that aren't exactly
+  // field=val are skipped.
+  const char *args_end =
+    static_cast<const char *>(memchr(q + 1, '?', end - q - 1));
+  if (args_end == nullptr)
+    args_end = end;
+  string field, value;
+  for (const char *chunk = q + 1; chunk <= args_end; ) {
+    const char *amp =
+      static_cast<const char *>(memchr(chunk, '&', args_end - chunk));
+    const char *chunk_end = (amp == nullptr) ? args_end : amp;
+    const char *eq =
+      static_cast<const char *>(memchr(chunk, '=', chunk_end - chunk));
+    if (eq != nullptr && memchr(eq + 1, '=', chunk_end - eq - 1) == nullptr) {
       // Add the field, value to the args_ map.
-      args_[URIDecode(fv[0])] = URIDecode(fv[1]);
+      field.clear();
+      value.clear();
+      URIDecode(chunk, eq - chunk, &field);
+      URIDecode(eq + 1, chunk_end - eq - 1, &value);
+      args_[field].swap(value);
+    }
+    chunk = chunk_end + 1;
+  }
+}
+
+static const char *kHttpDateFormat = "%a, %d %b %Y %H:%M:%S GMT";
+
+string FormatHttpDate(time_t t) {
+  struct tm tm;
+  char buf[64];
+  gmtime_r(&t, &tm);
+  size_t len = strftime(buf, sizeof(buf), kHttpDateFormat, &tm);
+  return string(buf, len);
+}
+
+bool ParseHttpDate(const string &date, time_t *t) {
+  struct tm tm;
+  memset(&tm, 0, sizeof(tm));
+  const char *end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S", &tm);
+  if (end == nullptr || strncasecmp(end, " GMT", 4) != 0)
+    return false;
+  *t = timegm(&tm);
+  return true;
+}
+
+// The most ranges we'll serve in one multipart/byteranges response.
+static const size_t kMaxByteRanges = 16;
+
+// Parses the decimal number in [*pos, end) into "n", advancing *pos.
+// Returns false if there are no digits or the number overflows.
+static bool ParseDecimal(const char **pos, const char *end, uint64_t *n) {
+  const char *p = *pos;
+  uint64_t val = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    if (val > (UINT64_MAX - 9) / 10)
+      return false;
+    val = val * 10 + (*p - '0');
+    p++;
+  }
+  if (p == *pos)
+    return false;
+  *pos = p;
+  *n = val;
+  return true;
+}
+
+bool ParseByteRanges(const string &header, uint64_t size,
+                     vector<ByteRange> *ranges) {
+  string spec = boost::trim_copy(header);
+  if (!boost::istarts_with(spec, "bytes="))
+    return false;
+
+  vector<string> parts;
+  boost::split(parts, spec.substr(6), boost::is_any_of(","));
+  if (parts.size() > kMaxByteRanges)
+    return false;
+
+  ranges->clear();
+  for (string &part : parts) {
+    boost::trim(part);
+    const char *pos = part.c_str(), *end = pos + part.size();
+    uint64_t first, last;
+
+    if (pos < end && *pos == '-') {
+      // A suffix range: the final "last" bytes.
+      pos++;
+      if (!ParseDecimal(&pos, end, &last) || pos != end)
+        return false;
+      if (last == 0 || size == 0)
+        continue;
+      first = (last >= size) ? 0 : size - last;
+      ranges->push_back(ByteRange(first, size - 1));
+      continue;
     }
+
+    if (!ParseDecimal(&pos, end, &first) || pos == end || *pos != '-')
+      return false;
+    pos++;
+    if (pos == end) {
+      last = UINT64_MAX;  // "first-" runs to the end
+    } else if (!ParseDecimal(&pos, end, &last) || pos != end ||
+               last < first) {
+      return false;
+    }
+    if (first >= size)
+      continue;  // unsatisfiable
+    ranges->push_back(ByteRange(first, (last >= size) ? size - 1 : last));
+  }
+
+  // Coalesce the ranges that overlap or touch.
+  std::sort(ranges->begin(), ranges->end());
+  size_t n = 0;
+  for (const ByteRange &r : *ranges) {
+    if (n > 0 && r.first <= (*ranges)[n - 1].second + 1)
+      (*ranges)[n - 1].second = std::max((*ranges)[n - 1].second, r.second);
+    else
+      (*ranges)[n++] = r;
   }
+  ranges->resize(n);
+  return true;
 }
 
 uint16_t GetRandPort() {
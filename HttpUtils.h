@@ -16,10 +16,12 @@
 #define HW4_HTTPUTILS_H_
 
 #include <stdint.h>
+#include <time.h>
 
 #include <string>
 #include <utility>
 #include <map>
+#include <vector>
 
 namespace hw4 {
 
@@ -50,6 +52,12 @@ bool IsPathSafe(const std::string &rootdir, const std::string &testfile);
 // XSS attacks.
 std::string EscapeHTML(const std::string &from);
 
+// A streaming variant of EscapeHTML that makes a single pass over the
+// "len" bytes at "from" and appends the escaped result to "out".
+// Nothing is allocated if "out" already has enough capacity, so callers
+// that escape many strings can reuse one output buffer.
+void EscapeHTML(const char *from, size_t len, std::string *out);
+
 // This function performs URI decoding.  It scans a string for
 // the "%" escape character and converts the token to the
 // appropriate ASCII character.  See the wikipedia article on
@@ -59,6 +67,10 @@ std::string EscapeHTML(const std::string &from);
 //
 std::string URIDecode(const std::string &from);
 
+// A streaming variant of URIDecode that decodes the "len" bytes at
+// "from" in a single pass, appending the result to "out".
+void URIDecode(const char *from, size_t len, std::string *out);
+
 // A URL that's part of a web request has the following structure:
 //
 //   /foo/bar/baz?field=value&field2=value2
@@ -82,12 +94,45 @@ class URLParser {
   // The args component is parsed into a map from field to value.
   std::map<std::string, std::string> args() const { return args_; }
 
+  // Returns the post-uri-decoding value of the arg "field", or empty
+  // string if the url has no such arg.
+  std::string arg(const std::string &field) const {
+    std::map<std::string, std::string>::const_iterator it = args_.find(field);
+    return (it == args_.end()) ? "" : it->second;
+  }
+
  private:
   std::string url_;
   std::string path_;
   std::map<std::string, std::string> args_;
 };
 
+// Formats "t" as an RFC 7231 HTTP-date, e.g.,
+// "Sun, 06 Nov 1994 08:49:37 GMT", for use in headers such as
+// Last-Modified.
+std::string FormatHttpDate(time_t t);
+
+// Parses an HTTP-date in the format produced by FormatHttpDate()
+// (matched case-insensitively, since request header values may have
+// been lowercased).  Returns true and sets "t" on success.
+bool ParseHttpDate(const std::string &date, time_t *t);
+
+// A byte range [first, last] (both inclusive) of a resource.
+typedef std::pair<uint64_t, uint64_t> ByteRange;
+
+// Parses the value of a Range header, e.g., "bytes=0-99,200-,-50",
+// against a resource that is "size" bytes long.  Returns false if the
+// header is malformed, uses a unit other than bytes, or asks for an
+// unreasonable number of ranges; the header should then be ignored
+// and the whole resource sent.  Otherwise returns true and stores
+// the satisfiable ranges, clipped to the end of the resource, in
+// "ranges", in order, with those that overlap or touch coalesced (as
+// RFC 7233 allows), so that they never add up to more than the
+// resource.  If none of them were satisfiable "ranges" is left empty
+// and the caller should answer "416 Range Not Satisfiable".
+bool ParseByteRanges(const std::string &header, uint64_t size,
+                     std::vector<ByteRange> *ranges);
+
 // Return a randomly generated port number between 10000 and 40000.
 uint16_t GetRandPort();
 
@@ -0,0 +1,29 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <string>
+
+#include "./IndexFilter.h"
+
+namespace hw4 {
+
+bool BuildIndexFilter(const IndexReader &reader,
+                      std::unique_ptr<BloomFilter> *filter) {
+  filter->reset(new BloomFilter(reader.num_words()));
+  bool ok = reader.ForEachWord([filter](const std::string &word) {
+    (*filter)->Add(IndexWordKey(word));
+  });
+  if (!ok)
+    filter->reset();
+  return ok;
+}
+
+}  // namespace hw4
@@ -0,0 +1,31 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_INDEXFILTER_H_
+#define HW4_INDEXFILTER_H_
+
+#include <memory>
+
+#include "./BloomFilter.h"
+#include "./IndexReader.h"
+
+namespace hw4 {
+
+// Builds a BloomFilter over the words of the index that "reader" has
+// open, keyed by IndexWordKey(), returning it through "filter".  Only
+// the index's word table is read, not the postings.  Returns false if
+// the word table can't be read.
+bool BuildIndexFilter(const IndexReader &reader,
+                      std::unique_ptr<BloomFilter> *filter);
+
+}  // namespace hw4
+
+#endif  // HW4_INDEXFILTER_H_
@@ -0,0 +1,457 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include "libhw1/HashTable.h"
+}
+#include "./libhw3/LayoutStructs.h"
+
+#include "./Checksum.h"
+#include "./IndexReader.h"
+#include "./ThreadPool.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+uint64_t IndexWordKey(const string &word) {
+  return FNVHash64(reinterpret_cast<unsigned char *>(
+                     const_cast<char *>(word.data())),
+                   static_cast<int>(word.size()));
+}
+
+// The generation of the next reader to be opened.
+static std::atomic<uint64_t> next_generation(1);
+
+IndexReader::~IndexReader() {
+  if (fd_ != -1)
+    close(fd_);
+}
+
+bool IndexReader::Open(const string &index_file) {
+  index_file_ = index_file;
+  generation_ = next_generation++;
+  fd_ = open(index_file.c_str(), O_RDONLY);
+  if (fd_ == -1)
+    return false;
+  struct stat st;
+  hw3::IndexFileHeader header;
+  if (fstat(fd_, &st) != 0 || !ReadAt(0, sizeof(header), &header))
+    return false;
+  header.toHostFormat();
+  file_bytes_ = st.st_size;
+  header_checksum_ = header.checksum;
+  doctable_offset_ = sizeof(header);
+  wordtable_offset_ = doctable_offset_ + header.doctableBytes;
+  int64_t sections_end = wordtable_offset_ + header.indexBytes;
+  if (header.magicNumber != hw3::kMagicNumber ||
+      header.doctableBytes < 0 || header.indexBytes < 0 ||
+      sections_end > file_bytes_ || !ReadTrailer(sections_end))
+    return false;
+  int64_t num_docs;
+  return ReadTableSize(doctable_offset_, &doctable_buckets_, &num_docs) &&
+    ReadTableSize(wordtable_offset_, &wordtable_buckets_, &num_words_);
+}
+
+bool IndexReader::ReadTrailer(int64_t sections_end) {
+  // hw3's files end with the sections.
+  if (file_bytes_ == sections_end)
+    return true;
+  ChecksumTrailer trailer;
+  if (file_bytes_ < sections_end + static_cast<int64_t>(sizeof(trailer)) ||
+      !ReadRaw(file_bytes_ - sizeof(trailer), sizeof(trailer), &trailer))
+    return false;
+  trailer.magic = ntohl(trailer.magic);
+  trailer.flags = ntohl(trailer.flags);
+  trailer.block_bytes = ntohl(trailer.block_bytes);
+  trailer.num_blocks = ntohl(trailer.num_blocks);
+  trailer.crc = ntohl(trailer.crc);
+  uint32_t num_blocks = trailer.block_bytes == 0 ? 0 :
+    (sections_end + trailer.block_bytes - 1) / trailer.block_bytes;
+  if (trailer.magic != kChecksumMagic ||
+      (trailer.flags & ~kTrailerWordPositions) != 0 ||
+      trailer.num_blocks != num_blocks ||
+      file_bytes_ != sections_end + 4 * int64_t{trailer.num_blocks} +
+        static_cast<int64_t>(sizeof(trailer)))
+    return false;
+
+  vector<uint32_t> crcs(trailer.num_blocks);
+  if (!ReadRaw(sections_end, crcs.size() * sizeof(uint32_t), crcs.data()) ||
+      Crc32c(crcs.data(), crcs.size() * sizeof(uint32_t)) != trailer.crc)
+    return false;
+  for (uint32_t &crc : crcs)
+    crc = ntohl(crc);
+  word_positions_ = (trailer.flags & kTrailerWordPositions) != 0;
+  block_bytes_ = trailer.block_bytes;
+  block_crcs_.swap(crcs);
+  block_states_.reset(new std::atomic<uint8_t>[block_crcs_.size()]());
+  // Nothing after the sections is read from here on.
+  file_bytes_ = sections_end;
+  return true;
+}
+
+bool IndexReader::EnableValidation() {
+  if (has_checksums()) {
+    validate_ = true;
+    return true;
+  }
+  return CheckHeaderChecksum();
+}
+
+bool IndexReader::CheckHeaderChecksum() const {
+  // The file is read a chunk at a time; they are as big as blocks.
+  string chunk(kChecksumBlockBytes, '\0');
+  uint32_t crc = 0;
+  for (int64_t at = doctable_offset_; at < file_bytes_; at += chunk.size()) {
+    size_t len = std::min<int64_t>(chunk.size(), file_bytes_ - at);
+    if (!ReadRaw(at, len, &chunk[0]))
+      return false;
+    crc = Crc32(chunk.data(), len, crc);
+  }
+  return crc == header_checksum_;
+}
+
+bool IndexReader::CheckBlock(size_t block) const {
+  uint8_t state = block_states_[block].load(std::memory_order_acquire);
+  if (state == 0) {
+    // Two threads may both check a block; they agree.  A block that
+    // can't be read right now isn't known to be corrupt, so it is
+    // checked again the next time.
+    int64_t start = static_cast<int64_t>(block) * block_bytes_;
+    string bytes(std::min<int64_t>(block_bytes_, file_bytes_ - start), '\0');
+    if (!ReadRaw(start, bytes.size(), &bytes[0]))
+      return false;
+    state = Crc32c(bytes.data(), bytes.size()) == block_crcs_[block] ? 1 : 2;
+    block_states_[block].store(state, std::memory_order_release);
+  }
+  return state == 1;
+}
+
+bool IndexReader::Scrub(int num_threads) const {
+  std::atomic<bool> ok(true);
+  ParallelFor(block_crcs_.size(), 1, num_threads,
+              [this, &ok](size_t begin, size_t end) {
+                for (size_t block = begin; block < end; block++) {
+                  if (!CheckBlock(block))
+                    ok = false;
+                }
+              });
+  return ok;
+}
+
+bool IndexReader::ReadAt(int64_t offset, size_t len, void *buf) const {
+  if (validate_ && len > 0) {
+    if (offset < 0 || offset + static_cast<int64_t>(len) > file_bytes_)
+      return false;
+    for (size_t block = offset / block_bytes_;
+         block <= (offset + len - 1) / block_bytes_; block++) {
+      if (!CheckBlock(block))
+        return false;
+    }
+  }
+  return ReadRaw(offset, len, buf);
+}
+
+bool IndexReader::ReadRaw(int64_t offset, size_t len, void *buf) const {
+  size_t got = 0;
+  while (got < len) {
+    ssize_t res = pread(fd_, static_cast<char *>(buf) + got, len - got,
+                        offset + got);
+    if (res == -1 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return false;
+    got += res;
+  }
+  return true;
+}
+
+bool IndexReader::ReadTableSize(int64_t offset, int32_t *num_buckets,
+                                int64_t *num_elements) const {
+  hw3::BucketListHeader blh;
+  if (!ReadAt(offset, sizeof(blh), &blh))
+    return false;
+  blh.toHostFormat();
+  int64_t records_offset = offset + sizeof(blh);
+  if (blh.numBuckets <= 0 ||
+      records_offset + static_cast<int64_t>(blh.numBuckets) *
+        static_cast<int64_t>(sizeof(hw3::BucketRecord)) > file_bytes_)
+    return false;
+
+  vector<hw3::BucketRecord> buckets(blh.numBuckets);
+  if (!ReadAt(records_offset, buckets.size() * sizeof(hw3::BucketRecord),
+              buckets.data()))
+    return false;
+  int64_t count = 0;
+  for (hw3::BucketRecord &br : buckets) {
+    br.toHostFormat();
+    if (br.chainNumElements < 0)
+      return false;
+    count += br.chainNumElements;
+  }
+  // Each element takes at least a position record, so a bigger count
+  // means a corrupt file.
+  if (count > file_bytes_ /
+      static_cast<int64_t>(sizeof(hw3::ElementPositionRecord)))
+    return false;
+  *num_buckets = blh.numBuckets;
+  *num_elements = count;
+  return true;
+}
+
+bool IndexReader::ReadChain(int64_t offset, int32_t num_buckets,
+                            uint64_t key, vector<int32_t> *positions) const {
+  // hw3's HashTableReader picks the bucket the same way.
+  int64_t bucket = static_cast<int64_t>(key % num_buckets);
+  hw3::BucketRecord br;
+  if (!ReadAt(offset + sizeof(hw3::BucketListHeader) +
+                bucket * sizeof(hw3::BucketRecord), sizeof(br), &br))
+    return false;
+  br.toHostFormat();
+  if (br.chainNumElements < 0 ||
+      br.chainNumElements > file_bytes_ /
+        static_cast<int64_t>(sizeof(hw3::ElementPositionRecord)))
+    return false;
+  positions->resize(br.chainNumElements);
+  if (!ReadAt(br.position,
+              positions->size() * sizeof(hw3::ElementPositionRecord),
+              positions->data()))
+    return false;
+  for (int32_t &position : *positions) {
+    hw3::ElementPositionRecord epr;
+    epr.position = position;
+    epr.toHostFormat();
+    position = epr.position;
+  }
+  return true;
+}
+
+bool IndexReader::LookupWord(const string &word, PostingsInfo *info) const {
+  vector<int32_t> positions;
+  if (!ReadChain(wordtable_offset_, wordtable_buckets_, IndexWordKey(word),
+                 &positions))
+    return false;
+  string candidate;
+  for (int32_t position : positions) {
+    hw3::WordPostingsHeader wph;
+    if (!ReadAt(position, sizeof(wph), &wph))
+      return false;
+    wph.toHostFormat();
+    if (wph.wordBytes != static_cast<int64_t>(word.size()) ||
+        wph.postingsBytes < 0)
+      continue;
+    candidate.resize(word.size());
+    if (!ReadAt(position + sizeof(wph), candidate.size(), &candidate[0]))
+      return false;
+    if (candidate != word)
+      continue;
+    info->offset = position + sizeof(wph) + word.size();
+    info->bytes = wph.postingsBytes;
+    return info->offset + info->bytes <= file_bytes_ &&
+      ReadTableSize(info->offset, &info->num_buckets, &info->num_docs);
+  }
+  return false;
+}
+
+bool IndexReader::ReadPostings(const PostingsInfo &info,
+                               vector<DocPosting> *postings) const {
+  // The whole table is read at once, and picked apart in memory.
+  string table(info.bytes, '\0');
+  if (!ReadAt(info.offset, table.size(), &table[0]))
+    return false;
+  // Returns a pointer to the "len" bytes at file offset "position", if
+  // they are within the table.
+  auto At = [&](int64_t position, size_t len) -> const char * {
+    if (position < info.offset ||
+        position + static_cast<int64_t>(len) > info.offset + info.bytes)
+      return nullptr;
+    return table.data() + (position - info.offset);
+  };
+
+  postings->clear();
+  postings->reserve(info.num_docs);
+  for (int32_t b = 0; b < info.num_buckets; b++) {
+    hw3::BucketRecord br;
+    const char *p = At(info.offset + sizeof(hw3::BucketListHeader) +
+                       b * sizeof(br), sizeof(br));
+    if (p == nullptr)
+      return false;
+    memcpy(&br, p, sizeof(br));
+    br.toHostFormat();
+    for (int32_t i = 0; i < br.chainNumElements; i++) {
+      hw3::ElementPositionRecord epr;
+      p = At(br.position + i * static_cast<int64_t>(sizeof(epr)),
+             sizeof(epr));
+      if (p == nullptr)
+        return false;
+      memcpy(&epr, p, sizeof(epr));
+      epr.toHostFormat();
+      hw3::DocIDElementHeader header;
+      p = At(epr.position, sizeof(header));
+      if (p == nullptr)
+        return false;
+      memcpy(&header, p, sizeof(header));
+      header.toHostFormat();
+      postings->push_back({header.docID, header.numPositions,
+            static_cast<int32_t>(epr.position + sizeof(header))});
+    }
+  }
+  std::sort(postings->begin(), postings->end(),
+            [](const DocPosting &a, const DocPosting &b) {
+              return a.doc_id < b.doc_id;
+            });
+  return true;
+}
+
+bool IndexReader::FindPosting(const PostingsInfo &info, uint64_t doc_id,
+                              DocPosting *posting) const {
+  vector<int32_t> positions;
+  if (!ReadChain(info.offset, info.num_buckets, doc_id, &positions))
+    return false;
+  for (int32_t position : positions) {
+    hw3::DocIDElementHeader header;
+    if (!ReadAt(position, sizeof(header), &header))
+      return false;
+    header.toHostFormat();
+    if (header.docID == doc_id) {
+      posting->doc_id = doc_id;
+      posting->num_positions = header.numPositions;
+      posting->positions_offset = position + sizeof(header);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IndexReader::ReadPositions(const DocPosting &posting,
+                                vector<int32_t> *positions) const {
+  int64_t bytes = static_cast<int64_t>(posting.num_positions) *
+    sizeof(hw3::DocIDElementPosition);
+  if (posting.num_positions < 0 || posting.positions_offset < 0 ||
+      posting.positions_offset + bytes > file_bytes_)
+    return false;
+  positions->resize(posting.num_positions);
+  if (!ReadAt(posting.positions_offset, bytes, positions->data()))
+    return false;
+  for (int32_t &position : *positions) {
+    hw3::DocIDElementPosition element(position);
+    element.toHostFormat();
+    position = element.position;
+  }
+  return true;
+}
+
+bool IndexReader::LookupDocName(uint64_t doc_id, string *name) const {
+  vector<int32_t> positions;
+  if (!ReadChain(doctable_offset_, doctable_buckets_, doc_id, &positions))
+    return false;
+  for (int32_t position : positions) {
+    hw3::DoctableElementHeader header;
+    if (!ReadAt(position, sizeof(header), &header))
+      return false;
+    header.toHostFormat();
+    if (header.docID != doc_id || header.filenameBytes < 0)
+      continue;
+    name->resize(header.filenameBytes);
+    return ReadAt(position + sizeof(header), name->size(), &(*name)[0]);
+  }
+  return false;
+}
+
+bool IndexReader::ForEachWord(
+    const std::function<void(const string &)> &fn) const {
+  vector<hw3::BucketRecord> buckets(wordtable_buckets_);
+  if (!ReadAt(wordtable_offset_ + sizeof(hw3::BucketListHeader),
+              buckets.size() * sizeof(hw3::BucketRecord), buckets.data()))
+    return false;
+  vector<hw3::ElementPositionRecord> chain;
+  string word;
+  for (hw3::BucketRecord &br : buckets) {
+    br.toHostFormat();
+    if (br.chainNumElements == 0)
+      continue;
+    if (br.chainNumElements < 0 ||
+        br.chainNumElements > file_bytes_ /
+          static_cast<int64_t>(sizeof(hw3::ElementPositionRecord)))
+      return false;
+    chain.resize(br.chainNumElements);
+    if (!ReadAt(br.position,
+                chain.size() * sizeof(hw3::ElementPositionRecord),
+                chain.data()))
+      return false;
+    for (hw3::ElementPositionRecord &epr : chain) {
+      epr.toHostFormat();
+      hw3::WordPostingsHeader wph;
+      if (!ReadAt(epr.position, sizeof(wph), &wph))
+        return false;
+      wph.toHostFormat();
+      if (wph.wordBytes < 0 || wph.wordBytes > file_bytes_)
+        return false;
+      word.resize(wph.wordBytes);
+      if (!ReadAt(epr.position + sizeof(wph), word.size(), &word[0]))
+        return false;
+      fn(word);
+    }
+  }
+  return true;
+}
+
+bool IndexReader::ForEachDoc(
+    const std::function<void(uint64_t, const string &)> &fn) const {
+  vector<hw3::BucketRecord> buckets(doctable_buckets_);
+  if (!ReadAt(doctable_offset_ + sizeof(hw3::BucketListHeader),
+              buckets.size() * sizeof(hw3::BucketRecord), buckets.data()))
+    return false;
+  vector<hw3::ElementPositionRecord> chain;
+  string name;
+  for (hw3::BucketRecord &br : buckets) {
+    br.toHostFormat();
+    if (br.chainNumElements == 0)
+      continue;
+    if (br.chainNumElements < 0 ||
+        br.chainNumElements > file_bytes_ /
+          static_cast<int64_t>(sizeof(hw3::ElementPositionRecord)))
+      return false;
+    chain.resize(br.chainNumElements);
+    if (!ReadAt(br.position,
+                chain.size() * sizeof(hw3::ElementPositionRecord),
+                chain.data()))
+      return false;
+    for (hw3::ElementPositionRecord &epr : chain) {
+      epr.toHostFormat();
+      hw3::DoctableElementHeader header;
+      if (!ReadAt(epr.position, sizeof(header), &header))
+        return false;
+      header.toHostFormat();
+      if (header.filenameBytes < 0 || header.filenameBytes > file_bytes_)
+        return false;
+      name.resize(header.filenameBytes);
+      if (!ReadAt(epr.position + sizeof(header), name.size(), &name[0]))
+        return false;
+      fn(header.docID, name);
+    }
+  }
+  return true;
+}
+
+}  // namespace hw4
@@ -0,0 +1,198 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_INDEXREADER_H_
+#define HW4_INDEXREADER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace hw4 {
+
+// Returns the key that a word has in an index file's word table: its
+// FNVHash64().
+uint64_t IndexWordKey(const std::string &word);
+
+// Where a word's docID table is in an index file, and how many
+// documents it lists.
+struct PostingsInfo {
+  int64_t offset;      // of the docID table
+  int32_t bytes;       // of the docID table
+  int32_t num_buckets;
+  int64_t num_docs;
+};
+
+// One document in a word's docID table: the document, the number of
+// times the word appears in it, and where the list of its positions
+// in the document is in the index file (which is only read if they
+// are needed; see IndexReader::ReadPositions()).
+struct DocPosting {
+  uint64_t doc_id;
+  int32_t num_positions;
+  int32_t positions_offset;
+};
+
+// An IndexReader reads an index file written by hw3's WriteIndex: its
+// doctable, its word table, and each word's docID table, which are
+// all hash tables in the layout of libhw3/LayoutStructs.h.
+//
+// Unlike hw3's readers, which are built on a FILE* and so have to be
+// made again for every query, an IndexReader only ever uses pread()
+// once it's open, so one reader can be shared by all of the threads
+// of the server.
+//
+// Rather than checking a whole file's checksum before it can be used,
+// as hw3 does, an IndexReader can check the block checksums at the end
+// of the files that IndexWriter writes (see Checksum.h) lazily: each
+// block the first time it is read (see EnableValidation()), and the
+// rest with Scrub(), which may run in the background while the reader
+// is in use.  Files without them are checked against their header's
+// checksum, as hw3 checks them.
+class IndexReader {
+ public:
+  IndexReader() : fd_(-1), generation_(0), header_checksum_(0),
+                  word_positions_(false), validate_(false),
+                  block_bytes_(0) { }
+  virtual ~IndexReader();
+
+  IndexReader(const IndexReader &) = delete;
+  IndexReader &operator=(const IndexReader &) = delete;
+
+  // Opens the index file "index_file", and checks its header.
+  // Returns false if it can't be read or isn't an index file.
+  bool Open(const std::string &index_file);
+
+  // From now on, each block of the file is checked against its
+  // checksum the first time it is read, and reads of a block that
+  // doesn't match fail.  A file without block checksums (as hw3 writes
+  // them) is instead checked against its header's checksum right away,
+  // reading all of it; if it doesn't match, returns false, and the
+  // reader shouldn't be used.  Must be called before the reader is
+  // shared.
+  bool EnableValidation();
+
+  const std::string &index_file() const { return index_file_; }
+
+  // Looks up "word".  If it is in the index, returns true and where
+  // its docID table is through "info"; only the table's bucket
+  // records are read, to count the documents.  Returns false if the
+  // word isn't there (or the file is corrupt).
+  bool LookupWord(const std::string &word, PostingsInfo *info) const;
+
+  // Reads every document in the docID table "info", in order of
+  // docID, into "postings".
+  bool ReadPostings(const PostingsInfo &info,
+                    std::vector<DocPosting> *postings) const;
+
+  // Looks up just document "doc_id" in the docID table "info", which
+  // is cheaper than reading all of it when the table is big.  Returns
+  // false if the document isn't there.
+  bool FindPosting(const PostingsInfo &info, uint64_t doc_id,
+                   DocPosting *posting) const;
+
+  // Reads the positions of a word in a document, which "posting"
+  // came from ReadPostings() or FindPosting(), into "positions", in
+  // the order hw3 wrote them (which is increasing).
+  bool ReadPositions(const DocPosting &posting,
+                     std::vector<int32_t> *positions) const;
+
+  // Looks up the file name of document "doc_id" in the doctable.
+  bool LookupDocName(uint64_t doc_id, std::string *name) const;
+
+  // Calls "fn" with every word in the word table.  Returns false if
+  // the table couldn't be read.
+  bool ForEachWord(
+    const std::function<void(const std::string &)> &fn) const;
+
+  // Calls "fn" with the docID and file name of every document in the
+  // doctable.  Returns false if the doctable couldn't be read.
+  bool ForEachDoc(
+    const std::function<void(uint64_t, const std::string &)> &fn) const;
+
+  // The number of words in the word table.
+  int64_t num_words() const { return num_words_; }
+
+  // Whether the file has block checksums.
+  bool has_checksums() const { return !block_crcs_.empty(); }
+
+  // Whether the file's positions count words, as its trailer says
+  // WriteIndexFile()'s do, rather than bytes, as hw3's (which have no
+  // trailer) do; phrases and NEARs need the former.
+  bool has_word_positions() const { return word_positions_; }
+
+  // Checks every block that hasn't been checked yet against its
+  // checksum, on "num_threads" threads.  Returns false if a block
+  // doesn't match (or can't be read).
+  bool Scrub(int num_threads) const;
+
+  // A number that no other Open() of this process gets, so that what
+  // is cached from this reader is never mistaken for what was cached
+  // from an earlier version of the same file.
+  uint64_t generation() const { return generation_; }
+
+ private:
+  // Reads the "len" bytes at "offset" into "buf".  Returns false if
+  // they aren't all there, or if validating and a block of them
+  // doesn't match its checksum.
+  bool ReadAt(int64_t offset, size_t len, void *buf) const;
+
+  // ReadAt() without the checks.
+  bool ReadRaw(int64_t offset, size_t len, void *buf) const;
+
+  // Reads the trailer and block checksums, if the file has them after
+  // the sections, which end at "sections_end".
+  bool ReadTrailer(int64_t sections_end);
+
+  // Returns whether the sections match "header_checksum_".
+  bool CheckHeaderChecksum() const;
+
+  // Returns whether block "block" matches its checksum, checking it
+  // if it hasn't been yet.
+  bool CheckBlock(size_t block) const;
+
+  // Reads the header and bucket records of the hash table at
+  // "offset", returning the number of buckets through "num_buckets"
+  // and the number of elements through "num_elements".
+  bool ReadTableSize(int64_t offset, int32_t *num_buckets,
+                     int64_t *num_elements) const;
+
+  // Returns through "positions" the positions of the elements in the
+  // bucket that "key" belongs to, of the hash table at "offset".
+  bool ReadChain(int64_t offset, int32_t num_buckets, uint64_t key,
+                 std::vector<int32_t> *positions) const;
+
+  std::string index_file_;
+  int fd_;
+  uint64_t generation_;
+  int64_t file_bytes_;
+  int64_t doctable_offset_;
+  int32_t doctable_buckets_;
+  int64_t wordtable_offset_;
+  int32_t wordtable_buckets_;
+  int64_t num_words_;
+
+  uint32_t header_checksum_;
+  bool word_positions_;
+  bool validate_;
+  uint32_t block_bytes_;
+  std::vector<uint32_t> block_crcs_;
+  // For each block: 0 if it hasn't been checked yet (or couldn't be
+  // read), 1 if it matches its checksum, and 2 if it doesn't.
+  std::unique_ptr<std::atomic<uint8_t>[]> block_states_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_INDEXREADER_H_
@@ -0,0 +1,412 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./libhw3/LayoutStructs.h"
+
+#include "./Checksum.h"
+#include "./FlatHashTable.h"
+#include "./IndexReader.h"
+#include "./IndexWriter.h"
+#include "./ThreadPool.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// The index file is built in one buffer aligned to this, so that it
+// is written a page at a time.
+static const size_t kFileAlign = 4096;
+
+// The file is written in chunks of about this many bytes, each by
+// one thread with one pwrite().
+static const size_t kWriteChunkBytes = 1 << 20;
+
+// WriteIndexFile() writes this many documents or words at a time on
+// each thread.
+static const size_t kWriteBatch = 64;
+
+// A document that a word is in, and the word's positions in it.
+typedef std::pair<uint64_t, const vector<int32_t> *> Posting;
+
+// A word, its IndexWordKey(), and its postings in docID order.  Words
+// are found by their keys, so "next" chains the (rare) words whose
+// keys are the same.
+struct WordPostings {
+  string word;
+  uint64_t key;
+  vector<Posting> postings;
+  size_t next;
+};
+
+// The end of a chain of WordPostings.
+static const size_t kNoWord = SIZE_MAX;
+
+namespace {
+
+// Where a hash table's parts go in the file, as hw3's WriteIndex lays
+// them out: at "base", a BucketListHeader and a BucketRecord per
+// bucket, then each bucket's chain, an ElementPositionRecord per
+// element followed by the elements, in bucket order.
+struct TableLayout {
+  int64_t base;
+  int64_t bytes;
+  int32_t num_buckets;
+  // The elements (by index) of bucket b are order[starts[b]] to
+  // order[starts[b + 1] - 1], in the order they were given, and its
+  // ElementPositionRecords are at chain_offsets[b].
+  vector<uint32_t> starts;
+  vector<uint32_t> order;
+  vector<int64_t> chain_offsets;
+  // Each element's offset, by index.
+  vector<int64_t> offsets;
+  // Each element's bucket, by index, while laying them out.
+  vector<uint32_t> buckets;
+};
+
+}  // namespace
+
+// Writes "record" at "at", in its disk format.
+template <typename T>
+static void Store(T record, char *at) {
+  record.toDiskFormat();
+  memcpy(at, &record, sizeof(record));
+}
+
+// Lays out "layout", a hash table at file offset "base" with
+// "num_buckets" buckets (or one per element, if it is zero), of
+// "num_elements" elements; element i has key "key(i)" and takes
+// "size(i)" bytes.
+template <typename KeyFn, typename SizeFn>
+static void LayOutTable(int64_t base, int num_buckets, size_t num_elements,
+                        KeyFn key, SizeFn size, TableLayout *layout) {
+  if (num_buckets == 0)
+    num_buckets = std::max<size_t>(num_elements, 1);
+  layout->base = base;
+  layout->num_buckets = num_buckets;
+
+  // The elements are sorted by bucket by counting them, which keeps
+  // them in order within each bucket.
+  vector<uint32_t> &starts = layout->starts;
+  starts.assign(num_buckets + 1, 0);
+  layout->buckets.resize(num_elements);
+  for (size_t i = 0; i < num_elements; i++) {
+    layout->buckets[i] = key(i) % num_buckets;
+    starts[layout->buckets[i] + 1]++;
+  }
+  for (int b = 0; b < num_buckets; b++)
+    starts[b + 1] += starts[b];
+  layout->order.resize(num_elements);
+  for (size_t i = 0; i < num_elements; i++)
+    layout->order[starts[layout->buckets[i]]++] = i;
+  // Each start was advanced to the next bucket's.
+  for (int b = num_buckets - 1; b > 0; b--)
+    starts[b] = starts[b - 1];
+  starts[0] = 0;
+
+  layout->chain_offsets.resize(num_buckets);
+  layout->offsets.resize(num_elements);
+  int64_t offset = base + sizeof(hw3::BucketListHeader) +
+    num_buckets * sizeof(hw3::BucketRecord);
+  for (int b = 0; b < num_buckets; b++) {
+    layout->chain_offsets[b] = offset;
+    offset += (starts[b + 1] - starts[b]) *
+      sizeof(hw3::ElementPositionRecord);
+    for (uint32_t k = starts[b]; k < starts[b + 1]; k++) {
+      layout->offsets[layout->order[k]] = offset;
+      offset += size(layout->order[k]);
+    }
+  }
+  layout->bytes = offset - base;
+}
+
+// Writes the parts of the hash table "layout" but its elements into
+// "file", the bytes of the whole file.
+static void WriteTable(const TableLayout &layout, char *file) {
+  char *at = file + layout.base;
+  Store(hw3::BucketListHeader(layout.num_buckets), at);
+  at += sizeof(hw3::BucketListHeader);
+  for (int b = 0; b < layout.num_buckets; b++) {
+    uint32_t start = layout.starts[b], end = layout.starts[b + 1];
+    Store(hw3::BucketRecord(end - start, layout.chain_offsets[b]), at);
+    at += sizeof(hw3::BucketRecord);
+    char *chain = file + layout.chain_offsets[b];
+    for (uint32_t k = start; k < end; k++) {
+      Store(hw3::ElementPositionRecord(layout.offsets[layout.order[k]]),
+            chain);
+      chain += sizeof(hw3::ElementPositionRecord);
+    }
+  }
+}
+
+static int64_t PostingBytes(const Posting &posting) {
+  return sizeof(hw3::DocIDElementHeader) +
+    posting.second->size() * sizeof(hw3::DocIDElementPosition);
+}
+
+// Returns the bytes of the element of "word" in the index, whose
+// docID table has "num_buckets" buckets (or one per document).
+static int64_t WordBytes(const WordPostings &word, int num_buckets) {
+  const vector<Posting> &postings = word.postings;
+  if (num_buckets == 0)
+    num_buckets = std::max<size_t>(postings.size(), 1);
+  int64_t bytes = sizeof(hw3::WordPostingsHeader) + word.word.size() +
+    sizeof(hw3::BucketListHeader) + num_buckets * sizeof(hw3::BucketRecord) +
+    postings.size() * sizeof(hw3::ElementPositionRecord);
+  for (const Posting &posting : postings)
+    bytes += PostingBytes(posting);
+  return bytes;
+}
+
+// Writes the element of "word" at "offset" in "file", laying out its
+// docID table in "table".
+static void WriteWord(const WordPostings &word, int64_t offset,
+                      int num_buckets, TableLayout *table, char *file) {
+  const vector<Posting> &postings = word.postings;
+  LayOutTable(offset + sizeof(hw3::WordPostingsHeader) + word.word.size(),
+              num_buckets, postings.size(),
+              [&postings](size_t i) { return postings[i].first; },
+              [&postings](size_t i) { return PostingBytes(postings[i]); },
+              table);
+  char *at = file + offset;
+  Store(hw3::WordPostingsHeader(word.word.size(), table->bytes), at);
+  memcpy(at + sizeof(hw3::WordPostingsHeader), word.word.data(),
+         word.word.size());
+  WriteTable(*table, file);
+  for (size_t i = 0; i < postings.size(); i++) {
+    at = file + table->offsets[i];
+    const vector<int32_t> &positions = *postings[i].second;
+    Store(hw3::DocIDElementHeader(postings[i].first, positions.size()), at);
+    at += sizeof(hw3::DocIDElementHeader);
+    for (int32_t position : positions) {
+      Store(hw3::DocIDElementPosition(position), at);
+      at += sizeof(hw3::DocIDElementPosition);
+    }
+  }
+}
+
+// Writes the "len" bytes at "data" to "fd" at "offset".
+static bool WriteAt(int fd, const char *data, size_t len, int64_t offset) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t res = pwrite(fd, data + done, len - done, offset + done);
+    if (res == -1 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return false;
+    done += res;
+  }
+  return true;
+}
+
+// Opens the temporary file that "path" is written to atomically,
+// returning its name through "tmp".  Returns -1 if it can't.
+static int OpenTemporary(const string &path, string *tmp) {
+  *tmp = path + ".tmp";
+  return open(tmp->c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+// Finishes writing "path": if "ok", syncs and closes "fd", the
+// temporary file "tmp", and renames it over "path"; and otherwise (or
+// if that fails) removes it.  Returns false if "path" wasn't replaced.
+static bool CommitTemporary(int fd, const string &tmp, const string &path,
+                            bool ok) {
+  ok = ok && fsync(fd) == 0;
+  ok = close(fd) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+IndexDocument MakeIndexDocument(const string &name,
+                                const vector<string> &words) {
+  IndexDocument doc;
+  doc.name = name;
+  for (size_t i = 0; i < words.size(); i++)
+    doc.words[words[i]].push_back(i);
+  return doc;
+}
+
+bool WriteFileAtomically(const string &path, const string &bytes) {
+  string tmp;
+  int fd = OpenTemporary(path, &tmp);
+  if (fd == -1)
+    return false;
+  return CommitTemporary(fd, tmp, path,
+                         WriteAt(fd, bytes.data(), bytes.size(), 0));
+}
+
+bool WriteIndexFile(const string &index_file,
+                    const vector<IndexDocument> &docs, int num_buckets,
+                    uint32_t checksum_block_bytes) {
+  // Each word's postings, with the first of the words with each key.
+  vector<WordPostings> postings;
+  FlatHashTable<size_t> word_table;
+  for (size_t d = 0; d < docs.size(); d++) {
+    for (const auto &word : docs[d].words) {
+      uint64_t key = IndexWordKey(word.first);
+      size_t *first = word_table.Lookup(key);
+      size_t w = first == nullptr ? kNoWord : *first;
+      while (w != kNoWord && postings[w].word != word.first)
+        w = postings[w].next;
+      if (w == kNoWord) {
+        w = postings.size();
+        postings.push_back({word.first, key, {}, first ? *first : kNoWord});
+        size_t unused;
+        if (first != nullptr)
+          *first = w;
+        else
+          word_table.Insert(key, w, &unused);
+      }
+      postings[w].postings.push_back({d + 1, &word.second});
+    }
+  }
+  vector<const WordPostings *> words;
+  words.reserve(postings.size());
+  for (const WordPostings &word : postings)
+    words.push_back(&word);
+  std::sort(words.begin(), words.end(),
+            [](const WordPostings *a, const WordPostings *b) {
+              return a->word < b->word;
+            });
+
+  // First, where everything goes, so that the documents and words can
+  // then be written in any order.
+  TableLayout doctable, index;
+  int64_t base = sizeof(hw3::IndexFileHeader);
+  LayOutTable(base, num_buckets, docs.size(),
+              [](size_t i) { return i + 1; },
+              [&docs](size_t i) {
+                return sizeof(hw3::DoctableElementHeader) +
+                  docs[i].name.size();
+              },
+              &doctable);
+  LayOutTable(base + doctable.bytes, num_buckets, words.size(),
+              [&words](size_t i) { return words[i]->key; },
+              [&words, num_buckets](size_t i) {
+                return WordBytes(*words[i], num_buckets);
+              },
+              &index);
+  size_t sections_bytes = base + doctable.bytes + index.bytes;
+  size_t num_blocks = checksum_block_bytes == 0 ? 0 :
+    (sections_bytes + checksum_block_bytes - 1) / checksum_block_bytes;
+  size_t file_bytes = sections_bytes + num_blocks * sizeof(uint32_t) +
+    sizeof(ChecksumTrailer);
+
+  std::unique_ptr<char, decltype(&free)> file(
+    static_cast<char *>(aligned_alloc(
+      kFileAlign, (file_bytes + kFileAlign - 1) & ~(kFileAlign - 1))),
+    &free);
+  if (file == nullptr)
+    return false;
+  WriteTable(doctable, file.get());
+  WriteTable(index, file.get());
+
+  // Then the documents and words, on every core.
+  int num_threads = std::max<int64_t>(sysconf(_SC_NPROCESSORS_ONLN), 1);
+  char *data = file.get();
+  ParallelFor(docs.size() + words.size(), kWriteBatch, num_threads,
+              [&](size_t begin, size_t end) {
+                TableLayout table;  // of each word's docIDs, in turn
+                for (size_t i = begin; i < end; i++) {
+                  if (i < docs.size()) {
+                    const string &name = docs[i].name;
+                    char *at = data + doctable.offsets[i];
+                    Store(hw3::DoctableElementHeader(i + 1, name.size()), at);
+                    memcpy(at + sizeof(hw3::DoctableElementHeader),
+                           name.data(), name.size());
+                  } else {
+                    size_t w = i - docs.size();
+                    WriteWord(*words[w], index.offsets[w], num_buckets,
+                              &table, data);
+                  }
+                }
+              });
+
+  // Then the file is written a chunk at a time, on every core, and
+  // each chunk's checksums are computed as it is.  The header and its
+  // chunk come last, once the checksum of all of the sections (which
+  // the header has, and which its block checksum covers) is known.
+  string tmp;
+  int fd = OpenTemporary(index_file, &tmp);
+  if (fd == -1)
+    return false;
+  size_t chunk_bytes = kWriteChunkBytes;
+  if (checksum_block_bytes > 0) {
+    chunk_bytes = std::max<size_t>(
+      chunk_bytes / checksum_block_bytes, 1) * checksum_block_bytes;
+  }
+  size_t num_chunks = (sections_bytes + chunk_bytes - 1) / chunk_bytes;
+  vector<uint32_t> chunk_crcs(num_chunks), block_crcs(num_blocks);
+  // Computes the block checksums of the chunk at "start", of "len"
+  // bytes.
+  auto ChecksumBlocks = [&](size_t start, size_t len) {
+    vector<uint32_t> crcs;
+    ComputeBlockChecksums(data + start, len, checksum_block_bytes, 1, &crcs);
+    std::copy(crcs.begin(), crcs.end(),
+              block_crcs.begin() + start / checksum_block_bytes);
+  };
+  std::atomic<bool> ok(true);
+  ParallelFor(num_chunks, 1, num_threads, [&](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; c++) {
+      size_t start = c * chunk_bytes;
+      size_t len = std::min(chunk_bytes, sections_bytes - start);
+      // The header isn't part of the sections.
+      size_t skip = c == 0 ? base : 0;
+      chunk_crcs[c] = Crc32(data + start + skip, len - skip);
+      if (c == 0)
+        continue;
+      if (checksum_block_bytes > 0)
+        ChecksumBlocks(start, len);
+      if (!WriteAt(fd, data + start, len, start))
+        ok = false;
+    }
+  });
+
+  uint32_t checksum = chunk_crcs[0];
+  for (size_t c = 1; c < num_chunks; c++) {
+    checksum = Crc32Combine(
+      checksum, chunk_crcs[c],
+      std::min(chunk_bytes, sections_bytes - c * chunk_bytes));
+  }
+  Store(hw3::IndexFileHeader(hw3::kMagicNumber, checksum, doctable.bytes,
+                             index.bytes), data);
+  size_t first_bytes = std::min(chunk_bytes, sections_bytes);
+  if (checksum_block_bytes > 0)
+    ChecksumBlocks(0, first_bytes);
+  string trailer = EncodeBlockChecksums(block_crcs, checksum_block_bytes,
+                                        kTrailerWordPositions);
+  memcpy(data + sections_bytes, trailer.data(), trailer.size());
+  return CommitTemporary(
+    fd, tmp, index_file,
+    ok && WriteAt(fd, data, first_bytes, 0) &&
+    WriteAt(fd, data + sections_bytes, file_bytes - sections_bytes,
+            sections_bytes));
+}
+
+}  // namespace hw4
@@ -0,0 +1,65 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_INDEXWRITER_H_
+#define HW4_INDEXWRITER_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "./Checksum.h"
+
+namespace hw4 {
+
+// A document to write to an index file: its name, and each of its
+// words with the word's positions in it, in increasing order.
+struct IndexDocument {
+  std::string name;
+  std::map<std::string, std::vector<int32_t>> words;
+};
+
+// Returns the IndexDocument named "name" of "words", in order; each
+// word's positions are its indices in "words".
+IndexDocument MakeIndexDocument(const std::string &name,
+                                const std::vector<std::string> &words);
+
+// Writes the index file "index_file" of "docs", in the layout of
+// hw3's WriteIndex, header checksum and all.  The documents get docIDs
+// 1, 2, and so on, in order.  Every hash table has "num_buckets"
+// buckets, or, if it is zero, as many as it has elements.  The file
+// ends with a trailer (see Checksum.h), which only IndexReader reads,
+// and which tells it that the positions of "docs" are word indices, as
+// MakeIndexDocument()'s are (see IndexReader::has_word_positions());
+// before it is the CRC-32C of every "checksum_block_bytes" bytes, or,
+// if that is zero, nothing.  Without its trailer, the file is what
+// hw3 would write.  The file is laid out first, in memory, and filled
+// in on every core; its chunks are then checksummed and written on
+// every core too, but for the first, which has the header.  It
+// replaces "index_file" atomically, as WriteFileAtomically() does.
+// Returns false (leaving "index_file" as it was) if it couldn't be
+// written.
+bool WriteIndexFile(const std::string &index_file,
+                    const std::vector<IndexDocument> &docs,
+                    int num_buckets = 0,
+                    uint32_t checksum_block_bytes = kChecksumBlockBytes);
+
+// Writes "bytes" to "path" by writing them to a temporary file, syncing
+// it, and renaming it over "path", so that whoever opens "path" gets
+// either all of the old bytes or all of the new ones.  Returns false
+// (leaving "path" as it was) if they couldn't be written.
+bool WriteFileAtomically(const std::string &path, const std::string &bytes);
+
+}  // namespace hw4
+
+#endif  // HW4_INDEXWRITER_H_
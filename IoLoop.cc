@@ -0,0 +1,1032 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+#include "./IoLoop.h"
+
+namespace hw4 {
+
+// static
+const size_t IoLoop::kRecvBufferSize = 16384;
+
+///////////////////////////////////////////////////////////////////////////////
+// The parts common to both implementations
+///////////////////////////////////////////////////////////////////////////////
+namespace {
+
+// A started operation.  Ops are recycled through a free list, and
+// the live ones are chained together so that Cancel() can find them.
+struct Op {
+  enum Kind { kAccept, kRecv, kSend, kPollIn, kRead, kOpenAt, kStatx };
+
+  Kind kind;
+  int fd;
+  bool multishot;
+  bool cancelled;
+  IoLoop::Callback cb;
+  IoLoop::RecvCallback recv_cb;
+
+  // The arguments of the operation.
+  const char *path;
+  char *buf;
+  size_t len;
+  off_t offset;
+  int flags;
+  struct statx *stx;
+
+  // For the epoll implementation: the result of a completed file
+  // operation or cancellation.
+  int result;
+
+  Op *prev, *next;
+};
+
+// The free and live Ops of one IoLoop.
+class OpList {
+ public:
+  OpList() : live_(nullptr) { }
+  ~OpList() {
+    while (live_ != nullptr)
+      Free(live_);
+    for (Op *op : free_)
+      delete op;
+  }
+
+  Op *New(Op::Kind kind, int fd) {
+    Op *op;
+    if (free_.empty()) {
+      op = new Op;
+    } else {
+      op = free_.back();
+      free_.pop_back();
+    }
+    op->kind = kind;
+    op->fd = fd;
+    op->multishot = false;
+    op->cancelled = false;
+    op->result = 0;
+    op->prev = nullptr;
+    op->next = live_;
+    if (live_ != nullptr)
+      live_->prev = op;
+    live_ = op;
+    return op;
+  }
+
+  void Free(Op *op) {
+    if (op->prev != nullptr)
+      op->prev->next = op->next;
+    else
+      live_ = op->next;
+    if (op->next != nullptr)
+      op->next->prev = op->prev;
+    // Drop whatever the callbacks captured now, not when reused.
+    op->cb = nullptr;
+    op->recv_cb = nullptr;
+    free_.push_back(op);
+  }
+
+  // Marks the live operations on "fd" cancelled.
+  void MarkCancelled(int fd) {
+    for (Op *op = live_; op != nullptr; op = op->next) {
+      if (op->fd == fd)
+        op->cancelled = true;
+    }
+  }
+
+ private:
+  Op *live_;
+  std::vector<Op *> free_;
+};
+
+// True if accept() failing with "err" only means that one connection
+// was lost, not that accepting is hopeless.
+bool IsTransientAcceptError(int err) {
+  return err == EAGAIN || err == EWOULDBLOCK || err == EINTR ||
+         err == ECONNABORTED || err == EPROTO;
+}
+
+}  // namespace
+
+IoLoop::IoLoop() : wake_fd_(-1) {
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+}
+
+IoLoop::~IoLoop() {
+  if (wake_fd_ != -1)
+    close(wake_fd_);
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+bool IoLoop::Init() {
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ == -1)
+    return false;
+  PollIn(wake_fd_, [this](int result) { RunPosted(result); });
+  return true;
+}
+
+void IoLoop::Post(std::function<void()> fn) {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  posted_.push_back(std::move(fn));
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  uint64_t one = 1;
+  while (write(wake_fd_, &one, sizeof(one)) == -1 && errno == EINTR) { }
+}
+
+void IoLoop::RunPosted(int result) {
+  if (result == -ECANCELED)
+    return;
+  uint64_t count;
+  while (read(wake_fd_, &count, sizeof(count)) == -1 && errno == EINTR) { }
+
+  std::vector<std::function<void()>> fns;
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  fns.swap(posted_);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  for (auto &fn : fns)
+    fn();
+  PollIn(wake_fd_, [this](int result) { RunPosted(result); });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// io_uring
+///////////////////////////////////////////////////////////////////////////////
+namespace {
+
+// glibc has no wrappers for the io_uring system calls.
+int IoUringSetup(unsigned entries, struct io_uring_params *p) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+int IoUringEnter(int fd, unsigned to_submit, unsigned min_complete,
+                 unsigned flags, const void *arg, size_t argsz) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, arg, argsz));
+}
+
+int IoUringRegister(int fd, unsigned opcode, const void *arg,
+                    unsigned nr_args) {
+  return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg,
+                                  nr_args));
+}
+
+class UringLoop : public IoLoop {
+ public:
+  UringLoop();
+  ~UringLoop() override;
+
+  // Sets up the ring.  Returns false if the kernel doesn't support
+  // what we need.
+  bool Setup();
+
+  const char *name() const override { return "io_uring"; }
+
+  void Accept(int listen_fd, Callback cb) override;
+  void Recv(int fd, bool multishot, RecvCallback cb) override;
+  void Send(int fd, const char *data, size_t len, Callback cb) override;
+  void PollIn(int fd, Callback cb) override;
+  void Read(int fd, char *buf, size_t len, off_t offset,
+            Callback cb) override;
+  void OpenAt(int dirfd, const char *path, int flags, Callback cb) override;
+  void Statx(int dirfd, const char *path, unsigned int mask,
+             struct statx *stx, Callback cb) override;
+  void Cancel(int fd) override;
+  int RunOnce(int timeout_ms) override;
+
+ private:
+  // Queues the submission for "op", which is (re)starting.
+  void Submit(Op *op);
+
+  // Returns a zeroed submission queue entry, first submitting the
+  // queue if it is full.
+  struct io_uring_sqe *GetSqe();
+
+  // Submits the queued entries, and, if "wait", waits up to
+  // "timeout_ms" for a completion.  Returns false on error.
+  bool Enter(bool wait, int timeout_ms);
+
+  // Handles the completions that have arrived.  Returns how many
+  // callbacks were called.
+  int Reap();
+  int Complete(Op *op, int res, uint32_t flags);
+
+  // Gives recv buffer "bid" back to the kernel.
+  void ProvideBuffer(uint16_t bid);
+
+  static const unsigned kEntries;
+  static const unsigned kNumRecvBuffers;
+  static const uint16_t kBufferGroup;
+
+  int ring_fd_;
+
+  // The shared rings, as mmap()ed.
+  void *ring_;
+  size_t ring_size_;
+  struct io_uring_sqe *sqes_;
+  size_t sqes_size_;
+
+  // Pointers into ring_.
+  unsigned *sq_head_, *sq_tail_, *sq_mask_, *sq_entries_;
+  unsigned *cq_head_, *cq_tail_, *cq_mask_;
+  struct io_uring_cqe *cqes_;
+
+  // The registered recv buffers, and the ring through which the
+  // kernel is told which are free.
+  struct io_uring_buf_ring *buf_ring_;
+  size_t buf_ring_size_;
+  char *recv_buffers_;
+  uint16_t buf_tail_;
+
+  // Cleared if the kernel turns out not to do multishot receives
+  // (they arrived after multishot accepts), in which case they are
+  // restarted after each completion instead.
+  bool multishot_accept_;
+  bool multishot_recv_;
+
+  OpList ops_;
+};
+
+// static
+const unsigned UringLoop::kEntries = 256;
+// static
+const unsigned UringLoop::kNumRecvBuffers = 128;
+// static
+const uint16_t UringLoop::kBufferGroup = 0;
+
+UringLoop::UringLoop()
+  : ring_fd_(-1), ring_(MAP_FAILED), ring_size_(0), sqes_(nullptr),
+    sqes_size_(0), buf_ring_(nullptr), buf_ring_size_(0),
+    recv_buffers_(nullptr), buf_tail_(0), multishot_accept_(true),
+    multishot_recv_(true) { }
+
+UringLoop::~UringLoop() {
+  // Closing the ring cancels whatever is still in flight.
+  if (ring_fd_ != -1)
+    close(ring_fd_);
+  if (sqes_ != nullptr)
+    munmap(sqes_, sqes_size_);
+  if (ring_ != MAP_FAILED)
+    munmap(ring_, ring_size_);
+  if (buf_ring_ != nullptr)
+    munmap(buf_ring_, buf_ring_size_);
+  delete[] recv_buffers_;
+}
+
+bool UringLoop::Setup() {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  p.flags = IORING_SETUP_CLAMP;
+  ring_fd_ = IoUringSetup(kEntries, &p);
+  if (ring_fd_ == -1)
+    return false;  // e.g., ENOSYS, or EPERM under a seccomp filter
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+      !(p.features & IORING_FEAT_NODROP) ||
+      !(p.features & IORING_FEAT_EXT_ARG))
+    return false;
+
+  // The submission and completion rings share one mapping.
+  size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  ring_size_ = sq_size > cq_size ? sq_size : cq_size;
+  ring_ = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (ring_ == MAP_FAILED)
+    return false;
+  sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+  void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+    return false;
+  sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+
+  char *base = static_cast<char *>(ring_);
+  sq_head_ = reinterpret_cast<unsigned *>(base + p.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned *>(base + p.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned *>(base + p.sq_off.ring_mask);
+  sq_entries_ = reinterpret_cast<unsigned *>(base + p.sq_off.ring_entries);
+  cq_head_ = reinterpret_cast<unsigned *>(base + p.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(base + p.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned *>(base + p.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<struct io_uring_cqe *>(base + p.cq_off.cqes);
+
+  // Submission queue entries are used in order, so the indirection
+  // array maps each slot to itself.
+  unsigned *array = reinterpret_cast<unsigned *>(base + p.sq_off.array);
+  for (unsigned i = 0; i < p.sq_entries; i++)
+    array[i] = i;
+
+  // Every operation we use has to be there.
+  size_t probe_size = sizeof(struct io_uring_probe) +
+                      256 * sizeof(struct io_uring_probe_op);
+  std::unique_ptr<char[]> probe_mem(new char[probe_size]);
+  memset(probe_mem.get(), 0, probe_size);
+  struct io_uring_probe *probe =
+    reinterpret_cast<struct io_uring_probe *>(probe_mem.get());
+  if (IoUringRegister(ring_fd_, IORING_REGISTER_PROBE, probe, 256) == -1)
+    return false;
+  for (int op : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND,
+                 IORING_OP_POLL_ADD, IORING_OP_READ, IORING_OP_OPENAT,
+                 IORING_OP_STATX, IORING_OP_ASYNC_CANCEL}) {
+    if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+      return false;
+  }
+
+  // Register the recv buffers.  Kernels that can do this (5.19 and
+  // later) can also do multishot accepts and cancel by descriptor.
+  buf_ring_size_ = kNumRecvBuffers * sizeof(struct io_uring_buf);
+  void *buf_ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf_ring == MAP_FAILED)
+    return false;
+  buf_ring_ = static_cast<struct io_uring_buf_ring *>(buf_ring);
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+  reg.ring_entries = kNumRecvBuffers;
+  reg.bgid = kBufferGroup;
+  if (IoUringRegister(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    return false;
+  recv_buffers_ = new char[kNumRecvBuffers * kRecvBufferSize];
+  for (unsigned bid = 0; bid < kNumRecvBuffers; bid++)
+    ProvideBuffer(bid);
+
+  return Init();
+}
+
+void UringLoop::ProvideBuffer(uint16_t bid) {
+  // Not buf_ring_->bufs[], which the kernel's header gets wrong for
+  // C++: an empty struct takes up space there, unlike in C.
+  struct io_uring_buf *buf = reinterpret_cast<struct io_uring_buf *>(
+    buf_ring_) + (buf_tail_ & (kNumRecvBuffers - 1));
+  buf->addr = reinterpret_cast<uint64_t>(recv_buffers_ +
+                                         bid * kRecvBufferSize);
+  buf->len = kRecvBufferSize;
+  buf->bid = bid;
+  buf_tail_++;
+  __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe *UringLoop::GetSqe() {
+  unsigned tail = *sq_tail_;
+  if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == *sq_entries_) {
+    Enter(false, 0);
+    tail = *sq_tail_;
+  }
+  struct io_uring_sqe *sqe = &sqes_[tail & *sq_mask_];
+  memset(sqe, 0, sizeof(*sqe));
+  // The kernel only looks at the tail when we enter, by which time
+  // the entry is filled in.
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  return sqe;
+}
+
+void UringLoop::Submit(Op *op) {
+  struct io_uring_sqe *sqe = GetSqe();
+  sqe->fd = op->fd;
+  sqe->user_data = reinterpret_cast<uint64_t>(op);
+  switch (op->kind) {
+    case Op::kAccept:
+      sqe->opcode = IORING_OP_ACCEPT;
+      sqe->accept_flags = SOCK_CLOEXEC;
+      if (multishot_accept_)
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+      break;
+    case Op::kRecv:
+      sqe->opcode = IORING_OP_RECV;
+      sqe->flags = IOSQE_BUFFER_SELECT;
+      sqe->buf_group = kBufferGroup;
+      if (op->multishot && multishot_recv_)
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+      break;
+    case Op::kSend:
+      sqe->opcode = IORING_OP_SEND;
+      sqe->addr = reinterpret_cast<uint64_t>(op->buf);
+      sqe->len = op->len;
+      sqe->msg_flags = MSG_NOSIGNAL;
+      break;
+    case Op::kPollIn:
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->poll32_events = POLLIN;
+      break;
+    case Op::kRead:
+      sqe->opcode = IORING_OP_READ;
+      sqe->addr = reinterpret_cast<uint64_t>(op->buf);
+      sqe->len = op->len;
+      sqe->off = op->offset;
+      break;
+    case Op::kOpenAt:
+      sqe->opcode = IORING_OP_OPENAT;
+      sqe->addr = reinterpret_cast<uint64_t>(op->path);
+      sqe->open_flags = op->flags;
+      break;
+    case Op::kStatx:
+      sqe->opcode = IORING_OP_STATX;
+      sqe->addr = reinterpret_cast<uint64_t>(op->path);
+      sqe->len = op->flags;
+      sqe->off = reinterpret_cast<uint64_t>(op->stx);
+      break;
+  }
+}
+
+void UringLoop::Accept(int listen_fd, Callback cb) {
+  Op *op = ops_.New(Op::kAccept, listen_fd);
+  op->multishot = true;
+  op->cb = std::move(cb);
+  Submit(op);
+}
+
+void UringLoop::Recv(int fd, bool multishot, RecvCallback cb) {
+  Op *op = ops_.New(Op::kRecv, fd);
+  op->multishot = multishot;
+  op->recv_cb = std::move(cb);
+  Submit(op);
+}
+
+void UringLoop::Send(int fd, const char *data, size_t len, Callback cb) {
+  Op *op = ops_.New(Op::kSend, fd);
+  op->buf = const_cast<char *>(data);
+  op->len = len;
+  op->cb = std::move(cb);
+  Submit(op);
+}
+
+void UringLoop::PollIn(int fd, Callback cb) {
+  Op *op = ops_.New(Op::kPollIn, fd);
+  op->cb = std::move(cb);
+  Submit(op);
+}
+
+void UringLoop::Read(int fd, char *buf, size_t len, off_t offset,
+                     Callback cb) {
+  Op *op = ops_.New(Op::kRead, fd);
+  op->buf = buf;
+  op->len = len;
+  op->offset = offset;
+  op->cb = std::move(cb);
+  Submit(op);
+}
+
+void UringLoop::OpenAt(int dirfd, const char *path, int flags, Callback cb) {
+  Op *op = ops_.New(Op::kOpenAt, dirfd);
+  op->path = path;
+  op->flags = flags;
+  op->cb = std::move(cb);
+  Submit(op);
+}
+
+void UringLoop::Statx(int dirfd, const char *path, unsigned int mask,
+                      struct statx *stx, Callback cb) {
+  Op *op = ops_.New(Op::kStatx, dirfd);
+  op->path = path;
+  op->flags = mask;
+  op->stx = stx;
+  op->cb = std::move(cb);
+  Submit(op);
+}
+
+void UringLoop::Cancel(int fd) {
+  ops_.MarkCancelled(fd);
+  struct io_uring_sqe *sqe = GetSqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = fd;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+  sqe->user_data = 0;
+  // The kernel finds the operations to cancel by the file "fd" refers
+  // to when the cancellation is submitted, which has to happen before
+  // the caller closes it.
+  Enter(false, 0);
+}
+
+bool UringLoop::Enter(bool wait, int timeout_ms) {
+  unsigned to_submit = *sq_tail_ - __atomic_load_n(sq_head_,
+                                                   __ATOMIC_ACQUIRE);
+  if (to_submit == 0 && !wait)
+    return true;
+
+  unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  const void *argp = nullptr;
+  size_t argsz = 0;
+  if (wait && timeout_ms >= 0) {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    flags |= IORING_ENTER_EXT_ARG;
+    argp = &arg;
+    argsz = sizeof(arg);
+  }
+  if (IoUringEnter(ring_fd_, to_submit, wait ? 1 : 0, flags, argp,
+                   argsz) >= 0)
+    return true;
+  // Timing out or being interrupted just means there's nothing to
+  // reap yet, and EBUSY means the completion queue is full, which
+  // reaping fixes; anything queued is submitted next time.
+  return errno == ETIME || errno == EINTR || errno == EBUSY;
+}
+
+int UringLoop::RunOnce(int timeout_ms) {
+  // Anything already completed is handled without waiting, but what
+  // was queued still goes out in the same system call.
+  bool ready = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) != *cq_head_;
+  if (!Enter(!ready && timeout_ms != 0, timeout_ms))
+    return -1;
+  return Reap();
+}
+
+int UringLoop::Reap() {
+  int count = 0;
+  unsigned head = *cq_head_;
+  while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe *cqe = &cqes_[head & *cq_mask_];
+    uint64_t user_data = cqe->user_data;
+    int res = cqe->res;
+    uint32_t flags = cqe->flags;
+    head++;
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    if (user_data != 0)
+      count += Complete(reinterpret_cast<Op *>(user_data), res, flags);
+  }
+  return count;
+}
+
+int UringLoop::Complete(Op *op, int res, uint32_t flags) {
+  bool more = (flags & IORING_CQE_F_MORE) != 0;
+  bool has_buffer = (flags & IORING_CQE_F_BUFFER) != 0;
+  uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+
+  if (op->cancelled) {
+    // Whatever got in before the cancellation is dropped, and the
+    // callback just hears that the operation is over.
+    if (op->kind == Op::kAccept && res >= 0)
+      close(res);
+    if (has_buffer)
+      ProvideBuffer(bid);
+    if (more)
+      return 0;
+    if (op->kind == Op::kRecv)
+      op->recv_cb(-ECANCELED, std::string_view());
+    else
+      op->cb(-ECANCELED);
+    ops_.Free(op);
+    return 1;
+  }
+
+  switch (op->kind) {
+    case Op::kAccept: {
+      if (res == -EINVAL && multishot_accept_) {
+        multishot_accept_ = false;
+        Submit(op);
+        return 0;
+      }
+      // A multishot accept that stopped (or a single-shot one) is
+      // restarted, so that accepting only stops on Cancel() or a
+      // real error.
+      bool ok = res >= 0 || IsTransientAcceptError(-res);
+      if (ok && !more)
+        Submit(op);
+      if (res >= 0) {
+        op->cb(res);
+        return 1;
+      }
+      if (ok || more)
+        return 0;
+      op->cb(res);
+      ops_.Free(op);
+      return 1;
+    }
+
+    case Op::kRecv: {
+      if (res == -EINVAL && op->multishot && multishot_recv_) {
+        multishot_recv_ = false;
+        Submit(op);
+        return 0;
+      }
+      if (res == -ENOBUFS) {
+        // Every buffer is in use; try again once this batch of
+        // callbacks has given some back.
+        if (!more)
+          Submit(op);
+        return 0;
+      }
+      bool rearm = op->multishot && res > 0 && !more;
+      if (rearm)
+        Submit(op);
+      std::string_view data;
+      if (res > 0 && has_buffer)
+        data = std::string_view(recv_buffers_ + bid * kRecvBufferSize, res);
+      op->recv_cb(res, data);
+      if (has_buffer)
+        ProvideBuffer(bid);
+      if (!more && !rearm)
+        ops_.Free(op);
+      return 1;
+    }
+
+    case Op::kPollIn:
+      // The result is the events that happened, but all that matters
+      // is that one did.
+      op->cb(res < 0 ? res : 0);
+      ops_.Free(op);
+      return 1;
+
+    default:
+      // One-shot operations.
+      op->cb(res);
+      ops_.Free(op);
+      return 1;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// epoll
+///////////////////////////////////////////////////////////////////////////////
+class EpollLoop : public IoLoop {
+ public:
+  EpollLoop() : epoll_fd_(-1), recv_buffer_(new char[kRecvBufferSize]) { }
+  ~EpollLoop() override;
+
+  bool Setup();
+
+  const char *name() const override { return "epoll"; }
+
+  void Accept(int listen_fd, Callback cb) override;
+  void Recv(int fd, bool multishot, RecvCallback cb) override;
+  void Send(int fd, const char *data, size_t len, Callback cb) override;
+  void PollIn(int fd, Callback cb) override;
+  void Read(int fd, char *buf, size_t len, off_t offset,
+            Callback cb) override;
+  void OpenAt(int dirfd, const char *path, int flags, Callback cb) override;
+  void Statx(int dirfd, const char *path, unsigned int mask,
+             struct statx *stx, Callback cb) override;
+  void Cancel(int fd) override;
+  int RunOnce(int timeout_ms) override;
+
+ private:
+  // The operations waiting for a descriptor to become readable
+  // ("in", an Accept(), Recv() or PollIn()) or writable ("out", a
+  // Send()), and the events epoll is watching it for.
+  struct Watch {
+    Op *in = nullptr;
+    Op *out = nullptr;
+    uint32_t events = 0;
+  };
+
+  // Makes epoll watch "fd" for what its pending operations need.
+  void UpdateWatch(int fd);
+
+  // Stops "op" from waiting on its descriptor, since it's finishing.
+  void Detach(Op *op);
+
+  // Try "op" now that its descriptor is ready.  Each returns the
+  // number of callbacks called, and frees "op" if it is finished.
+  int TryIn(Op *op);
+  int TryOut(Op *op);
+
+  // Runs a Send(), file operation, or cancelled operation from ready_.
+  int RunReady(Op *op);
+
+  int epoll_fd_;
+  std::unordered_map<int, Watch> watches_;
+
+  // Operations to complete in the next RunOnce(): Send()s, which are
+  // tried right away, file operations, and cancellations.
+  std::deque<Op *> ready_;
+
+  std::unique_ptr<char[]> recv_buffer_;
+  OpList ops_;
+};
+
+EpollLoop::~EpollLoop() {
+  if (epoll_fd_ != -1)
+    close(epoll_fd_);
+}
+
+bool EpollLoop::Setup() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ == -1)
+    return false;
+  return Init();
+}
+
+void EpollLoop::UpdateWatch(int fd) {
+  auto it = watches_.find(fd);
+  if (it == watches_.end())
+    return;
+  Watch &w = it->second;
+  uint32_t events = (w.in != nullptr ? EPOLLIN : 0) |
+                    (w.out != nullptr ? EPOLLOUT : 0);
+  if (events == 0) {
+    if (w.events != 0)
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    watches_.erase(it);
+    return;
+  }
+  if (events == w.events)
+    return;
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  int op = w.events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+  if (epoll_ctl(epoll_fd_, op, fd, &ev) == -1) {
+    // e.g., a regular file, which epoll can't watch: fail whatever
+    // was waiting on it.
+    int err = errno;
+    if (w.events != 0)
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    for (Op *pending : {w.in, w.out}) {
+      if (pending != nullptr) {
+        pending->cancelled = true;
+        pending->result = -err;
+        ready_.push_back(pending);
+      }
+    }
+    watches_.erase(it);
+    return;
+  }
+  w.events = events;
+}
+
+void EpollLoop::Detach(Op *op) {
+  auto it = watches_.find(op->fd);
+  if (it == watches_.end())
+    return;
+  if (it->second.in == op)
+    it->second.in = nullptr;
+  if (it->second.out == op)
+    it->second.out = nullptr;
+}
+
+void EpollLoop::Accept(int listen_fd, Callback cb) {
+  // Accepting until EAGAIN needs a nonblocking socket.  (The sockets
+  // it returns are blocking, as the worker threads expect.)
+  int fl = fcntl(listen_fd, F_GETFL);
+  if (fl != -1)
+    fcntl(listen_fd, F_SETFL, fl | O_NONBLOCK);
+  Op *op = ops_.New(Op::kAccept, listen_fd);
+  op->multishot = true;
+  op->cb = std::move(cb);
+  watches_[listen_fd].in = op;
+  UpdateWatch(listen_fd);
+}
+
+void EpollLoop::Recv(int fd, bool multishot, RecvCallback cb) {
+  Op *op = ops_.New(Op::kRecv, fd);
+  op->multishot = multishot;
+  op->recv_cb = std::move(cb);
+  watches_[fd].in = op;
+  UpdateWatch(fd);
+}
+
+void EpollLoop::Send(int fd, const char *data, size_t len, Callback cb) {
+  Op *op = ops_.New(Op::kSend, fd);
+  op->buf = const_cast<char *>(data);
+  op->len = len;
+  op->cb = std::move(cb);
+  ready_.push_back(op);
+}
+
+void EpollLoop::PollIn(int fd, Callback cb) {
+  Op *op = ops_.New(Op::kPollIn, fd);
+  op->cb = std::move(cb);
+  watches_[fd].in = op;
+  UpdateWatch(fd);
+}
+
+void EpollLoop::Read(int fd, char *buf, size_t len, off_t offset,
+                     Callback cb) {
+  Op *op = ops_.New(Op::kRead, fd);
+  op->buf = buf;
+  op->len = len;
+  op->offset = offset;
+  op->cb = std::move(cb);
+  ready_.push_back(op);
+}
+
+void EpollLoop::OpenAt(int dirfd, const char *path, int flags, Callback cb) {
+  Op *op = ops_.New(Op::kOpenAt, dirfd);
+  op->path = path;
+  op->flags = flags;
+  op->cb = std::move(cb);
+  ready_.push_back(op);
+}
+
+void EpollLoop::Statx(int dirfd, const char *path, unsigned int mask,
+                      struct statx *stx, Callback cb) {
+  Op *op = ops_.New(Op::kStatx, dirfd);
+  op->path = path;
+  op->flags = mask;
+  op->stx = stx;
+  op->cb = std::move(cb);
+  ready_.push_back(op);
+}
+
+void EpollLoop::Cancel(int fd) {
+  // Send()s that haven't been tried yet are still in ready_.
+  for (Op *op : ready_) {
+    if (op->fd == fd && op->kind == Op::kSend && !op->cancelled) {
+      op->cancelled = true;
+      op->result = -ECANCELED;
+    }
+  }
+  auto it = watches_.find(fd);
+  if (it == watches_.end())
+    return;
+  for (Op *op : {it->second.in, it->second.out}) {
+    if (op != nullptr) {
+      op->cancelled = true;
+      op->result = -ECANCELED;
+      ready_.push_back(op);
+    }
+  }
+  if (it->second.events != 0)
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  watches_.erase(it);
+}
+
+int EpollLoop::RunReady(Op *op) {
+  if (op->cancelled) {
+    if (op->kind == Op::kRecv)
+      op->recv_cb(op->result, std::string_view());
+    else
+      op->cb(op->result);
+    ops_.Free(op);
+    return 1;
+  }
+
+  ssize_t res;
+  switch (op->kind) {
+    case Op::kSend: {
+      int count = TryOut(op);
+      if (count == 0) {
+        watches_[op->fd].out = op;
+        UpdateWatch(op->fd);
+      }
+      return count;
+    }
+    case Op::kRead:
+      do {
+        res = pread(op->fd, op->buf, op->len, op->offset);
+      } while (res == -1 && errno == EINTR);
+      break;
+    case Op::kOpenAt:
+      res = openat(op->fd, op->path, op->flags);
+      break;
+    case Op::kStatx:
+      res = statx(op->fd, op->path, 0, op->flags, op->stx);
+      break;
+    default:
+      res = -1;
+      errno = EINVAL;
+      break;
+  }
+  op->cb(res == -1 ? -errno : static_cast<int>(res));
+  ops_.Free(op);
+  return 1;
+}
+
+int EpollLoop::TryIn(Op *op) {
+  switch (op->kind) {
+    case Op::kAccept: {
+      // Take a bounded number, so other descriptors get a turn.
+      int count = 0;
+      for (int i = 0; i < 64 && !op->cancelled; i++) {
+        int fd = accept4(op->fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd == -1) {
+          if (IsTransientAcceptError(errno))
+            break;
+          int err = errno;
+          Detach(op);
+          op->cb(-err);
+          ops_.Free(op);
+          return count + 1;
+        }
+        op->cb(fd);
+        count++;
+      }
+      return count;
+    }
+    case Op::kRecv: {
+      ssize_t res = recv(op->fd, recv_buffer_.get(), kRecvBufferSize,
+                         MSG_DONTWAIT);
+      if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+                        errno == EINTR))
+        return 0;
+      int result = res == -1 ? -errno : static_cast<int>(res);
+      bool done = !op->multishot || result <= 0;
+      if (done)
+        Detach(op);
+      op->recv_cb(result, std::string_view(recv_buffer_.get(),
+                                           result > 0 ? result : 0));
+      // If the callback cancelled a multishot receive, it's in ready_
+      // waiting to be told.
+      if (done)
+        ops_.Free(op);
+      return 1;
+    }
+    case Op::kPollIn:
+      Detach(op);
+      op->cb(0);
+      ops_.Free(op);
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+int EpollLoop::TryOut(Op *op) {
+  ssize_t res = send(op->fd, op->buf, op->len, MSG_DONTWAIT | MSG_NOSIGNAL);
+  if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+                    errno == EINTR))
+    return 0;
+  Detach(op);
+  op->cb(res == -1 ? -errno : static_cast<int>(res));
+  ops_.Free(op);
+  return 1;
+}
+
+int EpollLoop::RunOnce(int timeout_ms) {
+  int count = 0;
+
+  // The operations started by these callbacks wait for the next call.
+  std::deque<Op *> ready;
+  ready.swap(ready_);
+  for (Op *op : ready)
+    count += RunReady(op);
+
+  static const int kMaxEvents = 64;
+  struct epoll_event events[kMaxEvents];
+  int n = epoll_wait(epoll_fd_, events, kMaxEvents,
+                     (count > 0 || !ready_.empty()) ? 0 : timeout_ms);
+  if (n == -1)
+    return errno == EINTR ? count : -1;
+
+  for (int i = 0; i < n; i++) {
+    int fd = events[i].data.fd;
+    bool in = events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP);
+    bool out = events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP);
+    // Earlier callbacks may have cancelled or replaced what's waiting.
+    auto it = watches_.find(fd);
+    if (in && it != watches_.end() && it->second.in != nullptr)
+      count += TryIn(it->second.in);
+    it = watches_.find(fd);
+    if (out && it != watches_.end() && it->second.out != nullptr)
+      count += TryOut(it->second.out);
+    UpdateWatch(fd);
+  }
+  return count;
+}
+
+}  // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// Picking one
+///////////////////////////////////////////////////////////////////////////////
+std::unique_ptr<IoLoop> IoLoop::Create(bool allow_uring) {
+  if (allow_uring) {
+    std::unique_ptr<UringLoop> uring(new UringLoop());
+    if (uring->Setup())
+      return uring;
+  }
+  std::unique_ptr<EpollLoop> epoll(new EpollLoop());
+  if (epoll->Setup())
+    return epoll;
+  return nullptr;
+}
+
+}  // namespace hw4
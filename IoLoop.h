@@ -0,0 +1,141 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_IOLOOP_H_
+#define HW4_IOLOOP_H_
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace hw4 {
+
+// An IoLoop carries out many I/O operations at once on one thread.
+// Operations are started by the methods below, which return right
+// away; RunOnce() then submits everything started since the last call
+// together, waits for some of it to finish, and calls the callbacks of
+// whatever has.  Callbacks are only ever called from RunOnce(), never
+// from the method that started the operation, and may start more
+// operations.  A callback's "result" is what the corresponding system
+// call would have returned, except that errors are -errno.
+//
+// There are two implementations, picked by Create() at run time:
+//
+// - io_uring, where the operations are queued in memory shared with
+//   the kernel and each RunOnce() is a single io_uring_enter() system
+//   call that both submits them and collects their completions.
+//   Accept() and multishot Recv() stay armed in the kernel, producing
+//   a completion per connection or per read without being started
+//   again, and Recv() reads into a pool of buffers registered with
+//   the kernel, which picks one only when data arrives; so a thousand
+//   idle connections don't tie up a thousand buffers.
+//
+// - epoll, for kernels without (a new enough) io_uring: sockets are
+//   watched with epoll_wait() and read or written when they're ready,
+//   and file operations, which epoll can't wait for, are simply done
+//   by RunOnce().
+//
+// Apart from Post(), an IoLoop must only be used by one thread.  At
+// most one Accept(), Recv() or PollIn(), and one Send(), may be
+// pending per file descriptor.
+class IoLoop {
+ public:
+  typedef std::function<void(int result)> Callback;
+
+  // "result" is the number of bytes received (the first "result"
+  // bytes of "data", which is only valid until the callback returns),
+  // 0 when the peer has hung up, or -errno.
+  typedef std::function<void(int result, std::string_view data)>
+    RecvCallback;
+
+  virtual ~IoLoop();
+
+  IoLoop(const IoLoop &) = delete;
+  IoLoop &operator=(const IoLoop &) = delete;
+
+  // Returns an io_uring IoLoop if the kernel supports everything it
+  // needs and "allow_uring" is true, and otherwise an epoll one, or
+  // nullptr if not even that could be set up.
+  static std::unique_ptr<IoLoop> Create(bool allow_uring = true);
+
+  // "io_uring" or "epoll".
+  virtual const char *name() const = 0;
+
+  // Accepts connections on the listening socket "listen_fd" until
+  // Cancel()ed, calling "cb" with each new socket.  A result of
+  // -errno means accepting has stopped.
+  virtual void Accept(int listen_fd, Callback cb) = 0;
+
+  // Receives from socket "fd" once, or, if "multishot", each time
+  // data arrives until Cancel()ed or the result is 0 or -errno.
+  // Receives are at most kRecvBufferSize bytes.
+  virtual void Recv(int fd, bool multishot, RecvCallback cb) = 0;
+
+  // Sends some of the "len" bytes at "data", which must stay valid
+  // until "cb" is called with how many were sent.
+  virtual void Send(int fd, const char *data, size_t len, Callback cb) = 0;
+
+  // Calls "cb" with 0 when "fd" becomes readable.
+  virtual void PollIn(int fd, Callback cb) = 0;
+
+  // Like pread(), openat() and statx(), whose arguments must stay
+  // valid until "cb" is called.
+  virtual void Read(int fd, char *buf, size_t len, off_t offset,
+                    Callback cb) = 0;
+  virtual void OpenAt(int dirfd, const char *path, int flags,
+                      Callback cb) = 0;
+  virtual void Statx(int dirfd, const char *path, unsigned int mask,
+                     struct statx *stx, Callback cb) = 0;
+
+  // Stops the pending Accept(), Recv() or PollIn() on "fd" (and any
+  // Send()), whose callbacks are then called with -ECANCELED unless
+  // they complete first.  Must be called before closing "fd" if any
+  // operation on it is pending.
+  virtual void Cancel(int fd) = 0;
+
+  // Submits the operations started since the last call, waits up to
+  // "timeout_ms" milliseconds (forever if negative) for at least one
+  // to complete, and calls the callbacks of all that have.  Returns
+  // the number of callbacks called, or -1 on error.
+  virtual int RunOnce(int timeout_ms) = 0;
+
+  // Arranges for "fn" to be called by RunOnce(), waking it if it's
+  // waiting.  Unlike the other methods, may be called from any thread.
+  void Post(std::function<void()> fn);
+
+  static const size_t kRecvBufferSize;
+
+ protected:
+  IoLoop();
+
+  // Finishes construction, once the subclass is ready to PollIn():
+  // starts watching for Post()s.  Returns false on failure.
+  bool Init();
+
+ private:
+  // Runs the posted functions, and watches for more.
+  void RunPosted(int result);
+
+  // An eventfd that Post() makes readable.
+  int wake_fd_;
+  pthread_mutex_t lock_;
+  std::vector<std::function<void()>> posted_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_IOLOOP_H_
@@ -0,0 +1,594 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./MimeTypes.h"
+
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+const char *kDefaultMimeType = "application/octet-stream";
+
+namespace {
+
+struct MimeEntry {
+  const char *ext;
+  const char *type;
+};
+
+// The built-in extension table.  It must stay sorted by extension
+// (byte order, all lowercase) since LookupMimeType() binary searches
+// it; the static_assert below checks that at compile time.
+constexpr MimeEntry kMimeTable[] = {
+  { "3dm", "text/vnd.in3d.3dml" },
+  { "3dml", "text/vnd.in3d.3dml" },
+  { "3g2", "video/3gpp2" },
+  { "3gp", "video/3gpp" },
+  { "3gpp", "video/3gpp" },
+  { "3gpp2", "video/3gpp2" },
+  { "726", "audio/32kadpcm" },
+  { "7z", "application/x-7z-compressed" },
+  { "a", "text/vnd.a" },
+  { "aa3", "audio/ATRAC3" },
+  { "aac", "audio/aac" },
+  { "aal", "audio/ATRAC-ADVANCED-LOSSLESS" },
+  { "abc", "text/vnd.abc" },
+  { "ac3", "audio/ac3" },
+  { "acn", "audio/asc" },
+  { "adts", "audio/aac" },
+  { "ai", "application/postscript" },
+  { "aif", "audio/x-aiff" },
+  { "aifc", "audio/x-aiff" },
+  { "aiff", "audio/x-aiff" },
+  { "amr", "audio/AMR" },
+  { "apng", "image/apng" },
+  { "appcache", "text/cache-manifest" },
+  { "ascii", "text/vnd.ascii-art" },
+  { "ass", "audio/aac" },
+  { "at3", "audio/ATRAC3" },
+  { "atom", "application/atom+xml" },
+  { "atx", "audio/ATRAC-X" },
+  { "au", "audio/basic" },
+  { "avci", "image/avci" },
+  { "avcs", "image/avcs" },
+  { "avi", "video/x-msvideo" },
+  { "avif", "image/avif" },
+  { "awb", "audio/AMR-WB" },
+  { "axa", "audio/annodex" },
+  { "axv", "video/annodex" },
+  { "azv", "image/vnd.airzip.accelerator.azv" },
+  { "b16", "image/vnd.pco.b16" },
+  { "bat", "text/plain" },
+  { "bcpio", "application/x-bcpio" },
+  { "bib", "text/x-bibtex" },
+  { "bik", "video/vnd.radgamettools.bink" },
+  { "bin", "application/octet-stream" },
+  { "bk2", "video/vnd.radgamettools.bink" },
+  { "bmp", "image/bmp" },
+  { "boo", "text/x-boo" },
+  { "brf", "text/plain" },
+  { "btf", "image/prs.btif" },
+  { "btif", "image/prs.btif" },
+  { "bz2", "application/x-bzip2" },
+  { "c", "text/x-csrc" },
+  { "cc", "text/x-c++src" },
+  { "ccc", "text/vnd.net2phone.commcenter.command" },
+  { "cdf", "application/x-netcdf" },
+  { "cgm", "image/cgm" },
+  { "cls", "text/x-tex" },
+  { "cnd", "text/jcr-cnd" },
+  { "copyright", "text/vnd.debian.copyright" },
+  { "cpio", "application/x-cpio" },
+  { "cpp", "text/x-c++src" },
+  { "cql", "text/cql" },
+  { "csd", "audio/csound" },
+  { "csh", "application/x-csh" },
+  { "css", "text/css" },
+  { "csv", "text/csv" },
+  { "csvs", "text/csv-schema" },
+  { "curl", "text/vnd.curl" },
+  { "d", "text/x-dsrc" },
+  { "deb", "application/vnd.debian.binary-package" },
+  { "dif", "video/dv" },
+  { "diff", "text/x-diff" },
+  { "djv", "image/vnd.djvu" },
+  { "djvu", "image/vnd.djvu" },
+  { "dll", "application/octet-stream" },
+  { "dls", "audio/dls" },
+  { "dms", "text/vnd.DMClientScript" },
+  { "doc", "application/msword" },
+  { "docx",
+    "application/vnd.openxmlformats-officedocument.wordprocessingml.document" },
+  { "dot", "text/vnd.graphviz" },
+  { "dpx", "image/dpx" },
+  { "drle", "image/dicom-rle" },
+  { "dsc", "text/prs.lines.tag" },
+  { "dts", "audio/vnd.dts" },
+  { "dtshd", "audio/vnd.dts.hd" },
+  { "dv", "video/dv" },
+  { "dvb", "video/vnd.dvb.file" },
+  { "dvi", "application/x-dvi" },
+  { "dwg", "image/vnd.dwg" },
+  { "dxf", "image/vnd.dxf" },
+  { "ecelp4800", "audio/vnd.nuera.ecelp4800" },
+  { "ecelp7470", "audio/vnd.nuera.ecelp7470" },
+  { "ecelp9600", "audio/vnd.nuera.ecelp9600" },
+  { "emf", "image/emf" },
+  { "eml", "message/rfc822" },
+  { "enw", "audio/EVRCNW" },
+  { "eol", "audio/vnd.digital-winds" },
+  { "eot", "application/vnd.ms-fontobject" },
+  { "eps", "application/postscript" },
+  { "epub", "application/epub+zip" },
+  { "es", "text/javascript" },
+  { "etx", "text/x-setext" },
+  { "evb", "audio/EVRCB" },
+  { "evc", "audio/EVRC" },
+  { "evw", "audio/EVRCWB" },
+  { "exe", "application/octet-stream" },
+  { "exr", "image/aces" },
+  { "fbs", "image/vnd.fastbidsheet" },
+  { "fit", "image/fits" },
+  { "fits", "image/fits" },
+  { "flac", "audio/flac" },
+  { "fli", "video/fli" },
+  { "flt", "text/vnd.ficlab.flt" },
+  { "flx", "text/vnd.fmi.flexstor" },
+  { "fly", "text/vnd.fly" },
+  { "fpx", "image/vnd.fpx" },
+  { "fst", "image/vnd.fst" },
+  { "fts", "image/fits" },
+  { "fvt", "video/vnd.fvt" },
+  { "gcd", "text/x-pcs-gcd" },
+  { "ged", "text/vnd.familysearch.gedcom" },
+  { "gff3", "text/gff3" },
+  { "gif", "image/gif" },
+  { "gl", "video/gl" },
+  { "gtar", "application/x-gtar" },
+  { "gv", "text/vnd.graphviz" },
+  { "gz", "application/gzip" },
+  { "h", "text/x-chdr" },
+  { "h5", "application/x-hdf5" },
+  { "hans", "text/vnd.hans" },
+  { "hdf", "application/x-hdf" },
+  { "hdr", "image/vnd.radiance" },
+  { "heic", "image/heic" },
+  { "heics", "image/heic-sequence" },
+  { "heif", "image/heif" },
+  { "heifs", "image/heif-sequence" },
+  { "hej2", "image/hej2k" },
+  { "hgl", "text/vnd.hgl" },
+  { "hif", "image/avif" },
+  { "hs", "text/x-haskell" },
+  { "hsj2", "image/hsj2" },
+  { "htm", "text/html" },
+  { "html", "text/html" },
+  { "ico", "image/vnd.microsoft.icon" },
+  { "ics", "text/calendar" },
+  { "idx", "application/octet-stream" },
+  { "ief", "image/ief" },
+  { "ifb", "text/calendar" },
+  { "iso", "application/x-iso9660-image" },
+  { "jad", "text/vnd.sun.j2me.app-descriptor" },
+  { "jar", "application/java-archive" },
+  { "java", "text/x-java" },
+  { "jfif", "image/jpeg" },
+  { "jhc", "image/jphc" },
+  { "jls", "image/jls" },
+  { "jp2", "image/jp2" },
+  { "jpe", "image/jpeg" },
+  { "jpeg", "image/jpeg" },
+  { "jpf", "image/jpx" },
+  { "jpg", "image/jpeg" },
+  { "jpg2", "image/jp2" },
+  { "jpgm", "image/jpm" },
+  { "jph", "image/jph" },
+  { "jphc", "image/jphc" },
+  { "jpm", "image/jpm" },
+  { "jpx", "image/jpx" },
+  { "js", "text/javascript" },
+  { "json", "application/json" },
+  { "jsonld", "application/ld+json" },
+  { "jtd", "text/vnd.esmertec.theme-descriptor" },
+  { "jxl", "image/jxl" },
+  { "jxr", "image/jxr" },
+  { "jxra", "image/jxrA" },
+  { "jxrs", "image/jxrS" },
+  { "jxs", "image/jxs" },
+  { "jxsc", "image/jxsc" },
+  { "jxsi", "image/jxsi" },
+  { "jxss", "image/jxss" },
+  { "koz", "audio/vnd.audiokoz" },
+  { "ksh", "text/plain" },
+  { "ktx", "image/ktx" },
+  { "ktx2", "image/ktx2" },
+  { "l16", "audio/L16" },
+  { "latex", "application/x-latex" },
+  { "lbc", "audio/iLBC" },
+  { "lhs", "text/x-literate-haskell" },
+  { "loas", "audio/usac" },
+  { "ltx", "text/x-tex" },
+  { "lvp", "audio/vnd.lucent.voice" },
+  { "ly", "text/x-lilypond" },
+  { "m1v", "video/mpeg" },
+  { "m2v", "video/mpeg" },
+  { "m3u", "audio/mpegurl" },
+  { "m3u8", "application/vnd.apple.mpegurl" },
+  { "m4a", "audio/mp4" },
+  { "m4s", "video/iso.segment" },
+  { "m4u", "video/vnd.mpegurl" },
+  { "m4v", "video/mp4" },
+  { "man", "application/x-troff-man" },
+  { "manifest", "text/cache-manifest" },
+  { "map", "application/json" },
+  { "markdown", "text/markdown" },
+  { "mc2", "text/vnd.senx.warpscript" },
+  { "md", "text/markdown" },
+  { "mdi", "image/vnd.ms-modi" },
+  { "me", "application/x-troff-me" },
+  { "mhas", "audio/mhas" },
+  { "mht", "message/rfc822" },
+  { "mhtml", "message/rfc822" },
+  { "mid", "audio/sp-midi" },
+  { "mif", "application/x-mif" },
+  { "miz", "text/mizar" },
+  { "mj2", "video/mj2" },
+  { "mjp2", "video/mj2" },
+  { "mjs", "text/javascript" },
+  { "mkv", "video/x-matroska" },
+  { "mlp", "audio/vnd.dolby.mlp" },
+  { "mmr", "image/vnd.fujixerox.edmics-mmr" },
+  { "moc", "text/x-moc" },
+  { "mov", "video/quicktime" },
+  { "movie", "video/x-sgi-movie" },
+  { "mp1", "audio/mpeg" },
+  { "mp2", "audio/mpeg" },
+  { "mp3", "audio/mpeg" },
+  { "mp4", "video/mp4" },
+  { "mpa", "video/mpeg" },
+  { "mpe", "video/mpeg" },
+  { "mpeg", "video/mpeg" },
+  { "mpega", "audio/mpeg" },
+  { "mpf", "text/vnd.ms-mediapackage" },
+  { "mpg", "video/mpeg" },
+  { "mpg4", "video/mp4" },
+  { "mpga", "audio/mpeg" },
+  { "ms", "application/x-troff-ms" },
+  { "multitrack", "audio/vnd.presonus.multitrack" },
+  { "mxmf", "audio/mobile-xmf" },
+  { "mxu", "video/vnd.mpegurl" },
+  { "n3", "text/n3" },
+  { "nc", "application/x-netcdf" },
+  { "nim", "video/vnd.nokia.interleaved-multimedia" },
+  { "nq", "application/n-quads" },
+  { "nt", "application/n-triples" },
+  { "nws", "message/rfc822" },
+  { "o", "application/octet-stream" },
+  { "obj", "application/octet-stream" },
+  { "oda", "application/oda" },
+  { "odp", "application/vnd.oasis.opendocument.presentation" },
+  { "ods", "application/vnd.oasis.opendocument.spreadsheet" },
+  { "odt", "application/vnd.oasis.opendocument.text" },
+  { "oga", "audio/ogg" },
+  { "ogg", "audio/ogg" },
+  { "ogv", "video/ogg" },
+  { "omg", "audio/ATRAC3" },
+  { "opus", "audio/ogg" },
+  { "orc", "audio/csound" },
+  { "otf", "font/otf" },
+  { "p", "text/x-pascal" },
+  { "p12", "application/x-pkcs12" },
+  { "p7c", "application/pkcs7-mime" },
+  { "pas", "text/x-pascal" },
+  { "patch", "text/x-diff" },
+  { "pbm", "image/x-portable-bitmap" },
+  { "pcx", "image/vnd.zbrush.pcx" },
+  { "pdf", "application/pdf" },
+  { "pfx", "application/x-pkcs12" },
+  { "pgb", "image/vnd.globalgraphics.pgb" },
+  { "pgm", "image/x-portable-graymap" },
+  { "pl", "text/x-perl" },
+  { "plj", "audio/vnd.everad.plj" },
+  { "pm", "text/x-perl" },
+  { "png", "image/png" },
+  { "pnm", "image/x-portable-anymap" },
+  { "pot", "text/plain" },
+  { "ppa", "application/vnd.ms-powerpoint" },
+  { "ppm", "image/x-portable-pixmap" },
+  { "pps", "application/vnd.ms-powerpoint" },
+  { "ppt", "application/vnd.ms-powerpoint" },
+  { "pptx",
+    "application/vnd.openxmlformats-officedocument.presentationml.presentation" },
+  { "provn", "text/provenance-notation" },
+  { "ps", "application/postscript" },
+  { "psd", "image/vnd.adobe.photoshop" },
+  { "psid", "audio/prs.sid" },
+  { "pti", "image/prs.pti" },
+  { "pwz", "application/vnd.ms-powerpoint" },
+  { "py", "text/x-python" },
+  { "pya", "audio/vnd.ms-playready.media.pya" },
+  { "pyc", "application/x-python-code" },
+  { "pyo", "application/x-python-code" },
+  { "pyv", "video/vnd.ms-playready.media.pyv" },
+  { "qcp", "audio/EVRC-QCP" },
+  { "qt", "video/quicktime" },
+  { "ra", "audio/x-pn-realaudio" },
+  { "ram", "application/x-pn-realaudio" },
+  { "ras", "image/x-cmu-raster" },
+  { "rdf", "application/xml" },
+  { "rgb", "image/x-rgb" },
+  { "rgbe", "image/vnd.radiance" },
+  { "rip", "audio/vnd.rip" },
+  { "rlc", "image/vnd.fujixerox.edmics-rlc" },
+  { "roff", "text/troff" },
+  { "rpm", "application/x-redhat-package-manager" },
+  { "rss", "application/rss+xml" },
+  { "rst", "text/prs.fallenstein.rst" },
+  { "rtf", "application/rtf" },
+  { "rtx", "text/richtext" },
+  { "s11", "video/vnd.sealed.mpeg1" },
+  { "s14", "video/vnd.sealed.mpeg4" },
+  { "s1g", "image/vnd.sealedmedia.softseal.gif" },
+  { "s1j", "image/vnd.sealedmedia.softseal.jpg" },
+  { "s1m", "audio/vnd.sealedmedia.softseal.mpeg" },
+  { "s1n", "image/vnd.sealed.png" },
+  { "s1q", "video/vnd.sealedmedia.softseal.mov" },
+  { "scala", "text/x-scala" },
+  { "sco", "audio/csound" },
+  { "sfv", "text/x-sfv" },
+  { "sgi", "image/vnd.sealedmedia.softseal.gif" },
+  { "sgif", "image/vnd.sealedmedia.softseal.gif" },
+  { "sgm", "text/SGML" },
+  { "sgml", "text/SGML" },
+  { "sh", "application/x-sh" },
+  { "shaclc", "text/shaclc" },
+  { "shar", "application/x-shar" },
+  { "shc", "text/shaclc" },
+  { "shex", "text/shex" },
+  { "shtml", "text/html" },
+  { "si", "text/vnd.wap.si" },
+  { "sid", "audio/prs.sid" },
+  { "sjp", "image/vnd.sealedmedia.softseal.jpg" },
+  { "sjpg", "image/vnd.sealedmedia.softseal.jpg" },
+  { "sl", "text/vnd.wap.sl" },
+  { "smk", "video/vnd.radgamettools.smacker" },
+  { "smo", "video/vnd.sealedmedia.softseal.mov" },
+  { "smov", "video/vnd.sealedmedia.softseal.mov" },
+  { "smp", "audio/vnd.sealedmedia.softseal.mpeg" },
+  { "smp3", "audio/vnd.sealedmedia.softseal.mpeg" },
+  { "smpg", "video/vnd.sealed.mpeg1" },
+  { "smv", "audio/SMV" },
+  { "snd", "audio/basic" },
+  { "so", "application/octet-stream" },
+  { "soa", "text/dns" },
+  { "sofa", "audio/sofa" },
+  { "sos", "text/vnd.sosi" },
+  { "spdx", "text/spdx" },
+  { "spn", "image/vnd.sealed.png" },
+  { "spng", "image/vnd.sealed.png" },
+  { "spo", "text/vnd.in3d.spot" },
+  { "spot", "text/vnd.in3d.spot" },
+  { "spx", "audio/ogg" },
+  { "sql", "application/sql" },
+  { "src", "application/x-wais-source" },
+  { "srt", "application/x-subrip" },
+  { "ssw", "video/vnd.sealed.swf" },
+  { "sswf", "video/vnd.sealed.swf" },
+  { "sty", "text/x-tex" },
+  { "sv4cpio", "application/x-sv4cpio" },
+  { "sv4crc", "application/x-sv4crc" },
+  { "svg", "image/svg+xml" },
+  { "svgz", "image/svg+xml" },
+  { "swf", "application/x-shockwave-flash" },
+  { "t", "text/troff" },
+  { "tag", "text/prs.lines.tag" },
+  { "tap", "image/vnd.tencent.tap" },
+  { "tar", "application/x-tar" },
+  { "tcl", "text/x-tcl" },
+  { "tex", "text/x-tex" },
+  { "texi", "application/x-texinfo" },
+  { "texinfo", "application/x-texinfo" },
+  { "text", "text/plain" },
+  { "tfx", "image/tiff-fx" },
+  { "tgz", "application/gzip" },
+  { "tif", "image/tiff" },
+  { "tiff", "image/tiff" },
+  { "tk", "text/x-tcl" },
+  { "tm", "text/texmacs" },
+  { "toml", "application/toml" },
+  { "tr", "text/troff" },
+  { "trig", "application/trig" },
+  { "ts", "video/mp2t" },
+  { "tsv", "text/tab-separated-values" },
+  { "ttc", "font/collection" },
+  { "ttf", "font/ttf" },
+  { "ttl", "text/turtle" },
+  { "txt", "text/plain" },
+  { "uri", "text/uri-list" },
+  { "uris", "text/uri-list" },
+  { "ustar", "application/x-ustar" },
+  { "uva", "audio/vnd.dece.audio" },
+  { "uvg", "image/vnd.dece.graphic" },
+  { "uvh", "video/vnd.dece.hd" },
+  { "uvi", "image/vnd.dece.graphic" },
+  { "uvm", "video/vnd.dece.mobile" },
+  { "uvp", "video/vnd.dece.pd" },
+  { "uvs", "video/vnd.dece.sd" },
+  { "uvu", "video/vnd.dece.mp4" },
+  { "uvv", "video/vnd.dece.video" },
+  { "uvva", "audio/vnd.dece.audio" },
+  { "uvvg", "image/vnd.dece.graphic" },
+  { "uvvh", "video/vnd.dece.hd" },
+  { "uvvi", "image/vnd.dece.graphic" },
+  { "uvvm", "video/vnd.dece.mobile" },
+  { "uvvp", "video/vnd.dece.pd" },
+  { "uvvs", "video/vnd.dece.sd" },
+  { "uvvu", "video/vnd.dece.mp4" },
+  { "uvvv", "video/vnd.dece.video" },
+  { "vbk", "audio/vnd.nortel.vbk" },
+  { "vcard", "text/vcard" },
+  { "vcf", "text/vcard" },
+  { "vcs", "text/x-vcalendar" },
+  { "vfk", "text/vnd.exchangeable" },
+  { "viv", "video/vnd.vivo" },
+  { "vtf", "image/vnd.valve.source.texture" },
+  { "vtt", "text/vtt" },
+  { "wasm", "application/wasm" },
+  { "wav", "audio/wav" },
+  { "wbmp", "image/vnd.wap.wbmp" },
+  { "webm", "video/webm" },
+  { "webmanifest", "application/manifest+json" },
+  { "webp", "image/webp" },
+  { "wgsl", "text/wgsl" },
+  { "wiz", "application/msword" },
+  { "wmf", "image/wmf" },
+  { "wml", "text/vnd.wap.wml" },
+  { "wmls", "text/vnd.wap.wmlscript" },
+  { "woff", "font/woff" },
+  { "woff2", "font/woff2" },
+  { "wsdl", "application/xml" },
+  { "xbm", "image/x-xbitmap" },
+  { "xhe", "audio/usac" },
+  { "xhtml", "application/xhtml+xml" },
+  { "xif", "image/vnd.xiff" },
+  { "xlb", "application/vnd.ms-excel" },
+  { "xls", "application/vnd.ms-excel" },
+  { "xlsx",
+    "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet" },
+  { "xml", "text/xml" },
+  { "xpdl", "application/xml" },
+  { "xpm", "image/x-xpixmap" },
+  { "xsl", "application/xml" },
+  { "xwd", "image/x-xwindowdump" },
+  { "xyze", "image/vnd.radiance" },
+  { "xz", "application/x-xz" },
+  { "yaml", "text/yaml" },
+  { "yml", "text/yaml" },
+  { "yt", "video/vnd.youtube.yt" },
+  { "zip", "application/zip" },
+  { "zone", "text/dns" },
+};
+
+constexpr size_t kMimeTableLen = sizeof(kMimeTable) / sizeof(kMimeTable[0]);
+
+constexpr bool StrLess(const char *a, const char *b) {
+  return (*a == *b) ? (*a != '\0' && StrLess(a + 1, b + 1))
+                    : (static_cast<unsigned char>(*a) <
+                       static_cast<unsigned char>(*b));
+}
+
+constexpr bool TableSorted() {
+  for (size_t i = 0; i + 1 < kMimeTableLen; i++) {
+    if (!StrLess(kMimeTable[i].ext, kMimeTable[i + 1].ext))
+      return false;
+  }
+  return true;
+}
+
+static_assert(TableSorted(), "kMimeTable must be sorted by extension");
+
+// Extensions added at startup by LoadMimeTypes(), kept sorted so they
+// can be binary searched the same way as kMimeTable.
+vector<pair<string, string>> loaded_types;
+
+// Compares the NUL-terminated lowercase "known" against the "len"
+// bytes at "ext", lowercasing "ext" as we go.  Returns <0, 0, or >0
+// like strcmp().
+int CompareExt(const char *known, const char *ext, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    unsigned char k = static_cast<unsigned char>(known[i]);
+    unsigned char e = static_cast<unsigned char>(tolower(ext[i]));
+    if (k == '\0')
+      return -1;
+    if (k != e)
+      return (k < e) ? -1 : 1;
+  }
+  return (known[len] == '\0') ? 0 : 1;
+}
+
+}  // namespace
+
+const char *LookupMimeType(const char *ext, size_t len) {
+  // Binary search the built-in table.
+  size_t lo = 0, hi = kMimeTableLen;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = CompareExt(kMimeTable[mid].ext, ext, len);
+    if (cmp == 0)
+      return kMimeTable[mid].type;
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  // Then the extensions loaded from a mime.types file.
+  lo = 0;
+  hi = loaded_types.size();
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = CompareExt(loaded_types[mid].first.c_str(), ext, len);
+    if (cmp == 0)
+      return loaded_types[mid].second.c_str();
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return kDefaultMimeType;
+}
+
+const char *MimeTypeForFile(const string &fname) {
+  size_t dot = fname.find_last_of("./");
+  if (dot == string::npos || fname[dot] != '.')
+    return kDefaultMimeType;
+  return LookupMimeType(fname.data() + dot + 1, fname.size() - dot - 1);
+}
+
+bool LoadMimeTypes(const string &path) {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+
+  string line;
+  while (std::getline(in, line)) {
+    size_t hash = line.find('#');
+    if (hash != string::npos)
+      line.erase(hash);
+
+    std::istringstream fields(line);
+    string type, ext;
+    if (!(fields >> type))
+      continue;
+    while (fields >> ext) {
+      std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+      if (LookupMimeType(ext.data(), ext.size()) != kDefaultMimeType)
+        continue;  // already known; first definition wins
+      auto it = std::lower_bound(loaded_types.begin(), loaded_types.end(),
+                                 std::make_pair(ext, string()));
+      loaded_types.insert(it, std::make_pair(ext, type));
+    }
+  }
+  return true;
+}
+
+}  // namespace hw4
@@ -0,0 +1,48 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_MIMETYPES_H_
+#define HW4_MIMETYPES_H_
+
+#include <stddef.h>
+#include <string>
+
+namespace hw4 {
+
+// The Content-type we send when we don't recognize a file's suffix.
+extern const char *kDefaultMimeType;
+
+// Returns the MIME type for the file extension "ext" (the "len" bytes
+// after the final "." in a filename, e.g., "html"), compared
+// case-insensitively.  The built-in table is searched first, then
+// any extensions added by LoadMimeTypes().  If the extension is
+// unknown, returns kDefaultMimeType.  Never allocates; the returned
+// string lives for the lifetime of the program.
+const char *LookupMimeType(const char *ext, size_t len);
+
+// Convenience wrapper: returns the MIME type for the suffix of the
+// filename "fname".  Files without a suffix get kDefaultMimeType.
+const char *MimeTypeForFile(const std::string &fname);
+
+// Extends the built-in table with the entries in a mime.types(5)
+// style file, i.e., lines of the form
+//
+//   text/html   html htm
+//
+// with "#" comments.  Extensions that the built-in table already
+// knows keep their built-in type.  Returns false if the file could
+// not be read.  This is meant to be called once at startup, before
+// any threads start calling LookupMimeType().
+bool LoadMimeTypes(const std::string &path);
+
+}  // namespace hw4
+
+#endif  // HW4_MIMETYPES_H_
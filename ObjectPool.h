@@ -0,0 +1,128 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_OBJECTPOOL_H_
+#define HW4_OBJECTPOOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace hw4 {
+
+// An ObjectPool hands out objects from a fixed set that is constructed
+// up front, so that objects which are needed often (e.g., the state of
+// each client connection) can be recycled rather than allocated and
+// freed each time.  The free objects are kept on a lock-free stack, so
+// any number of threads can Get() and Put() concurrently.
+//
+// If every pooled object is in use, Get() falls back to "new T", and
+// Put() deletes such overflow objects rather than keeping them, so the
+// memory held by the pool stays at "capacity" objects no matter how
+// bursty the demand is.
+//
+// T must be default-constructible.  Objects come back from Get() in
+// whatever state they were Put() in; resetting them is up to the
+// caller.
+template <typename T>
+class ObjectPool {
+ public:
+  explicit ObjectPool(uint32_t capacity)
+    : objects_(new T[capacity]),
+      next_(new std::atomic<uint32_t>[capacity]),
+      capacity_(capacity), num_overflow_(0) {
+    // Chain every object onto the free stack, first one on top.
+    for (uint32_t i = 0; i < capacity; i++)
+      next_[i].store(i + 1 < capacity ? i + 1 : kNone,
+                     std::memory_order_relaxed);
+    head_.store(Pack(0, capacity > 0 ? 0 : kNone));
+  }
+  virtual ~ObjectPool() { }
+
+  ObjectPool(const ObjectPool &) = delete;
+  ObjectPool &operator=(const ObjectPool &) = delete;
+
+  // Returns a free object, or a new one if the pool is exhausted.
+  T *Get() {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    while (true) {
+      uint32_t index = Index(head);
+      if (index == kNone) {
+        num_overflow_.fetch_add(1, std::memory_order_relaxed);
+        return new T;
+      }
+      // "next" may be stale if another thread pops this object first,
+      // but then the tag has changed and the exchange fails.
+      uint32_t next = next_[index].load(std::memory_order_relaxed);
+      if (head_.compare_exchange_weak(head, Pack(Tag(head) + 1, next),
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_acquire))
+        return &objects_[index];
+    }
+  }
+
+  // Returns "obj", which came from Get(), to the pool.
+  void Put(T *obj) {
+    if (!Owns(obj)) {
+      num_overflow_.fetch_sub(1, std::memory_order_relaxed);
+      delete obj;
+      return;
+    }
+    uint32_t index = static_cast<uint32_t>(obj - objects_.get());
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    do {
+      next_[index].store(Index(head), std::memory_order_relaxed);
+    } while (!head_.compare_exchange_weak(head, Pack(Tag(head) + 1, index),
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed));
+  }
+
+  // Returns true if "obj" is one of the pooled objects.
+  bool Owns(const T *obj) const {
+    std::less_equal<const T *> le;
+    return le(objects_.get(), obj) && !le(objects_.get() + capacity_, obj);
+  }
+
+  // The number of pooled objects.
+  uint32_t capacity() const { return capacity_; }
+
+  // The number of overflow objects currently handed out.
+  uint32_t num_overflow() const {
+    return num_overflow_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // The top of the free stack is an object index packed with a tag
+  // that changes on every update, so that a thread that read the head
+  // before other threads popped and pushed the same object back can't
+  // mistake the stack for unchanged (the ABA problem).
+  static constexpr uint32_t kNone = UINT32_MAX;
+  static uint64_t Pack(uint32_t tag, uint32_t index) {
+    return (static_cast<uint64_t>(tag) << 32) | index;
+  }
+  static uint32_t Tag(uint64_t head) { return head >> 32; }
+  static uint32_t Index(uint64_t head) { return head & UINT32_MAX; }
+
+  std::unique_ptr<T[]> objects_;
+
+  // next_[i] is the object below object i on the free stack.
+  std::unique_ptr<std::atomic<uint32_t>[]> next_;
+
+  std::atomic<uint64_t> head_;
+  uint32_t capacity_;
+  std::atomic<uint32_t> num_overflow_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_OBJECTPOOL_H_
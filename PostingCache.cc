@@ -0,0 +1,229 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <string>
+#include <utility>
+#include <vector>
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+#include "./HashMix.h"
+#include "./PostingCache.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// The sketch has this many rows of this many one-byte counters.
+static const int kSketchRows = 4;
+static const size_t kSketchWidth = 1024;
+
+// After this many requests, a shard's counts are halved.
+static const size_t kSketchPeriod = 8 * kSketchWidth;
+
+// A word's postings are admitted once it has been looked up this
+// many times...
+static const int kMinRequests = 2;
+
+// ...if they would take at most this fraction of a shard.
+static const size_t kMaxEntryFraction = 8;
+
+// What an entry costs beyond its postings: the entry, and its table
+// and clock nodes.
+static const size_t kEntryOverhead = 128;
+
+// The counter of the key with hash "hash" in row "row" of a sketch.
+static size_t Counter(uint64_t hash, int row) {
+  return row * kSketchWidth + ((hash >> (4 + 15 * row)) % kSketchWidth);
+}
+
+PostingCache::PostingCache(size_t capacity)
+  : shards_(new Shard[kNumShards]), capacity_(capacity),
+    shard_capacity_(capacity / kNumShards) {
+  for (size_t i = 0; i < kNumShards; i++) {
+    Shard &shard = shards_[i];
+    Verify333(pthread_mutex_init(&shard.lock, nullptr) == 0);
+    shard.hand = shard.clock.end();
+    shard.bytes = 0;
+    shard.sketch.reset(new std::atomic<uint8_t>[kSketchRows * kSketchWidth]);
+    for (size_t c = 0; c < kSketchRows * kSketchWidth; c++)
+      shard.sketch[c].store(0, std::memory_order_relaxed);
+    shard.requests = 0;
+    shard.hits = 0;
+    shard.misses = 0;
+    shard.admitted = 0;
+    shard.rejected = 0;
+    shard.evicted = 0;
+  }
+}
+
+PostingCache::~PostingCache() {
+  for (size_t i = 0; i < kNumShards; i++)
+    Verify333(pthread_mutex_destroy(&shards_[i].lock) == 0);
+}
+
+// static
+string PostingCache::Key(const IndexReader &reader, const string &word) {
+  string key = std::to_string(reader.generation());
+  key += '\0';
+  key += reader.index_file();
+  key += '\0';
+  key += word;
+  return key;
+}
+
+void PostingCache::CountRequest(Shard *shard, uint64_t hash) {
+  if (shard->requests.fetch_add(1, std::memory_order_relaxed) + 1 ==
+      kSketchPeriod) {
+    for (size_t c = 0; c < kSketchRows * kSketchWidth; c++) {
+      std::atomic<uint8_t> &count = shard->sketch[c];
+      count.store(count.load(std::memory_order_relaxed) / 2,
+                  std::memory_order_relaxed);
+    }
+    shard->requests.store(0, std::memory_order_relaxed);
+  }
+  for (int row = 0; row < kSketchRows; row++) {
+    std::atomic<uint8_t> &count = shard->sketch[Counter(hash, row)];
+    uint8_t old = count.load(std::memory_order_relaxed);
+    if (old < UINT8_MAX)
+      count.store(old + 1, std::memory_order_relaxed);
+  }
+}
+
+int PostingCache::EstimateRequests(const Shard &shard, uint64_t hash) const {
+  int estimate = UINT8_MAX;
+  for (int row = 0; row < kSketchRows; row++) {
+    int count =
+      shard.sketch[Counter(hash, row)].load(std::memory_order_relaxed);
+    if (count < estimate)
+      estimate = count;
+  }
+  return estimate;
+}
+
+bool PostingCache::Lookup(const IndexReader &reader, const string &word,
+                          Postings *postings) {
+  string key = Key(reader, word);
+  uint64_t key_hash = IndexWordKey(key);
+  uint64_t hash = MixHash(key_hash);
+  Shard &shard = ShardOf(hash);
+  CountRequest(&shard, hash);
+
+  // Keys whose hashes collide are simply not both cached.
+  EntryPtr entry;
+  if (entries_.Find(key_hash, &entry) && entry->key == key) {
+    entry->referenced.store(true, std::memory_order_relaxed);
+    *postings = entry->postings;
+    shard.hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  shard.misses.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void PostingCache::Insert(const IndexReader &reader, const string &word,
+                          Postings postings) {
+  string key = Key(reader, word);
+  uint64_t key_hash = IndexWordKey(key);
+  uint64_t hash = MixHash(key_hash);
+  Shard &shard = ShardOf(hash);
+  size_t bytes =
+    postings->size() * sizeof(DocPosting) + key.size() + kEntryOverhead;
+
+  Verify333(pthread_mutex_lock(&shard.lock) == 0);
+  EntryPtr existing;
+  bool admit = !entries_.Find(key_hash, &existing) &&
+    bytes <= shard_capacity_ / kMaxEntryFraction;
+  int requests = EstimateRequests(shard, hash);
+  if (admit && requests < kMinRequests)
+    admit = false;
+
+  // Only entries that are asked for less often are evicted to make
+  // room; the hand picks them all before any is evicted.  Two turns
+  // of the clock are enough to find every entry that isn't
+  // referenced, and all of them would make room.
+  vector<ClockIter> victims;
+  size_t freed = 0;
+  size_t turns_left = 2 * shard.clock.size() + 1;
+  while (admit && shard.bytes - freed + bytes > shard_capacity_ &&
+         turns_left-- > 0) {
+    if (shard.hand == shard.clock.end())
+      shard.hand = shard.clock.begin();
+    Entry &entry = **shard.hand;
+    if (entry.victim ||
+        entry.referenced.exchange(false, std::memory_order_relaxed)) {
+      ++shard.hand;
+      continue;
+    }
+    if (EstimateRequests(shard, MixHash(IndexWordKey(entry.key))) >
+        requests) {
+      admit = false;
+      break;
+    }
+    entry.victim = true;
+    victims.push_back(shard.hand++);
+    freed += entry.bytes;
+  }
+  admit = admit && shard.bytes - freed + bytes <= shard_capacity_;
+  for (ClockIter victim : victims)
+    (*victim)->victim = false;
+
+  if (admit) {
+    for (ClockIter victim : victims) {
+      Erase(&shard, victim);
+      shard.evicted++;
+    }
+    // A new entry goes just behind the hand, so that it gets a whole
+    // turn of the clock to be referenced.
+    EntryPtr entry(new Entry());
+    entry->key = key;
+    entry->postings = std::move(postings);
+    entry->bytes = bytes;
+    shard.clock.insert(shard.hand, entry);
+    entries_.Insert(key_hash, entry, &existing);
+    shard.bytes += bytes;
+    shard.admitted++;
+  } else {
+    shard.rejected++;
+  }
+  Verify333(pthread_mutex_unlock(&shard.lock) == 0);
+}
+
+PostingCache::Stats PostingCache::stats() {
+  Stats total = Stats();
+  for (size_t i = 0; i < kNumShards; i++) {
+    Shard &shard = shards_[i];
+    Verify333(pthread_mutex_lock(&shard.lock) == 0);
+    total.hits += shard.hits.load(std::memory_order_relaxed);
+    total.misses += shard.misses.load(std::memory_order_relaxed);
+    total.admitted += shard.admitted;
+    total.rejected += shard.rejected;
+    total.evicted += shard.evicted;
+    total.bytes += shard.bytes;
+    total.entries += shard.clock.size();
+    Verify333(pthread_mutex_unlock(&shard.lock) == 0);
+  }
+  return total;
+}
+
+void PostingCache::Erase(Shard *shard, ClockIter it) {
+  if (shard->hand == it)
+    ++shard->hand;
+  EntryPtr removed;
+  entries_.Remove(IndexWordKey((*it)->key), &removed);
+  shard->bytes -= (*it)->bytes;
+  shard->clock.erase(it);
+}
+
+}  // namespace hw4
@@ -0,0 +1,157 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_POSTINGCACHE_H_
+#define HW4_POSTINGCACHE_H_
+
+extern "C" {
+  #include <pthread.h>  // for the pthread mutex functions
+}
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./ConcurrentHashTable.h"
+#include "./IndexReader.h"
+
+namespace hw4 {
+
+// A PostingCache is a bounded, thread-safe cache of words' decoded
+// postings, so that the words that many different queries share are
+// read from their index files only once.  Entries are keyed by the
+// reader's generation, the index file, and the word, so an index file
+// that is reopened never gets the postings of its old version.
+//
+// Entries are found through a ConcurrentHashTable, so lookups share
+// its locks instead of taking turns.  A hit only marks its entry as
+// referenced; eviction is CLOCK, an approximation of least recently
+// used that needs nothing more.  Inserts, which are rarer (each one
+// follows reading the postings from disk), go through one of several
+// shards, each with its own lock and its own clock: the shard's hand
+// passes over entries that were referenced since it last came by
+// (clearing their marks) and picks the others as victims.
+//
+// The cache remembers roughly how often each word has been looked up
+// lately (in a small count-min sketch per shard, whose counts are
+// halved now and then, so that old popularity fades).  Postings are
+// only admitted once their word has been asked for more than once,
+// if they aren't too big a part of the cache, and if the entries they
+// would evict have been asked for less often than they have; so a
+// burst of one-off words doesn't flush the words that keep coming
+// back.
+class PostingCache {
+ public:
+  typedef std::shared_ptr<const std::vector<DocPosting>> Postings;
+
+  // "capacity" is the most bytes of postings the cache will hold.
+  explicit PostingCache(size_t capacity);
+  virtual ~PostingCache();
+
+  PostingCache(const PostingCache &) = delete;
+  PostingCache &operator=(const PostingCache &) = delete;
+
+  // Looks up the postings of "word" in the index that "reader" has
+  // open.  On a hit, returns true and shares them through "postings".
+  // Either way, counts as a request for the word.
+  bool Lookup(const IndexReader &reader, const std::string &word,
+              Postings *postings);
+
+  // Offers the postings of "word", just read from "reader"'s index,
+  // for caching.  They are kept only if they are admitted.
+  void Insert(const IndexReader &reader, const std::string &word,
+              Postings postings);
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t admitted;
+    uint64_t rejected;
+    uint64_t evicted;
+    size_t bytes;
+    size_t entries;
+  };
+
+  // Returns the counts so far, and the current size.
+  Stats stats();
+
+  // The most bytes the cache will hold.
+  size_t capacity() const { return capacity_; }
+
+ private:
+  struct Entry {
+    std::string key;
+    Postings postings;
+    size_t bytes;
+
+    // Set by each hit, and cleared as the clock hand passes.
+    std::atomic<bool> referenced{false};
+
+    // True while Insert() considers evicting it; guarded by its
+    // shard's lock.
+    bool victim = false;
+  };
+  typedef std::shared_ptr<Entry> EntryPtr;
+  typedef std::list<EntryPtr>::iterator ClockIter;
+
+  struct Shard {
+    // Guards the clock, "bytes", and the admission counts.
+    pthread_mutex_t lock;
+
+    // The shard's entries, in the order the hand visits them, and the
+    // hand (end() stands for begin()).
+    std::list<EntryPtr> clock;
+    ClockIter hand;
+    size_t bytes;
+
+    // The count-min sketch of requests, and the number of requests
+    // since its counts were last halved.  Lookups count without the
+    // lock, so racing threads may lose a count now and then, which a
+    // sketch can live with.
+    std::unique_ptr<std::atomic<uint8_t>[]> sketch;
+    std::atomic<size_t> requests;
+
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    uint64_t admitted;
+    uint64_t rejected;
+    uint64_t evicted;
+  };
+
+  static std::string Key(const IndexReader &reader, const std::string &word);
+  Shard &ShardOf(uint64_t hash) { return shards_[hash % kNumShards]; }
+
+  // Counts a request for the key with hash "hash" in "shard"'s sketch.
+  void CountRequest(Shard *shard, uint64_t hash);
+
+  // Returns the estimated count of the key with hash "hash".
+  int EstimateRequests(const Shard &shard, uint64_t hash) const;
+
+  // Removes "it" from both "shard"'s clock and the entries.  The
+  // caller must hold "shard"'s lock.
+  void Erase(Shard *shard, ClockIter it);
+
+  static const size_t kNumShards = 16;
+  std::unique_ptr<Shard[]> shards_;
+
+  // Every shard's entries, by the IndexWordKey() of their keys.
+  ConcurrentHashTable<EntryPtr> entries_;
+  size_t capacity_;
+  size_t shard_capacity_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_POSTINGCACHE_H_
@@ -0,0 +1,619 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <sys/stat.h>
+#include <time.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+#include "./IndexFilter.h"
+#include "./QueryEngine.h"
+
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace hw4 {
+
+// Looking a document up in a docID table takes a few small reads,
+// where reading the whole table takes one big one; documents are
+// looked up only while there are this many times fewer of them than
+// there are in the table.
+static const int64_t kProbeRatio = 16;
+
+const int QueryEngine::kDefaultManifestCheckMs = 100;
+
+// Why an index's plan leaves out or skips phrases and NEARs.
+static const char *kNoWordPositions =
+  "its positions are hw3's byte offsets, so it can't match phrases or"
+  " NEARs";
+
+// Returns the CLOCK_MONOTONIC time, in nanoseconds.
+static int64_t MonotonicNs() {
+  struct timespec now;
+  Verify333(clock_gettime(CLOCK_MONOTONIC, &now) == 0);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// Returns false if "filter" rules out every document matching "node".
+static bool MayMatch(const BloomFilter &filter, const QueryNode &node) {
+  switch (node.type) {
+    case QueryNode::kWord:
+      return filter.MayContain(IndexWordKey(node.word));
+    case QueryNode::kAnd: {
+      bool required = false;
+      for (const QueryNode &child : node.children) {
+        if (child.negated)
+          continue;
+        if (!MayMatch(filter, child))
+          return false;
+        required = true;
+      }
+      return required;
+    }
+    case QueryNode::kOr:
+      for (const QueryNode &child : node.children) {
+        if (MayMatch(filter, child))
+          return true;
+      }
+      return false;
+    case QueryNode::kPhrase:
+    case QueryNode::kNear:
+      for (const QueryNode &child : node.children) {
+        if (!MayMatch(filter, child))
+          return false;
+      }
+      return true;
+  }
+  return true;
+}
+
+// Returns "node" as a query that ParseQuery() parses back into it.
+static string FormatQuery(const QueryNode &node) {
+  string out = node.negated ? "-" : "";
+  if (node.type == QueryNode::kWord)
+    return out + node.word;
+  string separator = node.type == QueryNode::kOr ? " OR " :
+    node.type == QueryNode::kNear ?
+    " NEAR/" + std::to_string(node.distance) + " " : " ";
+  out += node.type == QueryNode::kPhrase ? "\"" :
+    node.type == QueryNode::kNear ? "" : "(";
+  for (size_t i = 0; i < node.children.size(); i++)
+    out += (i > 0 ? separator : "") + FormatQuery(node.children[i]);
+  out += node.type == QueryNode::kPhrase ? "\"" :
+    node.type == QueryNode::kNear ? "" : ")";
+  return out;
+}
+
+QueryEngine::QueryEngine(size_t posting_cache_bytes, bool validate)
+  : validate_(validate),
+    manifest_check_ns_(int64_t{kDefaultManifestCheckMs} * 1000000) {
+  if (posting_cache_bytes > 0)
+    posting_cache_.reset(new PostingCache(posting_cache_bytes));
+  Verify333(pthread_mutex_init(&segments_lock_, nullptr) == 0);
+}
+
+QueryEngine::~QueryEngine() {
+  Verify333(pthread_mutex_destroy(&segments_lock_) == 0);
+}
+
+// Opens "index_file" into "reader", and builds its filter.
+static bool OpenIndex(const string &index_file, bool validate,
+                      shared_ptr<IndexReader> *reader,
+                      shared_ptr<BloomFilter> *filter) {
+  reader->reset(new IndexReader());
+  if (!(*reader)->Open(index_file))
+    return false;
+  // The filter reads a word header in most blocks, so it is built
+  // before validating, to not check the whole file up front.  It
+  // only decides which indices to skip, and the words' postings are
+  // still checked when a query reads them.
+  unique_ptr<BloomFilter> built;
+  BuildIndexFilter(**reader, &built);
+  *filter = std::move(built);
+  return !validate || (*reader)->EnableValidation();
+}
+
+bool QueryEngine::AddIndex(const string &index_file) {
+  shared_ptr<Index> index(new Index());
+  if (!OpenIndex(index_file, validate_, &index->reader, &index->filter))
+    return false;
+  indices_.push_back(index);
+  return true;
+}
+
+bool QueryEngine::AddSegments(const string &dir) {
+  unique_ptr<SegmentDir> segment_dir(new SegmentDir());
+  segment_dir->dir = dir;
+  shared_ptr<Segments> segments(new Segments());
+
+  // A directory without a manifest yet has no segments yet.
+  struct stat st;
+  if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    return false;
+  if (stat((dir + "/" + kSegmentManifest).c_str(), &st) == 0 &&
+      !LoadSegments(dir, Segments(), st, segments.get()))
+    return false;
+  segment_dir->segments = segments;
+  segment_dir->next_check_ns = MonotonicNs() + manifest_check_ns_;
+  segment_dirs_.push_back(std::move(segment_dir));
+  return true;
+}
+
+size_t QueryEngine::num_indices() const {
+  return Indices().size();
+}
+
+bool QueryEngine::Scrub(int num_threads, vector<string> *corrupt) const {
+  bool ok = true;
+  for (const auto &index : Indices()) {
+    if (index->reader->has_checksums() && !index->reader->Scrub(num_threads)) {
+      corrupt->push_back(index->reader->index_file());
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+QueryEngine::IndexList QueryEngine::Indices() const {
+  IndexList indices = indices_;
+  for (const auto &segment_dir : segment_dirs_) {
+    CheckManifest(segment_dir.get());
+    shared_ptr<const Segments> segments = CurrentSegments(*segment_dir);
+    indices.insert(indices.end(), segments->indices.begin(),
+                   segments->indices.end());
+  }
+  return indices;
+}
+
+shared_ptr<const QueryEngine::Segments> QueryEngine::CurrentSegments(
+    const SegmentDir &segment_dir) const {
+  Verify333(pthread_mutex_lock(&segments_lock_) == 0);
+  shared_ptr<const Segments> segments = segment_dir.segments;
+  Verify333(pthread_mutex_unlock(&segments_lock_) == 0);
+  return segments;
+}
+
+void QueryEngine::CheckManifest(SegmentDir *segment_dir) const {
+  // Only the first query after the interval is up checks; the others
+  // go on with the segments they have.
+  int64_t now = MonotonicNs();
+  int64_t next = segment_dir->next_check_ns.load();
+  if (now < next ||
+      !segment_dir->next_check_ns.compare_exchange_strong(
+        next, now + manifest_check_ns_))
+    return;
+
+  // If the manifest can't be read right now (or the segments it
+  // lists, which a merge may have just removed), the old segments are
+  // used until the next check tries again.
+  struct stat st;
+  if (stat((segment_dir->dir + "/" + kSegmentManifest).c_str(), &st) != 0)
+    return;
+  shared_ptr<const Segments> old = CurrentSegments(*segment_dir);
+  if (st.st_ino == old->manifest_inode &&
+      st.st_mtim.tv_sec == old->manifest_mtime.tv_sec &&
+      st.st_mtim.tv_nsec == old->manifest_mtime.tv_nsec)
+    return;
+  // The new segments are opened without the lock, so queries meanwhile
+  // use the old ones rather than wait.
+  shared_ptr<Segments> segments(new Segments());
+  if (!LoadSegments(segment_dir->dir, *old, st, segments.get()))
+    return;
+  Verify333(pthread_mutex_lock(&segments_lock_) == 0);
+  segment_dir->segments = segments;
+  Verify333(pthread_mutex_unlock(&segments_lock_) == 0);
+}
+
+bool QueryEngine::LoadSegments(const string &dir, const Segments &old,
+                               const struct stat &st,
+                               Segments *segments) const {
+  vector<SegmentInfo> infos;
+  if (!ReadSegmentManifest(dir, &infos))
+    return false;
+
+  // The segments that are open already, with what the manifest said
+  // of them, by file.
+  std::map<string, std::pair<const SegmentInfo *, const Index *>> open;
+  for (size_t i = 0; i < old.infos.size(); i++)
+    open[old.infos[i].index_file] = {&old.infos[i], old.indices[i].get()};
+
+  for (const SegmentInfo &info : infos) {
+    shared_ptr<Index> index(new Index());
+    auto it = open.find(info.index_file);
+    if (it != open.end()) {
+      index->reader = it->second.second->reader;
+      index->filter = it->second.second->filter;
+      if (it->second.first->deletes_file == info.deletes_file)
+        index->deleted = it->second.second->deleted;
+    } else if (!OpenIndex(dir + "/" + info.index_file, validate_,
+                          &index->reader, &index->filter)) {
+      return false;
+    }
+    if (!info.deletes_file.empty() && !index->deleted) {
+      shared_ptr<Tombstones> deleted(new Tombstones());
+      if (!ReadTombstones(dir + "/" + info.deletes_file, info.num_docs,
+                          deleted.get()))
+        return false;
+      index->deleted = deleted;
+    }
+    segments->indices.push_back(index);
+  }
+  segments->manifest_inode = st.st_ino;
+  segments->manifest_mtime = st.st_mtim;
+  segments->infos.swap(infos);
+  return true;
+}
+
+void QueryEngine::ProcessQuery(const vector<string> &words,
+                               vector<Result> *results,
+                               vector<IndexPlan> *plan) const {
+  results->clear();
+  if (plan != nullptr)
+    plan->clear();
+  if (words.empty())
+    return;
+
+  vector<uint64_t> keys;
+  for (const string &word : words)
+    keys.push_back(IndexWordKey(word));
+
+  IndexList indices = Indices();
+  for (const auto &index_ptr : indices) {
+    const Index &index = *index_ptr;
+    IndexPlan index_plan;
+    index_plan.index_file = index.reader->index_file();
+    // A document matches only if it has every word, so an index that
+    // lacks any one of them can be skipped.
+    if (index.filter) {
+      for (size_t i = 0; i < words.size(); i++) {
+        if (!index.filter->MayContain(keys[i])) {
+          index_plan.skipped = "filter rules out \"" + words[i] + "\"";
+          break;
+        }
+      }
+    }
+    if (index_plan.skipped.empty())
+      ProcessIndex(index, words, results, &index_plan);
+    if (plan != nullptr)
+      plan->push_back(std::move(index_plan));
+  }
+
+  std::stable_sort(results->begin(), results->end(),
+                   [](const Result &a, const Result &b) {
+                     return a.rank > b.rank;
+                   });
+}
+
+void QueryEngine::ProcessIndex(const Index &index,
+                               const vector<string> &words,
+                               vector<Result> *results,
+                               IndexPlan *plan) const {
+  const IndexReader &reader = *index.reader;
+
+  // Plan: look up every word's number of documents, and order the
+  // words rarest first.  (A repeated word is kept, and counts twice
+  // towards the rank, as it does in hw3.)
+  vector<std::pair<PostingsInfo, const string *>> terms;
+  for (const string &word : words) {
+    PostingsInfo info;
+    if (!reader.LookupWord(word, &info)) {
+      plan->skipped = "no \"" + word + "\"";
+      return;
+    }
+    terms.push_back({info, &word});
+  }
+  std::stable_sort(terms.begin(), terms.end(),
+                   [](const std::pair<PostingsInfo, const string *> &a,
+                      const std::pair<PostingsInfo, const string *> &b) {
+                     return a.first.num_docs < b.first.num_docs;
+                   });
+
+  // Evaluate: "matches" holds the documents that have every word so
+  // far, in order of docID, with their ranks so far.
+  vector<DocPosting> matches;
+  for (size_t t = 0; t < terms.size(); t++) {
+    const PostingsInfo &info = terms[t].first;
+    Step step;
+    step.word = *terms[t].second;
+    step.num_docs = info.num_docs;
+    PostingCache::Postings postings;
+    step.cached = posting_cache_ &&
+      posting_cache_->Lookup(reader, step.word, &postings);
+    step.probed = !step.cached && t > 0 &&
+      static_cast<int64_t>(matches.size()) * kProbeRatio < info.num_docs;
+
+    if (step.probed) {
+      size_t kept = 0;
+      for (const DocPosting &match : matches) {
+        DocPosting posting;
+        if (reader.FindPosting(info, match.doc_id, &posting)) {
+          matches[kept] = match;
+          matches[kept].num_positions += posting.num_positions;
+          kept++;
+        }
+      }
+      matches.resize(kept);
+    } else {
+      if (!step.cached &&
+          !ReadPostings(reader, step.word, info, &postings)) {
+        plan->skipped = "couldn't read \"" + step.word + "\"";
+        return;
+      }
+      const vector<DocPosting> &list = *postings;
+      if (t == 0) {
+        matches = list;
+      } else {
+        size_t kept = 0, p = 0;
+        for (const DocPosting &match : matches) {
+          while (p < list.size() && list[p].doc_id < match.doc_id)
+            p++;
+          if (p < list.size() && list[p].doc_id == match.doc_id) {
+            matches[kept] = match;
+            matches[kept].num_positions += list[p].num_positions;
+            kept++;
+          }
+        }
+        matches.resize(kept);
+      }
+    }
+    step.matches = matches.size();
+    plan->steps.push_back(step);
+    // Once no document is left, the commoner words needn't be read.
+    if (matches.empty())
+      return;
+  }
+
+  for (const DocPosting &match : matches) {
+    Result result;
+    if (IsDeleted(index, match.doc_id) ||
+        !reader.LookupDocName(match.doc_id, &result.document_name))
+      continue;
+    result.rank = match.num_positions;
+    results->push_back(std::move(result));
+  }
+}
+
+bool QueryEngine::ReadPostings(const IndexReader &reader, const string &word,
+                               const PostingsInfo &info,
+                               PostingCache::Postings *postings) const {
+  std::shared_ptr<vector<DocPosting>> read(new vector<DocPosting>());
+  if (!reader.ReadPostings(info, read.get()))
+    return false;
+  *postings = read;
+  if (posting_cache_)
+    posting_cache_->Insert(reader, word, *postings);
+  return true;
+}
+
+namespace {
+
+// A document that matches a query, while the best ones are picked.
+struct Candidate {
+  int rank;
+  size_t index;  // into indices_
+  uint64_t doc_id;
+};
+
+// Orders candidates best first: by rank, and then by index and docID,
+// as ProcessIndex's results are.  As a priority queue's comparison,
+// puts the worst candidate on top.
+struct Better {
+  bool operator()(const Candidate &a, const Candidate &b) const {
+    if (a.rank != b.rank)
+      return a.rank > b.rank;
+    if (a.index != b.index)
+      return a.index < b.index;
+    return a.doc_id < b.doc_id;
+  }
+};
+
+}  // namespace
+
+void QueryEngine::ProcessQuery(const QueryNode &query, size_t max_results,
+                               vector<Result> *results,
+                               vector<IndexPlan> *plan) const {
+  results->clear();
+  if (plan != nullptr)
+    plan->clear();
+
+  // The best candidates so far, worst on top.  Once there are
+  // "max_results" of them, a document has to rank higher than the top
+  // one to be kept, and (as candidates come in order of index and
+  // docID) that is the minimum score the iterators are given.
+  std::priority_queue<Candidate, vector<Candidate>, Better> best;
+  IndexList indices = Indices();
+  for (size_t i = 0; i < indices.size(); i++) {
+    const Index &index = *indices[i];
+    IndexPlan index_plan;
+    index_plan.index_file = index.reader->index_file();
+    unique_ptr<DocIterator> it;
+    if (index.filter && !MayMatch(*index.filter, query))
+      index_plan.skipped = "filter rules out the query";
+    else
+      it = BuildIterator(index, query, &index_plan);
+
+    if (it) {
+      index_plan.scored = 0;
+      uint64_t target = 0;
+      while (true) {
+        bool full = max_results > 0 && best.size() == max_results;
+        it->Advance(target, full ? best.top().rank : DocIterator::kNoMinimum);
+        if (it->doc() == DocIterator::kEnd)
+          break;
+        if (IsDeleted(index, it->doc())) {
+          target = it->doc() + 1;
+          continue;
+        }
+        Candidate candidate{it->score(), i, it->doc()};
+        index_plan.scored++;
+        if (!full) {
+          best.push(candidate);
+        } else if (Better()(candidate, best.top())) {
+          best.pop();
+          best.push(candidate);
+        }
+        target = it->doc() + 1;
+      }
+    }
+    if (plan != nullptr)
+      plan->push_back(std::move(index_plan));
+  }
+
+  vector<Candidate> candidates;
+  for (; !best.empty(); best.pop())
+    candidates.push_back(best.top());
+  std::reverse(candidates.begin(), candidates.end());
+  for (const Candidate &candidate : candidates) {
+    Result result;
+    const IndexReader &reader = *indices[candidate.index]->reader;
+    if (!reader.LookupDocName(candidate.doc_id, &result.document_name))
+      continue;
+    result.rank = candidate.rank;
+    results->push_back(std::move(result));
+  }
+}
+
+unique_ptr<TermIterator> QueryEngine::BuildTermIterator(
+    const Index &index, const string &word, IndexPlan *plan) const {
+  const IndexReader &reader = *index.reader;
+  Step step;
+  step.word = word;
+  step.num_docs = 0;
+  step.probed = false;
+  step.cached = false;
+  step.matches = -1;
+  PostingCache::Postings postings;
+  PostingsInfo info;
+  if (!reader.LookupWord(word, &info)) {
+    postings.reset(new vector<DocPosting>());
+  } else {
+    step.num_docs = info.num_docs;
+    step.cached = posting_cache_ &&
+      posting_cache_->Lookup(reader, word, &postings);
+    if (!step.cached && !ReadPostings(reader, word, info, &postings)) {
+      plan->skipped = "couldn't read \"" + word + "\"";
+      return nullptr;
+    }
+  }
+  plan->steps.push_back(step);
+  return unique_ptr<TermIterator>(new TermIterator(postings));
+}
+
+unique_ptr<DocIterator> QueryEngine::BuildIterator(const Index &index,
+                                                   const QueryNode &node,
+                                                   IndexPlan *plan) const {
+  if (node.type == QueryNode::kWord)
+    return BuildTermIterator(index, node.word, plan);
+
+  if (node.type == QueryNode::kPhrase || node.type == QueryNode::kNear) {
+    // Byte offsets don't tell which words are next to each other.
+    if (!index.reader->has_word_positions()) {
+      plan->skipped = kNoWordPositions;
+      return nullptr;
+    }
+    vector<unique_ptr<TermIterator>> words;
+    for (const QueryNode &child : node.children) {
+      unique_ptr<TermIterator> word =
+        BuildTermIterator(index, child.word, plan);
+      if (!word)
+        return nullptr;
+      words.push_back(std::move(word));
+    }
+    return unique_ptr<DocIterator>(new PhraseIterator(
+      index.reader.get(), std::move(words),
+      node.type == QueryNode::kNear ? node.distance : 0));
+  }
+
+  // Children that can't match anything are left out; and once a
+  // required one can't, the rest of an AND needn't be read at all.
+  // An OR can leave out the children that need word positions, too,
+  // if the index doesn't have them, and still find the rest's matches,
+  // unless all of its children do.
+  vector<unique_ptr<DocIterator>> children, excluded;
+  size_t num_left_out = plan->left_out.size();
+  bool answerable = node.type == QueryNode::kAnd;
+  for (const QueryNode &child : node.children) {
+    size_t num_steps = plan->steps.size();
+    unique_ptr<DocIterator> it = BuildIterator(index, child, plan);
+    if (!it && node.type == QueryNode::kOr &&
+        plan->skipped == kNoWordPositions) {
+      plan->skipped.clear();
+      plan->steps.resize(num_steps);
+      plan->left_out.push_back(FormatQuery(child));
+      continue;
+    }
+    if (!it)
+      return nullptr;
+    answerable = true;
+    bool empty = it->doc() == DocIterator::kEnd;
+    if (child.negated) {
+      if (!empty)
+        excluded.push_back(std::move(it));
+    } else if (empty && node.type == QueryNode::kAnd) {
+      children.clear();
+      break;
+    } else if (!empty) {
+      children.push_back(std::move(it));
+    }
+  }
+  if (!answerable) {
+    // Then this OR is left out as a whole, by its parent, if that is
+    // an OR too.
+    plan->skipped = kNoWordPositions;
+    plan->left_out.resize(num_left_out);
+    return nullptr;
+  }
+  if (node.type == QueryNode::kAnd) {
+    return unique_ptr<DocIterator>(
+      new AndIterator(std::move(children), std::move(excluded)));
+  }
+  return unique_ptr<DocIterator>(new OrIterator(std::move(children)));
+}
+
+// static
+string QueryEngine::ExplainPlan(const vector<IndexPlan> &plan) {
+  string out;
+  for (const IndexPlan &index_plan : plan) {
+    out += index_plan.index_file;
+    if (!index_plan.skipped.empty()) {
+      out += ": skipped, " + index_plan.skipped + "\n";
+      continue;
+    }
+    out += ":\n";
+    for (const string &part : index_plan.left_out)
+      out += "  left out " + part + ": " + kNoWordPositions + "\n";
+    for (const Step &step : index_plan.steps) {
+      out += "  \"" + step.word + "\" in " + std::to_string(step.num_docs)
+        + (step.probed ? " docs, looked up" :
+           step.cached ? " docs, cached" : " docs, read");
+      if (step.matches >= 0)
+        out += ": " + std::to_string(step.matches) + " left";
+      out += "\n";
+    }
+    if (index_plan.scored >= 0)
+      out += "  scored " + std::to_string(index_plan.scored) + " docs\n";
+  }
+  return out;
+}
+
+}  // namespace hw4
@@ -0,0 +1,257 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_QUERYENGINE_H_
+#define HW4_QUERYENGINE_H_
+
+extern "C" {
+  #include <pthread.h>  // for the pthread mutex functions
+}
+#include <stdint.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./BloomFilter.h"
+#include "./DocIterator.h"
+#include "./IndexReader.h"
+#include "./PostingCache.h"
+#include "./QueryParser.h"
+#include "./SegmentIndex.h"
+
+namespace hw4 {
+
+// A QueryEngine answers queries against a set of index files the way
+// hw3's QueryProcessor does: a document matches if it has every word
+// of the query, its rank is the total number of times they appear in
+// it, and the results are sorted by rank, highest first.
+//
+// It gets there with less I/O, though.  The index files are opened
+// once, rather than for every query, and each one's word table is
+// summarized in a BloomFilter, so an index that lacks a query word is
+// skipped without reading it.  In the indices that remain, the words
+// are planned rarest first, by the number of documents each one has
+// (which only takes reading their docID tables' bucket records): the
+// rarest word's documents are read, and then only looked up in the
+// more common words' docID tables when there are few enough of them,
+// so "the zebra" never reads all of "the".  Evaluation stops as soon
+// as no document is left.  Postings that are read in full may be kept
+// in a PostingCache, and are used from there by later queries.
+//
+// Queries with ORs, exclusions, phrases, and NEARs (see QueryParser.h)
+// are evaluated a document at a time instead, over DocIterators,
+// keeping only the best few documents; the ORs skip the documents that
+// can't beat the worst of those (see OrIterator), and word positions
+// are only read for documents that have all of a phrase's words (see
+// PhraseIterator).
+//
+// Besides index files, a QueryEngine can query the segments of a
+// SegmentIndex directory.  Before a query it checks whether the
+// directory's manifest has changed (at most every so often; see
+// SetManifestCheckMs()), and if so, it opens the new segments
+// (keeping the ones it has) and rereads the tombstones, so changes
+// show up in the queries after that; deleted documents never match.
+// The segments are reopened without holding up other queries, which
+// use the old ones meanwhile.
+//
+// Once its indices are added, a QueryEngine may be shared by threads.
+class QueryEngine {
+ public:
+  // The engine caches up to "posting_cache_bytes" of postings; zero
+  // turns off the cache.  If "validate", the blocks of index files are
+  // checked against their checksums as they are read, and files
+  // without block checksums against their header's checksum as they
+  // are opened (see IndexReader::EnableValidation()).
+  explicit QueryEngine(size_t posting_cache_bytes = 0,
+                       bool validate = true);
+  virtual ~QueryEngine();
+
+  QueryEngine(const QueryEngine &) = delete;
+  QueryEngine &operator=(const QueryEngine &) = delete;
+
+  // Opens the index file "index_file" and builds its filter.  Returns
+  // false if it can't be opened; an index that can be opened but
+  // whose filter can't be built is added, but never skipped.
+  bool AddIndex(const std::string &index_file);
+
+  // Adds the segments of the SegmentIndex directory "dir", now and as
+  // they change.  Returns false if its manifest can't be read, or its
+  // segments opened.
+  bool AddSegments(const std::string &dir);
+
+  // Checks the manifests of segment directories at most once per "ms"
+  // milliseconds, rather than before every query; 0 checks them
+  // before every query.  Must be called before the engine is shared.
+  void SetManifestCheckMs(int ms) {
+    manifest_check_ns_ = static_cast<int64_t>(ms) * 1000000;
+  }
+
+  static const int kDefaultManifestCheckMs;
+
+  // The number of index files and segments there are now.
+  size_t num_indices() const;
+
+  // Checks every block of every index file and segment that has block
+  // checksums, on "num_threads" threads per file, appending the files
+  // that don't match to "corrupt".  Returns false if there are any.
+  // Queries may run meanwhile.
+  bool Scrub(int num_threads, std::vector<std::string> *corrupt) const;
+
+  // The cache of postings, or nullptr if there is none.
+  PostingCache *posting_cache() const { return posting_cache_.get(); }
+
+  struct Result {
+    std::string document_name;
+    int rank;
+  };
+
+  // How one word of a query was evaluated in one index.
+  struct Step {
+    std::string word;
+    int64_t num_docs;  // that have the word, in the index
+    bool probed;       // looked up per document, not read in full
+    bool cached;       // found in the PostingCache
+    int64_t matches;   // documents left after this step, or -1 if the
+                       // query was evaluated a document at a time
+  };
+
+  // How a query was evaluated in one index.  If "skipped" isn't
+  // empty, it says why the index wasn't read (e.g., its filter ruled
+  // out a word) and there are no steps.  "left_out" has the parts of
+  // ORs that the index can't evaluate (phrases and NEARs, if its
+  // positions are byte offsets), which the rest of each OR was
+  // evaluated without.
+  struct IndexPlan {
+    std::string index_file;
+    std::string skipped;
+    std::vector<std::string> left_out;
+    std::vector<Step> steps;
+    int64_t scored = -1;  // documents scored, if evaluated a document
+                          // at a time
+  };
+
+  // Returns through "results" the documents that match the query
+  // "words".  If "plan" isn't nullptr, it gets how each index was
+  // evaluated, for explaining the query.
+  void ProcessQuery(const std::vector<std::string> &words,
+                    std::vector<Result> *results,
+                    std::vector<IndexPlan> *plan = nullptr) const;
+
+  // Returns through "results" the "max_results" documents that match
+  // "query" with the highest ranks (or all of them, if "max_results"
+  // is zero), ranked the same way.  Documents that tie are ranked in
+  // the order of their indices and docIDs.
+  void ProcessQuery(const QueryNode &query, size_t max_results,
+                    std::vector<Result> *results,
+                    std::vector<IndexPlan> *plan = nullptr) const;
+
+  // Formats "plan" as text, a line per index and step.
+  static std::string ExplainPlan(const std::vector<IndexPlan> &plan);
+
+ private:
+  // An index, as of one query; a segment's reader and filter are
+  // shared by all of its versions, which differ in their tombstones.
+  struct Index {
+    std::shared_ptr<IndexReader> reader;
+    std::shared_ptr<BloomFilter> filter;      // nullptr if none
+    std::shared_ptr<const Tombstones> deleted;  // nullptr if none
+  };
+  typedef std::vector<std::shared_ptr<const Index>> IndexList;
+
+  // The segments of a directory as of its manifest's last change,
+  // which is told by the manifest's inode (it is renamed into place)
+  // and modification time.  Never changed once it is in use; a change
+  // makes a new one.
+  struct Segments {
+    ino_t manifest_inode = 0;
+    struct timespec manifest_mtime = {0, 0};
+    std::vector<SegmentInfo> infos;
+    IndexList indices;
+  };
+
+  // A segment directory, and its current Segments.
+  struct SegmentDir {
+    std::string dir;
+    // When (on the CLOCK_MONOTONIC clock, in nanoseconds) its manifest
+    // is next checked.
+    std::atomic<int64_t> next_check_ns{0};
+    // Guarded by segments_lock_, which is held only to copy or replace
+    // the pointer.
+    std::shared_ptr<const Segments> segments;
+  };
+
+  // Returns the indices to query now: the index files, and the
+  // segments of each directory, rereading any whose manifest changed.
+  IndexList Indices() const;
+
+  // If it is time to, checks whether the manifest of "segment_dir" has
+  // changed, and if so, rereads its segments and makes them current.
+  void CheckManifest(SegmentDir *segment_dir) const;
+
+  // Returns the current Segments of "segment_dir".
+  std::shared_ptr<const Segments> CurrentSegments(
+    const SegmentDir &segment_dir) const;
+
+  // Reads the segments of directory "dir", whose manifest had "st"
+  // when it was checked, into "segments", reusing those of "old" that
+  // are still there.  Returns false if they can't be read.
+  bool LoadSegments(const std::string &dir, const Segments &old,
+                    const struct stat &st, Segments *segments) const;
+
+  // Returns whether "doc_id" is deleted from "index".
+  static bool IsDeleted(const Index &index, uint64_t doc_id) {
+    return index.deleted && doc_id < index.deleted->size() &&
+      (*index.deleted)[doc_id];
+  }
+
+  // Evaluates "words" in "index", appending its matches to "results"
+  // and what it did to "plan".
+  void ProcessIndex(const Index &index,
+                    const std::vector<std::string> &words,
+                    std::vector<Result> *results, IndexPlan *plan) const;
+
+  // Builds the iterator for "node" in "index", reading its words'
+  // postings and adding a step for each to "plan".  Returns nullptr
+  // (with "plan" saying why) if some postings can't be read, or if
+  // "node" needs word positions that the index doesn't have.
+  std::unique_ptr<DocIterator> BuildIterator(const Index &index,
+                                             const QueryNode &node,
+                                             IndexPlan *plan) const;
+
+  // Builds the iterator for "word" in "index", as BuildIterator()
+  // does.
+  std::unique_ptr<TermIterator> BuildTermIterator(const Index &index,
+                                                  const std::string &word,
+                                                  IndexPlan *plan) const;
+
+  // Reads the postings that "info" describes of "word" in "reader"'s
+  // index, and offers them to the cache.  Returns false if they can't
+  // be read.
+  bool ReadPostings(const IndexReader &reader, const std::string &word,
+                    const PostingsInfo &info,
+                    PostingCache::Postings *postings) const;
+
+  bool validate_;
+  IndexList indices_;
+  std::unique_ptr<PostingCache> posting_cache_;
+
+  // Guards the SegmentDirs' "segments", which change as queries come
+  // in.
+  mutable pthread_mutex_t segments_lock_;
+  std::vector<std::unique_ptr<SegmentDir>> segment_dirs_;
+  int64_t manifest_check_ns_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_QUERYENGINE_H_
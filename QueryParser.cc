@@ -0,0 +1,296 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <ctype.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./QueryParser.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// Splits "query" into words, "OR"s, "NEAR/k"s, "-"s, parentheses, and
+// phrases (each one token, starting with its opening quote).  A "-"
+// is its own token only at the start of a word, group, or phrase.
+// Returns false if a phrase isn't closed.
+static bool Tokenize(const string &query, vector<string> *tokens) {
+  size_t i = 0;
+  while (i < query.size()) {
+    char c = query[i];
+    if (isspace(static_cast<unsigned char>(c))) {
+      i++;
+    } else if (c == '(' || c == ')') {
+      tokens->push_back(string(1, c));
+      i++;
+    } else if (c == '"') {
+      size_t end = query.find('"', i + 1);
+      if (end == string::npos)
+        return false;
+      tokens->push_back(query.substr(i, end - i));
+      i = end + 1;
+    } else if (c == '-' && i + 1 < query.size() &&
+               !isspace(static_cast<unsigned char>(query[i + 1])) &&
+               query[i + 1] != ')') {
+      tokens->push_back("-");
+      i++;
+    } else {
+      size_t end = i;
+      while (end < query.size() &&
+             !isspace(static_cast<unsigned char>(query[end])) &&
+             query[end] != '(' && query[end] != ')' && query[end] != '"')
+        end++;
+      tokens->push_back(query.substr(i, end - i));
+      i = end;
+    }
+  }
+  return true;
+}
+
+// Returns true if "token" is "NEAR/k", returning k through "distance".
+static bool IsNear(const string &token, int *distance) {
+  static const string kNear = "NEAR/";
+  static const size_t kMaxDigits = 4;
+  if (token.compare(0, kNear.size(), kNear) != 0 ||
+      token.size() == kNear.size() ||
+      token.size() > kNear.size() + kMaxDigits)
+    return false;
+  int k = 0;
+  for (size_t i = kNear.size(); i < token.size(); i++) {
+    if (!isdigit(static_cast<unsigned char>(token[i])))
+      return false;
+    k = k * 10 + (token[i] - '0');
+  }
+  *distance = k;
+  return true;
+}
+
+static void MakeWord(const string &word, QueryNode *node) {
+  node->type = QueryNode::kWord;
+  node->word = word;
+  for (char &c : node->word)
+    c = tolower(static_cast<unsigned char>(c));
+  node->negated = false;
+  node->children.clear();
+}
+
+namespace {
+
+// A recursive descent parser over the tokens, with a function per
+// rule of the grammar:
+//
+//   or      := and ("OR" and)*
+//   and     := unary unary*
+//   unary   := "-"? near
+//   near    := primary ("NEAR/k" primary)*
+//   primary := word | phrase | "(" or ")"
+//
+// Each "(" costs a few stack frames, so groups nest at most kMaxDepth
+// deep; a query can be as long as a request line, and one of nothing
+// but "(" would otherwise overflow a server thread's stack.
+class Parser {
+ public:
+  explicit Parser(vector<string> tokens) : tokens_(std::move(tokens)) { }
+
+  bool Parse(QueryNode *root) {
+    pos_ = 0;
+    depth_ = 0;
+    return ParseOr(root) && pos_ == tokens_.size();
+  }
+
+ private:
+  static const int kMaxDepth = 64;
+
+  bool AtEnd() const { return pos_ == tokens_.size(); }
+  bool At(const char *token) const {
+    return !AtEnd() && tokens_[pos_] == token;
+  }
+  bool AtNear(int *distance) const {
+    return !AtEnd() && IsNear(tokens_[pos_], distance);
+  }
+
+  bool ParseOr(QueryNode *node) {
+    QueryNode first;
+    if (!ParseAnd(&first))
+      return false;
+    if (!At("OR")) {
+      *node = std::move(first);
+      return true;
+    }
+    node->type = QueryNode::kOr;
+    node->negated = false;
+    node->children.clear();
+    AddChild(node, std::move(first));
+    while (At("OR")) {
+      pos_++;
+      QueryNode next;
+      if (!ParseAnd(&next))
+        return false;
+      AddChild(node, std::move(next));
+    }
+    return true;
+  }
+
+  bool ParseAnd(QueryNode *node) {
+    node->type = QueryNode::kAnd;
+    node->negated = false;
+    node->children.clear();
+    while (!AtEnd() && !At("OR") && !At(")")) {
+      QueryNode child;
+      if (!ParseUnary(&child))
+        return false;
+      AddChild(node, std::move(child));
+    }
+    if (node->children.empty())
+      return false;
+    // Just one word or group needs no AND around it.
+    if (node->children.size() == 1 && !node->children[0].negated) {
+      QueryNode only = std::move(node->children[0]);
+      *node = std::move(only);
+    }
+    return true;
+  }
+
+  bool ParseUnary(QueryNode *node) {
+    bool negated = At("-");
+    if (negated)
+      pos_++;
+    if (!ParseNear(node))
+      return false;
+    node->negated = negated;
+    return true;
+  }
+
+  bool ParseNear(QueryNode *node) {
+    QueryNode first;
+    int distance;
+    if (!ParsePrimary(&first))
+      return false;
+    if (!AtNear(&distance)) {
+      *node = std::move(first);
+      return true;
+    }
+    if (first.type != QueryNode::kWord || distance <= 0)
+      return false;
+    node->type = QueryNode::kNear;
+    node->negated = false;
+    node->distance = distance;
+    node->children.clear();
+    node->children.push_back(std::move(first));
+    int next_distance;
+    while (AtNear(&next_distance)) {
+      pos_++;
+      QueryNode next;
+      if (next_distance != distance || !ParsePrimary(&next) ||
+          next.type != QueryNode::kWord)
+        return false;
+      node->children.push_back(std::move(next));
+    }
+    return true;
+  }
+
+  bool ParsePrimary(QueryNode *node) {
+    int distance;
+    if (AtEnd() || At("OR") || At(")") || At("-") || AtNear(&distance))
+      return false;
+    const string &token = tokens_[pos_];
+    if (token == "(") {
+      if (depth_ == kMaxDepth)
+        return false;
+      pos_++;
+      depth_++;
+      if (!ParseOr(node) || !At(")"))
+        return false;
+      depth_--;
+      pos_++;
+      return true;
+    }
+    pos_++;
+    if (token[0] != '"') {
+      MakeWord(token, node);
+      return true;
+    }
+
+    // A phrase of one word is just the word.
+    vector<string> words;
+    size_t i = 1;
+    while (i < token.size()) {
+      size_t end = i;
+      while (end < token.size() &&
+             !isspace(static_cast<unsigned char>(token[end])))
+        end++;
+      if (end > i)
+        words.push_back(token.substr(i, end - i));
+      i = end + 1;
+    }
+    if (words.empty())
+      return false;
+    if (words.size() == 1) {
+      MakeWord(words[0], node);
+      return true;
+    }
+    node->type = QueryNode::kPhrase;
+    node->negated = false;
+    node->children.assign(words.size(), QueryNode());
+    for (size_t w = 0; w < words.size(); w++)
+      MakeWord(words[w], &node->children[w]);
+    return true;
+  }
+
+  // Appends "child" to "parent", merging it in if it is the same kind
+  // of node, so "a (b c)" is one AND of three words.
+  static void AddChild(QueryNode *parent, QueryNode child) {
+    if (child.type == parent->type && !child.negated) {
+      for (QueryNode &grandchild : child.children)
+        parent->children.push_back(std::move(grandchild));
+    } else {
+      parent->children.push_back(std::move(child));
+    }
+  }
+
+  vector<string> tokens_;
+  size_t pos_;
+  int depth_;  // of the groups around pos_
+};
+
+}  // namespace
+
+bool ParseQuery(const string &query, QueryNode *root) {
+  vector<string> tokens;
+  if (!Tokenize(query, &tokens))
+    return false;
+  Parser parser(std::move(tokens));
+  return parser.Parse(root);
+}
+
+bool IsConjunction(const QueryNode &root, vector<string> *words) {
+  words->clear();
+  if (root.negated)
+    return false;
+  if (root.type == QueryNode::kWord) {
+    words->push_back(root.word);
+    return true;
+  }
+  if (root.type != QueryNode::kAnd)
+    return false;
+  for (const QueryNode &child : root.children) {
+    if (child.type != QueryNode::kWord || child.negated)
+      return false;
+    words->push_back(child.word);
+  }
+  return true;
+}
+
+}  // namespace hw4
@@ -0,0 +1,65 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_QUERYPARSER_H_
+#define HW4_QUERYPARSER_H_
+
+#include <string>
+#include <vector>
+
+namespace hw4 {
+
+// A parsed query: a word, the AND or OR of its children, or a phrase
+// or NEAR of its children, which are words.  A document matches an
+// AND if it matches every child that isn't negated and none of those
+// that are; an OR if it matches any child; a phrase if it has the
+// words one right after another; and a NEAR if it has the first word
+// with each of the others at most "distance" words away from it.
+struct QueryNode {
+  enum Type { kWord, kAnd, kOr, kPhrase, kNear };
+
+  Type type;
+  std::string word;                // if a kWord, in lower case
+  bool negated;                    // only ever a child of a kAnd
+  std::vector<QueryNode> children;  // unless a kWord
+  int distance = 0;                // if a kNear
+};
+
+// Parses "query" into "root".  Words next to each other are ANDed;
+// "OR" (in capitals, so that "or" is still a word) between them ORs
+// them, binding more loosely; a "-" in front of a word or group
+// excludes it; and parentheses group.  Words in double quotes are a
+// phrase, and "NEAR/k" (in capitals) between words, binding tightest
+// of all, makes them a NEAR with a distance of k.  So
+//
+//   cat (dog OR puppy) -food
+//
+// matches documents with "cat", either "dog" or "puppy", and not
+// "food", and
+//
+//   "black cat" OR cat NEAR/3 black
+//
+// matches those with "black cat", or "black" near "cat".  An AND that
+// only excludes (like the query "-food") matches nothing.  Returns
+// false if "query" is empty or malformed: if its parentheses or
+// quotes don't balance, groups nest more than 64 deep, a group or
+// phrase is empty, an "OR" or "NEAR/k" is missing a side, a NEAR is
+// of something other than words, or a chain of them has different
+// distances.
+bool ParseQuery(const std::string &query, QueryNode *root);
+
+// Returns true if "root" is a plain AND of words, which is all hw3's
+// query processor knows, and returns them through "words".
+bool IsConjunction(const QueryNode &root, std::vector<std::string> *words);
+
+}  // namespace hw4
+
+#endif  // HW4_QUERYPARSER_H_
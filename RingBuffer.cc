@@ -0,0 +1,188 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <new>
+
+#include "./RingBuffer.h"
+
+namespace hw4 {
+
+// static
+const size_t RingBuffer::kDefaultMinCapacity = 4096;
+const size_t RingBuffer::kDefaultMaxCapacity = 65536;
+
+// Returns the smallest power of two that is at least "n".
+static size_t RoundUpPow2(size_t n) {
+  size_t p = 1;
+  while (p < n)
+    p <<= 1;
+  return p;
+}
+
+RingBuffer::RingBuffer(size_t min_capacity, size_t max_capacity)
+  : data_(nullptr), capacity_(0), head_(0), tail_(0),
+    avg_message_size_(0) {
+  min_capacity_ = RoundUpPow2(min_capacity);
+  max_capacity_ = std::max(min_capacity_, RoundUpPow2(max_capacity));
+  Resize(min_capacity_);
+}
+
+RingBuffer::~RingBuffer() {
+  free(data_);
+}
+
+int RingBuffer::GetFreeSpace(struct iovec iov[2]) {
+  if (size() == capacity_) {
+    if (capacity_ >= max_capacity_)
+      return 0;
+    Resize(capacity_ * 2);
+  }
+
+  // The free space runs from the tail to the end of the buffer, and
+  // then wraps around to just before the head.
+  size_t avail = capacity_ - size();
+  size_t tail = tail_ & (capacity_ - 1);
+  size_t first = std::min(avail, capacity_ - tail);
+  iov[0].iov_base = data_ + tail;
+  iov[0].iov_len = first;
+  iov[1].iov_base = data_;
+  iov[1].iov_len = avail - first;
+  return (iov[1].iov_len > 0) ? 2 : 1;
+}
+
+void RingBuffer::Commit(size_t n) {
+  tail_ += n;
+}
+
+ssize_t RingBuffer::ReadFrom(int fd) {
+  struct iovec iov[2];
+  int iovcnt = GetFreeSpace(iov);
+  if (iovcnt == 0)
+    return 0;
+
+  ssize_t res;
+  while (1) {
+    res = readv(fd, iov, iovcnt);
+    if (res == -1) {
+      if ((errno == EAGAIN) || (errno == EINTR))
+        continue;
+    }
+    break;
+  }
+  if (res > 0)
+    Commit(res);
+  return res;
+}
+
+size_t RingBuffer::Find(std::string_view pattern, size_t from) const {
+  size_t n = size();
+  size_t len = pattern.size();
+  if (len == 0)
+    return (from <= n) ? from : npos;
+
+  size_t mask = capacity_ - 1;
+  size_t i = from;
+  while (i + len <= n) {
+    // Look for the first byte of the pattern in the contiguous piece
+    // of the candidate starting positions that begins at i.
+    size_t pos = (head_ + i) & mask;
+    size_t span = std::min(n - len + 1 - i, capacity_ - pos);
+    const char *hit = static_cast<const char *>(
+      memchr(data_ + pos, pattern[0], span));
+    if (hit == nullptr) {
+      i += span;
+      continue;
+    }
+
+    // Check the rest of the pattern, which may wrap.
+    size_t start = i + (hit - (data_ + pos));
+    size_t k = 1;
+    while (k < len && data_[(head_ + start + k) & mask] == pattern[k])
+      k++;
+    if (k == len)
+      return start;
+    i = start + 1;
+  }
+  return npos;
+}
+
+std::string_view RingBuffer::Front(size_t n) {
+  size_t head = head_ & (capacity_ - 1);
+  if (head + n > capacity_) {
+    // Rotate the head to the start of the buffer.
+    std::rotate(data_, data_ + head, data_ + capacity_);
+    tail_ = size();
+    head_ = 0;
+    head = 0;
+  }
+  return std::string_view(data_ + head, n);
+}
+
+void RingBuffer::Consume(size_t n) {
+  head_ += n;
+  if (head_ == tail_) {
+    // Start over at the front, so the next message is less likely
+    // to wrap.
+    head_ = tail_ = 0;
+  }
+}
+
+void RingBuffer::Clear() {
+  head_ = tail_ = 0;
+  MaybeShrink();
+}
+
+void RingBuffer::NoteMessageSize(size_t n) {
+  if (avg_message_size_ == 0)
+    avg_message_size_ = n;
+  else
+    avg_message_size_ = (avg_message_size_ * 7 + n) / 8;
+  MaybeShrink();
+}
+
+void RingBuffer::MaybeShrink() {
+  // Aim for room for a few average messages, so pipelined requests
+  // don't immediately force the buffer to grow again.
+  size_t target = min_capacity_;
+  while (target < 4 * avg_message_size_ && target < capacity_)
+    target <<= 1;
+  while (target < size())
+    target <<= 1;
+  if (target < capacity_)
+    Resize(target);
+}
+
+void RingBuffer::Resize(size_t capacity) {
+  char *data = static_cast<char *>(malloc(capacity));
+  if (data == nullptr)
+    throw std::bad_alloc();
+
+  // Copy the unconsumed bytes, in up to two pieces, to the front.
+  size_t n = size();
+  if (n > 0) {
+    size_t head = head_ & (capacity_ - 1);
+    size_t first = std::min(n, capacity_ - head);
+    memcpy(data, data_ + head, first);
+    memcpy(data + first, data_, n - first);
+  }
+  free(data_);
+  data_ = data;
+  capacity_ = capacity;
+  head_ = 0;
+  tail_ = n;
+}
+
+}  // namespace hw4
@@ -0,0 +1,110 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_RINGBUFFER_H_
+#define HW4_RINGBUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <string_view>
+
+namespace hw4 {
+
+// A RingBuffer holds bytes read from a file descriptor until they are
+// consumed.  ReadFrom() reads straight into the free space with a
+// single readv(), even when that space wraps around the end of the
+// buffer, so bytes are never staged in an intermediate buffer.
+//
+// The capacity is always a power of two between "min_capacity" and
+// "max_capacity".  It doubles when the buffer fills up with bytes that
+// haven't been consumed, and, as NoteMessageSize() reports the sizes
+// of the messages being read, it shrinks back when they turn out to
+// be much smaller than the buffer.
+class RingBuffer {
+ public:
+  static const size_t kDefaultMinCapacity;
+  static const size_t kDefaultMaxCapacity;
+
+  explicit RingBuffer(size_t min_capacity = kDefaultMinCapacity,
+                      size_t max_capacity = kDefaultMaxCapacity);
+  virtual ~RingBuffer();
+
+  RingBuffer(const RingBuffer &) = delete;
+  RingBuffer &operator=(const RingBuffer &) = delete;
+
+  // The number of unconsumed bytes, and the current capacity.
+  size_t size() const { return tail_ - head_; }
+  size_t capacity() const { return capacity_; }
+
+  // True if the buffer is full and can't grow any more.
+  bool full() const {
+    return size() == capacity_ && capacity_ >= max_capacity_;
+  }
+
+  // Does one readv() from "fd" into the free space, growing the
+  // buffer first if it is full.  Retries on EINTR and EAGAIN.
+  // Returns the number of bytes read, 0 on EOF or if the buffer is
+  // full(), or -1 on error.
+  ssize_t ReadFrom(int fd);
+
+  // For reading by other means than ReadFrom(): fills in "iov" with
+  // the free space, growing the buffer first if it is full, and
+  // returns how many of the two entries are used (0 if the buffer is
+  // full()).  Commit() then appends the first "n" bytes written there.
+  int GetFreeSpace(struct iovec iov[2]);
+  void Commit(size_t n);
+
+  // Returns the offset of the first occurrence of "pattern" in the
+  // unconsumed bytes at or after offset "from", or npos.
+  size_t Find(std::string_view pattern, size_t from = 0) const;
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  // Returns the first "n" unconsumed bytes (n <= size()) as one
+  // contiguous range, which stays valid until the next non-const
+  // call.  If they wrap around the end of the buffer, the contents
+  // are first rotated in place to straighten them out.
+  std::string_view Front(size_t n);
+
+  // Discards the first "n" unconsumed bytes.
+  void Consume(size_t n);
+
+  // Discards everything, and shrinks the buffer if it has grown
+  // beyond what recent messages needed.
+  void Clear();
+
+  // Reports that a message of "n" bytes was just read, so that the
+  // capacity can track the sizes actually seen.
+  void NoteMessageSize(size_t n);
+
+ private:
+  // Changes the capacity to "capacity", which is at least size().
+  void Resize(size_t capacity);
+
+  // Shrinks if the average message is much smaller than the buffer.
+  void MaybeShrink();
+
+  char *data_;
+  size_t capacity_;  // a power of two
+  size_t min_capacity_, max_capacity_;
+
+  // Bytes [head_, tail_) are unconsumed.  These count forever
+  // upwards, and are masked with capacity_ - 1 to find the bytes.
+  uint64_t head_, tail_;
+
+  // An exponentially-weighted average of recent message sizes.
+  size_t avg_message_size_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_RINGBUFFER_H_
@@ -0,0 +1,498 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+#include "./IndexReader.h"
+#include "./SegmentIndex.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+const char *kSegmentManifest = "SEGMENTS";
+const int SegmentIndex::kMergeFactor = 4;
+
+// The first line of a manifest.
+static const char *kManifestHeader = "hw4-segments";
+
+// Returns the tier of a segment with "num_live" live documents.
+static int Tier(int64_t num_live) {
+  int tier = 0;
+  while (num_live >= SegmentIndex::kMergeFactor) {
+    num_live /= SegmentIndex::kMergeFactor;
+    tier++;
+  }
+  return tier;
+}
+
+bool ReadSegmentManifest(const string &dir, vector<SegmentInfo> *segments) {
+  std::ifstream in(dir + "/" + kSegmentManifest);
+  string line;
+  if (!in || !std::getline(in, line) || line != kManifestHeader)
+    return false;
+  segments->clear();
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    SegmentInfo info;
+    if (!(fields >> info.index_file >> info.num_docs >> info.deletes_file) ||
+        info.num_docs < 0)
+      return false;
+    if (info.deletes_file == "-")
+      info.deletes_file.clear();
+    segments->push_back(info);
+  }
+  return in.eof();
+}
+
+bool ReadTombstones(const string &file, int64_t num_docs,
+                    Tombstones *deleted) {
+  std::ifstream in(file, std::ios::binary);
+  if (!in)
+    return false;
+  string bytes((std::istreambuf_iterator<char>(in)),
+               std::istreambuf_iterator<char>());
+  // A bit per docID, from 0 to "num_docs".
+  if (static_cast<int64_t>(bytes.size()) != num_docs / 8 + 1)
+    return false;
+  deleted->assign(num_docs + 1, false);
+  for (int64_t doc = 0; doc <= num_docs; doc++)
+    (*deleted)[doc] = (bytes[doc / 8] >> (doc % 8)) & 1;
+  return true;
+}
+
+SegmentIndex::SegmentIndex()
+  : next_id_(1), merging_(false), merger_running_(false), changed_(false),
+    stop_merger_(false) {
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+  Verify333(pthread_cond_init(&merger_cond_, nullptr) == 0);
+}
+
+SegmentIndex::~SegmentIndex() {
+  StopMerger();
+  Verify333(pthread_cond_destroy(&merger_cond_) == 0);
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+bool SegmentIndex::Open(const string &dir) {
+  dir_ = dir;
+  vector<SegmentInfo> infos;
+  struct stat st;
+  if (stat(Path(kSegmentManifest).c_str(), &st) == 0) {
+    if (!ReadSegmentManifest(dir, &infos))
+      return false;
+  } else if (errno != ENOENT) {
+    return false;
+  }
+
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  bool ok = true;
+  for (const SegmentInfo &info : infos) {
+    Segment segment;
+    segment.info = info;
+    segment.deletes_version = 0;
+    segment.deletes_dirty = false;
+    if (sscanf(info.index_file.c_str(), "seg-%" SCNd64 ".idx",
+               &segment.id) != 1 ||
+        (!info.deletes_file.empty() &&
+         sscanf(info.deletes_file.c_str(), "seg-%*d.%d.del",
+                &segment.deletes_version) != 1)) {
+      ok = false;
+      break;
+    }
+    if (info.deletes_file.empty()) {
+      segment.deleted.assign(info.num_docs + 1, false);
+    } else if (!ReadTombstones(Path(info.deletes_file), info.num_docs,
+                               &segment.deleted)) {
+      ok = false;
+      break;
+    }
+    segment.num_live = std::count(segment.deleted.begin() + 1,
+                                  segment.deleted.end(), false);
+
+    IndexReader reader;
+    ok = reader.Open(Path(info.index_file)) &&
+      reader.ForEachDoc([&](uint64_t doc_id, const string &name) {
+        if (doc_id < segment.deleted.size() && !segment.deleted[doc_id])
+          docs_[name] = {segment.id, doc_id};
+      });
+    if (!ok)
+      break;
+    next_id_ = std::max(next_id_, segment.id + 1);
+    segments_.push_back(std::move(segment));
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return ok;
+}
+
+bool SegmentIndex::AddDocuments(const vector<IndexDocument> &docs) {
+  if (docs.empty())
+    return true;
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  int64_t id = next_id_++;
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+
+  // The segment is written without the lock; nobody knows of it yet.
+  string file = "seg-" + std::to_string(id) + ".idx";
+  if (!WriteIndexFile(Path(file), docs)) {
+    unlink(Path(file).c_str());
+    return false;
+  }
+
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  Segment segment;
+  segment.id = id;
+  segment.info.index_file = file;
+  segment.info.num_docs = docs.size();
+  segment.deleted.assign(docs.size() + 1, false);
+  segment.num_live = docs.size();
+  segment.deletes_version = 0;
+  segment.deletes_dirty = false;
+  segments_.push_back(std::move(segment));
+  for (size_t d = 0; d < docs.size(); d++) {
+    auto it = docs_.find(docs[d].name);
+    if (it != docs_.end()) {
+      Delete(FindSegment(it->second.first), it->second.second);
+      it->second = {id, d + 1};
+    } else {
+      docs_[docs[d].name] = {id, d + 1};
+    }
+  }
+  bool ok = WriteChanges();
+  changed_ = true;
+  Verify333(pthread_cond_signal(&merger_cond_) == 0);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return ok;
+}
+
+bool SegmentIndex::DeleteDocuments(const vector<string> &names) {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  bool deleted = false;
+  for (const string &name : names) {
+    auto it = docs_.find(name);
+    if (it == docs_.end())
+      continue;
+    Delete(FindSegment(it->second.first), it->second.second);
+    docs_.erase(it);
+    deleted = true;
+  }
+  bool ok = !deleted || WriteChanges();
+  if (deleted) {
+    changed_ = true;
+    Verify333(pthread_cond_signal(&merger_cond_) == 0);
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return ok;
+}
+
+bool SegmentIndex::Merge(bool *merged) {
+  *merged = false;
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  if (merging_) {
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    return true;
+  }
+
+  // Segments with nothing left in them are just dropped.
+  vector<string> old_files;
+  for (auto it = segments_.begin(); it != segments_.end(); ) {
+    if (it->num_live > 0) {
+      ++it;
+      continue;
+    }
+    old_files.push_back(it->info.index_file);
+    if (!it->info.deletes_file.empty())
+      old_files.push_back(it->info.deletes_file);
+    it = segments_.erase(it);
+  }
+  if (!old_files.empty()) {
+    bool ok = WriteChanges();
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    if (ok) {
+      for (const string &file : old_files)
+        unlink(Path(file).c_str());
+    }
+    *merged = ok;
+    return ok;
+  }
+
+  // Otherwise, the oldest kMergeFactor segments of the lowest full
+  // tier are merged.
+  map<int, vector<int64_t>> tiers;
+  for (const Segment &segment : segments_)
+    tiers[Tier(segment.num_live)].push_back(segment.id);
+  vector<int64_t> ids;
+  for (const auto &tier : tiers) {
+    if (tier.second.size() >= static_cast<size_t>(kMergeFactor)) {
+      ids.assign(tier.second.begin(), tier.second.begin() + kMergeFactor);
+      break;
+    }
+  }
+  if (ids.empty()) {
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    return true;
+  }
+  vector<SegmentInfo> infos;
+  vector<Tombstones> deleted;
+  for (int64_t id : ids) {
+    Segment *segment = FindSegment(id);
+    infos.push_back(segment->info);
+    deleted.push_back(segment->deleted);
+  }
+  int64_t merged_id = next_id_++;
+  merging_ = true;
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+
+  // Read the live documents, and write them to a new segment, without
+  // the lock; the old segments' files don't change.  "origins" has
+  // the index into "ids" and the old docID of each new document.
+  vector<IndexDocument> docs;
+  vector<std::pair<size_t, uint64_t>> origins;
+  bool ok = true;
+  for (size_t i = 0; i < ids.size() && ok; i++) {
+    vector<uint64_t> doc_ids;
+    ok = ReadLiveDocuments(infos[i], deleted[i], &docs, &doc_ids);
+    for (uint64_t doc_id : doc_ids)
+      origins.push_back({i, doc_id});
+  }
+  string file = "seg-" + std::to_string(merged_id) + ".idx";
+  ok = ok && WriteIndexFile(Path(file), docs);
+
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  merging_ = false;
+  if (!ok) {
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    unlink(Path(file).c_str());
+    return false;
+  }
+  Segment segment;
+  segment.id = merged_id;
+  segment.info.index_file = file;
+  segment.info.num_docs = docs.size();
+  segment.deleted.assign(docs.size() + 1, false);
+  segment.num_live = docs.size();
+  segment.deletes_version = 0;
+  segment.deletes_dirty = false;
+
+  // Documents deleted (or replaced) during the merge stay deleted;
+  // the rest now live in the new segment.
+  for (size_t d = 0; d < docs.size(); d++) {
+    const Segment *old = FindSegment(ids[origins[d].first]);
+    if (old->deleted[origins[d].second])
+      Delete(&segment, d + 1);
+    else
+      docs_[docs[d].name] = {merged_id, d + 1};
+  }
+  auto first = std::find_if(segments_.begin(), segments_.end(),
+                            [&](const Segment &s) { return s.id == ids[0]; });
+  size_t at = first - segments_.begin();
+  for (int64_t id : ids) {
+    Segment *old = FindSegment(id);
+    old_files.push_back(old->info.index_file);
+    if (!old->info.deletes_file.empty())
+      old_files.push_back(old->info.deletes_file);
+    segments_.erase(segments_.begin() + (old - segments_.data()));
+  }
+  segments_.insert(segments_.begin() + at, std::move(segment));
+  ok = WriteChanges();
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  if (ok) {
+    for (const string &old_file : old_files)
+      unlink(Path(old_file).c_str());
+  }
+  *merged = ok;
+  return ok;
+}
+
+bool SegmentIndex::ReadLiveDocuments(const SegmentInfo &info,
+                                     const Tombstones &deleted,
+                                     vector<IndexDocument> *docs,
+                                     vector<uint64_t> *doc_ids) const {
+  IndexReader reader;
+  if (!reader.Open(Path(info.index_file)))
+    return false;
+  vector<std::pair<uint64_t, string>> names;
+  vector<string> words;
+  if (!reader.ForEachDoc([&](uint64_t doc_id, const string &name) {
+        if (doc_id < deleted.size() && !deleted[doc_id])
+          names.push_back({doc_id, name});
+      }) ||
+      !reader.ForEachWord([&](const string &word) {
+        words.push_back(word);
+      }))
+    return false;
+
+  // Each live document's place in "docs", by docID.
+  std::sort(names.begin(), names.end());
+  map<uint64_t, size_t> slots;
+  for (const auto &name : names) {
+    slots[name.first] = docs->size();
+    docs->push_back(IndexDocument{name.second, {}});
+    doc_ids->push_back(name.first);
+  }
+
+  vector<DocPosting> postings;
+  vector<int32_t> positions;
+  for (const string &word : words) {
+    PostingsInfo postings_info;
+    if (!reader.LookupWord(word, &postings_info) ||
+        !reader.ReadPostings(postings_info, &postings))
+      return false;
+    for (const DocPosting &posting : postings) {
+      auto slot = slots.find(posting.doc_id);
+      if (slot == slots.end())
+        continue;
+      if (!reader.ReadPositions(posting, &positions))
+        return false;
+      (*docs)[slot->second].words[word] = positions;
+    }
+  }
+  return true;
+}
+
+void SegmentIndex::StartMerger() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  if (!merger_running_) {
+    // It starts with a merge, in case a tier is full already.
+    merger_running_ = true;
+    stop_merger_ = false;
+    changed_ = true;
+    Verify333(pthread_create(&merger_, nullptr, &MergerMain,
+                             static_cast<void *>(this)) == 0);
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+void SegmentIndex::StopMerger() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  bool running = merger_running_;
+  stop_merger_ = true;
+  Verify333(pthread_cond_signal(&merger_cond_) == 0);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  if (!running)
+    return;
+  Verify333(pthread_join(merger_, nullptr) == 0);
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  merger_running_ = false;
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+// static
+void *SegmentIndex::MergerMain(void *segment_index) {
+  SegmentIndex *index = static_cast<SegmentIndex *>(segment_index);
+  Verify333(pthread_mutex_lock(&index->lock_) == 0);
+  while (!index->stop_merger_) {
+    if (!index->changed_) {
+      Verify333(pthread_cond_wait(&index->merger_cond_, &index->lock_) == 0);
+      continue;
+    }
+    index->changed_ = false;
+    Verify333(pthread_mutex_unlock(&index->lock_) == 0);
+    // A merge may fill the next tier up, so keep going until there's
+    // nothing to merge (or a merge fails; it is tried again after the
+    // next change).
+    bool merged = true;
+    while (merged && index->Merge(&merged)) { }
+    Verify333(pthread_mutex_lock(&index->lock_) == 0);
+  }
+  Verify333(pthread_mutex_unlock(&index->lock_) == 0);
+  return nullptr;
+}
+
+vector<SegmentInfo> SegmentIndex::segments() const {
+  vector<SegmentInfo> infos;
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  for (const Segment &segment : segments_)
+    infos.push_back(segment.info);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return infos;
+}
+
+size_t SegmentIndex::num_docs() const {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  size_t num_docs = docs_.size();
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return num_docs;
+}
+
+// static
+void SegmentIndex::Delete(Segment *segment, uint64_t doc_id) {
+  if (doc_id >= segment->deleted.size() || segment->deleted[doc_id])
+    return;
+  segment->deleted[doc_id] = true;
+  segment->num_live--;
+  segment->deletes_dirty = true;
+}
+
+SegmentIndex::Segment *SegmentIndex::FindSegment(int64_t id) {
+  for (Segment &segment : segments_) {
+    if (segment.id == id)
+      return &segment;
+  }
+  return nullptr;
+}
+
+bool SegmentIndex::WriteChanges() {
+  vector<string> old_files;
+  for (Segment &segment : segments_) {
+    if (!segment.deletes_dirty)
+      continue;
+    string bytes(segment.info.num_docs / 8 + 1, '\0');
+    for (size_t doc = 0; doc < segment.deleted.size(); doc++) {
+      if (segment.deleted[doc])
+        bytes[doc / 8] |= 1 << (doc % 8);
+    }
+    string file = "seg-" + std::to_string(segment.id) + "." +
+      std::to_string(segment.deletes_version + 1) + ".del";
+    if (!WriteFileAtomically(Path(file), bytes))
+      return false;
+    if (!segment.info.deletes_file.empty())
+      old_files.push_back(segment.info.deletes_file);
+    segment.info.deletes_file = file;
+    segment.deletes_version++;
+    segment.deletes_dirty = false;
+  }
+
+  string manifest = string(kManifestHeader) + "\n";
+  for (const Segment &segment : segments_) {
+    manifest += segment.info.index_file + " " +
+      std::to_string(segment.info.num_docs) + " " +
+      (segment.info.deletes_file.empty() ? "-" :
+       segment.info.deletes_file) + "\n";
+  }
+  if (!WriteFileAtomically(Path(kSegmentManifest), manifest))
+    return false;
+  // Readers that still have the old manifest may fail to read these,
+  // and read the new manifest instead.
+  for (const string &file : old_files)
+    unlink(Path(file).c_str());
+  return true;
+}
+
+}  // namespace hw4
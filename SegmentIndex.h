@@ -0,0 +1,172 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_SEGMENTINDEX_H_
+#define HW4_SEGMENTINDEX_H_
+
+extern "C" {
+  #include <pthread.h>  // for the pthread mutex and thread functions
+}
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./IndexWriter.h"
+
+namespace hw4 {
+
+// The deleted documents of a segment: deleted[docID] is true if the
+// document with that docID is deleted.
+typedef std::vector<bool> Tombstones;
+
+// A segment, as the manifest of a segment directory lists it.  File
+// names are within the directory.
+struct SegmentInfo {
+  std::string index_file;
+  int64_t num_docs;           // including the deleted ones
+  std::string deletes_file;   // of its Tombstones, or "" if none
+};
+
+// The name of a segment directory's manifest.
+extern const char *kSegmentManifest;
+
+// Reads the manifest of the segment directory "dir" into "segments",
+// oldest first.  Returns false if it can't be read.
+bool ReadSegmentManifest(const std::string &dir,
+                         std::vector<SegmentInfo> *segments);
+
+// Reads the tombstones file "file" of a segment of "num_docs"
+// documents.
+bool ReadTombstones(const std::string &file, int64_t num_docs,
+                    Tombstones *deleted);
+
+// A SegmentIndex is an index that can change: a directory of index
+// files, or segments, each of them an ordinary hw3-layout index that
+// is never changed once written, and a manifest listing the live ones.
+//
+// Adding documents writes them to a new, small segment, rather than
+// rebuilding the whole index; a document that is added again replaces
+// the one of the same name.  Deleting (or replacing) a document only
+// marks it in its segment's tombstones.  To keep the number of
+// segments (and so the cost of a query) down, segments are merged by
+// size tier: once there are kMergeFactor segments of about the same
+// number of live documents, they are merged into one, without their
+// deleted documents, which goes on to the next tier.  Merging may be
+// done in the background (StartMerger()), so that adding documents
+// never waits for it.
+//
+// Every change writes new files and then renames a new manifest into
+// place, so a reader (see QueryEngine::AddSegments()) always sees a
+// consistent set of segments, and can tell that it changed from the
+// manifest alone.  One process at a time may change a directory.
+class SegmentIndex {
+ public:
+  SegmentIndex();
+  virtual ~SegmentIndex();
+
+  SegmentIndex(const SegmentIndex &) = delete;
+  SegmentIndex &operator=(const SegmentIndex &) = delete;
+
+  // Opens the segment directory "dir", which must exist; if it has no
+  // manifest, it starts out empty.  Returns false if its segments
+  // can't be read.
+  bool Open(const std::string &dir);
+
+  // Adds "docs" in a new segment, replacing any documents of the same
+  // names.  Returns false if they couldn't be written.
+  bool AddDocuments(const std::vector<IndexDocument> &docs);
+
+  // Deletes the documents named "names"; names that aren't in the
+  // index are ignored.  Returns false if the tombstones couldn't be
+  // written.
+  bool DeleteDocuments(const std::vector<std::string> &names);
+
+  // Merges one tier, if one is full, or drops the segments that have
+  // no live documents left, returning whether it did through
+  // "merged".  Returns false if a merge failed.
+  bool Merge(bool *merged);
+
+  // Starts merging in a thread of its own, after every change, until
+  // StopMerger() (or destruction).
+  void StartMerger();
+  void StopMerger();
+
+  // The segments now, oldest first, and the number of documents that
+  // aren't deleted.
+  std::vector<SegmentInfo> segments() const;
+  size_t num_docs() const;
+
+  // This many segments of a tier are merged into one.  A segment of n
+  // live documents is in tier floor(log_kMergeFactor(n)).
+  static const int kMergeFactor;
+
+ private:
+  struct Segment {
+    int64_t id;          // its index file is "seg-<id>.idx"
+    SegmentInfo info;
+    Tombstones deleted;
+    int64_t num_live;
+    int deletes_version;  // of "info.deletes_file"
+    bool deletes_dirty;   // "deleted" changed since it was written
+  };
+
+  // Marks docID "doc_id" of "segment" deleted.
+  static void Delete(Segment *segment, uint64_t doc_id);
+
+  // Writes the tombstones of the segments whose tombstones changed,
+  // and then the manifest.  The caller must hold lock_.
+  bool WriteChanges();
+
+  // Returns the segment with id "id".  The caller must hold lock_.
+  Segment *FindSegment(int64_t id);
+
+  // Reads the live documents of "info", whose tombstones are
+  // "deleted", appending them to "docs" and their docIDs to
+  // "doc_ids".
+  bool ReadLiveDocuments(const SegmentInfo &info, const Tombstones &deleted,
+                         std::vector<IndexDocument> *docs,
+                         std::vector<uint64_t> *doc_ids) const;
+
+  std::string Path(const std::string &file) const {
+    return dir_ + "/" + file;
+  }
+
+  static void *MergerMain(void *segment_index);
+
+  std::string dir_;
+
+  // Guards everything below.
+  mutable pthread_mutex_t lock_;
+
+  // Oldest first.
+  std::vector<Segment> segments_;
+  int64_t next_id_;
+
+  // Where each live document is: its name's segment id and docID.
+  std::map<std::string, std::pair<int64_t, uint64_t>> docs_;
+
+  // Whether a merge is running; only one runs at a time.
+  bool merging_;
+
+  // The merger thread, and what it waits for.
+  pthread_t merger_;
+  bool merger_running_;
+  pthread_cond_t merger_cond_;
+  bool changed_;
+  bool stop_merger_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_SEGMENTINDEX_H_
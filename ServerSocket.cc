@@ -148,6 +148,30 @@ bool ServerSocket::Accept(int *accepted_fd,
   // assign the file descriptor returned by accept to accepted_fd
   *accepted_fd = cfd;
 
+  if (!DescribeClient(cfd, client_addr, client_port, client_dnsname,
+                      server_addr, server_dnsname)) {
+    close(cfd);
+    *accepted_fd = -1;
+    return false;
+  }
+  return true;
+}
+
+bool ServerSocket::DescribeClient(int client_fd,
+                                  std::string *client_addr,
+                                  uint16_t *client_port,
+                                  std::string *client_dnsname,
+                                  std::string *server_addr,
+                                  std::string *server_dnsname) {
+  // The client's address, as accept() would have returned it.
+  struct sockaddr_storage addr_storage;
+  struct sockaddr *addr = reinterpret_cast<sockaddr*>(&addr_storage);
+  socklen_t addr_len = sizeof(sockaddr_storage);
+  if (getpeername(client_fd, addr, &addr_len) != 0) {
+    std::cerr << "getpeername() failed " << strerror(errno) << std::endl;
+    return false;
+  }
+
   // 2 cases of sock_family_: AF_INET and AF_INET6
   // the following code is inspired from lecture code example
   switch (addr->sa_family) {
@@ -176,8 +200,6 @@ bool ServerSocket::Accept(int *accepted_fd,
   default:
     {
       std::cerr << "address is neither IPv4 nor IPv6" << std::endl;
-      close(cfd);
-      *accepted_fd = -1;
       return false;
     }
   }
@@ -200,7 +222,7 @@ bool ServerSocket::Accept(int *accepted_fd,
       struct sockaddr_in srvr;
       socklen_t srvrlen = sizeof(srvr);
       char addrbuf[INET_ADDRSTRLEN];
-      getsockname(cfd, (struct sockaddr *) &srvr, &srvrlen);
+      getsockname(client_fd, (struct sockaddr *) &srvr, &srvrlen);
       inet_ntop(AF_INET, &srvr.sin_addr, addrbuf, INET_ADDRSTRLEN);
       // Get the server's dns name, or return it's IP address as
       // a substitute if the dns lookup fails.
@@ -215,7 +237,7 @@ bool ServerSocket::Accept(int *accepted_fd,
       struct sockaddr_in6 srvr;
       socklen_t srvrlen = sizeof(srvr);
       char addrbuf[INET6_ADDRSTRLEN];
-      getsockname(cfd, (struct sockaddr *) &srvr, &srvrlen);
+      getsockname(client_fd, (struct sockaddr *) &srvr, &srvrlen);
       inet_ntop(AF_INET6, &srvr.sin6_addr, addrbuf, INET6_ADDRSTRLEN);
       // Get the server's dns name, or return it's IP address as
       // a substitute if the dns lookup fails.
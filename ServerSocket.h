@@ -83,6 +83,15 @@ class ServerSocket {
               std::string *client_dnsname, std::string *server_addr,
               std::string *server_dnsname);
 
+  // Returns, through the same output parameters as Accept(), the
+  // information about both ends of "client_fd", a connection accepted
+  // some other way (e.g., by an IoLoop).  Returns false on failure,
+  // in which case the caller should close "client_fd".
+  bool DescribeClient(int client_fd,
+                      std::string *client_addr, uint16_t *client_port,
+                      std::string *client_dnsname, std::string *server_addr,
+                      std::string *server_dnsname);
+
  private:
   uint16_t port_;
   int listen_sock_fd_;
@@ -0,0 +1,175 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_TASK_H_
+#define HW4_TASK_H_
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace hw4 {
+
+// A Task<T> is a coroutine that produces a T (or nothing, for
+// Task<void>), so that code which waits for I/O can be written as
+// ordinary sequential code:
+//
+//   Task<int> CountBytes(IoLoop *loop, int fd) {
+//     int total = 0;
+//     while (true) {
+//       RecvResult r = co_await AsyncRecv(loop, fd);
+//       if (r.result <= 0)
+//         co_return total;
+//       total += r.result;
+//     }
+//   }
+//
+// Each co_await of an operation suspends the coroutine, returning
+// control to whoever resumed it last (usually an IoLoop's RunOnce()),
+// and the operation's completion resumes it where it left off.
+//
+// A Task doesn't start running until it is co_await'ed by another
+// coroutine, which is then suspended until the Task finishes and
+// gets its result; or until it is passed to Spawn(), which starts it
+// with nobody waiting.  A Task that is never started is destroyed,
+// unstarted, with the Task object.
+//
+// Exceptions thrown by a Task terminate the program, as they would on
+// any of the server's threads.
+template <typename T = void>
+class Task;
+
+namespace task_internal {
+
+// What the promise types of all Tasks have in common: whom to resume
+// when the Task finishes, and whether anybody is waiting at all.
+class PromiseBase {
+ public:
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  // When the coroutine finishes, control goes straight to the
+  // coroutine that co_await'ed it; a spawned one just frees itself.
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> h) noexcept {
+      PromiseBase &promise = h.promise();
+      if (promise.detached_) {
+        h.destroy();
+        return std::noop_coroutine();
+      }
+      return promise.continuation_;
+    }
+    void await_resume() noexcept { }
+  };
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() noexcept { std::terminate(); }
+
+  std::coroutine_handle<> continuation_;
+  bool detached_ = false;
+};
+
+template <typename T>
+class Promise : public PromiseBase {
+ public:
+  Task<T> get_return_object() noexcept;
+  void return_value(T value) { value_.emplace(std::move(value)); }
+  T result() { return std::move(*value_); }
+
+ private:
+  std::optional<T> value_;
+};
+
+template <>
+class Promise<void> : public PromiseBase {
+ public:
+  Task<void> get_return_object() noexcept;
+  void return_void() noexcept { }
+  void result() noexcept { }
+};
+
+}  // namespace task_internal
+
+template <typename T>
+class Task {
+ public:
+  typedef task_internal::Promise<T> promise_type;
+
+  Task() noexcept { }
+  Task(Task &&other) noexcept : handle_(other.handle_) {
+    other.handle_ = nullptr;
+  }
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (handle_)
+        handle_.destroy();
+      handle_ = other.handle_;
+      other.handle_ = nullptr;
+    }
+    return *this;
+  }
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task() {
+    if (handle_)
+      handle_.destroy();
+  }
+
+  // co_await'ing a Task runs it until it finishes, and returns its
+  // result.  Each Task can be co_await'ed once.
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<> waiter) noexcept {
+    handle_.promise().continuation_ = waiter;
+    return handle_;
+  }
+  T await_resume() { return handle_.promise().result(); }
+
+ private:
+  template <typename U> friend class task_internal::Promise;
+  friend void Spawn(Task<void> task);
+
+  explicit Task(std::coroutine_handle<promise_type> handle) noexcept
+    : handle_(handle) { }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+// Starts running "task", which frees itself when it finishes.  Spawn()
+// returns when the task first suspends (or finishes).
+inline void Spawn(Task<void> task) {
+  std::coroutine_handle<Task<void>::promise_type> handle = task.handle_;
+  task.handle_ = nullptr;
+  handle.promise().detached_ = true;
+  handle.resume();
+}
+
+namespace task_internal {
+
+template <typename T>
+Task<T> Promise<T>::get_return_object() noexcept {
+  return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() noexcept {
+  return Task<void>(
+      std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+}  // namespace task_internal
+
+}  // namespace hw4
+
+#endif  // HW4_TASK_H_
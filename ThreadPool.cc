@@ -10,7 +10,10 @@
  */
 
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <vector>
 
 #include "./ThreadPool.h"
 
@@ -138,4 +141,47 @@ void *ThreadLoop(void *tpool) {
   return nullptr;
 }
 
+namespace {
+
+// The batches of a ParallelFor(), which its threads take in turn.
+struct ParallelForWork {
+  size_t n;
+  size_t batch;
+  const std::function<void(size_t, size_t)> *fn;
+  std::atomic<size_t> next;
+};
+
+void *ParallelForThread(void *arg) {
+  ParallelForWork *work = static_cast<ParallelForWork *>(arg);
+  while (true) {
+    size_t begin = work->next.fetch_add(work->batch);
+    if (begin >= work->n)
+      break;
+    (*work->fn)(begin, std::min(begin + work->batch, work->n));
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+void ParallelFor(size_t n, size_t batch, int num_threads,
+                 const std::function<void(size_t, size_t)> &fn) {
+  ParallelForWork work;
+  work.n = n;
+  work.batch = std::max<size_t>(batch, 1);
+  work.fn = &fn;
+  work.next = 0;
+  size_t num_batches = (n + work.batch - 1) / work.batch;
+  size_t num_helpers = std::min<size_t>(std::max(num_threads, 1),
+                                        std::max<size_t>(num_batches, 1)) - 1;
+  std::vector<pthread_t> helpers(num_helpers);
+  for (pthread_t &helper : helpers) {
+    Verify333(pthread_create(&helper, nullptr, &ParallelForThread,
+                             static_cast<void *>(&work)) == 0);
+  }
+  ParallelForThread(&work);
+  for (pthread_t &helper : helpers)
+    Verify333(pthread_join(helper, nullptr) == 0);
+}
+
 }  // namespace hw4
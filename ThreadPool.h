@@ -16,7 +16,9 @@ extern "C" {
 #include <pthread.h>  // for the pthread threading/mutex functions
 }
 
+#include <stddef.h>   // for size_t
 #include <stdint.h>   // for uint32_t, etc.
+#include <functional>  // for std::function
 #include <list>       // for std::list
 
 namespace hw4 {
@@ -41,8 +43,9 @@ class ThreadPool {
   // pull a task off the task queue and invoke the thread_task_fn
   // function pointer inside of it, passing it the Task* itself as an
   // argument.  The thread_task_fn takes ownership of the Task and
-  // must arrange to delete the task when it is done.  Customers will
-  // probably want to subclass Task to add task-specific fields to it.
+  // must arrange to delete (or recycle) the task when it is done.
+  // Customers will probably want to subclass Task to add task-specific
+  // fields to it.
   class Task;
   typedef void (*thread_task_fn)(Task *arg);
 
@@ -85,6 +88,15 @@ class ThreadPool {
   pthread_t *thread_array_;
 };
 
+// Calls "fn" with every batch of "batch" indices from 0 to "n" - 1, as
+// the range [begin, end) (the last batch may be smaller), on up to
+// "num_threads" threads: the calling thread, and as many more as
+// there are batches for, which each take the next batch until there
+// are none left.  Returns once every call has.  Unlike a ThreadPool,
+// which is for long-lived work, this is for splitting up one job.
+void ParallelFor(size_t n, size_t batch, int num_threads,
+                 const std::function<void(size_t begin, size_t end)> &fn);
+
 }  // namespace hw4
 
 #endif  // HW4_THREADPOOL_H_
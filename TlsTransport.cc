@@ -0,0 +1,214 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include "./TlsTransport.h"
+
+namespace hw4 {
+
+// static
+const long TlsContext::kSessionCacheSize = 20000;  // NOLINT(runtime/int)
+const long TlsContext::kSessionTimeout = 3600;     // NOLINT(runtime/int)
+
+// Identifies this server's sessions in the session cache and tickets.
+static const unsigned char kSessionIdContext[] = "333gle";
+
+// The application protocols we speak, most preferred first, in ALPN's
+// wire format: each is preceded by its length.
+static const unsigned char kAlpnProtocols[] = "\x02h2\x08http/1.1";
+
+// Picks the first of kAlpnProtocols that the client offers.
+static int SelectAlpn(SSL *ssl, const unsigned char **out,
+                      unsigned char *outlen, const unsigned char *in,
+                      unsigned int inlen, void *arg) {
+  unsigned char *selected;
+  if (SSL_select_next_proto(&selected, outlen, kAlpnProtocols,
+                            sizeof(kAlpnProtocols) - 1, in, inlen) !=
+      OPENSSL_NPN_NEGOTIATED)
+    return SSL_TLSEXT_ERR_NOACK;
+  *out = selected;
+  return SSL_TLSEXT_ERR_OK;
+}
+
+TlsContext::~TlsContext() {
+  if (ctx_ != nullptr)
+    SSL_CTX_free(ctx_);
+}
+
+bool TlsContext::Init(const std::string &cert_file,
+                      const std::string &key_file) {
+  ctx_ = SSL_CTX_new(TLS_server_method());
+  if (ctx_ == nullptr) {
+    ERR_print_errors_fp(stderr);
+    return false;
+  }
+  SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+  SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS |
+                            SSL_OP_NO_RENEGOTIATION |
+                            SSL_OP_CIPHER_SERVER_PREFERENCE);
+
+  // Session resumption: tickets are on by default; also keep a cache
+  // for clients that send session IDs instead.
+  SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_sess_set_cache_size(ctx_, kSessionCacheSize);
+  SSL_CTX_set_timeout(ctx_, kSessionTimeout);
+  SSL_CTX_set_session_id_context(ctx_, kSessionIdContext,
+                                 sizeof(kSessionIdContext) - 1);
+
+  // Offer HTTP/2 to clients that can speak it.
+  SSL_CTX_set_alpn_select_cb(ctx_, SelectAlpn, nullptr);
+
+  if (SSL_CTX_use_certificate_chain_file(ctx_, cert_file.c_str()) != 1 ||
+      SSL_CTX_use_PrivateKey_file(ctx_, key_file.c_str(),
+                                  SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_check_private_key(ctx_) != 1) {
+    ERR_print_errors_fp(stderr);
+    return false;
+  }
+  return true;
+}
+
+TlsTransport::TlsTransport(TlsContext *ctx, int fd)
+  : ssl_(SSL_new(ctx->ctx())), ok_(false) {
+  if (ssl_ != nullptr)
+    ok_ = (SSL_set_fd(ssl_, fd) == 1);
+}
+
+bool TlsTransport::Handshake() {
+  if (!ok_)
+    return false;
+  int res;
+  do {
+    res = SSL_accept(ssl_);
+  } while (res != 1 && SSL_get_error(ssl_, res) == SSL_ERROR_SYSCALL &&
+           (errno == EINTR || errno == EAGAIN));
+  ok_ = (res == 1);
+  ERR_clear_error();
+  return ok_;
+}
+
+void TlsTransport::Close() {
+  if (ssl_ == nullptr)
+    return;
+  if (ok_)
+    SSL_shutdown(ssl_);
+  SSL_free(ssl_);
+  ssl_ = nullptr;
+  ok_ = false;
+}
+
+std::string TlsTransport::alpn_protocol() const {
+  const unsigned char *proto = nullptr;
+  unsigned int len = 0;
+  if (ssl_ != nullptr)
+    SSL_get0_alpn_selected(ssl_, &proto, &len);
+  if (proto == nullptr)
+    return "";
+  return std::string(reinterpret_cast<const char *>(proto), len);
+}
+
+bool TlsTransport::session_reused() const {
+  return ssl_ != nullptr && SSL_session_reused(ssl_) == 1;
+}
+
+bool TlsTransport::ktls_send() const {
+  return ssl_ != nullptr && BIO_get_ktls_send(SSL_get_wbio(ssl_));
+}
+
+bool TlsTransport::HasPending() const {
+  return ssl_ != nullptr && SSL_has_pending(ssl_);
+}
+
+// Returns true if a failed SSL call with result "res" should just be
+// retried.
+static bool ShouldRetry(SSL *ssl, int res) {
+  int err = SSL_get_error(ssl, res);
+  if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+    return true;
+  return err == SSL_ERROR_SYSCALL && (errno == EINTR || errno == EAGAIN);
+}
+
+ssize_t TlsTransport::Readv(const struct iovec *iov, int iovcnt) {
+  if (!ok_)
+    return -1;
+
+  // Fill the buffers in order, but only block for the first byte:
+  // after that, take only what is already decrypted.
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    if (i > 0 && SSL_pending(ssl_) == 0)
+      break;
+    size_t n;
+    int res;
+    do {
+      res = SSL_read_ex(ssl_, iov[i].iov_base, iov[i].iov_len, &n);
+    } while (res != 1 && ShouldRetry(ssl_, res));
+    if (res != 1) {
+      bool eof = (SSL_get_error(ssl_, res) == SSL_ERROR_ZERO_RETURN);
+      ERR_clear_error();
+      if (total > 0)
+        break;
+      ok_ = false;
+      return eof ? 0 : -1;
+    }
+    total += n;
+    if (n < iov[i].iov_len)
+      break;
+  }
+  return total;
+}
+
+bool TlsTransport::WriteAll(const char *data, size_t len) {
+  while (ok_ && len > 0) {
+    size_t n;
+    int res = SSL_write_ex(ssl_, data, len, &n);
+    if (res != 1) {
+      if (ShouldRetry(ssl_, res))
+        continue;
+      ERR_clear_error();
+      ok_ = false;
+      break;
+    }
+    data += n;
+    len -= n;
+  }
+  return ok_;
+}
+
+bool TlsTransport::SendFile(int fd, off_t offset, size_t len) {
+  if (!ok_)
+    return false;
+  if (!ktls_send())
+    return SendFileByCopy(fd, offset, len);
+
+  while (len > 0) {
+    ossl_ssize_t res = SSL_sendfile(ssl_, fd, offset, len, 0);
+    if (res < 0) {
+      if (ShouldRetry(ssl_, res))
+        continue;
+      ERR_clear_error();
+      ok_ = false;
+      return false;
+    }
+    if (res == 0)
+      return false;  // the file got shorter
+    offset += res;
+    len -= res;
+  }
+  return true;
+}
+
+}  // namespace hw4
@@ -0,0 +1,96 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_TLSTRANSPORT_H_
+#define HW4_TLSTRANSPORT_H_
+
+#include <openssl/ssl.h>
+#include <string>
+
+#include "./Transport.h"
+
+namespace hw4 {
+
+// The server side TLS configuration that every connection shares: the
+// certificate and key, and the state that lets returning clients skip
+// the expensive part of the handshake.  Clients can resume a session
+// either with a session ticket (which OpenSSL encrypts with keys kept
+// here, so the server stores nothing per client) or, for clients that
+// don't do tickets, from a cache of the last kSessionCacheSize
+// sessions.  A TlsContext is thread-safe once Init() has returned.
+class TlsContext {
+ public:
+  TlsContext() : ctx_(nullptr) { }
+  virtual ~TlsContext();
+
+  TlsContext(const TlsContext &) = delete;
+  TlsContext &operator=(const TlsContext &) = delete;
+
+  // Loads the PEM-encoded certificate chain in "cert_file" and the
+  // matching private key in "key_file".  Returns false, after printing
+  // OpenSSL's reasons to stderr, if they can't be used.
+  bool Init(const std::string &cert_file, const std::string &key_file);
+
+  SSL_CTX *ctx() const { return ctx_; }
+
+  static const long kSessionCacheSize;  // NOLINT(runtime/int)
+  static const long kSessionTimeout;    // NOLINT(runtime/int)
+
+ private:
+  SSL_CTX *ctx_;
+};
+
+// A Transport that speaks TLS over a socket.  The socket stays owned
+// by whoever owns it (e.g., a TcpTransport); Close() just ends the
+// TLS session.
+//
+// The kernel's TLS offload (kTLS) is used when the kernel and the
+// negotiated cipher support it.  OpenSSL then hands the session keys
+// to the kernel after the handshake, so that SendFile() can use
+// sendfile() and stay zero-copy just like plain TCP.  Without kTLS,
+// SendFile() reads the file and encrypts it in user space.
+class TlsTransport : public Transport {
+ public:
+  TlsTransport(TlsContext *ctx, int fd);
+  virtual ~TlsTransport() { Close(); }
+
+  // Does the server side of the handshake.  Returns false if it
+  // failed, in which case the connection should be closed.
+  bool Handshake();
+
+  // Sends a close_notify, if the session is still up, and frees it.
+  void Close();
+
+  // The application protocol the handshake agreed on with ALPN ("h2"
+  // or "http/1.1"), or "" if the client didn't ask for one.
+  std::string alpn_protocol() const;
+
+  // True if the handshake resumed an earlier session.
+  bool session_reused() const;
+
+  // True if records are being encrypted by the kernel.
+  bool ktls_send() const;
+
+  ssize_t Readv(const struct iovec *iov, int iovcnt) override;
+  bool WriteAll(const char *data, size_t len) override;
+  bool SendFile(int fd, off_t offset, size_t len) override;
+
+  // True if OpenSSL has buffered record data not yet read.
+  bool HasPending() const override;
+
+ private:
+  SSL *ssl_;
+  bool ok_;  // false once an error or EOF has been seen
+};
+
+}  // namespace hw4
+
+#endif  // HW4_TLSTRANSPORT_H_
@@ -0,0 +1,130 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <string>
+#include <vector>
+
+#include "./Tokenizer.h"
+
+using std::vector;
+
+namespace hw4 {
+
+// Records the words that start or end in a block of "n" bytes at
+// offset "base", whose letters are the set bits of "letters" (bit i
+// for byte i).  "in_word" and "start" carry a word over from block to
+// block.
+static inline void AddWords(uint32_t letters, int n, size_t base,
+                            bool *in_word, size_t *start,
+                            vector<Tokenizer::Word> *words) {
+  // A bit is set where a byte is a letter and the one before isn't,
+  // or the other way around; those alternate between starts and ends.
+  uint64_t shifted = (static_cast<uint64_t>(letters) << 1) | *in_word;
+  uint32_t block = (static_cast<uint64_t>(1) << n) - 1;
+  uint32_t changes = (letters ^ shifted) & block;
+  while (changes != 0) {
+    size_t pos = base + __builtin_ctz(changes);
+    if (*in_word)
+      words->push_back({*start, pos - *start});
+    else
+      *start = pos;
+    *in_word = !*in_word;
+    changes &= changes - 1;
+  }
+}
+
+#if defined(__SSE2__)
+// Tokenize()'s loop, 32 bytes at a time with AVX2.  The Makefile
+// targets baseline x86-64, which doesn't have AVX2, so this is
+// compiled for AVX2 on its own, and only called where
+// __builtin_cpu_supports() says the CPU has it.  Returns where it
+// stopped, with fewer than 32 of the "len" bytes at "buf" left.
+__attribute__((target("avx2")))
+static size_t TokenizeAvx2(char *buf, size_t len, bool *in_word,
+                           size_t *start, vector<Tokenizer::Word> *words) {
+  const __m256i case_bit = _mm256_set1_epi8(0x20),
+                a = _mm256_set1_epi8('a'), z = _mm256_set1_epi8(25);
+  size_t pos = 0;
+  for (; pos + 32 <= len; pos += 32) {
+    __m256i *at = reinterpret_cast<__m256i *>(buf + pos);
+    __m256i v = _mm256_loadu_si256(at);
+    __m256i t = _mm256_sub_epi8(_mm256_or_si256(v, case_bit), a);
+    __m256i letter = _mm256_cmpeq_epi8(_mm256_min_epu8(t, z), t);
+    _mm256_storeu_si256(
+      at, _mm256_or_si256(v, _mm256_and_si256(letter, case_bit)));
+    AddWords(static_cast<uint32_t>(_mm256_movemask_epi8(letter)), 32, pos,
+             in_word, start, words);
+  }
+  return pos;
+}
+#endif
+
+void Tokenizer::Tokenize(const char *text, size_t len) {
+  lowered_.assign(text, len);
+  words_.clear();
+  char *buf = &lowered_[0];
+  size_t pos = 0;
+  bool in_word = false;
+  size_t start = 0;
+
+  // A byte b is a letter if (b | 0x20) - 'a' is at most 25, unsigned,
+  // and then b | 0x20 is its lower case.
+#if defined(__SSE2__)
+  if (__builtin_cpu_supports("avx2"))
+    pos = TokenizeAvx2(buf, len, &in_word, &start, &words_);
+  const __m128i case_bit = _mm_set1_epi8(0x20), a = _mm_set1_epi8('a'),
+                z = _mm_set1_epi8(25);
+  while (pos + 16 <= len) {
+    __m128i *at = reinterpret_cast<__m128i *>(buf + pos);
+    __m128i v = _mm_loadu_si128(at);
+    __m128i t = _mm_sub_epi8(_mm_or_si128(v, case_bit), a);
+    __m128i letter = _mm_cmpeq_epi8(_mm_min_epu8(t, z), t);
+    _mm_storeu_si128(at, _mm_or_si128(v, _mm_and_si128(letter, case_bit)));
+    AddWords(static_cast<uint32_t>(_mm_movemask_epi8(letter)), 16, pos,
+             &in_word, &start, &words_);
+    pos += 16;
+  }
+#endif
+  TokenizeFrom(pos, in_word, start);
+}
+
+void Tokenizer::TokenizeScalar(const char *text, size_t len) {
+  lowered_.assign(text, len);
+  words_.clear();
+  TokenizeFrom(0, false, 0);
+}
+
+void Tokenizer::TokenizeFrom(size_t pos, bool in_word, size_t start) {
+  char *buf = &lowered_[0];
+  size_t len = lowered_.size();
+  for (; pos < len; pos++) {
+    uint8_t lower = static_cast<uint8_t>(buf[pos]) | 0x20;
+    bool letter = lower >= 'a' && lower <= 'z';
+    if (letter)
+      buf[pos] = lower;
+    if (letter == in_word)
+      continue;
+    if (in_word)
+      words_.push_back({start, pos - start});
+    else
+      start = pos;
+    in_word = letter;
+  }
+  if (in_word)
+    words_.push_back({start, len - start});
+}
+
+}  // namespace hw4
@@ -0,0 +1,72 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_TOKENIZER_H_
+#define HW4_TOKENIZER_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+namespace hw4 {
+
+// A Tokenizer splits text into words as hw2's FileParser does: a word
+// is a run of (ASCII) letters, in lower case.  The i'th word of the
+// text has position i.
+//
+// Tokenize() classifies and lowercases the text 32 bytes at a time
+// with AVX2, on CPUs that have it, or 16 at a time with SSE2, on the
+// rest of x86-64, and a byte at a time elsewhere; TokenizeScalar()
+// always goes a byte at a time, and gives the same words.  Rather than a string
+// per word, the words are offsets into a lowercased copy of the text,
+// and both of those buffers are kept from one text to the next, so a
+// Tokenizer that is reused (one per thread) stops allocating once it
+// has seen its largest text.
+class Tokenizer {
+ public:
+  // A word: lowered()[offset, offset + length).
+  struct Word {
+    size_t offset;
+    size_t length;
+  };
+
+  Tokenizer() = default;
+  virtual ~Tokenizer() { }
+
+  // Splits the "len" bytes at "text" into words, replacing the words
+  // of the last text.
+  void Tokenize(const char *text, size_t len);
+  void TokenizeScalar(const char *text, size_t len);
+
+  // The words of the last text, in order, and the text with its words
+  // lowercased (its other bytes are unchanged).
+  const std::vector<Word> &words() const { return words_; }
+  const std::string &lowered() const { return lowered_; }
+
+  // The i'th word, copied out.
+  std::string word(size_t i) const {
+    return lowered_.substr(words_[i].offset, words_[i].length);
+  }
+
+ private:
+  // Tokenizes the bytes of the last text from "pos" on, a byte at a
+  // time; "in_word" says whether a word started at "start" is still
+  // going at "pos".
+  void TokenizeFrom(size_t pos, bool in_word, size_t start);
+
+  std::string lowered_;
+  std::vector<Word> words_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_TOKENIZER_H_
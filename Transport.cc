@@ -0,0 +1,91 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "./Transport.h"
+
+namespace hw4 {
+
+bool Transport::SendFileByCopy(int fd, off_t offset, size_t len) {
+  char buf[16384];
+  while (len > 0) {
+    ssize_t res = pread(fd, buf, std::min(len, sizeof(buf)), offset);
+    if (res == -1 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return false;
+    if (!WriteAll(buf, res))
+      return false;
+    offset += res;
+    len -= res;
+  }
+  return true;
+}
+
+void TcpTransport::Close() {
+  if (fd_ != -1)
+    close(fd_);
+  fd_ = -1;
+}
+
+ssize_t TcpTransport::Readv(const struct iovec *iov, int iovcnt) {
+  ssize_t res;
+  while (1) {
+    res = readv(fd_, iov, iovcnt);
+    if (res == -1) {
+      if ((errno == EAGAIN) || (errno == EINTR))
+        continue;
+    }
+    break;
+  }
+  return res;
+}
+
+bool TcpTransport::WriteAll(const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t res = write(fd_, data, len);
+    if (res == -1) {
+      if ((errno == EAGAIN) || (errno == EINTR))
+        continue;
+      return false;
+    }
+    if (res == 0)
+      return false;
+    data += res;
+    len -= res;
+  }
+  return true;
+}
+
+bool TcpTransport::SendFile(int fd, off_t offset, size_t len) {
+  while (len > 0) {
+    ssize_t res = sendfile(fd_, fd, &offset, len);
+    if (res == -1) {
+      if ((errno == EAGAIN) || (errno == EINTR))
+        continue;
+      // Not every kind of file or socket supports sendfile().
+      if ((errno == EINVAL) || (errno == ENOSYS))
+        return SendFileByCopy(fd, offset, len);
+      return false;
+    }
+    if (res == 0)
+      return false;  // the file got shorter
+    len -= res;
+  }
+  return true;
+}
+
+}  // namespace hw4
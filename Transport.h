@@ -0,0 +1,83 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_TRANSPORT_H_
+#define HW4_TRANSPORT_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+namespace hw4 {
+
+// A Transport is the byte stream an HttpConnection talks to its client
+// over: a plain TCP socket (TcpTransport), or TLS on top of one
+// (TlsTransport).  All of the methods block, and retry after EINTR
+// and EAGAIN.
+class Transport {
+ public:
+  Transport() { }
+  virtual ~Transport() { }
+
+  Transport(const Transport &) = delete;
+  Transport &operator=(const Transport &) = delete;
+
+  // Reads into the "iovcnt" buffers described by "iov", like readv().
+  // Returns the number of bytes read, 0 on EOF, or -1 on error.
+  virtual ssize_t Readv(const struct iovec *iov, int iovcnt) = 0;
+
+  // Writes all "len" bytes at "data".  Returns false on error.
+  virtual bool WriteAll(const char *data, size_t len) = 0;
+
+  // Sends the "len" bytes starting at "offset" of the open file "fd",
+  // without copying them through user space if the transport can.
+  // Returns false on error, or if the file ends first.
+  virtual bool SendFile(int fd, off_t offset, size_t len) = 0;
+
+  // True if the transport has already taken bytes off the socket
+  // that Readv() will return, so that waiting for the socket to
+  // become readable could wait for nothing.
+  virtual bool HasPending() const { return false; }
+
+ protected:
+  // A SendFile() that pread()s the file and WriteAll()s it, for when
+  // nothing better is possible.
+  bool SendFileByCopy(int fd, off_t offset, size_t len);
+};
+
+// A Transport over a plain socket, which it owns.
+class TcpTransport : public Transport {
+ public:
+  explicit TcpTransport(int fd = -1) : fd_(fd) { }
+  virtual ~TcpTransport() { Close(); }
+
+  // Starts using socket "fd", which the transport now owns.
+  void Attach(int fd) { fd_ = fd; }
+
+  // Closes the socket, if there is one.
+  void Close();
+
+  int fd() const { return fd_; }
+
+  ssize_t Readv(const struct iovec *iov, int iovcnt) override;
+  bool WriteAll(const char *data, size_t len) override;
+
+  // Uses sendfile(), so the file's bytes go straight from the page
+  // cache to the socket.
+  bool SendFile(int fd, off_t offset, size_t len) override;
+
+ private:
+  int fd_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_TRANSPORT_H_
@@ -0,0 +1,191 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Measures the word table of an index build, as MemIndex does it,
+// with libhw1's HashTable and with FlatHashTable: every word of the
+// corpus is hashed with FNVHash64() and looked up, and new words are
+// inserted.  Then every distinct word, and as many words that aren't
+// there, are looked up again, as queries would.
+//
+// The corpus is the text files under "dir" (e.g., ../projdocs); by
+// default it is a synthetic one whose word frequencies follow Zipf's
+// law, like English text.
+//
+//   usage: ./bench_flathashtable [dir]
+
+#include <ctype.h>
+#include <ftw.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "./FlatHashTable.h"
+
+extern "C" {
+  #include "libhw1/HashTable.h"
+}
+
+using std::string;
+using std::vector;
+
+// The corpus, as the hashes of its words, in order.
+static vector<uint64_t> words;
+
+static uint64_t HashWord(const string &word) {
+  return FNVHash64(reinterpret_cast<unsigned char *>(
+                     const_cast<char *>(word.data())),
+                   static_cast<int>(word.size()));
+}
+
+// Adds the words of the file at "path" to the corpus, as MemIndex
+// would see them: runs of letters, in lower case.
+static int AddFile(const char *path, const struct stat *st, int type) {
+  if (type != FTW_F)
+    return 0;
+  std::ifstream in(path, std::ios::binary);
+  string contents((std::istreambuf_iterator<char>(in)),
+                  std::istreambuf_iterator<char>());
+  string word;
+  for (char c : contents) {
+    if (isalpha(static_cast<unsigned char>(c))) {
+      word += tolower(static_cast<unsigned char>(c));
+    } else if (!word.empty()) {
+      words.push_back(HashWord(word));
+      word.clear();
+    }
+  }
+  return 0;
+}
+
+// Fills the corpus with "n" words from a vocabulary of "vocab" words
+// whose frequencies follow Zipf's law.
+static void MakeCorpus(size_t n, size_t vocab) {
+  vector<double> cumulative(vocab);
+  double total = 0;
+  for (size_t i = 0; i < vocab; i++) {
+    total += 1.0 / (i + 1);
+    cumulative[i] = total;
+  }
+  uint64_t x = 88172645463325252ULL;
+  for (size_t i = 0; i < n; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    double r = (x >> 11) * (1.0 / 9007199254740992.0) * total;
+    size_t rank = std::lower_bound(cumulative.begin(), cumulative.end(),
+                                   r) - cumulative.begin();
+    words.push_back(HashWord("word" + std::to_string(rank)));
+  }
+}
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double> secs =
+    std::chrono::steady_clock::now() - start;
+  return secs.count();
+}
+
+static void Report(const char *name, double build_secs, double lookup_secs,
+                   size_t distinct, uint64_t check) {
+  printf("%-14s %14.0f %14.0f %10zu %20llu\n", name,
+         words.size() / build_secs, 2 * distinct / lookup_secs, distinct,
+         static_cast<unsigned long long>(check));  // NOLINT(runtime/int)
+}
+
+// The value for each word is its number of occurrences, standing in
+// for MemIndex's postings.
+static void BenchHashTable() {
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  HashTable *table = HashTable_Allocate(128);
+  vector<uint64_t> distinct;
+  for (uint64_t h : words) {
+    HTKeyValue_t kv, old;
+    if (HashTable_Find(table, h, &kv)) {
+      kv.value = reinterpret_cast<HTValue_t>(
+                   reinterpret_cast<uintptr_t>(kv.value) + 1);
+    } else {
+      kv.key = h;
+      kv.value = reinterpret_cast<HTValue_t>(1);
+      distinct.push_back(h);
+    }
+    HashTable_Insert(table, kv, &old);
+  }
+  double build_secs = Seconds(start);
+
+  start = std::chrono::steady_clock::now();
+  uint64_t check = 0;
+  for (uint64_t h : distinct) {
+    HTKeyValue_t kv;
+    if (HashTable_Find(table, h, &kv))
+      check += reinterpret_cast<uintptr_t>(kv.value);
+    if (HashTable_Find(table, ~h, &kv))
+      check++;
+  }
+  Report("HashTable", build_secs, Seconds(start), distinct.size(), check);
+  HashTable_Free(table, [](HTValue_t) { });
+}
+
+static void BenchFlatHashTable() {
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  hw4::FlatHashTable<uint64_t> table;
+  vector<uint64_t> distinct;
+  for (uint64_t h : words) {
+    uint64_t *count = table.Lookup(h);
+    if (count != nullptr) {
+      (*count)++;
+    } else {
+      uint64_t old;
+      table.Insert(h, 1, &old);
+      distinct.push_back(h);
+    }
+  }
+  double build_secs = Seconds(start);
+
+  start = std::chrono::steady_clock::now();
+  uint64_t check = 0, value;
+  for (uint64_t h : distinct) {
+    if (table.Find(h, &value))
+      check += value;
+    if (table.Find(~h, &value))
+      check++;
+  }
+  Report("FlatHashTable", build_secs, Seconds(start), distinct.size(),
+         check);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 2) {
+    fprintf(stderr, "usage: %s [dir]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (argc == 2) {
+    if (ftw(argv[1], AddFile, 16) != 0) {
+      perror(argv[1]);
+      return EXIT_FAILURE;
+    }
+  } else {
+    MakeCorpus(10000000, 500000);
+  }
+  printf("%zu words\n", words.size());
+
+  printf("%-14s %14s %14s %10s %20s\n", "table", "words/sec",
+         "lookups/sec", "distinct", "(check)");
+  BenchHashTable();
+  BenchFlatHashTable();
+  return EXIT_SUCCESS;
+}
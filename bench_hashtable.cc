@@ -0,0 +1,160 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Measures the throughput of a shared table under a read-mostly mix
+// of operations (90% lookups, 5% inserts, 5% removes) from a growing
+// number of threads: libhw1's HashTable, which has to be guarded by
+// a single mutex to be shared, against ConcurrentHashTable.  Every
+// run starts from a table of the same size, so that both tables
+// already span a lot of memory.
+//
+//   usage: ./bench_hashtable [operations_per_thread]
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "./ConcurrentHashTable.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+  #include "libhw1/HashTable.h"
+}
+
+// The keys are drawn from a space twice the size of the initial
+// table, so lookups hit about half the time.
+static const uint64_t kInitialKeys = 1 << 20;
+static const uint64_t kKeySpace = 2 * kInitialKeys;
+
+// What a shared libhw1 HashTable takes.
+class LockedHashTable {
+ public:
+  explicit LockedHashTable(size_t num_buckets)
+    : table_(HashTable_Allocate(num_buckets)) {
+    Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+  }
+  ~LockedHashTable() {
+    HashTable_Free(table_, [](HTValue_t) { });
+    pthread_mutex_destroy(&lock_);
+  }
+
+  bool Insert(uint64_t key, uint64_t value, uint64_t *old_value) {
+    HTKeyValue_t kv, old;
+    kv.key = key;
+    kv.value = reinterpret_cast<HTValue_t>(value);
+    Verify333(pthread_mutex_lock(&lock_) == 0);
+    bool replaced = HashTable_Insert(table_, kv, &old);
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    if (replaced)
+      *old_value = reinterpret_cast<uint64_t>(old.value);
+    return replaced;
+  }
+
+  bool Find(uint64_t key, uint64_t *value) {
+    HTKeyValue_t kv;
+    Verify333(pthread_mutex_lock(&lock_) == 0);
+    bool found = HashTable_Find(table_, key, &kv);
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    if (found)
+      *value = reinterpret_cast<uint64_t>(kv.value);
+    return found;
+  }
+
+  bool Remove(uint64_t key, uint64_t *value) {
+    HTKeyValue_t kv;
+    Verify333(pthread_mutex_lock(&lock_) == 0);
+    bool found = HashTable_Remove(table_, key, &kv);
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    if (found)
+      *value = reinterpret_cast<uint64_t>(kv.value);
+    return found;
+  }
+
+ private:
+  HashTable *table_;
+  pthread_mutex_t lock_;
+};
+
+// Runs "n" operations on "table", with keys from a private
+// pseudo-random sequence.  Returns the number of lookups that hit, so
+// the work can't be optimized away.
+template <typename Table>
+static uint64_t RunMix(Table *table, int n, uint64_t seed) {
+  uint64_t hits = 0, value;
+  uint64_t x = seed * 0x9E3779B97F4A7C15ULL + 1;
+  for (int i = 0; i < n; i++) {
+    // xorshift64
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    uint64_t key = x % kKeySpace;
+    int op = static_cast<int>((x >> 40) % 100);
+    if (op < 90)
+      hits += table->Find(key, &value);
+    else if (op < 95)
+      table->Insert(key, key, &value);
+    else
+      table->Remove(key, &value);
+  }
+  return hits;
+}
+
+template <typename Table>
+static void Bench(const char *name, int n, unsigned int max_threads) {
+  for (unsigned int t = 1; t <= max_threads; t *= 2) {
+    Table table(kInitialKeys);
+    uint64_t value;
+    for (uint64_t k = 0; k < kKeySpace; k += 2)
+      table.Insert(k, k, &value);
+
+    std::vector<uint64_t> hits(t);
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < t; i++) {
+      threads.emplace_back([&table, &hits, n, i] {
+        hits[i] = RunMix(&table, n, i + 1);
+      });
+    }
+    for (std::thread &th : threads)
+      th.join();
+    std::chrono::duration<double> secs =
+      std::chrono::steady_clock::now() - start;
+
+    uint64_t total_hits = 0;
+    for (uint64_t h : hits)
+      total_hits += h;
+    double ops = static_cast<double>(n) * t;
+    printf("%-12s %8u %14.0f %10.2f\n", name, t, ops / secs.count(),
+           total_hits / (ops * 0.9));
+  }
+}
+
+int main(int argc, char **argv) {
+  int n = (argc > 1) ? atoi(argv[1]) : 2000000;
+  if (n <= 0) {
+    fprintf(stderr, "usage: %s [operations_per_thread]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int max_threads = std::thread::hardware_concurrency();
+  if (max_threads == 0)
+    max_threads = 1;
+
+  printf("%-12s %8s %14s %10s\n", "table", "threads", "ops/sec",
+         "hit rate");
+  Bench<LockedHashTable>("HashTable", n, max_threads);
+  Bench<hw4::ConcurrentHashTable<uint64_t>>("Concurrent", n, max_threads);
+  return EXIT_SUCCESS;
+}
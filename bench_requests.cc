@@ -0,0 +1,166 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Measures the cost of reading and parsing requests, as HttpServer's
+// connection threads do, with the request headers allocated from the
+// heap or from the connection's arena.  For each mode and number of
+// threads it reports operator new calls per request and the
+// aggregate requests per second.
+//
+//   usage: ./bench_requests [requests_per_thread]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./HttpConnection.h"
+#include "./HttpRequest.h"
+#include "./HttpUtils.h"
+
+using std::string;
+
+static std::atomic<uint64_t> num_news(0);
+
+void *operator new(size_t size) {
+  num_news.fetch_add(1, std::memory_order_relaxed);
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+// The heap's memory_resource uses the aligned forms.
+void *operator new(size_t size, std::align_val_t align) {
+  num_news.fetch_add(1, std::memory_order_relaxed);
+  void *p = aligned_alloc(static_cast<size_t>(align),
+                          (size + static_cast<size_t>(align) - 1) &
+                          ~(static_cast<size_t>(align) - 1));
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+  free(p);
+}
+
+// A typical browser request for a query page.
+static const char *kRequest =
+  "GET /query?terms=some+search+terms HTTP/1.1\r\n"
+  "Host: localhost:5555\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:77.0) "
+  "Gecko/20100101 Firefox/77.0\r\n"
+  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+  "image/webp,*/*;q=0.8\r\n"
+  "Accept-Language: en-US,en;q=0.5\r\n"
+  "Accept-Encoding: gzip, deflate\r\n"
+  "Referer: http://localhost:5555/query?terms=other+terms\r\n"
+  "Connection: keep-alive\r\n"
+  "Upgrade-Insecure-Requests: 1\r\n"
+  "Cache-Control: max-age=0\r\n"
+  "\r\n";
+
+// Requests are written this many at a time, so they fit in the
+// socket buffer.
+static const int kBatch = 16;
+
+// Reads and parses "n" requests on a connection of its own.
+static void RunConnection(int n, bool use_arena) {
+  int sp[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sp) != 0) {
+    perror("socketpair");
+    exit(EXIT_FAILURE);
+  }
+  string batch;
+  for (int i = 0; i < kBatch; i++)
+    batch += kRequest;
+
+  hw4::HttpConnection conn(sp[0]);
+  for (int done = 0; done < n; done += kBatch) {
+    if (hw4::WrappedWrite(sp[1], (unsigned char *) batch.data(),
+                          batch.size()) != static_cast<int>(batch.size())) {
+      perror("write");
+      exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < kBatch; i++) {
+      {
+        hw4::HttpRequest req(use_arena ? conn.arena() :
+                             std::pmr::get_default_resource());
+        if (!conn.GetNextRequest(&req)) {
+          fprintf(stderr, "GetNextRequest failed\n");
+          exit(EXIT_FAILURE);
+        }
+        hw4::URLParser parser;
+        parser.Parse(req.uri());
+        if (parser.arg("terms").empty()) {
+          fprintf(stderr, "bad parse\n");
+          exit(EXIT_FAILURE);
+        }
+      }
+      conn.arena()->Reset();
+    }
+  }
+  close(sp[1]);
+}
+
+int main(int argc, char **argv) {
+  int n = (argc > 1) ? atoi(argv[1]) : 200000;
+  n -= n % kBatch;
+  if (n <= 0) {
+    fprintf(stderr, "usage: %s [requests_per_thread]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int max_threads = std::thread::hardware_concurrency();
+  if (max_threads == 0)
+    max_threads = 1;
+
+  printf("%-6s %8s %14s %14s\n", "mode", "threads", "news/request",
+         "requests/sec");
+  for (int use_arena = 0; use_arena <= 1; use_arena++) {
+    for (unsigned int t = 1; t <= max_threads; t *= 2) {
+      num_news = 0;
+      std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (unsigned int i = 0; i < t; i++)
+        threads.emplace_back(RunConnection, n, use_arena != 0);
+      for (std::thread &th : threads)
+        th.join();
+      std::chrono::duration<double> secs =
+        std::chrono::steady_clock::now() - start;
+
+      double requests = static_cast<double>(n) * t;
+      printf("%-6s %8u %14.1f %14.0f\n", use_arena ? "arena" : "heap", t,
+             num_news / requests, requests / secs.count());
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Measures the Tokenizer on one core, in MB/s: Tokenize(), which uses
+// SSE2 (or AVX2, when built with -mavx2), against TokenizeScalar(),
+// and checks that they split the corpus into the same words.
+//
+// The corpus is the text files under "dir" (e.g., ../projdocs); by
+// default it is synthetic English-like text.  Add -O2 (and -mavx2) to
+// CFLAGS for meaningful numbers.
+//
+//   usage: ./bench_tokenizer [dir]
+
+#include <ftw.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "./Tokenizer.h"
+
+using std::string;
+using std::vector;
+
+// The documents of the corpus.
+static vector<string> docs;
+static size_t corpus_bytes = 0;
+
+static int AddFile(const char *path, const struct stat *st, int type) {
+  if (type != FTW_F)
+    return 0;
+  std::ifstream in(path, std::ios::binary);
+  docs.emplace_back((std::istreambuf_iterator<char>(in)),
+                    std::istreambuf_iterator<char>());
+  corpus_bytes += docs.back().size();
+  return 0;
+}
+
+// Fills the corpus with "n" documents of about "size" bytes each, of
+// capitalized words of 1 to 12 letters, spaces, and punctuation.
+static void MakeCorpus(size_t n, size_t size) {
+  uint64_t x = 88172645463325252ULL;
+  for (size_t d = 0; d < n; d++) {
+    string doc;
+    while (doc.size() < size) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      size_t len = 1 + x % 12;
+      for (size_t i = 0; i < len; i++)
+        doc += static_cast<char>((i == 0 && x % 5 == 0 ? 'A' : 'a') +
+                                 (x >> (8 + 2 * i)) % 26);
+      doc += (x >> 40) % 8 == 0 ? ". " : " ";
+    }
+    corpus_bytes += doc.size();
+    docs.push_back(doc);
+  }
+}
+
+// Tokenizes the corpus "rounds" times with "fn", returning MB/s and
+// adding the number of words to "words".
+template <typename Fn>
+static double Bench(int rounds, Fn fn, uint64_t *words) {
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (const string &doc : docs)
+      *words += fn(doc);
+  }
+  std::chrono::duration<double> secs =
+    std::chrono::steady_clock::now() - start;
+  return rounds * corpus_bytes / 1e6 / secs.count();
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    if (ftw(argv[1], &AddFile, 16) != 0) {
+      fprintf(stderr, "couldn't read %s\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+  } else {
+    MakeCorpus(2000, 8192);
+  }
+  if (corpus_bytes == 0) {
+    fprintf(stderr, "the corpus is empty\n");
+    return EXIT_FAILURE;
+  }
+
+  // The same words, either way.
+  hw4::Tokenizer vectorized, scalar;
+  for (const string &doc : docs) {
+    vectorized.Tokenize(doc.data(), doc.size());
+    scalar.TokenizeScalar(doc.data(), doc.size());
+    bool same = vectorized.lowered() == scalar.lowered() &&
+      vectorized.words().size() == scalar.words().size();
+    for (size_t i = 0; same && i < scalar.words().size(); i++) {
+      same = vectorized.words()[i].offset == scalar.words()[i].offset &&
+        vectorized.words()[i].length == scalar.words()[i].length;
+    }
+    if (!same) {
+      fprintf(stderr, "Tokenize() and TokenizeScalar() differ\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  int rounds = std::max<int>(1, 200000000 / corpus_bytes);
+  uint64_t words = 0;
+  double scalar_mbs = Bench(rounds, [&](const string &doc) {
+    scalar.TokenizeScalar(doc.data(), doc.size());
+    return scalar.words().size();
+  }, &words);
+  double vectorized_mbs = Bench(rounds, [&](const string &doc) {
+    vectorized.Tokenize(doc.data(), doc.size());
+    return vectorized.words().size();
+  }, &words);
+
+  printf("%zu documents, %zu bytes, %d rounds\n", docs.size(),
+         corpus_bytes, rounds);
+  printf("%-12s %10s\n", "tokenizer", "MB/s/core");
+  printf("%-12s %10.0f\n", "scalar", scalar_mbs);
+#if defined(__SSE2__)
+  printf("%-12s %10.0f\n",
+         __builtin_cpu_supports("avx2") ? "avx2" : "sse2", vectorized_mbs);
+#else
+  printf("%-12s %10.0f\n", "(scalar)", vectorized_mbs);
+#endif
+  printf("(%llu words)\n",
+         static_cast<unsigned long long>(words));  // NOLINT(runtime/int)
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Builds (or brings up to date) a segment directory that http333d can
+// serve, of the text files under a directory tree.  Run it again after
+// the tree changes: only the files that changed are parsed again.
+//
+//   usage: ./buildsegments crawl_root segment_dir
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "./Crawler.h"
+#include "./SegmentIndex.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+
+// The name of the crawler's manifest in the segment directory.
+static const char *kCrawlManifest = "CRAWLED";
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    cerr << "Usage: " << argv[0] << " crawl_root segment_dir" << endl;
+    return EXIT_FAILURE;
+  }
+  string root = argv[1], dir = argv[2];
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    cerr << "couldn't create " << dir << endl;
+    return EXIT_FAILURE;
+  }
+
+  hw4::SegmentIndex index;
+  hw4::Crawler crawler(&index, dir + "/" + kCrawlManifest);
+  if (!index.Open(dir) || !crawler.Open()) {
+    cerr << "couldn't read " << dir << endl;
+    return EXIT_FAILURE;
+  }
+  hw4::CrawlStats stats;
+  if (!crawler.Crawl(root, &stats)) {
+    cerr << "couldn't crawl " << root << " into " << dir << endl;
+    return EXIT_FAILURE;
+  }
+
+  // Merge what there is to merge before exiting.
+  bool merged = true;
+  while (merged) {
+    if (!index.Merge(&merged)) {
+      cerr << "couldn't merge the segments of " << dir << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  cout << stats.files << " files: " << stats.parsed << " parsed, "
+       << stats.unchanged << " touched but unchanged, " << stats.deleted
+       << " deleted; " << index.num_docs() << " documents in "
+       << index.segments().size() << " segments" << endl;
+  return EXIT_SUCCESS;
+}
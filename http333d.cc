@@ -10,40 +10,88 @@
  */
 
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <signal.h>
+#include <stdint.h>
 #include <cstdlib>
 #include <cstdio>
 #include <iostream>
 #include <list>
+#include <map>
 
 #include "./ServerSocket.h"
 #include "./HttpServer.h"
+#include "./MimeTypes.h"
 
 using std::cerr;
 using std::cout;
 using std::endl;
 using std::list;
+using std::map;
 using std::string;
 
 // Print out program usage, and exit() with EXIT_FAILURE.
 void Usage(char *progname);
 
+// The options of the server, as parsed by GetPortAndPath().
+struct ServerOptions {
+  string mimetypes;
+  map<string, int> max_ages;
+  size_t gzip_cache_bytes = hw4::HttpServer::kDefaultGzipCacheBytes;
+  bool gzip_queries = false;
+  size_t posting_cache_bytes = hw4::HttpServer::kDefaultPostingCacheBytes;
+  string cert_file;
+  string key_file;
+  bool use_io_uring = true;
+  bool validate_indices = true;
+};
+
 // Parses the command-line arguments, invokes Usage() on failure.
 // "port" is a return parameter to the port number to listen on,
 // "path" is a return parameter to the directory containing
 // our static files, and "indices" is a return parameter to a
-// list of index filenames.  Ensures that the path is a readable
+// list of index filenames (or segment directories, which are
+// written by a SegmentIndex).  Ensures that the path is a readable
 // directory, and the index filenames are readable, and if not,
 // invokes Usage() to exit.
+//
+// Options come before the positional arguments, and are returned
+// through the fields of "options":
+//   -m file   extend the built-in MIME types from a mime.types file
+//             ("mimetypes")
+//   -c prefix=seconds
+//             send "Cache-Control: max-age=seconds" for static files
+//             under the path prefix, e.g., -c /static/img/=86400
+//             (may be repeated; "max_ages")
+//   -Z bytes  keep at most this many bytes of gzip'ed static files in
+//             memory; 0 turns off on-the-fly compression
+//             ("gzip_cache_bytes")
+//   -z        gzip query results pages ("gzip_queries")
+//   -P bytes  keep at most this many bytes of index postings in
+//             memory; 0 turns off the cache ("posting_cache_bytes")
+//   -C file   serve HTTPS with the PEM certificate chain in this file
+//             ("cert_file")
+//   -K file   ...and the PEM private key in this file, which defaults
+//             to the certificate file ("key_file")
+//   -E        use epoll even if io_uring is available ("use_io_uring")
+//   -U        don't check the indices' checksums, which are otherwise
+//             checked as the indices are opened (hw3's files) or as
+//             queries read them and in the background (files with
+//             block checksums; "validate_indices")
 void GetPortAndPath(int argc,
                     char **argv,
                     uint16_t *port,
                     string *path,
-                    list<string> *indices);
+                    list<string> *indices,
+                    ServerOptions *options);
+
+// Parses the byte count "arg" of option "-opt" into "bytes", invoking
+// Usage() if it isn't a number that fits in a size_t.
+void ParseBytes(char opt, const char *arg, char *progname, size_t *bytes);
 
 int main(int argc, char **argv) {
   // Print out welcome message.
@@ -62,12 +110,37 @@ int main(int argc, char **argv) {
   uint16_t portnum;
   string staticdir;
   list<string> indices;
-  GetPortAndPath(argc, argv, &portnum, &staticdir, &indices);
+  ServerOptions options;
+  GetPortAndPath(argc, argv, &portnum, &staticdir, &indices, &options);
   cout << "    port: " << portnum << endl;
   cout << "    path: " << staticdir << endl;
 
+  // Extend the built-in MIME types before any worker threads start.
+  if (!options.mimetypes.empty()) {
+    if (!hw4::LoadMimeTypes(options.mimetypes)) {
+      cerr << "couldn't read MIME types from " << options.mimetypes << endl;
+      Usage(argv[0]);
+    }
+    cout << "    MIME types: " << options.mimetypes << endl;
+  }
+
   // Run the server.
   hw4::HttpServer hs(portnum, staticdir, indices);
+  for (const auto &max_age : options.max_ages) {
+    hs.SetCacheMaxAge(max_age.first, max_age.second);
+  }
+  hs.SetGzipCacheBytes(options.gzip_cache_bytes);
+  hs.SetGzipQueries(options.gzip_queries);
+  hs.SetPostingCacheBytes(options.posting_cache_bytes);
+  hs.SetUseIoUring(options.use_io_uring);
+  hs.SetValidateIndices(options.validate_indices);
+  if (!options.cert_file.empty()) {
+    if (!hs.EnableTls(options.cert_file, options.key_file)) {
+      cerr << "couldn't load the TLS certificate and key" << endl;
+      Usage(argv[0]);
+    }
+    cout << "    TLS certificate: " << options.cert_file << endl;
+  }
   if (!hs.Run()) {
     cerr << "  server failed to run!?" << endl;
   }
@@ -78,16 +151,34 @@ int main(int argc, char **argv) {
 
 
 void Usage(char *progname) {
-  cerr << "Usage: " << progname << " port staticfiles_directory indices+";
+  cerr << "Usage: " << progname
+       << " [-m mime.types] [-c prefix=seconds]... [-Z bytes] [-z]"
+       << " [-P bytes] [-C cert.pem [-K key.pem]] [-E] [-U]"
+       << " port staticfiles_directory indices+";
   cerr << endl;
   exit(EXIT_FAILURE);
 }
 
+void ParseBytes(char opt, const char *arg, char *progname, size_t *bytes) {
+  // strtoull() accepts (and negates) a leading '-', so only digits
+  // are allowed.
+  char *end;
+  errno = 0;
+  unsigned long long value = strtoull(arg, &end, 10);  // NOLINT(runtime/int)
+  if (*arg < '0' || *arg > '9' || *end != '\0' || errno == ERANGE ||
+      value > SIZE_MAX) {
+    cerr << "bad byte count \"" << arg << "\" for -" << opt << endl;
+    Usage(progname);
+  }
+  *bytes = value;
+}
+
 void GetPortAndPath(int argc,
                     char **argv,
                     uint16_t *port,
                     string *path,
-                    list<string> *indices) {
+                    list<string> *indices,
+                    ServerOptions *options) {
   // Be sure to check a few things:
   //  (a) that you have a sane number of command line arguments
   //  (b) that the port number is reasonable
@@ -97,13 +188,65 @@ void GetPortAndPath(int argc,
 
   // STEP 1:
 
+  // options come first
+  int opt;
+  while ((opt = getopt(argc, argv, "m:c:Z:zP:C:K:EU")) != -1) {
+    switch (opt) {
+      case 'm':
+        options->mimetypes = optarg;
+        break;
+      case 'c': {
+        string rule(optarg);
+        size_t eq = rule.find('=');
+        if (eq == string::npos || eq == 0 || rule[0] != '/' ||
+            atoi(rule.c_str() + eq + 1) < 0) {
+          cerr << "bad cache rule \"" << rule << "\"" << endl;
+          Usage(argv[0]);
+        }
+        options->max_ages[rule.substr(0, eq)] = atoi(rule.c_str() + eq + 1);
+        break;
+      }
+      case 'Z':
+        ParseBytes(opt, optarg, argv[0], &options->gzip_cache_bytes);
+        break;
+      case 'z':
+        options->gzip_queries = true;
+        break;
+      case 'P':
+        ParseBytes(opt, optarg, argv[0], &options->posting_cache_bytes);
+        break;
+      case 'C':
+        options->cert_file = optarg;
+        break;
+      case 'K':
+        options->key_file = optarg;
+        break;
+      case 'E':
+        options->use_io_uring = false;
+        break;
+      case 'U':
+        options->validate_indices = false;
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  if (options->cert_file.empty() && !options->key_file.empty()) {
+    cerr << "-K needs -C" << endl;
+    Usage(argv[0]);
+  }
+  if (options->key_file.empty())
+    options->key_file = options->cert_file;
+  char **args = argv + optind - 1;
+  int nargs = argc - optind + 1;
+
   // sanity check for command line arguments
-  if (argc < 4) {
+  if (nargs < 4) {
     Usage(argv[0]);
   }
 
   // sanity check for the port number
-  *port = atoi(argv[1]);
+  *port = atoi(args[1]);
   if (*port < 1024) {
     cerr << "port number is not reasonable (<1024)" << endl;
     Usage(argv[0]);
@@ -111,22 +254,29 @@ void GetPortAndPath(int argc,
 
   // sanity check for readable directory
   struct stat dirstat;
-  if (stat(argv[2], &dirstat) != 0) {
+  if (stat(args[2], &dirstat) != 0) {
     cerr << "stat error" << gai_strerror(errno) << endl;
     Usage(argv[0]);
   }
 
   if (!S_ISDIR(dirstat.st_mode)) {
-    cerr << argv[2] << " is not a directory." << endl;
+    cerr << args[2] << " is not a directory." << endl;
     Usage(argv[0]);
   }
 
   // passed the sanity check for valid and readable directory
-  *path = string(argv[2]);
+  *path = string(args[2]);
 
   // checking for requirement (d)
-  for (int i = 3; i < argc; i++) {
-    string idxfile(argv[i]);
+  for (int i = 3; i < nargs; i++) {
+    string idxfile(args[i]);
+
+    // a directory of segments is checked when it is opened
+    struct stat segments;
+    if (stat(args[i], &segments) == 0 && S_ISDIR(segments.st_mode)) {
+      indices->push_back(args[i]);
+      continue;
+    }
 
     if (idxfile.length() < 4 ||
         idxfile.substr(idxfile.find_last_of(".") + 1).compare("idx") != 0) {
@@ -134,7 +284,7 @@ void GetPortAndPath(int argc,
       continue;
     }
     struct stat file;
-    if (stat(argv[i], &file) == -1) {
+    if (stat(args[i], &file) == -1) {
       cerr << idxfile << " is not readable." << endl;
       continue;
     }
@@ -144,7 +294,7 @@ void GetPortAndPath(int argc,
       continue;
     }
 
-    indices->push_back(argv[i]);
+    indices->push_back(args[i]);
   }
 
   // no readable index file passed in
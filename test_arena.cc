@@ -0,0 +1,85 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "./Arena.h"
+#include "./HttpRequest.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+namespace hw4 {
+
+TEST(Test_Arena, TestArenaAllocate) {
+  Arena arena(128);
+  ASSERT_EQ(1U, arena.num_blocks());
+
+  // Allocations are aligned as asked and don't overlap.
+  char *a = static_cast<char *>(arena.allocate(3, 1));
+  uint64_t *b = static_cast<uint64_t *>(arena.allocate(8, 8));
+  ASSERT_EQ(0U, reinterpret_cast<uintptr_t>(b) % 8);
+  ASSERT_LE(a + 3, reinterpret_cast<char *>(b));
+  ASSERT_EQ(11U, arena.bytes_allocated());
+
+  // Outgrowing the block, or asking for more than a block, adds one.
+  char *c = static_cast<char *>(arena.allocate(120, 1));
+  char *d = static_cast<char *>(arena.allocate(1000, 16));
+  ASSERT_EQ(0U, reinterpret_cast<uintptr_t>(d) % 16);
+  ASSERT_NE(c, d);
+  ASSERT_EQ(3U, arena.num_blocks());
+  ASSERT_EQ(1131U, arena.bytes_allocated());
+
+  // Reset() leaves a single block big enough for all of that.
+  arena.Reset();
+  ASSERT_EQ(1U, arena.num_blocks());
+  ASSERT_EQ(0U, arena.bytes_allocated());
+  for (size_t len : {3, 8, 120, 1000})
+    ASSERT_NE(nullptr, arena.allocate(len, 8));
+  ASSERT_EQ(1U, arena.num_blocks());
+}
+
+TEST(Test_Arena, TestArenaContainers) {
+  Arena arena;
+  for (int round = 0; round < 3; round++) {
+    {
+      std::pmr::vector<std::pmr::string> v(&arena);
+      for (int i = 0; i < 100; i++)
+        v.emplace_back("a string too long for the small string buffer");
+      ASSERT_EQ(100U, v.size());
+      ASSERT_EQ("a string too long for the small string buffer", v[99]);
+      ASSERT_EQ(&arena, v[99].get_allocator().resource());
+    }
+    ASSERT_LT(0U, arena.bytes_allocated());
+    arena.Reset();
+  }
+  ASSERT_EQ(1U, arena.num_blocks());
+
+  // HttpRequest keeps its headers in the arena it was given.
+  {
+    HttpRequest req(&arena);
+    req.AddHeader("host", "somehost.foo.bar");
+    req.AddHeader("user-agent",
+                  "Mozilla/5.0 (X11; Linux x86_64; rv:77.0) Firefox/77.0");
+    req.AddHeader("host", "otherhost.foo.bar");
+    ASSERT_LT(0U, arena.bytes_allocated());
+    ASSERT_EQ(2, req.GetHeaderCount());
+    ASSERT_EQ("otherhost.foo.bar", req.GetHeaderValue("host"));
+    ASSERT_EQ("", req.GetHeaderValue("accept"));
+  }
+  arena.Reset();
+}
+
+}  // namespace hw4
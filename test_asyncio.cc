@@ -0,0 +1,132 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "./AsyncIo.h"
+#include "./FileReader.h"
+#include "./IoLoop.h"
+#include "./Task.h"
+#include "./ThreadPool.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::unique_ptr;
+
+namespace hw4 {
+
+// Receives from "fd" until the peer hangs up.
+static Task<> ReceiveAll(IoLoop *loop, int fd, string *out, bool *done) {
+  while (true) {
+    RecvResult r = co_await AsyncRecv(loop, fd);
+    if (r.result <= 0)
+      break;
+    out->append(r.data);
+  }
+  *done = true;
+}
+
+// Sends the file, then hangs up.
+static Task<> SendFileThenClose(IoLoop *loop, int fd, string path,
+                                uint64_t offset, uint64_t len,
+                                int *result) {
+  bool ok = co_await AsyncSendFile(loop, fd, path, offset, len);
+  shutdown(fd, SHUT_WR);
+  *result = ok ? 1 : 0;
+}
+
+static void TestSendAndReceive(IoLoop *loop) {
+  string path = "test_files/hextext.txt";
+  string contents;
+  ASSERT_TRUE(FileReader(".", path).ReadFile(&contents));
+
+  // Both ends of the conversation are coroutines on the one loop,
+  // interleaving as each waits for the other.
+  int sv[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+  string received;
+  bool done = false;
+  int sent = -1;
+  Spawn(ReceiveAll(loop, sv[1], &received, &done));
+  Spawn(SendFileThenClose(loop, sv[0], path, 100, contents.size() - 150,
+                          &sent));
+  for (int i = 0; i < 500 && !done; i++)
+    ASSERT_GE(loop->RunOnce(10), 0);
+  ASSERT_TRUE(done);
+  ASSERT_EQ(1, sent);
+  ASSERT_EQ(contents.substr(100, contents.size() - 150), received);
+  close(sv[0]);
+  close(sv[1]);
+
+  // A missing file is an error, before anything is sent.
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+  received.clear();
+  done = false;
+  Spawn(ReceiveAll(loop, sv[1], &received, &done));
+  Spawn(SendFileThenClose(loop, sv[0], "test_files/no_such_file", 0, 10,
+                          &sent));
+  for (int i = 0; i < 500 && !done; i++)
+    ASSERT_GE(loop->RunOnce(10), 0);
+  ASSERT_TRUE(done);
+  ASSERT_EQ(0, sent);
+  ASSERT_EQ("", received);
+  close(sv[0]);
+  close(sv[1]);
+}
+
+// Hops to the pool and back, recording which thread it ran on.
+static Task<> Hop(IoLoop *loop, ThreadPool *pool,
+                  pthread_t *worker, pthread_t *back, bool *done) {
+  co_await ResumeOn(pool);
+  *worker = pthread_self();
+  co_await ResumeOn(loop);
+  *back = pthread_self();
+  *done = true;
+}
+
+static void TestResumeOn(IoLoop *loop) {
+  ThreadPool pool(2);
+  pthread_t worker, back;
+  bool done = false;
+  Spawn(Hop(loop, &pool, &worker, &back, &done));
+  while (!done)
+    ASSERT_GE(loop->RunOnce(-1), 0);
+  ASSERT_FALSE(pthread_equal(worker, pthread_self()));
+  ASSERT_TRUE(pthread_equal(back, pthread_self()));
+}
+
+TEST(Test_AsyncIo, TestEpoll) {
+  unique_ptr<IoLoop> loop = IoLoop::Create(false);
+  ASSERT_NE(nullptr, loop.get());
+  TestSendAndReceive(loop.get());
+  TestResumeOn(loop.get());
+}
+
+TEST(Test_AsyncIo, TestUring) {
+  unique_ptr<IoLoop> loop = IoLoop::Create(true);
+  ASSERT_NE(nullptr, loop.get());
+  if (string("io_uring") != loop->name()) {
+    GTEST_SKIP() << "no io_uring here";
+  }
+  TestSendAndReceive(loop.get());
+  TestResumeOn(loop.get());
+}
+
+}  // namespace hw4
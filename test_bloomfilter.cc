@@ -0,0 +1,61 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+
+#include "./BloomFilter.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+namespace hw4 {
+
+TEST(Test_BloomFilter, TestEmpty) {
+  BloomFilter filter(0);
+  ASSERT_GT(filter.num_bits(), 0U);
+  for (uint64_t k = 0; k < 1000; k++)
+    ASSERT_FALSE(filter.MayContain(k));
+  filter.Add(42);
+  ASSERT_TRUE(filter.MayContain(42));
+}
+
+TEST(Test_BloomFilter, TestFalsePositives) {
+  // Every key that was added is found, and about 1% of the keys that
+  // weren't are, at the default 10 bits per key.
+  const uint64_t kKeys = 100000;
+  BloomFilter filter(kKeys);
+  for (uint64_t k = 0; k < kKeys; k++)
+    filter.Add(k * 7919);
+  for (uint64_t k = 0; k < kKeys; k++)
+    ASSERT_TRUE(filter.MayContain(k * 7919));
+
+  int false_positives = 0;
+  for (uint64_t k = 0; k < kKeys; k++) {
+    if (filter.MayContain(k * 7919 + 1))
+      false_positives++;
+  }
+  ASSERT_LT(false_positives, static_cast<int>(kKeys / 50));
+
+  // Fewer bits per key means more false positives.
+  BloomFilter small(kKeys, 4);
+  ASSERT_LT(small.num_bits(), filter.num_bits());
+  for (uint64_t k = 0; k < kKeys; k++)
+    small.Add(k * 7919);
+  int small_false_positives = 0;
+  for (uint64_t k = 0; k < kKeys; k++) {
+    ASSERT_TRUE(small.MayContain(k * 7919));
+    if (small.MayContain(k * 7919 + 1))
+      small_false_positives++;
+  }
+  ASSERT_GT(small_false_positives, false_positives);
+}
+
+}  // namespace hw4
@@ -0,0 +1,86 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "./Checksum.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+TEST(Test_Checksum, TestCrc32c) {
+  // The check values of CRC-32C, from RFC 3720.
+  ASSERT_EQ(0U, Crc32c("", 0));
+  ASSERT_EQ(0xE3069283U, Crc32c("123456789", 9));
+  string zeros(32, '\0');
+  ASSERT_EQ(0x8A9136AAU, Crc32c(zeros.data(), zeros.size()));
+  string ones(32, '\xff');
+  ASSERT_EQ(0x62A8AB43U, Crc32c(ones.data(), ones.size()));
+
+  // Continuing from the CRC of a prefix, at every split.
+  string text;
+  for (int i = 0; i < 100; i++)
+    text += static_cast<char>(i * 37 + 11);
+  uint32_t whole = Crc32c(text.data(), text.size());
+  for (size_t split = 0; split <= text.size(); split++) {
+    uint32_t crc = Crc32c(text.data(), split);
+    ASSERT_EQ(whole, Crc32c(text.data() + split, text.size() - split, crc));
+  }
+}
+
+TEST(Test_Checksum, TestCrc32) {
+  // The check value of CRC-32, which zlib and hw3 compute.
+  ASSERT_EQ(0U, Crc32("", 0));
+  ASSERT_EQ(0xCBF43926U, Crc32("123456789", 9));
+  ASSERT_EQ(0xCBF43926U, Crc32("6789", 4, Crc32("12345", 5)));
+  ASSERT_EQ(0xCBF43926U,
+            Crc32Combine(Crc32("12345", 5), Crc32("6789", 4), 4));
+}
+
+TEST(Test_Checksum, TestBlockChecksums) {
+  string data;
+  for (int i = 0; i < 10000; i++)
+    data += static_cast<char>(i * 131 + i / 7);
+  vector<uint32_t> serial, parallel;
+  ComputeBlockChecksums(data.data(), data.size(), 256, 1, &serial);
+  ASSERT_EQ(40U, serial.size());  // the last block is 16 bytes
+  ASSERT_EQ(Crc32c(data.data() + 39 * 256, 16), serial.back());
+  ComputeBlockChecksums(data.data(), data.size(), 256, 4, &parallel);
+  ASSERT_EQ(serial, parallel);
+  ComputeBlockChecksums(data.data(), 0, 256, 4, &parallel);
+  ASSERT_EQ(0U, parallel.size());
+
+  // The CRCs, then the trailer, in network byte order.
+  string encoded = EncodeBlockChecksums(serial, 256, kTrailerWordPositions);
+  ASSERT_EQ(4 * serial.size() + sizeof(ChecksumTrailer), encoded.size());
+  uint32_t crc;
+  memcpy(&crc, encoded.data() + 4, sizeof(crc));
+  ASSERT_EQ(serial[1], ntohl(crc));
+  ChecksumTrailer trailer;
+  memcpy(&trailer, encoded.data() + 4 * serial.size(), sizeof(trailer));
+  ASSERT_EQ(kChecksumMagic, ntohl(trailer.magic));
+  ASSERT_EQ(kTrailerWordPositions, ntohl(trailer.flags));
+  ASSERT_EQ(256U, ntohl(trailer.block_bytes));
+  ASSERT_EQ(40U, ntohl(trailer.num_blocks));
+  ASSERT_EQ(Crc32c(encoded.data(), 4 * serial.size()), ntohl(trailer.crc));
+}
+
+}  // namespace hw4
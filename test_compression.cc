@@ -0,0 +1,156 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <zlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./Compression.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+// Inflates the gzip stream "gz" into "out".
+static bool Gunzip(const string &gz, string *out) {
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, 15 + 16) != Z_OK)
+    return false;
+  zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(gz.data()));
+  zs.avail_in = gz.size();
+  int res = Z_OK;
+  char buf[4096];
+  out->clear();
+  while (res == Z_OK) {
+    zs.next_out = reinterpret_cast<Bytef *>(buf);
+    zs.avail_out = sizeof(buf);
+    res = inflate(&zs, Z_NO_FLUSH);
+    out->append(buf, sizeof(buf) - zs.avail_out);
+  }
+  inflateEnd(&zs);
+  return res == Z_STREAM_END;
+}
+
+TEST(Test_Compression, TestAcceptsGzip) {
+  ASSERT_TRUE(AcceptsGzip("gzip"));
+  ASSERT_TRUE(AcceptsGzip("deflate, gzip;q=0.5, br"));
+  ASSERT_TRUE(AcceptsGzip("*"));
+  ASSERT_TRUE(AcceptsGzip("x-gzip"));
+  ASSERT_FALSE(AcceptsGzip(""));
+  ASSERT_FALSE(AcceptsGzip("identity"));
+  ASSERT_FALSE(AcceptsGzip("gzip;q=0"));
+  ASSERT_FALSE(AcceptsGzip("gzip;q=0, *"));
+  ASSERT_FALSE(AcceptsGzip("*;q=0"));
+}
+
+TEST(Test_Compression, TestIsCompressibleType) {
+  ASSERT_TRUE(IsCompressibleType("text/html"));
+  ASSERT_TRUE(IsCompressibleType("text/csv"));
+  ASSERT_TRUE(IsCompressibleType("image/svg+xml"));
+  ASSERT_TRUE(IsCompressibleType("application/json"));
+  ASSERT_FALSE(IsCompressibleType("image/png"));
+  ASSERT_FALSE(IsCompressibleType("image/jpeg"));
+  ASSERT_FALSE(IsCompressibleType("application/gzip"));
+}
+
+TEST(Test_Compression, TestGzipRoundTrip) {
+  string text;
+  for (int i = 0; i < 1000; i++)
+    text += "<li> <a href=\"/static/foo.html\">foo.html</a> [3]<br>\n";
+
+  string gz, back;
+  ASSERT_TRUE(GzipCompress(text.data(), text.size(), &gz));
+  ASSERT_LT(gz.size(), text.size() / 10);
+  ASSERT_TRUE(Gunzip(gz, &back));
+  ASSERT_EQ(text, back);
+
+  // A stream written in flushed pieces decodes to the same thing,
+  // and each flush makes everything so far decodable.
+  GzipStream stream;
+  string streamed;
+  ASSERT_TRUE(stream.Write(text.data(), 100, true, &streamed));
+  ASSERT_FALSE(streamed.empty());
+  ASSERT_TRUE(stream.Write(text.data() + 100, text.size() - 100, false,
+                           &streamed));
+  ASSERT_TRUE(stream.Finish(&streamed));
+  ASSERT_TRUE(Gunzip(streamed, &back));
+  ASSERT_EQ(text, back);
+}
+
+TEST(Test_Compression, TestGzipCache) {
+  GzipCache cache(10);
+  string gz, type;
+  ASSERT_FALSE(cache.Lookup("a", "e1", &gz, &type));
+
+  cache.Insert("a", "e1", "aaaa", "text/plain");
+  cache.Insert("b", "e1", "bbbb", "text/html");
+  ASSERT_EQ(8U, cache.size());
+  ASSERT_TRUE(cache.Lookup("a", "e1", &gz, &type));
+  ASSERT_EQ("aaaa", gz);
+  ASSERT_EQ("text/plain", type);
+
+  // "b" is now least recently used, so it is evicted first.
+  cache.Insert("c", "e1", "cccc", "text/css");
+  ASSERT_FALSE(cache.Lookup("b", "e1", &gz, &type));
+  ASSERT_TRUE(cache.Lookup("a", "e1", &gz, &type));
+  ASSERT_TRUE(cache.Lookup("c", "e1", &gz, &type));
+
+  // A changed file (new ETag) misses and drops the stale entry.
+  ASSERT_FALSE(cache.Lookup("a", "e2", &gz, &type));
+  ASSERT_EQ(4U, cache.size());
+
+  // Entries bigger than the whole cache aren't kept.
+  cache.Insert("d", "e1", "ddddddddddddddd", "text/plain");
+  ASSERT_FALSE(cache.Lookup("d", "e1", &gz, &type));
+}
+
+TEST(Test_Compression, TestGzipCacheConcurrent) {
+  // Room for about half of the files at once.
+  GzipCache cache(50 * 100);
+  std::atomic<int> failures(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&, t] {
+      uint64_t x = t + 1;
+      string gz, type;
+      for (int i = 0; i < 20000; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        // File n's bytes are 100 copies of its last digit, and its
+        // ETag changes now and then.
+        int n = x % 100;
+        string fname = "f" + std::to_string(n);
+        string etag = std::to_string((x >> 8) % 2);
+        string bytes(100, '0' + n % 10);
+        if (cache.Lookup(fname, etag, &gz, &type)) {
+          if (gz != bytes || type != etag)
+            failures++;
+        } else {
+          cache.Insert(fname, etag, bytes, etag);
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+  ASSERT_EQ(0, failures.load());
+  ASSERT_LE(cache.size(), cache.capacity());
+}
+
+}  // namespace hw4
@@ -0,0 +1,147 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./ConcurrentHashTable.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+TEST(Test_ConcurrentHashTable, TestBasic) {
+  ConcurrentHashTable<string> table(64);
+  string value;
+  ASSERT_EQ(0U, table.NumElements());
+  ASSERT_FALSE(table.Find(1, &value));
+  ASSERT_FALSE(table.Remove(1, &value));
+
+  ASSERT_FALSE(table.Insert(1, "one", &value));
+  ASSERT_FALSE(table.Insert(2, "two", &value));
+  ASSERT_EQ(2U, table.NumElements());
+  ASSERT_TRUE(table.Find(1, &value));
+  ASSERT_EQ("one", value);
+
+  // Replacing returns the old value.
+  ASSERT_TRUE(table.Insert(1, "uno", &value));
+  ASSERT_EQ("one", value);
+  ASSERT_EQ(2U, table.NumElements());
+  ASSERT_TRUE(table.Find(1, &value));
+  ASSERT_EQ("uno", value);
+
+  ASSERT_TRUE(table.Remove(2, &value));
+  ASSERT_EQ("two", value);
+  ASSERT_FALSE(table.Find(2, &value));
+  ASSERT_EQ(1U, table.NumElements());
+}
+
+TEST(Test_ConcurrentHashTable, TestGrowing) {
+  // Every key stays findable, and removable, while the stripes grow
+  // (and are part way through moving their entries).
+  ConcurrentHashTable<uint64_t> table(64);
+  size_t initial_buckets = table.NumBuckets();
+  const uint64_t kKeys = 100000;
+  uint64_t value;
+  for (uint64_t k = 0; k < kKeys; k++) {
+    ASSERT_FALSE(table.Insert(k, k * 3, &value));
+    if (k % 997 == 0) {
+      for (uint64_t j = 0; j <= k; j += 101) {
+        ASSERT_TRUE(table.Find(j, &value));
+        ASSERT_EQ(j * 3, value);
+      }
+    }
+  }
+  ASSERT_EQ(kKeys, table.NumElements());
+  ASSERT_GE(table.NumBuckets(), initial_buckets * 64);
+  ASSERT_FALSE(table.Find(kKeys, &value));
+
+  for (uint64_t k = 0; k < kKeys; k += 2)
+    ASSERT_TRUE(table.Remove(k, &value));
+  for (uint64_t k = 0; k < kKeys; k++)
+    ASSERT_EQ(k % 2 == 1, table.Find(k, &value));
+  ASSERT_EQ(kKeys / 2, table.NumElements());
+}
+
+TEST(Test_ConcurrentHashTable, TestStress) {
+  // Writers each insert, replace, and remove their own keys, checking
+  // as they go, while readers look up a set of keys that never
+  // change; all of them share the stripes, which grow meanwhile.
+  ConcurrentHashTable<uint64_t> table(64);
+  const uint64_t kStable = 1000;
+  const uint64_t kStableBase = 1ULL << 40;
+  uint64_t value;
+  for (uint64_t k = 0; k < kStable; k++)
+    table.Insert(kStableBase + k, k, &value);
+
+  const int kWriters = 4, kReaders = 4;
+  const uint64_t kKeysPerWriter = 20000;
+  std::atomic<int> writers_done(0);
+  std::atomic<int> failures(0);
+  vector<std::thread> threads;
+  for (int w = 0; w < kWriters; w++) {
+    threads.emplace_back([&, w] {
+      uint64_t base = static_cast<uint64_t>(w) << 32;
+      uint64_t v;
+      for (uint64_t k = 0; k < kKeysPerWriter; k++) {
+        if (table.Insert(base + k, k, &v))
+          failures++;
+        if (!table.Find(base + k, &v) || v != k)
+          failures++;
+        if (!table.Insert(base + k, k + 1, &v) || v != k)
+          failures++;
+      }
+      // Take back every third key.
+      for (uint64_t k = 0; k < kKeysPerWriter; k += 3) {
+        if (!table.Remove(base + k, &v) || v != k + 1)
+          failures++;
+      }
+      writers_done++;
+    });
+  }
+  for (int r = 0; r < kReaders; r++) {
+    threads.emplace_back([&, r] {
+      uint64_t v;
+      uint64_t k = r;
+      while (writers_done.load() < kWriters) {
+        k = (k + 7) % kStable;
+        if (!table.Find(kStableBase + k, &v) || v != k)
+          failures++;
+      }
+    });
+  }
+  for (std::thread &t : threads)
+    t.join();
+  ASSERT_EQ(0, failures.load());
+
+  uint64_t removed = (kKeysPerWriter + 2) / 3;
+  ASSERT_EQ(kStable + kWriters * (kKeysPerWriter - removed),
+            table.NumElements());
+  for (int w = 0; w < kWriters; w++) {
+    uint64_t base = static_cast<uint64_t>(w) << 32;
+    for (uint64_t k = 0; k < kKeysPerWriter; k++) {
+      bool found = table.Find(base + k, &value);
+      ASSERT_EQ(k % 3 != 0, found);
+      if (found) {
+        ASSERT_EQ(k + 1, value);
+      }
+    }
+  }
+}
+
+}  // namespace hw4
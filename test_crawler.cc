@@ -0,0 +1,212 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include "libhw1/HashTable.h"
+}
+
+#include "./Crawler.h"
+#include "./QueryEngine.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+class Test_Crawler : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    TearDown();
+    ASSERT_EQ(0, mkdir(kTree, 0755));
+    ASSERT_EQ(0, mkdir((string(kTree) + "/sub").c_str(), 0755));
+    ASSERT_EQ(0, mkdir(kSegments, 0755));
+    WriteFile("a.txt", "The zebra.");
+    WriteFile("b.txt", "A lion, and the zebra!");
+    WriteFile("sub/c.txt", "Bikes");
+  }
+
+  void TearDown() override {
+    RemoveDir(string(kTree) + "/sub");
+    RemoveDir(kTree);
+    RemoveDir(kSegments);
+  }
+
+  static void RemoveDir(const string &path) {
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr)
+      return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+      unlink((path + "/" + entry->d_name).c_str());
+    closedir(dir);
+    rmdir(path.c_str());
+  }
+
+  static void WriteFile(const string &name, const string &contents) {
+    std::ofstream out(string(kTree) + "/" + name, std::ios::binary);
+    out << contents;
+  }
+
+  static string Path(const string &name) {
+    return string(kTree) + "/" + name;
+  }
+
+  // Returns the names of the documents that have "word", sorted.
+  static vector<string> Query(QueryEngine *engine, const string &word) {
+    vector<QueryEngine::Result> results;
+    engine->ProcessQuery({word}, &results);
+    vector<string> names;
+    for (const QueryEngine::Result &result : results)
+      names.push_back(result.document_name);
+    std::sort(names.begin(), names.end());
+    return names;
+  }
+
+  static constexpr const char *kTree = "test_files/test_crawl_tree";
+  static constexpr const char *kSegments = "test_files/test_crawl_segments";
+  static constexpr const char *kManifest =
+    "test_files/test_crawl_segments/CRAWLED";
+};
+
+TEST_F(Test_Crawler, TestParseDocument) {
+  Tokenizer tokenizer;
+  IndexDocument doc = ParseDocument("d", "The cat, the DOG; e-mail 42x",
+                                    &tokenizer);
+  ASSERT_EQ("d", doc.name);
+  ASSERT_EQ((vector<int32_t>{0, 2}), doc.words["the"]);
+  ASSERT_EQ(vector<int32_t>{1}, doc.words["cat"]);
+  ASSERT_EQ(vector<int32_t>{3}, doc.words["dog"]);
+  ASSERT_EQ(vector<int32_t>{4}, doc.words["e"]);
+  ASSERT_EQ(vector<int32_t>{5}, doc.words["mail"]);
+  ASSERT_EQ(vector<int32_t>{6}, doc.words["x"]);
+  ASSERT_EQ(6U, doc.words.size());
+}
+
+TEST_F(Test_Crawler, TestHashContents) {
+  for (string contents : {string(), string("The zebra."),
+                          string("\0\xff bytes", 8)}) {
+    ASSERT_EQ(FNVHash64(reinterpret_cast<unsigned char *>(&contents[0]),
+                        static_cast<int>(contents.size())),
+              HashContents(contents));
+  }
+}
+
+TEST_F(Test_Crawler, TestRecrawl) {
+  SegmentIndex index;
+  ASSERT_TRUE(index.Open(kSegments));
+  Crawler crawler(&index, kManifest, 2);
+  ASSERT_TRUE(crawler.Open());
+  CrawlStats stats;
+  ASSERT_FALSE(crawler.Crawl("test_files/non-existent", &stats));
+  ASSERT_TRUE(crawler.Crawl(kTree, &stats));
+  ASSERT_EQ(3U, stats.files);
+  ASSERT_EQ(3U, stats.parsed);
+  ASSERT_EQ(3U, index.num_docs());
+
+  QueryEngine engine;
+  engine.SetManifestCheckMs(0);
+  ASSERT_TRUE(engine.AddSegments(kSegments));
+  ASSERT_EQ((vector<string>{Path("a.txt"), Path("b.txt")}),
+            Query(&engine, "zebra"));
+  ASSERT_EQ(vector<string>{Path("sub/c.txt")}, Query(&engine, "bikes"));
+
+  // Nothing changed, so nothing is parsed, or written.
+  size_t num_segments = index.segments().size();
+  ASSERT_TRUE(crawler.Crawl(kTree, &stats));
+  ASSERT_EQ(3U, stats.files);
+  ASSERT_EQ(0U, stats.parsed);
+  ASSERT_EQ(num_segments, index.segments().size());
+
+  // A changed file is parsed again, and replaces its document; one
+  // whose mtime changed but not its contents isn't.
+  WriteFile("b.txt", "A lion, and no stripes at all");
+  struct timespec times[2] = {{0, UTIME_OMIT}, {12345, 0}};
+  ASSERT_EQ(0, utimensat(AT_FDCWD, Path("a.txt").c_str(), times, 0));
+  ASSERT_TRUE(crawler.Crawl(kTree, &stats));
+  ASSERT_EQ(1U, stats.parsed);
+  ASSERT_EQ(1U, stats.unchanged);
+  ASSERT_EQ(3U, index.num_docs());
+  ASSERT_EQ(vector<string>{Path("a.txt")}, Query(&engine, "zebra"));
+  ASSERT_EQ(vector<string>{Path("b.txt")}, Query(&engine, "stripes"));
+
+  // A file that's gone is deleted, and a new one added.
+  ASSERT_EQ(0, unlink(Path("sub/c.txt").c_str()));
+  WriteFile("sub/d.txt", "More bikes");
+  ASSERT_TRUE(crawler.Crawl(kTree, &stats));
+  ASSERT_EQ(3U, stats.files);
+  ASSERT_EQ(1U, stats.parsed);
+  ASSERT_EQ(0U, stats.unchanged);
+  ASSERT_EQ(1U, stats.deleted);
+  ASSERT_EQ(vector<string>{Path("sub/d.txt")}, Query(&engine, "bikes"));
+
+  // The manifest remembers all of that.
+  SegmentIndex reopened;
+  ASSERT_TRUE(reopened.Open(kSegments));
+  Crawler recrawler(&reopened, kManifest);
+  ASSERT_TRUE(recrawler.Open());
+  ASSERT_TRUE(recrawler.Crawl(kTree, &stats));
+  ASSERT_EQ(3U, stats.files);
+  ASSERT_EQ(0U, stats.parsed);
+  ASSERT_EQ(0U, stats.deleted);
+  ASSERT_EQ(3U, reopened.num_docs());
+}
+
+TEST_F(Test_Crawler, TestUnreadable) {
+  SegmentIndex index;
+  ASSERT_TRUE(index.Open(kSegments));
+  Crawler crawler(&index, kManifest, 2);
+  ASSERT_TRUE(crawler.Open());
+  CrawlStats stats;
+  ASSERT_TRUE(crawler.Crawl(kTree, &stats));
+
+  // A changed file that can't be read keeps its document, rather than
+  // being deleted, and a new one is left out.  (Root can read them.)
+  bool root = geteuid() == 0;
+  WriteFile("b.txt", "A lion, and no stripes at all");
+  WriteFile("e.txt", "Stripes");
+  ASSERT_EQ(0, chmod(Path("b.txt").c_str(), 0));
+  ASSERT_EQ(0, chmod(Path("e.txt").c_str(), 0));
+  ASSERT_TRUE(crawler.Crawl(kTree, &stats));
+  ASSERT_EQ(root ? 4U : 3U, stats.files);
+  ASSERT_EQ(root ? 2U : 0U, stats.parsed);
+  ASSERT_EQ(0U, stats.deleted);
+  ASSERT_EQ(root ? 4U : 3U, index.num_docs());
+
+  QueryEngine engine;
+  ASSERT_TRUE(engine.AddSegments(kSegments));
+  vector<string> zebras = {Path("a.txt")};
+  if (!root)
+    zebras.push_back(Path("b.txt"));
+  ASSERT_EQ(zebras, Query(&engine, "zebra"));
+
+  // Once it can be read, it's parsed again.
+  ASSERT_EQ(0, chmod(Path("b.txt").c_str(), 0644));
+  ASSERT_EQ(0, chmod(Path("e.txt").c_str(), 0644));
+  ASSERT_TRUE(crawler.Crawl(kTree, &stats));
+  ASSERT_EQ(4U, stats.files);
+  ASSERT_EQ(root ? 0U : 2U, stats.parsed);
+  ASSERT_EQ(4U, index.num_docs());
+}
+
+}  // namespace hw4
@@ -0,0 +1,151 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "./DocIterator.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::unique_ptr;
+using std::vector;
+
+namespace hw4 {
+
+// Random postings: each of "num_docs" documents has the word with
+// probability 1 / "every", some number of times.
+static vector<DocPosting> RandomPostings(uint64_t num_docs, int every,
+                                         unsigned int *seed) {
+  vector<DocPosting> postings;
+  for (uint64_t doc = 1; doc <= num_docs; doc++) {
+    if (rand_r(seed) % every == 0)
+      postings.push_back({doc, 1 + static_cast<int>(rand_r(seed) % 5)});
+  }
+  return postings;
+}
+
+static unique_ptr<DocIterator> Term(const vector<DocPosting> &postings) {
+  return unique_ptr<DocIterator>(new TermIterator(
+    std::make_shared<const vector<DocPosting>>(postings)));
+}
+
+// The number of times "doc" is in "postings", or 0.
+static int Count(const vector<DocPosting> &postings, uint64_t doc) {
+  for (const DocPosting &posting : postings) {
+    if (posting.doc_id == doc)
+      return posting.num_positions;
+  }
+  return 0;
+}
+
+// Walks "it" as QueryEngine does, keeping the best "k" documents (or
+// all of them, if "k" is 0), best first.
+static vector<std::pair<int, uint64_t>> Best(DocIterator *it, size_t k) {
+  vector<std::pair<int, uint64_t>> best;  // (-score, doc), a max-heap
+  uint64_t target = 0;
+  while (true) {
+    bool full = k > 0 && best.size() == k;
+    it->Advance(target, full ? -best.front().first : DocIterator::kNoMinimum);
+    if (it->doc() == DocIterator::kEnd)
+      break;
+    std::pair<int, uint64_t> doc(-it->score(), it->doc());
+    if (full && doc < best.front()) {
+      std::pop_heap(best.begin(), best.end());
+      best.pop_back();
+    }
+    if (!full || best.size() < k) {
+      best.push_back(doc);
+      std::push_heap(best.begin(), best.end());
+    }
+    target = it->doc() + 1;
+  }
+  std::sort_heap(best.begin(), best.end());
+  return best;
+}
+
+TEST(Test_DocIterator, TestTerm) {
+  vector<DocPosting> postings;
+  for (uint64_t doc = 1; doc <= 1000; doc += 3)
+    postings.push_back({doc, static_cast<int>(doc % 7)});
+  unique_ptr<DocIterator> it = Term(postings);
+  ASSERT_EQ(6, it->max_score());
+  ASSERT_EQ(1U, it->doc());
+  ASSERT_EQ(1, it->score());
+
+  // Advancing goes to the first document at or after the target, and
+  // never backwards.
+  it->Advance(500, DocIterator::kNoMinimum);
+  ASSERT_EQ(502U, it->doc());
+  it->Advance(502, DocIterator::kNoMinimum);
+  ASSERT_EQ(502U, it->doc());
+  it->Advance(10, DocIterator::kNoMinimum);
+  ASSERT_EQ(502U, it->doc());
+  it->Advance(503, DocIterator::kNoMinimum);
+  ASSERT_EQ(505U, it->doc());
+
+  // A word that can't score enough is done.
+  it->Advance(0, 6);
+  ASSERT_EQ(DocIterator::kEnd, it->doc());
+}
+
+TEST(Test_DocIterator, TestBooleans) {
+  unsigned int seed = 333;
+  vector<DocPosting> a = RandomPostings(2000, 2, &seed);
+  vector<DocPosting> b = RandomPostings(2000, 5, &seed);
+  vector<DocPosting> c = RandomPostings(2000, 50, &seed);
+  vector<DocPosting> d = RandomPostings(2000, 3, &seed);
+
+  // a OR (b c -d), every document, and then the best few, each time
+  // checked against working them out one document at a time.
+  auto build = [&]() {
+    vector<unique_ptr<DocIterator>> required, excluded, either;
+    required.push_back(Term(b));
+    required.push_back(Term(c));
+    excluded.push_back(Term(d));
+    either.push_back(Term(a));
+    either.push_back(unique_ptr<DocIterator>(
+      new AndIterator(std::move(required), std::move(excluded))));
+    return unique_ptr<DocIterator>(new OrIterator(std::move(either)));
+  };
+  vector<std::pair<int, uint64_t>> expected;
+  for (uint64_t doc = 1; doc <= 2000; doc++) {
+    int score = Count(a, doc);
+    bool and_matches = Count(b, doc) > 0 && Count(c, doc) > 0 &&
+      Count(d, doc) == 0;
+    if (and_matches)
+      score += Count(b, doc) + Count(c, doc);
+    if (Count(a, doc) > 0 || and_matches)
+      expected.push_back({-score, doc});
+  }
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(15, build()->max_score());
+  ASSERT_EQ(expected, Best(build().get(), 0));
+  for (size_t k : {1, 5, 20}) {
+    vector<std::pair<int, uint64_t>> best(expected.begin(),
+                                          expected.begin() + k);
+    ASSERT_EQ(best, Best(build().get(), k));
+  }
+
+  // An AND with nothing required matches nothing.
+  vector<unique_ptr<DocIterator>> none, excluded;
+  excluded.push_back(Term(a));
+  AndIterator only_excluded(std::move(none), std::move(excluded));
+  ASSERT_EQ(DocIterator::kEnd, only_excluded.doc());
+}
+
+}  // namespace hw4
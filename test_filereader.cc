@@ -9,6 +9,9 @@
  * author.
  */
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "./FileReader.h"
 
 #include "gtest/gtest.h"
@@ -44,4 +47,47 @@ TEST(Test_FileReader, TestFileReaderBasic) {
   HW4Environment::AddPoints(5);
 }
 
+TEST(Test_FileReader, TestFileReaderStat) {
+  struct stat st;
+  FileReader f(".", "test_files/hextext.txt");
+  ASSERT_TRUE(f.StatFile(&st));
+  ASSERT_EQ(4800, st.st_size);
+
+  // Directories, missing files, and path attacks fail.
+  f = FileReader(".", "test_files");
+  ASSERT_FALSE(f.StatFile(&st));
+  f = FileReader(".", "non-existent");
+  ASSERT_FALSE(f.StatFile(&st));
+  f = FileReader("./libhw2", "./libhw2/../cpplint.py");
+  ASSERT_FALSE(f.StatFile(&st));
+
+  // So does a file that can't be read (except by root, who can read
+  // anything).
+  const char *unreadable = "test_files/unreadable.txt";
+  int fd = open(unreadable, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  ASSERT_NE(-1, fd);
+  close(fd);
+  f = FileReader(".", unreadable);
+  ASSERT_EQ(geteuid() == 0, f.StatFile(&st));
+  unlink(unreadable);
+}
+
+TEST(Test_FileReader, TestFileReaderRange) {
+  FileReader f(".", "test_files/hextext.txt");
+  string whole, part;
+  ASSERT_TRUE(f.ReadFile(&whole));
+
+  ASSERT_TRUE(f.ReadRange(100, 50, &part));
+  ASSERT_EQ(whole.substr(100, 50), part);
+
+  // Reading past EOF returns what's there.
+  ASSERT_TRUE(f.ReadRange(4790, 100, &part));
+  ASSERT_EQ(whole.substr(4790), part);
+  ASSERT_TRUE(f.ReadRange(5000, 10, &part));
+  ASSERT_EQ("", part);
+
+  f = FileReader("./libhw2", "./libhw2/../cpplint.py");
+  ASSERT_FALSE(f.ReadRange(0, 10, &part));
+}
+
 }  // namespace hw4
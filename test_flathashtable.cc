@@ -0,0 +1,127 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "./FlatHashTable.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+TEST(Test_FlatHashTable, TestBasic) {
+  FlatHashTable<string> table;
+  string value;
+  ASSERT_EQ(0U, table.NumElements());
+  ASSERT_FALSE(table.Find(1, &value));
+  ASSERT_FALSE(table.Remove(1, &value));
+
+  ASSERT_FALSE(table.Insert(1, "one", &value));
+  ASSERT_FALSE(table.Insert(2, "two", &value));
+  ASSERT_EQ(2U, table.NumElements());
+  ASSERT_TRUE(table.Find(1, &value));
+  ASSERT_EQ("one", value);
+
+  // Replacing returns the old value.
+  ASSERT_TRUE(table.Insert(1, "uno", &value));
+  ASSERT_EQ("one", value);
+  ASSERT_EQ(2U, table.NumElements());
+  ASSERT_EQ("uno", *table.Lookup(1));
+  *table.Lookup(1) = "eins";
+  ASSERT_TRUE(table.Find(1, &value));
+  ASSERT_EQ("eins", value);
+
+  ASSERT_TRUE(table.Remove(2, &value));
+  ASSERT_EQ("two", value);
+  ASSERT_FALSE(table.Find(2, &value));
+  ASSERT_EQ(nullptr, table.Lookup(2));
+  ASSERT_EQ(1U, table.NumElements());
+}
+
+TEST(Test_FlatHashTable, TestChurn) {
+  // A pseudo-random mix of inserts and removes, checked against a
+  // std::map; removals shift entries around, and the table grows.
+  FlatHashTable<uint64_t> table;
+  std::map<uint64_t, uint64_t> expected;
+  uint64_t x = 12345, value;
+  for (int i = 0; i < 200000; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    uint64_t key = x % 5000;
+    if ((x >> 32) % 3 == 0) {
+      bool present = expected.erase(key) == 1;
+      ASSERT_EQ(present, table.Remove(key, &value));
+    } else {
+      bool present = expected.count(key) == 1;
+      ASSERT_EQ(present, table.Insert(key, i, &value));
+      expected[key] = i;
+    }
+  }
+  ASSERT_EQ(expected.size(), table.NumElements());
+  for (uint64_t key = 0; key < 5000; key++) {
+    auto it = expected.find(key);
+    ASSERT_EQ(it != expected.end(), table.Find(key, &value));
+    if (it != expected.end()) {
+      ASSERT_EQ(it->second, value);
+    }
+  }
+}
+
+// Undoes FlatHashTable's mixing of keys, to make keys that collide.
+static uint64_t Unmix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0x9cb4b2f8129337dbULL;
+  h ^= h >> 33;
+  h *= 0x4f74430c22a54005ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+TEST(Test_FlatHashTable, TestCollisions) {
+  // More keys than fit within the longest probe distance all have the
+  // same home slot until the table is 2048 slots big.
+  FlatHashTable<uint64_t> table;
+  const uint64_t kKeys = 300;
+  uint64_t value;
+  for (uint64_t j = 0; j < kKeys; j++)
+    ASSERT_FALSE(table.Insert(Unmix(j << 10), j, &value));
+  ASSERT_EQ(kKeys, table.NumElements());
+  ASSERT_GE(table.capacity(), 2048U);
+  for (uint64_t j = 0; j < kKeys; j++) {
+    ASSERT_TRUE(table.Find(Unmix(j << 10), &value));
+    ASSERT_EQ(j, value);
+  }
+  for (uint64_t j = 0; j < kKeys; j += 2)
+    ASSERT_TRUE(table.Remove(Unmix(j << 10), &value));
+  for (uint64_t j = 0; j < kKeys; j++)
+    ASSERT_EQ(j % 2 == 1, table.Find(Unmix(j << 10), &value));
+}
+
+TEST(Test_FlatHashTable, TestMoveOnly) {
+  FlatHashTable<std::unique_ptr<int>> table(100);
+  size_t capacity = table.capacity();
+  std::unique_ptr<int> old;
+  for (int i = 0; i < 100; i++)
+    ASSERT_FALSE(table.Insert(i, std::make_unique<int>(i), &old));
+  ASSERT_EQ(capacity, table.capacity());
+  ASSERT_EQ(42, **table.Lookup(42));
+  ASSERT_TRUE(table.Remove(42, &old));
+  ASSERT_EQ(42, *old);
+}
+
+}  // namespace hw4
@@ -0,0 +1,207 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <string>
+
+#include "./Hpack.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+// Decodes "hex" (whitespace is ignored) into bytes.
+static string FromHex(const string &hex) {
+  string out;
+  int nibbles = 0;
+  int acc = 0;
+  for (char c : hex) {
+    if (!isxdigit(static_cast<unsigned char>(c)))
+      continue;
+    acc = acc * 16 + (isdigit(c) ? c - '0' : (c | 0x20) - 'a' + 10);
+    if (++nibbles % 2 == 0) {
+      out.push_back(static_cast<char>(acc));
+      acc = 0;
+    }
+  }
+  return out;
+}
+
+static bool Decode(HpackDecoder *dec, const string &block,
+                   HeaderList *headers) {
+  headers->clear();
+  return dec->Decode(reinterpret_cast<const uint8_t *>(block.data()),
+                     block.size(), headers);
+}
+
+TEST(Test_Hpack, TestIntegers) {
+  // RFC 7541 C.1
+  string out;
+  HpackEncodeInteger(10, 5, 0, &out);
+  ASSERT_EQ(FromHex("0a"), out);
+  out.clear();
+  HpackEncodeInteger(1337, 5, 0xe0, &out);
+  ASSERT_EQ(FromHex("ff 9a 0a"), out);
+  out.clear();
+  HpackEncodeInteger(42, 8, 0, &out);
+  ASSERT_EQ(FromHex("2a"), out);
+
+  string in = FromHex("ff 9a 0a");
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(in.data());
+  uint64_t v;
+  ASSERT_TRUE(HpackDecodeInteger(&p, p + in.size(), 5, &v));
+  ASSERT_EQ(1337U, v);
+  ASSERT_EQ(reinterpret_cast<const uint8_t *>(in.data()) + 3, p);
+
+  // Truncated, and absurdly long.
+  in = FromHex("1f 9a");
+  p = reinterpret_cast<const uint8_t *>(in.data());
+  ASSERT_FALSE(HpackDecodeInteger(&p, p + in.size(), 5, &v));
+  in = FromHex("1f ff ff ff ff ff 01");
+  p = reinterpret_cast<const uint8_t *>(in.data());
+  ASSERT_FALSE(HpackDecodeInteger(&p, p + in.size(), 5, &v));
+}
+
+TEST(Test_Hpack, TestHuffman) {
+  // RFC 7541 C.4.1
+  string coded = FromHex("f1e3 c2e5 f23a 6ba0 ab90 f4ff");
+  ASSERT_EQ(coded.size(), HuffmanEncodedLength("www.example.com"));
+  string out;
+  HuffmanEncode("www.example.com", &out);
+  ASSERT_EQ(coded, out);
+
+  string decoded;
+  ASSERT_TRUE(HuffmanDecode(reinterpret_cast<const uint8_t *>(coded.data()),
+                            coded.size(), &decoded));
+  ASSERT_EQ("www.example.com", decoded);
+
+  // Every octet survives the round trip.
+  string all;
+  for (int c = 0; c < 256; c++)
+    all.push_back(static_cast<char>(c));
+  out.clear();
+  decoded.clear();
+  HuffmanEncode(all, &out);
+  ASSERT_TRUE(HuffmanDecode(reinterpret_cast<const uint8_t *>(out.data()),
+                            out.size(), &decoded));
+  ASSERT_EQ(all, decoded);
+
+  // 'a' is 00011, so it must be padded with 111, not zeros, and not
+  // with a whole byte.
+  decoded.clear();
+  ASSERT_TRUE(HuffmanDecode(reinterpret_cast<const uint8_t *>("\x1f"), 1,
+                            &decoded));
+  ASSERT_EQ("a", decoded);
+  ASSERT_FALSE(HuffmanDecode(reinterpret_cast<const uint8_t *>("\x18"), 1,
+                             &decoded));
+  ASSERT_FALSE(HuffmanDecode(reinterpret_cast<const uint8_t *>("\x1f\xff"), 2,
+                             &decoded));
+}
+
+TEST(Test_Hpack, TestDecodeRequests) {
+  // RFC 7541 C.4: three requests on one connection, Huffman coded,
+  // sharing the dynamic table.
+  HpackDecoder dec;
+  HeaderList h;
+
+  ASSERT_TRUE(Decode(&dec, FromHex("8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff"),
+                     &h));
+  ASSERT_EQ(4U, h.size());
+  ASSERT_EQ(HeaderField(":method", "GET"), h[0]);
+  ASSERT_EQ(HeaderField(":scheme", "http"), h[1]);
+  ASSERT_EQ(HeaderField(":path", "/"), h[2]);
+  ASSERT_EQ(HeaderField(":authority", "www.example.com"), h[3]);
+  ASSERT_EQ(57U, dec.table().size());
+
+  ASSERT_TRUE(Decode(&dec, FromHex("8286 84be 5886 a8eb 1064 9cbf"), &h));
+  ASSERT_EQ(5U, h.size());
+  ASSERT_EQ(HeaderField(":authority", "www.example.com"), h[3]);
+  ASSERT_EQ(HeaderField("cache-control", "no-cache"), h[4]);
+  ASSERT_EQ(110U, dec.table().size());
+
+  ASSERT_TRUE(Decode(&dec, FromHex("8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925"
+                                   "a849 e95b b8e8 b4bf"), &h));
+  ASSERT_EQ(5U, h.size());
+  ASSERT_EQ(HeaderField(":scheme", "https"), h[1]);
+  ASSERT_EQ(HeaderField(":path", "/index.html"), h[2]);
+  ASSERT_EQ(HeaderField(":authority", "www.example.com"), h[3]);
+  ASSERT_EQ(HeaderField("custom-key", "custom-value"), h[4]);
+  ASSERT_EQ(164U, dec.table().size());
+  ASSERT_EQ(3U, dec.table().num_entries());
+
+  // Index 0, an index past the end of the table, a table bigger than
+  // we allow, and a truncated literal are all errors.
+  HpackDecoder bad;
+  ASSERT_FALSE(Decode(&bad, FromHex("80"), &h));
+  ASSERT_FALSE(Decode(&bad, FromHex("be"), &h));
+  ASSERT_FALSE(Decode(&bad, FromHex("3fe2 1f"), &h));
+  ASSERT_FALSE(Decode(&bad, FromHex("4088 25a8"), &h));
+}
+
+TEST(Test_Hpack, TestEncoder) {
+  HpackEncoder enc;
+  HpackDecoder dec;
+  HeaderList response = {
+    {":status", "200"},
+    {"content-type", "text/html"},
+    {"cache-control", "max-age=3600"},
+    {"etag", "\"1234-5678\""},
+    {"content-length", "4096"},
+  };
+
+  string first;
+  enc.Encode(response, &first);
+  HeaderList h;
+  ASSERT_TRUE(Decode(&dec, first, &h));
+  ASSERT_EQ(response, h);
+
+  // The second time around the fields that were indexed cost a byte
+  // each; the ETag and length, which weren't, are still literals.
+  response[3].second = "\"1234-9999\"";
+  string second;
+  enc.Encode(response, &second);
+  ASSERT_EQ(FromHex("88 bf be"), second.substr(0, 3));
+  ASSERT_TRUE(Decode(&dec, second, &h));
+  ASSERT_EQ(response, h);
+  ASSERT_EQ(enc.table().size(), dec.table().size());
+
+  // When the peer shrinks the table, the next block says so first.
+  enc.SetMaxTableSize(0);
+  string third;
+  enc.Encode(response, &third);
+  ASSERT_EQ(0x20, third[0]);
+  ASSERT_TRUE(Decode(&dec, third, &h));
+  ASSERT_EQ(response, h);
+  ASSERT_EQ(0U, dec.table().num_entries());
+
+  // If it shrinks and grows again between blocks, the next one
+  // announces the smallest size and then the final one.
+  enc.SetMaxTableSize(4096);
+  string grown;
+  enc.Encode(response, &grown);
+  ASSERT_TRUE(Decode(&dec, grown, &h));
+  ASSERT_LT(0U, dec.table().num_entries());
+  enc.SetMaxTableSize(100);
+  enc.SetMaxTableSize(0);
+  enc.SetMaxTableSize(2048);
+  string fourth;
+  enc.Encode(response, &fourth);
+  ASSERT_EQ(FromHex("20 3fe1 0f"), fourth.substr(0, 4));
+  ASSERT_TRUE(Decode(&dec, fourth, &h));
+  ASSERT_EQ(response, h);
+  ASSERT_EQ(2048U, dec.table().max_size());
+  ASSERT_EQ(enc.table().size(), dec.table().size());
+}
+
+}  // namespace hw4
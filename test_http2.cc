@@ -0,0 +1,319 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "./FileReader.h"
+#include "./Hpack.h"
+#include "./Http2Connection.h"
+#include "./HttpConnection.h"
+#include "./HttpRequest.h"
+#include "./HttpResponse.h"
+#include "./HttpUtils.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+// A frame as the test client sees it.
+struct Frame {
+  uint8_t type;
+  uint8_t flags;
+  uint32_t stream_id;
+  string payload;
+};
+
+static const char *kPreface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+// A 100000 byte body that isn't all the same byte.
+static string BigBody() {
+  string body;
+  for (int i = 0; body.size() < 100000; i++)
+    body += std::to_string(i) + ",";
+  return body.substr(0, 100000);
+}
+
+// Answers "/big" with BigBody(), "/file" with test_files/hextext.txt,
+// "/stream" with a body written in pieces, "/unchanged" with a 304,
+// and anything else with "hello".
+static bool Handler(const HttpRequest &req, ResponseWriter *w) {
+  HttpResponse rep;
+  rep.set_protocol("HTTP/1.1");
+  rep.set_response_code(200);
+  rep.set_message("OK");
+  rep.set_content_type("text/plain");
+  rep.AddHeader("Connection", "keep-alive");  // not allowed in HTTP/2
+  rep.AddHeader("X-Uri", req.uri());
+  if (req.uri() == "/stream") {
+    return w->WriteChunkedHeader(rep) && w->WriteChunk("one,", 4) &&
+           w->WriteChunk("two", 3) && w->WriteLastChunk();
+  }
+  if (req.uri() == "/big") {
+    rep.AppendToBody(BigBody());
+  } else if (req.uri() == "/file") {
+    struct stat st;
+    if (stat("test_files/hextext.txt", &st) != 0)
+      return false;
+    rep.set_body_file("test_files/hextext.txt", 0, st.st_size);
+  } else if (req.uri() == "/unchanged") {
+    rep.set_response_code(304);
+  } else {
+    rep.AppendToBody("hello");
+  }
+  return w->WriteResponse(rep);
+}
+
+// Reads and serves an HTTP/2 connection on "fd", the way
+// HttpServer_ThrFn does, setting "clean" to Serve*()'s result.
+static void Serve(int fd, bool *clean) {
+  HttpConnection conn(fd);
+  HttpRequest req;
+  ASSERT_TRUE(conn.GetNextRequest(&req));
+  Http2Connection h2(&conn, Handler);
+  if (Http2Connection::IsPreface(req)) {
+    *clean = h2.ServePriorKnowledge();
+  } else {
+    ASSERT_TRUE(Http2Connection::WantsUpgrade(req));
+    *clean = h2.ServeUpgrade(req);
+  }
+}
+
+static void WriteString(int fd, const string &s) {
+  ASSERT_EQ(static_cast<int>(s.size()),
+            WrappedWrite(fd, (unsigned char *) s.data(), s.size()));
+}
+
+static void WriteFrame(int fd, uint8_t type, uint8_t flags,
+                       uint32_t stream_id, const string &payload) {
+  string f;
+  f.push_back(static_cast<char>(payload.size() >> 16));
+  f.push_back(static_cast<char>(payload.size() >> 8));
+  f.push_back(static_cast<char>(payload.size()));
+  f.push_back(static_cast<char>(type));
+  f.push_back(static_cast<char>(flags));
+  for (int shift = 24; shift >= 0; shift -= 8)
+    f.push_back(static_cast<char>(stream_id >> shift));
+  WriteString(fd, f + payload);
+}
+
+static string Be32(uint32_t v) {
+  string s;
+  for (int shift = 24; shift >= 0; shift -= 8)
+    s.push_back(static_cast<char>(v >> shift));
+  return s;
+}
+
+// A SETTINGS entry.
+static string Setting(uint16_t id, uint32_t value) {
+  string s;
+  s.push_back(static_cast<char>(id >> 8));
+  s.push_back(static_cast<char>(id));
+  return s + Be32(value);
+}
+
+static bool ReadExactly(int fd, size_t n, string *out) {
+  out->resize(n);
+  size_t got = 0;
+  while (got < n) {
+    int res = WrappedRead(fd, (unsigned char *) &(*out)[got], n - got);
+    if (res <= 0)
+      return false;
+    got += res;
+  }
+  return true;
+}
+
+static bool ReadFrame(int fd, Frame *f) {
+  string h;
+  if (!ReadExactly(fd, 9, &h))
+    return false;
+  const uint8_t *b = reinterpret_cast<const uint8_t *>(h.data());
+  size_t len = (b[0] << 16) | (b[1] << 8) | b[2];
+  f->type = b[3];
+  f->flags = b[4];
+  f->stream_id = ((b[5] & 0x7f) << 24) | (b[6] << 16) | (b[7] << 8) | b[8];
+  return ReadExactly(fd, len, &f->payload);
+}
+
+// A GET request for "path" as a header block.
+static string RequestBlock(HpackEncoder *enc, const string &path) {
+  HeaderList h = {
+    {":method", "GET"}, {":scheme", "http"}, {":path", path},
+    {":authority", "localhost"}, {"user-agent", "test_http2"},
+  };
+  string block;
+  enc->Encode(h, &block);
+  return block;
+}
+
+// The responses the client has seen so far, by stream.
+struct Responses {
+  std::map<uint32_t, HeaderList> headers;
+  std::map<uint32_t, string> bodies;
+  std::map<uint32_t, bool> ended;
+  HpackDecoder decoder;
+  size_t biggest_data_frame = 0;
+
+  // Reads frames until stream "stream_id" ends, answering SETTINGS
+  // and checking the others.
+  void ReadUntilEnd(int fd, uint32_t stream_id) {
+    Frame f;
+    while (!ended[stream_id]) {
+      ASSERT_TRUE(ReadFrame(fd, &f));
+      if (f.type == 0x4 && (f.flags & 0x1) == 0) {
+        WriteFrame(fd, 0x4, 0x1, 0, "");  // ACK the server's SETTINGS
+      } else if (f.type == 0x1) {
+        ASSERT_EQ(0x4, f.flags & 0x4);  // END_HEADERS
+        HeaderList h;
+        ASSERT_TRUE(decoder.Decode(
+          reinterpret_cast<const uint8_t *>(f.payload.data()),
+          f.payload.size(), &h));
+        headers[f.stream_id] = h;
+      } else if (f.type == 0x0) {
+        bodies[f.stream_id] += f.payload;
+        biggest_data_frame = std::max(biggest_data_frame, f.payload.size());
+      } else {
+        ASSERT_TRUE(f.type == 0x4 || f.type == 0x8);  // SETTINGS ACK
+      }
+      if ((f.type == 0x0 || f.type == 0x1) && (f.flags & 0x1))
+        ended[f.stream_id] = true;
+    }
+  }
+
+  string Header(uint32_t stream_id, const string &name) {
+    for (const HeaderField &h : headers[stream_id]) {
+      if (h.first == name)
+        return h.second;
+    }
+    return "(none)";
+  }
+};
+
+TEST(Test_Http2, TestMultiplexing) {
+  int spair[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  bool clean = false;
+  std::thread server(Serve, spair[0], &clean);
+  int fd = spair[1];
+
+  // A tiny initial window, so that "/big" stalls after 100 bytes.
+  WriteString(fd, kPreface);
+  WriteFrame(fd, 0x4, 0, 0, Setting(0x4, 100));
+
+  HpackEncoder enc;
+  WriteFrame(fd, 0x1, 0x5, 1, RequestBlock(&enc, "/big"));
+  WriteFrame(fd, 0x1, 0x5, 3, RequestBlock(&enc, "/small"));
+
+  // The small response isn't stuck behind the big one.
+  Responses r;
+  r.ReadUntilEnd(fd, 3);
+  ASSERT_EQ("hello", r.bodies[3]);
+  ASSERT_EQ("200", r.Header(3, ":status"));
+  ASSERT_EQ("text/plain", r.Header(3, "content-type"));
+  ASSERT_EQ("5", r.Header(3, "content-length"));
+  ASSERT_EQ("/small", r.Header(3, "x-uri"));
+  ASSERT_EQ("(none)", r.Header(3, "connection"));
+  ASSERT_EQ(100U, r.bodies[1].size());
+  ASSERT_FALSE(r.ended[1]);
+
+  // A ping is answered, even while a stream is blocked.
+  WriteFrame(fd, 0x6, 0, 0, "12345678");
+  Frame f;
+  ASSERT_TRUE(ReadFrame(fd, &f));
+  ASSERT_EQ(0x6, f.type);
+  ASSERT_EQ(0x1, f.flags);
+  ASSERT_EQ("12345678", f.payload);
+
+  // Opening the windows lets the rest through, in frames no bigger
+  // than the default maximum.
+  WriteFrame(fd, 0x8, 0, 1, Be32(1000000));
+  WriteFrame(fd, 0x8, 0, 0, Be32(1000000));
+  r.ReadUntilEnd(fd, 1);
+  ASSERT_EQ(BigBody(), r.bodies[1]);
+  ASSERT_EQ("100000", r.Header(1, "content-length"));
+  ASSERT_LE(r.biggest_data_frame, 16384U);
+
+  // Files, streamed bodies, and bodiless responses, with the default
+  // window again.
+  WriteFrame(fd, 0x4, 0, 0, Setting(0x4, 65535));
+  WriteFrame(fd, 0x1, 0x5, 5, RequestBlock(&enc, "/file"));
+  WriteFrame(fd, 0x1, 0x5, 7, RequestBlock(&enc, "/stream"));
+  WriteFrame(fd, 0x1, 0x5, 9, RequestBlock(&enc, "/unchanged"));
+  r.ReadUntilEnd(fd, 5);
+  r.ReadUntilEnd(fd, 7);
+  r.ReadUntilEnd(fd, 9);
+  string expected;
+  FileReader fr(".", "test_files/hextext.txt");
+  ASSERT_TRUE(fr.ReadFile(&expected));
+  ASSERT_EQ(expected, r.bodies[5]);
+  ASSERT_EQ("one,two", r.bodies[7]);
+  ASSERT_EQ("(none)", r.Header(7, "content-length"));
+  ASSERT_EQ("304", r.Header(9, ":status"));
+  ASSERT_EQ("", r.bodies[9]);
+
+  // GOAWAY lets the server finish up and hang up cleanly.
+  WriteFrame(fd, 0x7, 0, 0, Be32(0) + Be32(0));
+  server.join();
+  ASSERT_TRUE(clean);
+  close(fd);
+}
+
+TEST(Test_Http2, TestUpgrade) {
+  int spair[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  bool clean = false;
+  std::thread server(Serve, spair[0], &clean);
+  int fd = spair[1];
+
+  // SETTINGS_MAX_CONCURRENT_STREAMS = 100, as curl sends it.
+  WriteString(fd, "GET /small HTTP/1.1\r\n"
+                  "Host: localhost\r\n"
+                  "Connection: Upgrade, HTTP2-Settings\r\n"
+                  "Upgrade: h2c\r\n"
+                  "HTTP2-Settings: AAMAAABk\r\n"
+                  "\r\n");
+  string line;
+  ASSERT_TRUE(ReadExactly(fd, 71, &line));
+  ASSERT_EQ("HTTP/1.1 101 Switching Protocols\r\n"
+            "Connection: Upgrade\r\n"
+            "Upgrade: h2c\r\n"
+            "\r\n", line);
+
+  // The request is answered as stream 1.
+  WriteString(fd, kPreface);
+  WriteFrame(fd, 0x4, 0, 0, "");
+  Responses r;
+  r.ReadUntilEnd(fd, 1);
+  ASSERT_EQ("hello", r.bodies[1]);
+  ASSERT_EQ("/small", r.Header(1, "x-uri"));
+
+  // A DATA frame on stream 0 is a connection error.
+  WriteFrame(fd, 0x0, 0, 0, "x");
+  Frame f;
+  do {
+    ASSERT_TRUE(ReadFrame(fd, &f));
+  } while (f.type != 0x7);
+  ASSERT_EQ(Be32(1) + Be32(0x1), f.payload);  // PROTOCOL_ERROR
+  server.join();
+  ASSERT_FALSE(clean);
+  close(fd);
+}
+
+}  // namespace hw4
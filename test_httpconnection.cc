@@ -11,6 +11,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <string.h>
 #include <string>
 
 #include "./HttpConnection.h"
@@ -127,4 +128,82 @@ TEST(Test_HttpConnection, TestHttpConnectionBasic) {
   HW4Environment::AddPoints(10);
 }
 
+TEST(Test_HttpConnection, TestHttpResponseHeaders) {
+  // Extra headers go between Content-type and Content-length.
+  HttpResponse rep;
+  rep.set_protocol("HTTP/1.1");
+  rep.set_response_code(200);
+  rep.set_message("OK");
+  rep.set_content_type("text/plain");
+  rep.AddHeader("ETag", "\"1-2-3\"");
+  rep.AddHeader("Cache-Control", "max-age=60");
+  rep.AppendToBody("hi");
+  ASSERT_EQ("HTTP/1.1 200 OK\r\n"
+            "Content-type: text/plain\r\n"
+            "ETag: \"1-2-3\"\r\n"
+            "Cache-Control: max-age=60\r\n"
+            "Content-length: 2\r\n\r\nhi",
+            rep.GenerateResponseString());
+
+  // A 304 has neither a body nor a Content-length.
+  HttpResponse notmod;
+  notmod.set_protocol("HTTP/1.1");
+  notmod.set_response_code(304);
+  notmod.set_message("Not Modified");
+  notmod.AddHeader("ETag", "\"1-2-3\"");
+  ASSERT_EQ("HTTP/1.1 304 Not Modified\r\n"
+            "ETag: \"1-2-3\"\r\n\r\n",
+            notmod.GenerateResponseString());
+}
+
+TEST(Test_HttpConnection, TestHttpResponseStream) {
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  HttpConnection hc(spair[0]);
+
+  HttpResponse rep;
+  rep.set_protocol("HTTP/1.1");
+  rep.set_response_code(200);
+  rep.set_message("OK");
+  rep.set_content_type("text/html");
+
+  // Chunked: the header goes out at Start(), each Flush() sends a
+  // chunk, and Finish() sends the terminating chunk.
+  HttpResponseStream chunked(&hc, true, false);
+  ASSERT_TRUE(chunked.Start(rep));
+  ASSERT_TRUE(chunked.Write("hello, "));
+  ASSERT_TRUE(chunked.Flush());
+  ASSERT_TRUE(chunked.Flush());  // nothing buffered, so no chunk
+  ASSERT_TRUE(chunked.Write(string(20, 'x')));
+  ASSERT_TRUE(chunked.Finish());
+  string expected = "HTTP/1.1 200 OK\r\n"
+                    "Content-type: text/html\r\n"
+                    "Transfer-Encoding: chunked\r\n\r\n"
+                    "7\r\nhello, \r\n"
+                    "14\r\n" + string(20, 'x') + "\r\n"
+                    "0\r\n\r\n";
+  unsigned char buf[1024] = { 0 };
+  ASSERT_EQ(static_cast<int>(expected.size()),
+            WrappedRead(spair[1], buf, sizeof(buf)));
+  ASSERT_EQ(expected, (const char *) buf);
+
+  // Not chunked: everything is sent at Finish() with a Content-length.
+  HttpResponseStream buffered(&hc, false, false);
+  ASSERT_TRUE(buffered.Start(rep));
+  ASSERT_TRUE(buffered.Write("hello, "));
+  ASSERT_TRUE(buffered.Flush());
+  ASSERT_TRUE(buffered.Write("world"));
+  ASSERT_TRUE(buffered.Finish());
+  expected = "HTTP/1.1 200 OK\r\n"
+             "Content-type: text/html\r\n"
+             "Content-length: 12\r\n\r\n"
+             "hello, world";
+  memset(buf, 0, sizeof(buf));
+  ASSERT_EQ(static_cast<int>(expected.size()),
+            WrappedRead(spair[1], buf, sizeof(buf)));
+  ASSERT_EQ(expected, (const char *) buf);
+
+  close(spair[1]);
+}
+
 }  // namespace hw4
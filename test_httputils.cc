@@ -14,6 +14,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <string>
+#include <vector>
 
 #include "./HttpUtils.h"
 
@@ -42,6 +43,24 @@ TEST(Test_HttpUtils, TestHttpUtilsURIDecode) {
   ASSERT_EQ(string("  blah blah"), URIDecode(spacey));
 }
 
+TEST(Test_HttpUtils, TestHttpUtilsURIDecodeStreaming) {
+  // The streaming variant appends to the caller's buffer.
+  string out("x");
+  string two("%74%77%6f");
+  URIDecode(two.data(), two.size(), &out);
+  ASSERT_EQ(string("xtwo"), out);
+
+  // Long runs without escapes, with escapes straddling the 16 and 32
+  // byte boundaries used by the vectorized scan.
+  string longplain(40, 'a');
+  ASSERT_EQ(longplain, URIDecode(longplain));
+  string straddle = string(14, 'a') + "%41+" + string(13, 'b') + "%6";
+  ASSERT_EQ(string(14, 'a') + "A " + string(13, 'b') + "%6",
+            URIDecode(straddle));
+  string trailing = string(31, 'c') + "%";
+  ASSERT_EQ(trailing, URIDecode(trailing));
+}
+
 TEST(Test_HttpUtils, TestHttpUtilsURLParser) {
   // Test out URL parsing.
   string easy("/foo/bar");
@@ -119,6 +138,82 @@ TEST(Test_HttpUtils, TestEscapeHTML) {
   HW4Environment::AddPoints(15);
 }
 
+TEST(Test_HttpUtils, TestEscapeHTMLStreaming) {
+  // Escaping many strings into one reused buffer.
+  string out;
+  string a = "<a>", b = "b&c";
+  EscapeHTML(a.data(), a.size(), &out);
+  EscapeHTML(b.data(), b.size(), &out);
+  ASSERT_EQ("&lt;a&gt;b&amp;c", out);
+
+  // Unsafe bytes at and around the 16 and 32 byte block boundaries.
+  string longstr = string(15, 'x') + "<" + string(16, 'y') + ">" +
+                   string(40, 'z') + "\'";
+  string expected = string(15, 'x') + "&lt;" + string(16, 'y') + "&gt;" +
+                    string(40, 'z') + "&apos;";
+  ASSERT_EQ(expected, EscapeHTML(longstr));
+
+  // Binary data passes through untouched.
+  string binary("a\0b\xff", 4);
+  ASSERT_EQ(binary, EscapeHTML(binary));
+}
+
+TEST(Test_HttpUtils, TestHttpUtilsHttpDate) {
+  ASSERT_EQ("Sun, 06 Nov 1994 08:49:37 GMT", FormatHttpDate(784111777));
+
+  time_t t;
+  ASSERT_TRUE(ParseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT", &t));
+  ASSERT_EQ(784111777, t);
+  // Request header values may have been lowercased.
+  ASSERT_TRUE(ParseHttpDate("sun, 06 nov 1994 08:49:37 gmt", &t));
+  ASSERT_EQ(784111777, t);
+  ASSERT_FALSE(ParseHttpDate("Sunday, 06-Nov-94", &t));
+  ASSERT_FALSE(ParseHttpDate("Sun, 06 Nov 1994 08:49:37 PST", &t));
+}
+
+TEST(Test_HttpUtils, TestHttpUtilsParseByteRanges) {
+  std::vector<ByteRange> r;
+  ASSERT_TRUE(ParseByteRanges("bytes=0-99", 1000, &r));
+  ASSERT_EQ(1U, r.size());
+  ASSERT_EQ(ByteRange(0, 99), r[0]);
+
+  // Open-ended, suffix, and clipped ranges; unsatisfiable ones are
+  // dropped.
+  ASSERT_TRUE(ParseByteRanges("bytes=900-, 1000-1001", 1000, &r));
+  ASSERT_EQ(1U, r.size());
+  ASSERT_EQ(ByteRange(900, 999), r[0]);
+  ASSERT_TRUE(ParseByteRanges("bytes=0-9, -50", 1000, &r));
+  ASSERT_EQ(2U, r.size());
+  ASSERT_EQ(ByteRange(0, 9), r[0]);
+  ASSERT_EQ(ByteRange(950, 999), r[1]);
+  ASSERT_TRUE(ParseByteRanges("bytes=990-2000", 1000, &r));
+  ASSERT_EQ(ByteRange(990, 999), r[0]);
+
+  // Ranges are put in order, and those that overlap or touch are
+  // coalesced, so the same bytes are never sent twice.
+  ASSERT_TRUE(ParseByteRanges(
+                "bytes=500-599, 0-99, 550-650, 100-149, 0-99, -50", 1000, &r));
+  ASSERT_EQ((std::vector<ByteRange>{{0, 149}, {500, 650}, {950, 999}}), r);
+  ASSERT_TRUE(ParseByteRanges("bytes=0-, 0-, 0-, 0-, 0-, 0-", 1000, &r));
+  ASSERT_EQ(std::vector<ByteRange>{ByteRange(0, 999)}, r);
+  ASSERT_TRUE(ParseByteRanges("bytes=-5000", 1000, &r));
+  ASSERT_EQ(ByteRange(0, 999), r[0]);
+
+  // Nothing satisfiable means a 416.
+  ASSERT_TRUE(ParseByteRanges("bytes=1000-", 1000, &r));
+  ASSERT_TRUE(r.empty());
+  ASSERT_TRUE(ParseByteRanges("bytes=-0", 1000, &r));
+  ASSERT_TRUE(r.empty());
+
+  // Malformed headers are ignored.
+  ASSERT_FALSE(ParseByteRanges("items=0-1", 1000, &r));
+  ASSERT_FALSE(ParseByteRanges("bytes=5-1", 1000, &r));
+  ASSERT_FALSE(ParseByteRanges("bytes=a-b", 1000, &r));
+  ASSERT_FALSE(ParseByteRanges("bytes=1-2-3", 1000, &r));
+  ASSERT_FALSE(ParseByteRanges("bytes=-", 1000, &r));
+  ASSERT_FALSE(ParseByteRanges("bytes=99999999999999999999-", 1000, &r));
+}
+
 TEST(Test_HttpUtils, TestHttpUtilsWrappedReadWrite) {
   string filedata = "This is a test; this is only a test.\n";
 
@@ -0,0 +1,31 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <string>
+#include <vector>
+
+#include "./IndexWriter.h"
+#include "./test_index.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+bool WriteTestIndex(const string &fname, const vector<TestDoc> &docs,
+                    int num_buckets) {
+  vector<IndexDocument> index_docs;
+  for (const TestDoc &doc : docs)
+    index_docs.push_back(MakeIndexDocument(doc.first, doc.second));
+  return WriteIndexFile(fname, index_docs, num_buckets);
+}
+
+}  // namespace hw4
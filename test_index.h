@@ -0,0 +1,34 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_TEST_INDEX_H_
+#define HW4_TEST_INDEX_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hw4 {
+
+// A document of a test index: its file name, and its words in order.
+typedef std::pair<std::string, std::vector<std::string>> TestDoc;
+
+// Writes an index file named "fname" with WriteIndexFile(), for the
+// tests of the code that reads them.  The documents get docIDs 1, 2,
+// and so on, and every hash table has "num_buckets" buckets, so that
+// most buckets have several elements.  Returns false if the file
+// couldn't be written.
+bool WriteTestIndex(const std::string &fname,
+                    const std::vector<TestDoc> &docs, int num_buckets = 3);
+
+}  // namespace hw4
+
+#endif  // HW4_TEST_INDEX_H_
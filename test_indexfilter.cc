@@ -0,0 +1,46 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./IndexFilter.h"
+#include "./IndexReader.h"
+#include "./test_index.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+TEST(Test_IndexFilter, TestBuild) {
+  const char *fname = "test_files/test_filter.idx";
+  ASSERT_TRUE(WriteTestIndex(fname, {{"a.txt", {"bike", "apalooza"}},
+                                     {"b.txt", {"seattle", "ride"}}}));
+  IndexReader reader;
+  ASSERT_TRUE(reader.Open(fname));
+  unlink(fname);
+  ASSERT_EQ(4, reader.num_words());
+
+  std::unique_ptr<BloomFilter> filter;
+  ASSERT_TRUE(BuildIndexFilter(reader, &filter));
+  ASSERT_NE(nullptr, filter.get());
+  for (const char *word : {"bike", "apalooza", "seattle", "ride"})
+    ASSERT_TRUE(filter->MayContain(IndexWordKey(word)));
+  ASSERT_FALSE(filter->MayContain(IndexWordKey("tricycle")));
+}
+
+}  // namespace hw4
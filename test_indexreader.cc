@@ -0,0 +1,323 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "./libhw3/LayoutStructs.h"
+
+#include "./Checksum.h"
+#include "./IndexReader.h"
+#include "./IndexWriter.h"
+#include "./test_index.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+TEST(Test_IndexReader, TestOpen) {
+  IndexReader reader;
+  ASSERT_FALSE(reader.Open("test_files/non-existent"));
+  IndexReader text;
+  ASSERT_FALSE(text.Open("test_files/hextext.txt"));
+}
+
+TEST(Test_IndexReader, TestLookup) {
+  const char *fname = "test_files/test_reader.idx";
+  vector<TestDoc> docs;
+  for (int d = 0; d < 20; d++) {
+    // Every document has "all"; only the even ones have "even", once
+    // per multiple of 4 in its number; and each has its own word.
+    vector<string> words = {"all", "doc" + std::to_string(d)};
+    if (d % 2 == 0) {
+      words.push_back("even");
+      if (d % 4 == 0)
+        words.push_back("even");
+    }
+    docs.push_back({"dir/doc" + std::to_string(d) + ".txt", words});
+  }
+  ASSERT_TRUE(WriteTestIndex(fname, docs, 4));
+  IndexReader reader;
+  ASSERT_TRUE(reader.Open(fname));
+  unlink(fname);
+  ASSERT_EQ(fname, reader.index_file());
+  ASSERT_EQ(22, reader.num_words());
+
+  std::set<string> words;
+  ASSERT_TRUE(reader.ForEachWord([&](const string &w) { words.insert(w); }));
+  ASSERT_EQ(22U, words.size());
+  ASSERT_EQ(1U, words.count("doc17"));
+
+  PostingsInfo info;
+  ASSERT_FALSE(reader.LookupWord("odd", &info));
+  ASSERT_TRUE(reader.LookupWord("all", &info));
+  ASSERT_EQ(20, info.num_docs);
+  ASSERT_TRUE(reader.LookupWord("even", &info));
+  ASSERT_EQ(10, info.num_docs);
+
+  vector<DocPosting> postings;
+  ASSERT_TRUE(reader.ReadPostings(info, &postings));
+  ASSERT_EQ(10U, postings.size());
+  for (size_t i = 0; i < postings.size(); i++) {
+    // docIDs start at 1, so document d has docID d + 1.
+    ASSERT_EQ(2 * i + 1, postings[i].doc_id);
+    ASSERT_EQ(i % 2 == 0 ? 2 : 1, postings[i].num_positions);
+  }
+
+  DocPosting posting;
+  ASSERT_TRUE(reader.FindPosting(info, 5, &posting));
+  ASSERT_EQ(5U, posting.doc_id);
+  ASSERT_EQ(2, posting.num_positions);
+
+  // Document 4 is "all doc4 even even".
+  vector<int32_t> positions;
+  ASSERT_TRUE(reader.ReadPositions(posting, &positions));
+  ASSERT_EQ((vector<int32_t>{2, 3}), positions);
+  ASSERT_TRUE(reader.ReadPositions(postings[2], &positions));
+  ASSERT_EQ((vector<int32_t>{2, 3}), positions);
+  ASSERT_FALSE(reader.FindPosting(info, 6, &posting));
+  ASSERT_FALSE(reader.FindPosting(info, 100, &posting));
+
+  string name;
+  ASSERT_TRUE(reader.LookupDocName(18, &name));
+  ASSERT_EQ("dir/doc17.txt", name);
+  ASSERT_FALSE(reader.LookupDocName(21, &name));
+}
+
+TEST(Test_IndexReader, TestWriteMany) {
+  // Enough documents and words that they're written in many batches.
+  const char *fname = "test_files/test_many.idx";
+  vector<IndexDocument> docs;
+  for (int d = 0; d < 500; d++) {
+    vector<string> words;
+    for (int w = 1; w <= 40; w++) {
+      if (d % w == 0)
+        words.push_back("w" + std::to_string(w) + "x" + std::to_string(d % 7));
+    }
+    docs.push_back(MakeIndexDocument("doc" + std::to_string(d), words));
+  }
+  ASSERT_TRUE(WriteIndexFile(fname, docs));
+  ASSERT_NE(0, access((string(fname) + ".tmp").c_str(), F_OK));
+  IndexReader reader;
+  ASSERT_TRUE(reader.Open(fname));
+  unlink(fname);
+  int num_words = 0;
+  for (int w = 1; w <= 40; w++) {
+    for (int r = 0; r < 7; r++) {
+      int num_docs = 0;
+      for (int d = r; d < 500; d += 7)
+        num_docs += d % w == 0;
+      PostingsInfo info;
+      string word = "w" + std::to_string(w) + "x" + std::to_string(r);
+      ASSERT_EQ(num_docs > 0, reader.LookupWord(word, &info));
+      if (num_docs > 0) {
+        ASSERT_EQ(num_docs, info.num_docs);
+        num_words++;
+      }
+    }
+  }
+  ASSERT_EQ(num_words, reader.num_words());
+  string name;
+  ASSERT_TRUE(reader.LookupDocName(500, &name));
+  ASSERT_EQ("doc499", name);
+}
+
+// Returns the bytes of the file "fname".
+static string ReadFile(const char *fname) {
+  std::ifstream in(fname, std::ios::binary);
+  return string(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+}
+
+TEST(Test_IndexReader, TestHeaderChecksum) {
+  const char *fname = "test_files/test_header.idx";
+  vector<IndexDocument> docs;
+  for (int d = 0; d < 20; d++) {
+    docs.push_back(MakeIndexDocument("dir/doc" + std::to_string(d) + ".txt",
+                                     {"all", "doc" + std::to_string(d)}));
+  }
+  // Without block checksums, the file is exactly what hw3 writes (the
+  // header, with the CRC-32 of the sections, and the sections), and
+  // then just the trailer.
+  ASSERT_TRUE(WriteIndexFile(fname, docs, 4, 0));
+  string bytes = ReadFile(fname);
+  hw3::IndexFileHeader header;
+  ASSERT_LE(sizeof(header) + sizeof(ChecksumTrailer), bytes.size());
+  memcpy(&header, bytes.data(), sizeof(header));
+  header.toHostFormat();
+  ASSERT_EQ(hw3::kMagicNumber, header.magicNumber);
+  ASSERT_EQ(bytes.size(), sizeof(header) + header.doctableBytes +
+            header.indexBytes + sizeof(ChecksumTrailer));
+  bytes.resize(bytes.size() - sizeof(ChecksumTrailer));
+  ASSERT_EQ(Crc32(bytes.data() + sizeof(header),
+                  bytes.size() - sizeof(header)), header.checksum);
+  IndexReader reader;
+  ASSERT_TRUE(reader.Open(fname));
+  ASSERT_FALSE(reader.has_checksums());
+  ASSERT_TRUE(reader.has_word_positions());
+  ASSERT_TRUE(reader.EnableValidation());
+  string name;
+  ASSERT_TRUE(reader.LookupDocName(18, &name));
+  ASSERT_EQ("dir/doc17.txt", name);
+
+  // Without the trailer, hw3's positions are taken to be its byte
+  // offsets.
+  ASSERT_EQ(0, truncate(fname, bytes.size()));
+  IndexReader hw3;
+  ASSERT_TRUE(hw3.Open(fname));
+  ASSERT_FALSE(hw3.has_word_positions());
+  ASSERT_TRUE(hw3.EnableValidation());
+
+  // With them, the header is the same.
+  ASSERT_TRUE(WriteIndexFile(fname, docs, 4, 64));
+  string checked = ReadFile(fname);
+  ASSERT_LT(bytes.size(), checked.size());
+  ASSERT_EQ(bytes, checked.substr(0, bytes.size()));
+  unlink(fname);
+}
+
+TEST(Test_IndexReader, TestCorruptTables) {
+  const char *fname = "test_files/test_corrupt.idx";
+  vector<IndexDocument> docs = {MakeIndexDocument("doc", {"zebra"})};
+  ASSERT_TRUE(WriteIndexFile(fname, docs, 1, 0));
+  string bytes = ReadFile(fname);
+  hw3::IndexFileHeader header;
+  memcpy(&header, bytes.data(), sizeof(header));
+  header.toHostFormat();
+  auto rewrite = [&](const string &corrupt) {
+    std::ofstream out(fname, std::ios::binary | std::ios::trunc);
+    out << corrupt;
+  };
+  auto walk = [&](IndexReader *reader) {
+    return reader->ForEachWord([](const string &) { }) &&
+      reader->ForEachDoc([](uint64_t, const string &) { });
+  };
+
+  // A chain's length that is negative, or too long for the file, or a
+  // word's or file name's that is too long, fails Open() or the walk,
+  // rather than throwing or allocating it.
+  for (int32_t length : {-1, 1 << 30}) {
+    int64_t doctable = sizeof(header);
+    for (int64_t table : {doctable, doctable + header.doctableBytes}) {
+      string corrupt = bytes;
+      uint32_t disk = htonl(length);
+      memcpy(&corrupt[table + sizeof(hw3::BucketListHeader)], &disk,
+             sizeof(disk));
+      rewrite(corrupt);
+      IndexReader reader;
+      ASSERT_FALSE(reader.Open(fname) && walk(&reader));
+    }
+  }
+  // The length (an int16_t, so at most 32767) starts the word's
+  // header, and ends the document's.
+  std::pair<const char *, size_t> lengths[] = {
+    {"zebra", sizeof(hw3::WordPostingsHeader)}, {"doc", sizeof(int16_t)}};
+  for (const auto &length : lengths) {
+    string corrupt = bytes;
+    size_t at = corrupt.find(length.first);
+    ASSERT_NE(string::npos, at);
+    corrupt[at - length.second] = '\x7f';
+    rewrite(corrupt);
+    IndexReader reader;
+    ASSERT_TRUE(reader.Open(fname));
+    ASSERT_FALSE(walk(&reader));
+  }
+  rewrite(bytes);
+  IndexReader reader;
+  ASSERT_TRUE(reader.Open(fname));
+  ASSERT_TRUE(walk(&reader));
+  unlink(fname);
+}
+
+TEST(Test_IndexReader, TestChecksums) {
+  const char *fname = "test_files/test_checksums.idx";
+  vector<IndexDocument> docs;
+  for (int d = 0; d < 20; d++) {
+    docs.push_back(MakeIndexDocument("dir/doc" + std::to_string(d) + ".txt",
+                                     {"all", "doc" + std::to_string(d)}));
+  }
+  // Small blocks, so that the file has many of them.
+  ASSERT_TRUE(WriteIndexFile(fname, docs, 4, 64));
+  IndexReader reader;
+  ASSERT_TRUE(reader.Open(fname));
+  ASSERT_TRUE(reader.has_checksums());
+  ASSERT_TRUE(reader.EnableValidation());
+  string name;
+  ASSERT_TRUE(reader.LookupDocName(18, &name));
+  ASSERT_EQ("dir/doc17.txt", name);
+  ASSERT_TRUE(reader.Scrub(3));
+
+  // Corrupt one document's name.
+  string bytes = ReadFile(fname);
+  size_t at = bytes.find("dir/doc17.txt");
+  ASSERT_NE(string::npos, at);
+  bytes[at + 4] = 'D';
+  {
+    std::ofstream out(fname, std::ios::binary | std::ios::trunc);
+    out << bytes;
+  }
+
+  // Without validation the bad name is read back; with it, only the
+  // reads of its block fail.
+  IndexReader unchecked;
+  ASSERT_TRUE(unchecked.Open(fname));
+  ASSERT_TRUE(unchecked.LookupDocName(18, &name));
+  ASSERT_EQ("dir/Doc17.txt", name);
+  IndexReader checked;
+  ASSERT_TRUE(checked.Open(fname));
+  ASSERT_TRUE(checked.EnableValidation());
+  ASSERT_FALSE(checked.LookupDocName(18, &name));
+  PostingsInfo info;
+  ASSERT_TRUE(checked.LookupWord("doc3", &info));
+  ASSERT_FALSE(checked.Scrub(2));
+  ASSERT_FALSE(unchecked.Scrub(1));
+
+  // A file as hw3 writes it, without the block checksums, is checked
+  // against its header's checksum instead, all at once.
+  uint32_t num_blocks;
+  memcpy(&num_blocks, bytes.data() + bytes.size() - 8, sizeof(num_blocks));
+  size_t sections_end = bytes.size() - sizeof(ChecksumTrailer) -
+    4 * ntohl(num_blocks);
+  ASSERT_EQ(0, truncate(fname, sections_end));
+  IndexReader hw3;
+  ASSERT_TRUE(hw3.Open(fname));
+  ASSERT_FALSE(hw3.has_checksums());
+  ASSERT_FALSE(hw3.has_word_positions());
+  ASSERT_FALSE(hw3.EnableValidation());
+  ASSERT_TRUE(hw3.LookupDocName(18, &name));
+  ASSERT_EQ("dir/Doc17.txt", name);
+
+  bytes[at + 4] = 'd';
+  {
+    std::ofstream out(fname, std::ios::binary | std::ios::trunc);
+    out << bytes.substr(0, sections_end);
+  }
+  IndexReader intact;
+  ASSERT_TRUE(intact.Open(fname));
+  ASSERT_FALSE(intact.has_checksums());
+  ASSERT_TRUE(intact.EnableValidation());
+  ASSERT_TRUE(intact.LookupDocName(18, &name));
+  ASSERT_EQ("dir/doc17.txt", name);
+  ASSERT_TRUE(intact.Scrub(2));
+  unlink(fname);
+}
+
+}  // namespace hw4
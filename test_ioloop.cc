@@ -0,0 +1,240 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./IoLoop.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::unique_ptr;
+
+namespace hw4 {
+
+// Runs "loop" until "done" returns true, or a few seconds pass.
+static bool RunUntil(IoLoop *loop, std::function<bool()> done) {
+  for (int i = 0; i < 500 && !done(); i++) {
+    if (loop->RunOnce(10) < 0)
+      return false;
+  }
+  return done();
+}
+
+// Returns a socket listening on a free loopback port, which is
+// returned through "port".
+static int Listen(uint16_t *port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (fd == -1 ||
+      bind(fd, reinterpret_cast<struct sockaddr *>(&addr), len) != 0 ||
+      listen(fd, 16) != 0 ||
+      getsockname(fd, reinterpret_cast<struct sockaddr *>(&addr), &len) != 0)
+    return -1;
+  *port = ntohs(addr.sin_port);
+  return fd;
+}
+
+static int Connect(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+              sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Both implementations get the same tests; the io_uring ones are
+// skipped where the kernel doesn't have it.
+static void TestSockets(IoLoop *loop) {
+  uint16_t port;
+  int listen_fd = Listen(&port);
+  ASSERT_NE(-1, listen_fd);
+
+  // One Accept() keeps accepting.
+  std::vector<int> accepted;
+  int accept_result = 0;
+  loop->Accept(listen_fd, [&](int fd) {
+    if (fd >= 0)
+      accepted.push_back(fd);
+    else
+      accept_result = fd;
+  });
+  int c1 = Connect(port), c2 = Connect(port);
+  ASSERT_NE(-1, c1);
+  ASSERT_NE(-1, c2);
+  ASSERT_TRUE(RunUntil(loop, [&] { return accepted.size() == 2; }));
+
+  // A multishot Recv() gets each write, then the hangup.
+  string received;
+  int last_result = 1;
+  int calls = 0;
+  loop->Recv(accepted[0], true, [&](int result, std::string_view data) {
+    calls++;
+    last_result = result;
+    received.append(data);
+  });
+  ASSERT_EQ(5, write(c1, "hello", 5));
+  ASSERT_TRUE(RunUntil(loop, [&] { return received == "hello"; }));
+  ASSERT_EQ(8, write(c1, ", world!", 8));
+  ASSERT_TRUE(RunUntil(loop, [&] { return received == "hello, world!"; }));
+  close(c1);
+  ASSERT_TRUE(RunUntil(loop, [&] { return last_result == 0; }));
+  int final_calls = calls;
+  loop->RunOnce(0);
+  ASSERT_EQ(final_calls, calls);
+
+  // Send().
+  int sent = -1;
+  loop->Send(accepted[1], "pong", 4, [&](int result) { sent = result; });
+  ASSERT_TRUE(RunUntil(loop, [&] { return sent == 4; }));
+  char buf[4];
+  ASSERT_EQ(4, read(c2, buf, 4));
+  ASSERT_EQ("pong", string(buf, 4));
+
+  // A single-shot Recv(), and PollIn(), are over after one callback.
+  calls = 0;
+  loop->Recv(accepted[1], false, [&](int result, std::string_view data) {
+    calls++;
+    last_result = result;
+  });
+  ASSERT_EQ(2, write(c2, "hi", 2));
+  ASSERT_TRUE(RunUntil(loop, [&] { return calls == 1; }));
+  ASSERT_EQ(2, last_result);
+  bool readable = false;
+  loop->PollIn(accepted[1], [&](int result) {
+    readable = result == 0;
+  });
+  loop->RunOnce(0);
+  ASSERT_FALSE(readable);
+  ASSERT_EQ(1, write(c2, "x", 1));
+  ASSERT_TRUE(RunUntil(loop, [&] { return readable; }));
+  ASSERT_EQ(1U, static_cast<size_t>(recv(accepted[1], buf, 4, 0)));
+
+  // Cancelling a pending receive, and the accept, tells their
+  // callbacks so.
+  int recv_result = 0;
+  loop->Recv(accepted[1], true, [&](int result, std::string_view data) {
+    recv_result = result;
+  });
+  loop->RunOnce(0);
+  loop->Cancel(accepted[1]);
+  ASSERT_TRUE(RunUntil(loop, [&] { return recv_result == -ECANCELED; }));
+  loop->Cancel(listen_fd);
+  ASSERT_TRUE(RunUntil(loop, [&] { return accept_result == -ECANCELED; }));
+
+  close(c2);
+  for (int fd : accepted)
+    close(fd);
+  close(listen_fd);
+}
+
+static void TestFiles(IoLoop *loop) {
+  const char *path = "test_files/hextext.txt";
+  struct stat st;
+  ASSERT_EQ(0, stat(path, &st));
+
+  int fd = -1;
+  struct statx stx;
+  int statx_result = 1;
+  loop->OpenAt(AT_FDCWD, path, O_RDONLY, [&](int result) { fd = result; });
+  loop->Statx(AT_FDCWD, path, STATX_SIZE | STATX_MTIME, &stx,
+              [&](int result) { statx_result = result; });
+  ASSERT_TRUE(RunUntil(loop, [&] { return fd != -1 && statx_result != 1; }));
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(0, statx_result);
+  ASSERT_EQ(static_cast<uint64_t>(st.st_size), stx.stx_size);
+  ASSERT_EQ(st.st_mtim.tv_sec, stx.stx_mtime.tv_sec);
+
+  // Two reads at different offsets, in one batch.
+  string head(16, '\0'), tail(16, '\0');
+  int head_result = -1, tail_result = -1;
+  loop->Read(fd, &head[0], head.size(), 0,
+             [&](int result) { head_result = result; });
+  loop->Read(fd, &tail[0], tail.size(), st.st_size - 16,
+             [&](int result) { tail_result = result; });
+  ASSERT_TRUE(RunUntil(loop, [&] {
+    return head_result != -1 && tail_result != -1;
+  }));
+  ASSERT_EQ(16, head_result);
+  ASSERT_EQ(16, tail_result);
+  char expected[16];
+  ASSERT_EQ(16, pread(fd, expected, 16, 0));
+  ASSERT_EQ(string(expected, 16), head);
+  ASSERT_EQ(16, pread(fd, expected, 16, st.st_size - 16));
+  ASSERT_EQ(string(expected, 16), tail);
+  close(fd);
+
+  int missing = 0;
+  loop->OpenAt(AT_FDCWD, "test_files/no_such_file", O_RDONLY,
+               [&](int result) { missing = result; });
+  ASSERT_TRUE(RunUntil(loop, [&] { return missing != 0; }));
+  ASSERT_EQ(-ENOENT, missing);
+}
+
+static void TestPost(IoLoop *loop) {
+  // Post() wakes a RunOnce() that would otherwise wait forever.
+  int ran = 0;
+  std::thread poster([&] {
+    usleep(20000);
+    loop->Post([&] { ran++; });
+  });
+  while (ran == 0)
+    ASSERT_GE(loop->RunOnce(-1), 0);
+  poster.join();
+
+  // And keeps working.
+  loop->Post([&] { ran++; });
+  loop->Post([&] { ran++; });
+  ASSERT_TRUE(RunUntil(loop, [&] { return ran == 3; }));
+}
+
+TEST(Test_IoLoop, TestEpoll) {
+  unique_ptr<IoLoop> loop = IoLoop::Create(false);
+  ASSERT_NE(nullptr, loop.get());
+  ASSERT_EQ(string("epoll"), loop->name());
+  TestSockets(loop.get());
+  TestFiles(loop.get());
+  TestPost(loop.get());
+}
+
+TEST(Test_IoLoop, TestUring) {
+  unique_ptr<IoLoop> loop = IoLoop::Create(true);
+  ASSERT_NE(nullptr, loop.get());
+  if (string("io_uring") != loop->name()) {
+    GTEST_SKIP() << "no io_uring here";
+  }
+  TestSockets(loop.get());
+  TestFiles(loop.get());
+  TestPost(loop.get());
+}
+
+}  // namespace hw4
@@ -0,0 +1,62 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+
+#include "./MimeTypes.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+TEST(Test_MimeTypes, TestMimeTypesBuiltin) {
+  ASSERT_STREQ("text/html", MimeTypeForFile("index.html"));
+  ASSERT_STREQ("text/html", MimeTypeForFile("dir.d/INDEX.HTM"));
+  ASSERT_STREQ("image/jpeg", MimeTypeForFile("a/b/c.jpeg"));
+  ASSERT_STREQ("image/svg+xml", MimeTypeForFile("logo.svg"));
+  ASSERT_STREQ("application/json", MimeTypeForFile("data.json"));
+
+  // No suffix, an empty suffix, or a dot in a directory name.
+  ASSERT_STREQ(kDefaultMimeType, MimeTypeForFile("README"));
+  ASSERT_STREQ(kDefaultMimeType, MimeTypeForFile("foo."));
+  ASSERT_STREQ(kDefaultMimeType, MimeTypeForFile("foo.html/bar"));
+  ASSERT_STREQ(kDefaultMimeType, MimeTypeForFile("foo.nosuchext"));
+
+  // Prefixes of known extensions don't match.
+  ASSERT_STREQ(kDefaultMimeType, LookupMimeType("htm", 2));
+  ASSERT_STREQ("text/html", LookupMimeType("htmlx", 4));
+}
+
+TEST(Test_MimeTypes, TestMimeTypesLoad) {
+  ASSERT_FALSE(LoadMimeTypes("test_files/non-existent"));
+
+  const char *fname = "test_files/test.mime.types";
+  FILE *f = fopen(fname, "w");
+  ASSERT_NE(nullptr, f);
+  fputs("# a comment line\n"
+        "application/x-hw4test  hwfour hw4z  # trailing comment\n"
+        "text/x-not-html html\n", f);
+  fclose(f);
+  ASSERT_TRUE(LoadMimeTypes(fname));
+  unlink(fname);
+
+  ASSERT_STREQ("application/x-hw4test", MimeTypeForFile("a.hwfour"));
+  ASSERT_STREQ("application/x-hw4test", MimeTypeForFile("a.HW4Z"));
+  // Built-in types win over the loaded file.
+  ASSERT_STREQ("text/html", MimeTypeForFile("a.html"));
+}
+
+}  // namespace hw4
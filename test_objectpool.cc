@@ -0,0 +1,118 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <pthread.h>
+#include <atomic>
+#include <set>
+#include <vector>
+
+#include "./ObjectPool.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+namespace hw4 {
+
+struct PooledThing {
+  PooledThing() : users(0), uses(0) { }
+  std::atomic<int> users;
+  int uses;
+};
+
+TEST(Test_ObjectPool, TestObjectPoolBasic) {
+  ObjectPool<PooledThing> pool(4);
+  ASSERT_EQ(4U, pool.capacity());
+
+  // The pooled objects are handed out once each...
+  std::set<PooledThing *> got;
+  for (int i = 0; i < 4; i++) {
+    PooledThing *p = pool.Get();
+    ASSERT_TRUE(pool.Owns(p));
+    got.insert(p);
+  }
+  ASSERT_EQ(4U, got.size());
+  ASSERT_EQ(0U, pool.num_overflow());
+
+  // ...and then it overflows to the heap.
+  PooledThing *extra = pool.Get();
+  ASSERT_FALSE(pool.Owns(extra));
+  ASSERT_EQ(0U, got.count(extra));
+  ASSERT_EQ(1U, pool.num_overflow());
+  pool.Put(extra);
+  ASSERT_EQ(0U, pool.num_overflow());
+
+  // Objects come back as they were Put().
+  PooledThing *p = *got.begin();
+  p->uses = 42;
+  for (PooledThing *q : got)
+    pool.Put(q);
+  std::set<PooledThing *> again;
+  bool found = false;
+  for (int i = 0; i < 4; i++) {
+    PooledThing *q = pool.Get();
+    again.insert(q);
+    if (q == p) {
+      ASSERT_EQ(42, q->uses);
+      found = true;
+    }
+  }
+  ASSERT_EQ(got, again);
+  ASSERT_TRUE(found);
+  for (PooledThing *q : again)
+    pool.Put(q);
+}
+
+static const int kNumPoolThreads = 8;
+static const int kNumPoolRounds = 20000;
+
+static void *PoolThreadFn(void *arg) {
+  ObjectPool<PooledThing> *pool = static_cast<ObjectPool<PooledThing> *>(arg);
+  for (int i = 0; i < kNumPoolRounds; i++) {
+    PooledThing *a = pool->Get();
+    PooledThing *b = pool->Get();
+    // Nobody else may be holding either of them.
+    if (a->users.fetch_add(1) != 0 || b->users.fetch_add(1) != 0)
+      return reinterpret_cast<void *>(1);
+    a->users.fetch_sub(1);
+    b->users.fetch_sub(1);
+    pool->Put(b);
+    pool->Put(a);
+  }
+  return nullptr;
+}
+
+TEST(Test_ObjectPool, TestObjectPoolThreads) {
+  // Fewer objects than the threads want, so some of them overflow.
+  ObjectPool<PooledThing> pool(kNumPoolThreads);
+  pthread_t threads[kNumPoolThreads];
+  for (int i = 0; i < kNumPoolThreads; i++)
+    ASSERT_EQ(0, pthread_create(&threads[i], nullptr, PoolThreadFn, &pool));
+  for (int i = 0; i < kNumPoolThreads; i++) {
+    void *ret;
+    ASSERT_EQ(0, pthread_join(threads[i], &ret));
+    ASSERT_EQ(nullptr, ret);
+  }
+  ASSERT_EQ(0U, pool.num_overflow());
+
+  // Every object made it back exactly once.
+  std::set<PooledThing *> got;
+  for (int i = 0; i < kNumPoolThreads; i++) {
+    PooledThing *p = pool.Get();
+    ASSERT_TRUE(pool.Owns(p));
+    got.insert(p);
+  }
+  ASSERT_EQ(static_cast<size_t>(kNumPoolThreads), got.size());
+  PooledThing *extra = pool.Get();
+  ASSERT_FALSE(pool.Owns(extra));
+  pool.Put(extra);
+}
+
+}  // namespace hw4
@@ -0,0 +1,150 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <unistd.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./PostingCache.h"
+#include "./test_index.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+class Test_PostingCache : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(WriteTestIndex(kIndex, {{"a", {"word"}}}));
+    ASSERT_TRUE(reader_.Open(kIndex));
+  }
+  void TearDown() override { unlink(kIndex); }
+
+  // Postings for "n" documents.
+  static PostingCache::Postings MakePostings(size_t n) {
+    std::shared_ptr<vector<DocPosting>> postings(new vector<DocPosting>());
+    for (size_t i = 0; i < n; i++)
+      postings->push_back({i + 1, 1});
+    return postings;
+  }
+
+  static constexpr const char *kIndex = "test_files/test_cache.idx";
+  IndexReader reader_;
+};
+
+TEST_F(Test_PostingCache, TestAdmission) {
+  PostingCache cache(1 << 20);
+  PostingCache::Postings postings, found;
+
+  // A word that has been looked up only once isn't kept...
+  ASSERT_FALSE(cache.Lookup(reader_, "once", &found));
+  cache.Insert(reader_, "once", MakePostings(10));
+  ASSERT_FALSE(cache.Lookup(reader_, "once", &found));
+  // ...but is by the second time.
+  postings = MakePostings(10);
+  cache.Insert(reader_, "once", postings);
+  ASSERT_TRUE(cache.Lookup(reader_, "once", &found));
+  ASSERT_EQ(postings.get(), found.get());
+
+  PostingCache::Stats stats = cache.stats();
+  ASSERT_EQ(1U, stats.hits);
+  ASSERT_EQ(2U, stats.misses);
+  ASSERT_EQ(1U, stats.admitted);
+  ASSERT_EQ(1U, stats.rejected);
+  ASSERT_EQ(1U, stats.entries);
+  ASSERT_GT(stats.bytes, 10 * sizeof(DocPosting));
+
+  // Postings that would take too much of the cache aren't kept, no
+  // matter how popular.
+  for (int i = 0; i < 5; i++)
+    ASSERT_FALSE(cache.Lookup(reader_, "huge", &found));
+  cache.Insert(reader_, "huge", MakePostings(1 << 16));
+  ASSERT_FALSE(cache.Lookup(reader_, "huge", &found));
+
+  // A reader of the same file opened again doesn't see the old
+  // reader's postings.
+  IndexReader reopened;
+  ASSERT_TRUE(reopened.Open(kIndex));
+  ASSERT_NE(reader_.generation(), reopened.generation());
+  ASSERT_FALSE(cache.Lookup(reopened, "once", &found));
+}
+
+TEST_F(Test_PostingCache, TestEviction) {
+  // Room for a couple of hundred entries in all.
+  PostingCache cache(64 * 1024);
+  PostingCache::Postings found;
+  auto Request = [&](const string &word) {
+    if (!cache.Lookup(reader_, word, &found))
+      cache.Insert(reader_, word, MakePostings(10));
+  };
+
+  // Popular words get in...
+  for (int round = 0; round < 4; round++) {
+    for (int w = 0; w < 10; w++)
+      Request("popular" + std::to_string(w));
+  }
+  for (int w = 0; w < 10; w++)
+    ASSERT_TRUE(cache.Lookup(reader_, "popular" + std::to_string(w), &found));
+
+  // ...and stay there through a scan of words that are asked for only
+  // twice each, although the scan is far bigger than the cache.
+  for (int w = 0; w < 2000; w++) {
+    Request("scan" + std::to_string(w));
+    Request("scan" + std::to_string(w));
+  }
+  for (int w = 0; w < 10; w++)
+    ASSERT_TRUE(cache.Lookup(reader_, "popular" + std::to_string(w), &found));
+  PostingCache::Stats stats = cache.stats();
+  ASSERT_LE(stats.bytes, cache.capacity());
+  ASSERT_GT(stats.evicted, 0U);
+}
+
+TEST_F(Test_PostingCache, TestConcurrent) {
+  PostingCache cache(256 * 1024);
+  std::atomic<int> failures(0);
+  vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&, t] {
+      PostingCache::Postings found;
+      uint64_t x = t + 1;
+      for (int i = 0; i < 20000; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        // Each word's postings have as many documents as its number.
+        size_t n = x % 200;
+        string word = "w" + std::to_string(n);
+        if (cache.Lookup(reader_, word, &found)) {
+          if (found->size() != n)
+            failures++;
+        } else {
+          cache.Insert(reader_, word, MakePostings(n));
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+  ASSERT_EQ(0, failures.load());
+  PostingCache::Stats stats = cache.stats();
+  ASSERT_EQ(8U * 20000, stats.hits + stats.misses);
+  ASSERT_GT(stats.hits, 0U);
+  ASSERT_LE(stats.bytes, cache.capacity());
+}
+
+}  // namespace hw4
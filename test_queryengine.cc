@@ -0,0 +1,348 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <ctype.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "./IndexWriter.h"
+#include "./QueryEngine.h"
+#include "./test_index.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+class Test_QueryEngine : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // "the" is in every document of the first index, "zebra" in just
+    // two of them, and "bike" in none; the second index has only
+    // bikes.
+    vector<TestDoc> animals;
+    for (int d = 0; d < 100; d++) {
+      vector<string> words = {"the", "the", "animal"};
+      if (d == 10 || d == 20)
+        words.insert(words.end(), d / 10, "zebra");
+      if (d == 30)
+        words.push_back("lion");
+      animals.push_back({"animals/" + std::to_string(d), words});
+    }
+    ASSERT_TRUE(WriteTestIndex(kAnimals, animals, 7));
+    ASSERT_TRUE(WriteTestIndex(kBikes, {{"bikes/0", {"the", "bike"}},
+                                        {"bikes/1", {"bike", "bike"}}}));
+    ASSERT_TRUE(engine_.AddIndex(kAnimals));
+    ASSERT_TRUE(engine_.AddIndex(kBikes));
+    ASSERT_FALSE(engine_.AddIndex("test_files/non-existent"));
+    ASSERT_EQ(2U, engine_.num_indices());
+  }
+
+  void TearDown() override {
+    unlink(kAnimals);
+    unlink(kBikes);
+  }
+
+  static constexpr const char *kAnimals = "test_files/test_animals.idx";
+  static constexpr const char *kBikes = "test_files/test_bikes.idx";
+  QueryEngine engine_;
+};
+
+TEST_F(Test_QueryEngine, TestResults) {
+  vector<QueryEngine::Result> results;
+  engine_.ProcessQuery({"bike"}, &results);
+  ASSERT_EQ(2U, results.size());
+  ASSERT_EQ("bikes/1", results[0].document_name);
+  ASSERT_EQ(2, results[0].rank);
+  ASSERT_EQ("bikes/0", results[1].document_name);
+  ASSERT_EQ(1, results[1].rank);
+
+  // Every word has to be there, and the rank adds up their counts.
+  engine_.ProcessQuery({"the", "zebra"}, &results);
+  ASSERT_EQ(2U, results.size());
+  ASSERT_EQ("animals/20", results[0].document_name);
+  ASSERT_EQ(4, results[0].rank);
+  ASSERT_EQ("animals/10", results[1].document_name);
+  ASSERT_EQ(3, results[1].rank);
+
+  // A repeated word counts twice, as it does in hw3.
+  engine_.ProcessQuery({"zebra", "zebra"}, &results);
+  ASSERT_EQ(2U, results.size());
+  ASSERT_EQ(4, results[0].rank);
+
+  engine_.ProcessQuery({"zebra", "lion"}, &results);
+  ASSERT_EQ(0U, results.size());
+  engine_.ProcessQuery({"unicorn"}, &results);
+  ASSERT_EQ(0U, results.size());
+  engine_.ProcessQuery({}, &results);
+  ASSERT_EQ(0U, results.size());
+}
+
+TEST_F(Test_QueryEngine, TestPlan) {
+  vector<QueryEngine::Result> results;
+  vector<QueryEngine::IndexPlan> plan;
+  engine_.ProcessQuery({"the", "zebra"}, &results, &plan);
+  ASSERT_EQ(2U, plan.size());
+
+  // The rarest word goes first, and its two documents are looked up
+  // in "the" rather than reading all 100 of them.
+  ASSERT_EQ(kAnimals, plan[0].index_file);
+  ASSERT_EQ("", plan[0].skipped);
+  ASSERT_EQ(2U, plan[0].steps.size());
+  ASSERT_EQ("zebra", plan[0].steps[0].word);
+  ASSERT_EQ(2, plan[0].steps[0].num_docs);
+  ASSERT_FALSE(plan[0].steps[0].probed);
+  ASSERT_EQ("the", plan[0].steps[1].word);
+  ASSERT_EQ(100, plan[0].steps[1].num_docs);
+  ASSERT_TRUE(plan[0].steps[1].probed);
+  ASSERT_EQ(2, plan[0].steps[1].matches);
+
+  // The bikes index has no zebras, which its filter knows.
+  ASSERT_EQ(kBikes, plan[1].index_file);
+  ASSERT_NE(string::npos, plan[1].skipped.find("filter"));
+  ASSERT_EQ(0U, plan[1].steps.size());
+
+  // Evaluation stops once no document is left.
+  engine_.ProcessQuery({"animal", "the", "lion", "zebra"}, &results, &plan);
+  ASSERT_EQ(2U, plan[0].steps.size());
+  ASSERT_EQ("lion", plan[0].steps[0].word);
+  ASSERT_EQ("zebra", plan[0].steps[1].word);
+  ASSERT_FALSE(plan[0].steps[1].probed);
+  ASSERT_EQ(0, plan[0].steps[1].matches);
+
+  string text = QueryEngine::ExplainPlan(plan);
+  ASSERT_NE(string::npos, text.find("\"lion\" in 1 docs, read: 1 left"));
+  ASSERT_NE(string::npos, text.find(kBikes));
+}
+
+TEST_F(Test_QueryEngine, TestBoolean) {
+  vector<QueryEngine::Result> results;
+  vector<QueryEngine::IndexPlan> plan;
+  auto process = [&](const string &query, size_t max_results) {
+    QueryNode root;
+    ASSERT_TRUE(ParseQuery(query, &root));
+    engine_.ProcessQuery(root, max_results, &results, &plan);
+  };
+
+  // A document matching either word ranks by the ones it has.
+  process("zebra OR lion", 0);
+  ASSERT_EQ(3U, results.size());
+  ASSERT_EQ("animals/20", results[0].document_name);
+  ASSERT_EQ(2, results[0].rank);
+  ASSERT_EQ("animals/10", results[1].document_name);
+  ASSERT_EQ("animals/30", results[2].document_name);
+  ASSERT_EQ(1, results[2].rank);
+  ASSERT_EQ(3, plan[0].scored);
+  ASSERT_NE(string::npos, plan[1].skipped.find("filter"));
+
+  // Ties go to the earlier index and document.
+  process("bike OR zebra", 2);
+  ASSERT_EQ(2U, results.size());
+  ASSERT_EQ("animals/20", results[0].document_name);
+  ASSERT_EQ("bikes/1", results[1].document_name);
+
+  process("the -zebra", 0);
+  ASSERT_EQ(99U, results.size());
+  ASSERT_EQ(2, results[0].rank);
+  ASSERT_EQ("bikes/0", results[98].document_name);
+  process("the -zebra", 3);
+  ASSERT_EQ(3U, results.size());
+  ASSERT_EQ("animals/0", results[0].document_name);
+  ASSERT_EQ("animals/2", results[2].document_name);
+
+  process("animal (zebra OR lion) -lion", 0);
+  ASSERT_EQ(2U, results.size());
+  ASSERT_EQ("animals/20", results[0].document_name);
+  ASSERT_EQ(3, results[0].rank);
+  ASSERT_EQ("animals/10", results[1].document_name);
+
+  // A plain list of words gets the same results either way.
+  process("the zebra", 0);
+  vector<QueryEngine::Result> plain;
+  engine_.ProcessQuery({"the", "zebra"}, &plain);
+  ASSERT_EQ(plain.size(), results.size());
+  for (size_t i = 0; i < plain.size(); i++) {
+    ASSERT_EQ(plain[i].document_name, results[i].document_name);
+    ASSERT_EQ(plain[i].rank, results[i].rank);
+  }
+
+  process("-the", 0);
+  ASSERT_EQ(0U, results.size());
+  process("unicorn OR lion -animal", 0);
+  ASSERT_EQ(0U, results.size());
+
+  string text = QueryEngine::ExplainPlan(plan);
+  ASSERT_NE(string::npos, text.find("\"lion\" in 1 docs, read\n"));
+  ASSERT_NE(string::npos, text.find("scored 0 docs"));
+}
+
+TEST_F(Test_QueryEngine, TestPhrases) {
+  // The animals are "the the animal", and then maybe "zebra" or
+  // "zebra zebra" or "lion".
+  vector<QueryEngine::Result> results;
+  vector<QueryEngine::IndexPlan> plan;
+  auto process = [&](const string &query) {
+    QueryNode root;
+    ASSERT_TRUE(ParseQuery(query, &root));
+    engine_.ProcessQuery(root, 0, &results, &plan);
+  };
+
+  process("\"the animal\"");
+  ASSERT_EQ(100U, results.size());
+  ASSERT_EQ(1, results[0].rank);
+  ASSERT_NE(string::npos, plan[1].skipped.find("filter"));
+  process("\"the the\"");
+  ASSERT_EQ(100U, results.size());
+  process("\"animal the\"");
+  ASSERT_EQ(0U, results.size());
+  process("\"animal zebra zebra\"");
+  ASSERT_EQ(1U, results.size());
+  ASSERT_EQ("animals/20", results[0].document_name);
+
+  // A NEAR counts the first word's positions with the others close.
+  process("the NEAR/2 zebra");
+  ASSERT_EQ(2U, results.size());
+  ASSERT_EQ(1, results[0].rank);
+  process("zebra NEAR/2 the");
+  ASSERT_EQ(2U, results.size());
+  process("zebra NEAR/2 zebra");
+  ASSERT_EQ("animals/20", results[0].document_name);
+  ASSERT_EQ(2, results[0].rank);
+  process("the NEAR/1 zebra");
+  ASSERT_EQ(0U, results.size());
+
+  process("\"animal zebra\" OR lion");
+  ASSERT_EQ(3U, results.size());
+  process("the -\"the animal\"");
+  ASSERT_EQ(1U, results.size());
+  ASSERT_EQ("bikes/0", results[0].document_name);
+}
+
+TEST_F(Test_QueryEngine, TestByteOffsets) {
+  // An index as hw3 writes it: each position the byte offset of the
+  // word in its file, as hw2's parser gives, and no trailer, which is
+  // what would say that they count words.
+  const char *fname = "test_files/test_offsets.idx";
+  vector<string> texts = {"the quick fox", "a fox, a quick fox!"};
+  vector<IndexDocument> docs;
+  for (size_t d = 0; d < texts.size(); d++) {
+    IndexDocument doc;
+    doc.name = "texts/" + std::to_string(d);
+    const string &text = texts[d];
+    for (size_t i = 0; i < text.size();) {
+      if (!isalpha(text[i])) {
+        i++;
+        continue;
+      }
+      size_t start = i;
+      while (i < text.size() && isalpha(text[i]))
+        i++;
+      doc.words[text.substr(start, i - start)].push_back(start);
+    }
+    docs.push_back(doc);
+  }
+  ASSERT_EQ((vector<int32_t>{2, 15}), docs[1].words["fox"]);
+  ASSERT_TRUE(WriteIndexFile(fname, docs, 3, 0));
+  struct stat st;
+  ASSERT_EQ(0, stat(fname, &st));
+  ASSERT_EQ(0, truncate(fname, st.st_size - sizeof(ChecksumTrailer)));
+
+  QueryEngine engine;
+  ASSERT_TRUE(engine.AddIndex(fname));
+  unlink(fname);
+  vector<QueryEngine::Result> results;
+  vector<QueryEngine::IndexPlan> plan;
+  auto process = [&](const string &query) {
+    QueryNode root;
+    ASSERT_TRUE(ParseQuery(query, &root));
+    engine.ProcessQuery(root, 0, &results, &plan);
+  };
+
+  // Words still match, and rank by their counts.
+  process("fox OR the");
+  ASSERT_EQ(2U, results.size());
+  ASSERT_EQ("texts/0", results[0].document_name);
+  ASSERT_EQ(2, results[0].rank);
+  engine.ProcessQuery({"quick", "fox"}, &results);
+  ASSERT_EQ(2U, results.size());
+
+  // Offsets 4 and 10 aren't one apart, though "quick fox" is a phrase
+  // in both documents, and 0 and 10 aren't within two, though "the"
+  // and "fox" are two words apart.  So rather than miss them, phrases
+  // and NEARs skip the index.
+  process("\"quick fox\"");
+  ASSERT_EQ(0U, results.size());
+  ASSERT_EQ(1U, plan.size());
+  ASSERT_NE(string::npos, plan[0].skipped.find("byte offsets"));
+  process("the NEAR/2 fox");
+  ASSERT_EQ(0U, results.size());
+  ASSERT_NE(string::npos, plan[0].skipped.find("byte offsets"));
+
+  // In an OR, though, they're just left out, and the rest still
+  // matches.
+  process("the OR \"quick fox\"");
+  ASSERT_EQ(1U, results.size());
+  ASSERT_EQ("texts/0", results[0].document_name);
+  ASSERT_EQ("", plan[0].skipped);
+  ASSERT_EQ(vector<string>{"\"quick fox\""}, plan[0].left_out);
+  ASSERT_NE(string::npos,
+            QueryEngine::ExplainPlan(plan).find("left out \"quick fox\""));
+  process("a OR (quick -the \"a fox\") OR fox (the NEAR/2 fox OR \"a b\")");
+  ASSERT_EQ(1U, results.size());
+  ASSERT_EQ("texts/1", results[0].document_name);
+  ASSERT_EQ((vector<string>{"(quick -the \"a fox\")",
+                            "(fox (the NEAR/2 fox OR \"a b\"))"}),
+            plan[0].left_out);
+  ASSERT_EQ(1U, plan[0].steps.size());
+  process("\"quick fox\" OR the NEAR/2 fox");
+  ASSERT_EQ(0U, results.size());
+  ASSERT_NE(string::npos, plan[0].skipped.find("byte offsets"));
+  ASSERT_EQ(0U, plan[0].left_out.size());
+
+  // Files that IndexWriter writes say that their positions count
+  // words, with or without block checksums.
+  IndexReader reader;
+  ASSERT_TRUE(WriteIndexFile(fname, docs, 3, 0));
+  ASSERT_TRUE(reader.Open(fname));
+  unlink(fname);
+  ASSERT_FALSE(reader.has_checksums());
+  ASSERT_TRUE(reader.has_word_positions());
+}
+
+TEST_F(Test_QueryEngine, TestPostingCache) {
+  QueryEngine engine(1 << 20);
+  ASSERT_TRUE(engine.AddIndex(kAnimals));
+  vector<QueryEngine::Result> results;
+  vector<QueryEngine::IndexPlan> plan;
+
+  // "zebra" is read the first two times, and cached the second.
+  for (int i = 0; i < 3; i++) {
+    engine.ProcessQuery({"zebra", "animal"}, &results, &plan);
+    ASSERT_EQ(2U, results.size());
+    ASSERT_EQ(i == 2, plan[0].steps[0].cached);
+  }
+  PostingCache::Stats stats = engine.posting_cache()->stats();
+  ASSERT_EQ(1U, stats.hits);
+  ASSERT_EQ(1U, stats.admitted);
+
+  // Without a cache, nothing is.
+  ASSERT_EQ(nullptr, engine_.posting_cache());
+  engine_.ProcessQuery({"zebra"}, &results, &plan);
+  engine_.ProcessQuery({"zebra"}, &results, &plan);
+  ASSERT_FALSE(plan[0].steps[0].cached);
+}
+
+}  // namespace hw4
@@ -0,0 +1,122 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <string>
+#include <vector>
+
+#include "./QueryParser.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// Writes "node" back out, fully parenthesized, to compare parses.
+static string Show(const QueryNode &node) {
+  string out = node.negated ? "-" : "";
+  if (node.type == QueryNode::kWord)
+    return out + node.word;
+  string separator = " ";
+  if (node.type == QueryNode::kOr)
+    separator = " | ";
+  else if (node.type == QueryNode::kNear)
+    separator = " ~" + std::to_string(node.distance) + " ";
+  out += node.type == QueryNode::kPhrase ? "\"" : "(";
+  for (size_t i = 0; i < node.children.size(); i++) {
+    if (i > 0)
+      out += separator;
+    out += Show(node.children[i]);
+  }
+  return out + (node.type == QueryNode::kPhrase ? "\"" : ")");
+}
+
+static string Parse(const string &query) {
+  QueryNode root;
+  if (!ParseQuery(query, &root))
+    return "error";
+  return Show(root);
+}
+
+TEST(Test_QueryParser, TestParse) {
+  ASSERT_EQ("zebra", Parse("Zebra"));
+  ASSERT_EQ("(the zebra)", Parse("  the   ZEBRA "));
+
+  // OR binds more loosely than AND, and "or" is just a word.
+  ASSERT_EQ("((a b) | c)", Parse("a b OR c"));
+  ASSERT_EQ("(a b or c)", Parse("a b or c"));
+  ASSERT_EQ("(a (b | c) d)", Parse("a (b OR c) d"));
+
+  // Nested groups of the same kind are merged.
+  ASSERT_EQ("(a b c)", Parse("a (b c)"));
+  ASSERT_EQ("(a | b | c)", Parse("a OR (b OR c)"));
+  ASSERT_EQ("b", Parse("((b))"));
+
+  // "-" excludes a word or a group, but not inside a word.
+  ASSERT_EQ("(cat (dog | puppy) -food)", Parse("cat (dog OR puppy) -food"));
+  ASSERT_EQ("(a -(b | c))", Parse("a -(b OR c)"));
+  ASSERT_EQ("(-a)", Parse("-a"));
+  ASSERT_EQ("e-mail", Parse("e-mail"));
+
+  // Quotes make a phrase, and NEAR/k binds tightest.
+  ASSERT_EQ("\"black cat\"", Parse("\"Black  cat\""));
+  ASSERT_EQ("cat", Parse("\" cat \""));
+  ASSERT_EQ("(a \"b c\" d)", Parse("a\"b c\"d"));
+  ASSERT_EQ("(\"black cat\" | (cat ~3 black))",
+            Parse("\"black cat\" OR cat NEAR/3 black"));
+  ASSERT_EQ("(a (b ~2 c ~2 d) e)", Parse("a b NEAR/2 c NEAR/2 d e"));
+  ASSERT_EQ("(a -\"b c\" -(d ~5 e))", Parse("a -\"b c\" -d NEAR/5 e"));
+  ASSERT_EQ("(near a)", Parse("NEAR a"));
+  ASSERT_EQ("error", Parse("\"a b"));
+  ASSERT_EQ("error", Parse("a \"\""));
+  ASSERT_EQ("error", Parse("a NEAR/3"));
+  ASSERT_EQ("error", Parse("NEAR/3 a"));
+  ASSERT_EQ("error", Parse("a NEAR/0 b"));
+  ASSERT_EQ("error", Parse("a NEAR/2 b NEAR/3 c"));
+  ASSERT_EQ("error", Parse("a NEAR/2 (b c)"));
+  ASSERT_EQ("error", Parse("\"a b\" NEAR/2 c"));
+
+  ASSERT_EQ("error", Parse(""));
+  ASSERT_EQ("error", Parse("   "));
+  ASSERT_EQ("error", Parse("a OR"));
+  ASSERT_EQ("error", Parse("OR a"));
+  ASSERT_EQ("error", Parse("a OR OR b"));
+  ASSERT_EQ("error", Parse("(a b"));
+  ASSERT_EQ("error", Parse("a b)"));
+  ASSERT_EQ("error", Parse("a () b"));
+
+  // Groups nest at most 64 deep, however long the query.
+  ASSERT_EQ("b", Parse(string(64, '(') + "b" + string(64, ')')));
+  ASSERT_EQ("error", Parse(string(65, '(') + "b" + string(65, ')')));
+  ASSERT_EQ("error", Parse(string(60000, '(')));
+}
+
+TEST(Test_QueryParser, TestIsConjunction) {
+  QueryNode root;
+  vector<string> words;
+  ASSERT_TRUE(ParseQuery("the Zebra the", &root));
+  ASSERT_TRUE(IsConjunction(root, &words));
+  ASSERT_EQ((vector<string>{"the", "zebra", "the"}), words);
+  ASSERT_TRUE(ParseQuery("zebra", &root));
+  ASSERT_TRUE(IsConjunction(root, &words));
+  ASSERT_EQ(vector<string>{"zebra"}, words);
+
+  ASSERT_TRUE(ParseQuery("the OR zebra", &root));
+  ASSERT_FALSE(IsConjunction(root, &words));
+  ASSERT_TRUE(ParseQuery("the -zebra", &root));
+  ASSERT_FALSE(IsConjunction(root, &words));
+  ASSERT_TRUE(ParseQuery("\"the zebra\"", &root));
+  ASSERT_FALSE(IsConjunction(root, &words));
+}
+
+}  // namespace hw4
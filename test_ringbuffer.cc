@@ -0,0 +1,123 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <string>
+
+#include "./HttpUtils.h"
+#include "./RingBuffer.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+// Writes "s" to "fd".
+static void WriteString(int fd, const string &s) {
+  ASSERT_EQ(static_cast<int>(s.size()),
+            WrappedWrite(fd, (unsigned char *) s.data(), s.size()));
+}
+
+TEST(Test_RingBuffer, TestRingBufferWrap) {
+  int spair[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  RingBuffer rb(16, 16);
+  ASSERT_EQ(16U, rb.capacity());
+
+  // Move the head along so the next read wraps.
+  WriteString(spair[1], "0123456789ab");
+  ASSERT_EQ(12, rb.ReadFrom(spair[0]));
+  ASSERT_EQ("0123456789", rb.Front(10));
+  rb.Consume(10);
+  ASSERT_EQ(2U, rb.size());
+
+  // This lands in two pieces, with "\r\n\r\n" across the wrap point.
+  WriteString(spair[1], "cde\r\n\r\nfghijkl");
+  ASSERT_EQ(14, rb.ReadFrom(spair[0]));
+  ASSERT_EQ(16U, rb.size());
+  ASSERT_TRUE(rb.full());
+  ASSERT_EQ(5U, rb.Find("\r\n\r\n"));
+  ASSERT_EQ(7U, rb.Find("\r\n", 6));
+  ASSERT_EQ(14U, rb.Find("kl"));
+  ASSERT_EQ(3U, rb.Find("d", 1));
+  ASSERT_EQ(RingBuffer::npos, rb.Find("ab", 1));
+  ASSERT_EQ(RingBuffer::npos, rb.Find("klm"));
+
+  // A full buffer that can't grow reads nothing.
+  ASSERT_EQ(0, rb.ReadFrom(spair[0]));
+
+  // Front() straightens out wrapped bytes.
+  ASSERT_EQ("abcde\r\n\r\nfghijkl", rb.Front(16));
+  rb.Consume(16);
+  ASSERT_EQ(0U, rb.size());
+
+  WriteString(spair[1], "n");
+  ASSERT_EQ(1, rb.ReadFrom(spair[0]));
+  ASSERT_EQ("n", rb.Front(1));
+
+  close(spair[0]);
+  close(spair[1]);
+}
+
+TEST(Test_RingBuffer, TestRingBufferAdapt) {
+  int spair[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  RingBuffer rb(4096, 65536);
+  ASSERT_EQ(4096U, rb.capacity());
+
+  // A big message grows the buffer, a power of two at a time.
+  string big(20000, 'x');
+  big += "\r\n\r\n";
+  WriteString(spair[1], big);
+  while (rb.Find("\r\n\r\n") == RingBuffer::npos)
+    ASSERT_LT(0, rb.ReadFrom(spair[0]));
+  ASSERT_EQ(32768U, rb.capacity());
+  ASSERT_EQ(big, rb.Front(big.size()));
+  rb.Consume(big.size());
+  rb.NoteMessageSize(big.size());
+
+  // A run of small ones shrinks it back.
+  for (int i = 0; i < 40; i++)
+    rb.NoteMessageSize(500);
+  ASSERT_EQ(4096U, rb.capacity());
+
+  // But never below what's buffered.
+  string partial(3000, 'y');
+  WriteString(spair[1], partial);
+  ASSERT_EQ(3000, rb.ReadFrom(spair[0]));
+  rb.NoteMessageSize(10);
+  ASSERT_EQ(4096U, rb.capacity());
+  ASSERT_EQ(partial, rb.Front(3000));
+
+  // A header bigger than the limit fills the buffer, then stops.
+  string huge(70000, 'z');
+  WriteString(spair[1], huge);
+  size_t total = 3000;
+  ssize_t res;
+  while ((res = rb.ReadFrom(spair[0])) > 0)
+    total += res;
+  ASSERT_EQ(0, res);
+  ASSERT_TRUE(rb.full());
+  ASSERT_EQ(65536U, total);
+
+  // Clear() forgets it all.
+  rb.Clear();
+  ASSERT_EQ(0U, rb.size());
+
+  close(spair[0]);
+  close(spair[1]);
+}
+
+}  // namespace hw4
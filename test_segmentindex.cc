@@ -0,0 +1,195 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "./QueryEngine.h"
+#include "./SegmentIndex.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+class Test_SegmentIndex : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    RemoveDir();
+    ASSERT_EQ(0, mkdir(kDir, 0755));
+  }
+
+  void TearDown() override {
+    RemoveDir();
+  }
+
+  static void RemoveDir() {
+    DIR *dir = opendir(kDir);
+    if (dir == nullptr)
+      return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+      unlink((string(kDir) + "/" + entry->d_name).c_str());
+    closedir(dir);
+    rmdir(kDir);
+  }
+
+  // Returns the names of the documents that have "query", best first.
+  static vector<string> Query(QueryEngine *engine, const string &query) {
+    QueryNode root;
+    vector<QueryEngine::Result> results;
+    vector<string> names;
+    if (!ParseQuery(query, &root))
+      return names;
+    engine->ProcessQuery(root, 100, &results);
+    for (const QueryEngine::Result &result : results)
+      names.push_back(result.document_name);
+    return names;
+  }
+
+  static constexpr const char *kDir = "test_files/test_segments";
+};
+
+TEST_F(Test_SegmentIndex, TestAddDelete) {
+  SegmentIndex index;
+  ASSERT_TRUE(index.Open(kDir));
+  ASSERT_EQ(0U, index.num_docs());
+  ASSERT_TRUE(index.AddDocuments(
+      {MakeIndexDocument("a", {"the", "zebra"}),
+       MakeIndexDocument("b", {"the", "lion"})}));
+  ASSERT_TRUE(index.AddDocuments({MakeIndexDocument("c", {"the", "bike"})}));
+  ASSERT_EQ(3U, index.num_docs());
+  ASSERT_EQ(2U, index.segments().size());
+
+  QueryEngine engine;
+  engine.SetManifestCheckMs(0);
+  ASSERT_FALSE(engine.AddSegments("test_files/non-existent"));
+  ASSERT_TRUE(engine.AddSegments(kDir));
+  ASSERT_EQ(2U, engine.num_indices());
+  ASSERT_EQ((vector<string>{"a", "b", "c"}), Query(&engine, "the"));
+
+  // Replacing a document hides the old one, and the engine notices
+  // the new manifest without being told.
+  ASSERT_TRUE(index.AddDocuments({MakeIndexDocument("a", {"the", "lion"})}));
+  ASSERT_EQ(3U, index.num_docs());
+  ASSERT_EQ(vector<string>{}, Query(&engine, "zebra"));
+  ASSERT_EQ((vector<string>{"b", "a"}), Query(&engine, "lion"));
+  ASSERT_EQ(3U, engine.num_indices());
+
+  // So does deleting one, in both kinds of query.
+  ASSERT_TRUE(index.DeleteDocuments({"b", "non-existent"}));
+  ASSERT_EQ(2U, index.num_docs());
+  ASSERT_EQ((vector<string>{"c", "a"}), Query(&engine, "the"));
+  vector<QueryEngine::Result> results;
+  engine.ProcessQuery({"lion"}, &results);
+  ASSERT_EQ(1U, results.size());
+  ASSERT_EQ("a", results[0].document_name);
+
+  // Reopening the directory finds the same documents.
+  SegmentIndex reopened;
+  ASSERT_TRUE(reopened.Open(kDir));
+  ASSERT_EQ(2U, reopened.num_docs());
+  ASSERT_EQ(3U, reopened.segments().size());
+  ASSERT_TRUE(reopened.DeleteDocuments({"a"}));
+  ASSERT_EQ(1U, reopened.num_docs());
+
+  // An engine that checks the manifest less often keeps querying the
+  // segments it has until it checks again.
+  QueryEngine patient;
+  patient.SetManifestCheckMs(3600 * 1000);
+  ASSERT_TRUE(patient.AddSegments(kDir));
+  ASSERT_TRUE(reopened.AddDocuments(
+      {MakeIndexDocument("d", {"the", "lion"})}));
+  ASSERT_EQ(vector<string>{}, Query(&patient, "lion"));
+  ASSERT_EQ(vector<string>{"d"}, Query(&engine, "lion"));
+}
+
+TEST_F(Test_SegmentIndex, TestMerge) {
+  SegmentIndex index;
+  ASSERT_TRUE(index.Open(kDir));
+  QueryEngine engine;
+  engine.SetManifestCheckMs(0);
+  ASSERT_TRUE(engine.AddSegments(kDir));
+
+  // A tier merges once it has kMergeFactor segments.
+  bool merged;
+  for (int i = 0; i < SegmentIndex::kMergeFactor; i++) {
+    ASSERT_TRUE(index.Merge(&merged));
+    ASSERT_FALSE(merged);
+    string name = std::to_string(i);
+    ASSERT_TRUE(index.AddDocuments(
+        {MakeIndexDocument("doc" + name, {"the", "zebra", "the"}),
+         MakeIndexDocument("extra" + name, {"extra"})}));
+  }
+  ASSERT_TRUE(index.DeleteDocuments({"doc1"}));
+  ASSERT_EQ(static_cast<size_t>(SegmentIndex::kMergeFactor),
+            index.segments().size());
+  ASSERT_TRUE(index.Merge(&merged));
+  ASSERT_TRUE(merged);
+
+  // The deleted document is gone from the merged segment, and the
+  // rest keep their words and positions.
+  vector<SegmentInfo> segments = index.segments();
+  ASSERT_EQ(1U, segments.size());
+  ASSERT_EQ(2 * SegmentIndex::kMergeFactor - 1, segments[0].num_docs);
+  ASSERT_EQ("", segments[0].deletes_file);
+  ASSERT_EQ(static_cast<size_t>(2 * SegmentIndex::kMergeFactor - 1),
+            index.num_docs());
+  ASSERT_EQ(1U, engine.num_indices());
+  ASSERT_EQ(static_cast<size_t>(SegmentIndex::kMergeFactor - 1),
+            Query(&engine, "\"the zebra the\"").size());
+  ASSERT_TRUE(index.Merge(&merged));
+  ASSERT_FALSE(merged);
+
+  // Deleting and replacing still work on the merged segment, and a
+  // segment with nothing left is dropped.
+  ASSERT_TRUE(index.AddDocuments({MakeIndexDocument("doc0", {"lion"})}));
+  ASSERT_TRUE(index.DeleteDocuments({"doc0"}));
+  ASSERT_EQ(2U, index.segments().size());
+  ASSERT_TRUE(index.Merge(&merged));
+  ASSERT_TRUE(merged);
+  ASSERT_EQ(1U, index.segments().size());
+  ASSERT_EQ(vector<string>{}, Query(&engine, "lion"));
+  ASSERT_EQ((vector<string>{"doc2", "doc3"}), Query(&engine, "zebra"));
+}
+
+TEST_F(Test_SegmentIndex, TestMerger) {
+  SegmentIndex index;
+  ASSERT_TRUE(index.Open(kDir));
+  index.StartMerger();
+  int num_docs = SegmentIndex::kMergeFactor * SegmentIndex::kMergeFactor;
+  for (int i = 0; i < num_docs; i++) {
+    string name = "doc" + std::to_string(i);
+    ASSERT_TRUE(index.AddDocuments({MakeIndexDocument(name, {"word"})}));
+  }
+  index.StopMerger();
+
+  // Whatever the merger got to, nothing is lost, and once it's done
+  // the two tiers have merged into one segment.
+  ASSERT_EQ(static_cast<size_t>(num_docs), index.num_docs());
+  bool merged = true;
+  while (merged)
+    ASSERT_TRUE(index.Merge(&merged));
+  ASSERT_EQ(1U, index.segments().size());
+
+  QueryEngine engine;
+  ASSERT_TRUE(engine.AddSegments(kDir));
+  ASSERT_EQ(static_cast<size_t>(num_docs), Query(&engine, "word").size());
+}
+
+}  // namespace hw4
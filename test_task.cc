@@ -0,0 +1,126 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <coroutine>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./Task.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// Suspends the awaiting coroutine until Resume() is called, standing
+// in for an I/O operation.
+class Gate {
+ public:
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> h) { waiter_ = h; }
+  int await_resume() const noexcept { return value_; }
+
+  bool waiting() const { return static_cast<bool>(waiter_); }
+  void Resume(int value) {
+    std::coroutine_handle<> h = waiter_;
+    waiter_ = nullptr;
+    value_ = value;
+    h.resume();
+  }
+
+ private:
+  std::coroutine_handle<> waiter_;
+  int value_ = 0;
+};
+
+static Task<int> Add(int a, int b) {
+  co_return a + b;
+}
+
+static Task<string> Waits(Gate *gate, vector<string> *log) {
+  log->push_back("waiting");
+  int v = co_await *gate;
+  log->push_back("woke " + std::to_string(v));
+  co_return "got " + std::to_string(v);
+}
+
+static Task<> Outer(Gate *gate, vector<string> *log) {
+  int sum = co_await Add(2, 3);
+  log->push_back("sum " + std::to_string(sum));
+  string s = co_await Waits(gate, log);
+  log->push_back(s);
+}
+
+TEST(Test_Task, TestSpawnAndAwait) {
+  Gate gate;
+  vector<string> log;
+
+  // Spawn() runs the task until it first suspends; nested tasks run
+  // as part of it.
+  Spawn(Outer(&gate, &log));
+  ASSERT_TRUE(gate.waiting());
+  ASSERT_EQ((vector<string>{"sum 5", "waiting"}), log);
+
+  // Resuming it finishes the inner task, then the outer one, which
+  // frees itself.
+  gate.Resume(7);
+  ASSERT_FALSE(gate.waiting());
+  ASSERT_EQ((vector<string>{"sum 5", "waiting", "woke 7", "got 7"}), log);
+}
+
+static Task<> Counts(int *count) {
+  (*count)++;
+  co_return;
+}
+
+TEST(Test_Task, TestLazy) {
+  // A Task doesn't run until it's started, and one that never is
+  // is simply destroyed.
+  int count = 0;
+  {
+    Task<> t = Counts(&count);
+    ASSERT_EQ(0, count);
+  }
+  ASSERT_EQ(0, count);
+  Spawn(Counts(&count));
+  ASSERT_EQ(1, count);
+}
+
+// Many tasks are suspended at once, and each is resumed
+// independently, in any order; only their own state moves.
+static Task<> Accumulate(Gate *gate, int *total) {
+  for (int i = 0; i < 3; i++)
+    *total += co_await *gate;
+}
+
+TEST(Test_Task, TestManySuspended) {
+  const int kTasks = 1000;
+  std::unique_ptr<Gate[]> gates(new Gate[kTasks]);
+  vector<int> totals(kTasks, 0);
+  for (int i = 0; i < kTasks; i++)
+    Spawn(Accumulate(&gates[i], &totals[i]));
+  for (int round = 0; round < 3; round++) {
+    for (int i = kTasks - 1; i >= 0; i--) {
+      ASSERT_TRUE(gates[i].waiting());
+      gates[i].Resume(i);
+    }
+  }
+  for (int i = 0; i < kTasks; i++) {
+    ASSERT_FALSE(gates[i].waiting());
+    ASSERT_EQ(3 * i, totals[i]);
+  }
+}
+
+}  // namespace hw4
@@ -11,6 +11,9 @@
 
 #include <unistd.h>
 
+#include <atomic>
+#include <memory>
+
 #include "gtest/gtest.h"
 extern "C" {
   #include "libhw1/CSE333.h"
@@ -62,4 +65,28 @@ TEST(Test_ThreadPool, TestThreadPoolBasic) {
   ASSERT_EQ((uint32_t) 300, workcount);
 }
 
+TEST(Test_ThreadPool, TestParallelFor) {
+  for (int num_threads : {1, 3, 16}) {
+    for (size_t batch : {1, 7, 1000}) {
+      // Every index is visited exactly once, in batches of "batch".
+      const size_t n = 500;
+      std::unique_ptr<std::atomic<int>[]> visits(new std::atomic<int>[n]());
+      std::atomic<size_t> calls(0);
+      ParallelFor(n, batch, num_threads, [&](size_t begin, size_t end) {
+        ASSERT_EQ(0U, begin % batch);
+        ASSERT_EQ(std::min(begin + batch, n), end);
+        for (size_t i = begin; i < end; i++)
+          visits[i]++;
+        calls++;
+      });
+      ASSERT_EQ((n + batch - 1) / batch, calls);
+      for (size_t i = 0; i < n; i++)
+        ASSERT_EQ(1, visits[i]);
+    }
+  }
+  bool called = false;
+  ParallelFor(0, 1, 4, [&](size_t, size_t) { called = true; });
+  ASSERT_FALSE(called);
+}
+
 }  // namespace hw4
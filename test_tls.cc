@@ -0,0 +1,184 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <string>
+#include <thread>
+
+#include "./FileReader.h"
+#include "./HttpConnection.h"
+#include "./HttpRequest.h"
+#include "./HttpResponse.h"
+#include "./TlsTransport.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+// Writes a new self-signed certificate for "localhost", and its key,
+// to "cert_file" and "key_file".
+static bool MakeSelfSignedCert(const string &cert_file,
+                               const string &key_file) {
+  EVP_PKEY *key = EVP_EC_gen("P-256");
+  X509 *x509 = X509_new();
+  if (key == nullptr || x509 == nullptr)
+    return false;
+  ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+  X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+  X509_gmtime_adj(X509_getm_notAfter(x509), 3600);
+  X509_set_pubkey(x509, key);
+  X509_NAME *name = X509_get_subject_name(x509);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                             (const unsigned char *) "localhost", -1, -1, 0);
+  X509_set_issuer_name(x509, name);
+  bool ok = X509_sign(x509, key, EVP_sha256()) > 0;
+
+  FILE *f = fopen(cert_file.c_str(), "w");
+  ok = ok && f != nullptr && PEM_write_X509(f, x509) == 1;
+  if (f != nullptr)
+    fclose(f);
+  f = fopen(key_file.c_str(), "w");
+  ok = ok && f != nullptr &&
+       PEM_write_PrivateKey(f, key, nullptr, nullptr, 0, nullptr,
+                            nullptr) == 1;
+  if (f != nullptr)
+    fclose(f);
+  X509_free(x509);
+  EVP_PKEY_free(key);
+  return ok;
+}
+
+// Reads from "ssl" until the peer closes, returning everything.
+static string ReadAll(SSL *ssl) {
+  string result;
+  char buf[4096];
+  size_t n;
+  while (SSL_read_ex(ssl, buf, sizeof(buf), &n) == 1)
+    result.append(buf, n);
+  return result;
+}
+
+// Sets up a TLS connection over a socketpair, serving it with an
+// HttpConnection in another thread: the request for "/file" is
+// answered with the file "fname" as the body.  The client offers
+// "session" for resumption, if it isn't null.  Returns the whole
+// response and sets "reused" to whether the session was resumed, and
+// "session" to the new session.
+static string FetchOverTls(TlsContext *ctx, SSL_CTX *client_ctx,
+                           const string &fname, SSL_SESSION **session,
+                           bool *reused) {
+  int spair[2];
+  EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+
+  std::thread server([&]() {
+    HttpConnection hc(spair[0]);
+    ASSERT_TRUE(hc.StartTls(ctx));
+    ASSERT_EQ("h2", hc.alpn_protocol());
+    HttpRequest req;
+    ASSERT_TRUE(hc.GetNextRequest(&req));
+    ASSERT_EQ("/file", req.uri());
+    ASSERT_EQ("close", req.GetHeaderValue("connection"));
+
+    struct stat st;
+    ASSERT_EQ(0, stat(fname.c_str(), &st));
+    HttpResponse rep;
+    rep.set_protocol("HTTP/1.1");
+    rep.set_response_code(200);
+    rep.set_message("OK");
+    rep.set_body_file(fname, 0, st.st_size);
+    ASSERT_TRUE(hc.WriteResponse(rep));
+  });
+
+  SSL *ssl = SSL_new(client_ctx);
+  SSL_set_fd(ssl, spair[1]);
+  if (*session != nullptr)
+    SSL_set_session(ssl, *session);
+  EXPECT_EQ(1, SSL_connect(ssl));
+
+  // The client offered HTTP/2, which the server prefers.
+  const unsigned char *alpn;
+  unsigned int alpn_len;
+  SSL_get0_alpn_selected(ssl, &alpn, &alpn_len);
+  EXPECT_EQ("h2", string(reinterpret_cast<const char *>(alpn), alpn_len));
+  string req = "GET /file HTTP/1.1\r\nConnection: close\r\n\r\n";
+  size_t n;
+  EXPECT_EQ(1, SSL_write_ex(ssl, req.data(), req.size(), &n));
+  string response = ReadAll(ssl);
+  server.join();
+
+  *reused = (SSL_session_reused(ssl) == 1);
+  if (*session != nullptr)
+    SSL_SESSION_free(*session);
+  *session = SSL_get1_session(ssl);
+  // The server has hung up, so just mark the session as cleanly shut
+  // down, without which it would no longer be resumable.
+  SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+  SSL_free(ssl);
+  close(spair[1]);
+  return response;
+}
+
+TEST(Test_Tls, TestTlsTransport) {
+  char dir[] = "/tmp/test_tls_XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+  string cert_file = string(dir) + "/cert.pem";
+  string key_file = string(dir) + "/key.pem";
+  ASSERT_TRUE(MakeSelfSignedCert(cert_file, key_file));
+
+  TlsContext ctx;
+  ASSERT_FALSE(TlsContext().Init(cert_file, "/nonexistent/key.pem"));
+  ASSERT_TRUE(ctx.Init(cert_file, key_file));
+
+  SSL_CTX *client_ctx = SSL_CTX_new(TLS_client_method());
+  ASSERT_NE(nullptr, client_ctx);
+  static const unsigned char kAlpn[] = "\x02h2\x08http/1.1";
+  ASSERT_EQ(0, SSL_CTX_set_alpn_protos(client_ctx, kAlpn, sizeof(kAlpn) - 1));
+
+  // The file comes through intact, after the headers.
+  string expected;
+  FileReader fr(".", "test_files/hextext.txt");
+  ASSERT_TRUE(fr.ReadFile(&expected));
+  SSL_SESSION *session = nullptr;
+  bool reused;
+  string response = FetchOverTls(&ctx, client_ctx, "test_files/hextext.txt",
+                                 &session, &reused);
+  ASSERT_FALSE(reused);
+  ASSERT_EQ(0U, response.find("HTTP/1.1 200 OK\r\n"));
+  ASSERT_NE(string::npos, response.find(
+              "Content-length: " + std::to_string(expected.size()) + "\r\n"));
+  ASSERT_EQ(expected, response.substr(response.find("\r\n\r\n") + 4));
+
+  // Coming back with that session skips the full handshake.
+  ASSERT_NE(nullptr, session);
+  response = FetchOverTls(&ctx, client_ctx, "test_files/hextext.txt",
+                          &session, &reused);
+  ASSERT_TRUE(reused);
+  ASSERT_EQ(expected, response.substr(response.find("\r\n\r\n") + 4));
+
+  SSL_SESSION_free(session);
+  SSL_CTX_free(client_ctx);
+  unlink(cert_file.c_str());
+  unlink(key_file.c_str());
+  rmdir(dir);
+}
+
+}  // namespace hw4
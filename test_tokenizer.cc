@@ -0,0 +1,87 @@
+/*
+ * Copyright ©2020 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2020 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "./Tokenizer.h"
+
+#include "gtest/gtest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+static vector<string> Words(const Tokenizer &tokenizer) {
+  vector<string> words;
+  for (size_t i = 0; i < tokenizer.words().size(); i++)
+    words.push_back(tokenizer.word(i));
+  return words;
+}
+
+TEST(Test_Tokenizer, TestTokenize) {
+  Tokenizer tokenizer;
+  tokenizer.Tokenize("", 0);
+  ASSERT_EQ(0U, tokenizer.words().size());
+
+  string text = "The CAT, the dog; e-mail 42x@[Z]` \xc3\xa9t\xc3\xa9";
+  tokenizer.Tokenize(text.data(), text.size());
+  ASSERT_EQ((vector<string>{"the", "cat", "the", "dog", "e", "mail", "x",
+                            "z", "t"}), Words(tokenizer));
+  ASSERT_EQ(text.size(), tokenizer.lowered().size());
+  ASSERT_EQ("the cat, the dog; e-mail 42x@[z]` \xc3\xa9t\xc3\xa9",
+            tokenizer.lowered());
+
+  // Words that cross the 16- and 32-byte blocks, and one that ends
+  // the text.
+  text = string(14, ' ') + "Hello" + string(12, '.') + "World" +
+    string(30, 'Q');
+  tokenizer.Tokenize(text.data(), text.size());
+  ASSERT_EQ((vector<string>{"hello", "world" + string(30, 'q')}),
+            Words(tokenizer));
+  ASSERT_EQ(14U, tokenizer.words()[0].offset);
+  ASSERT_EQ(31U, tokenizer.words()[1].offset);
+  ASSERT_EQ(35U, tokenizer.words()[1].length);
+}
+
+TEST(Test_Tokenizer, TestSameAsScalar) {
+  // Random texts of every length up to a few blocks, mostly of the
+  // bytes around the letters, must split the same either way.
+  const char kBytes[] = "@AZ[`az{ 09-\x80\xc1\xe1\xfa\xff";
+  uint64_t x = 88172645463325252ULL;
+  Tokenizer vectorized, scalar;
+  for (size_t len = 0; len < 200; len++) {
+    for (int trial = 0; trial < 20; trial++) {
+      string text;
+      for (size_t i = 0; i < len; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        text += (x % 4 == 0) ? kBytes[(x >> 8) % (sizeof(kBytes) - 1)] :
+          static_cast<char>('a' + (x >> 8) % 26);
+      }
+      vectorized.Tokenize(text.data(), text.size());
+      scalar.TokenizeScalar(text.data(), text.size());
+      ASSERT_EQ(scalar.lowered(), vectorized.lowered());
+      ASSERT_EQ(scalar.words().size(), vectorized.words().size());
+      for (size_t i = 0; i < scalar.words().size(); i++) {
+        ASSERT_EQ(scalar.words()[i].offset, vectorized.words()[i].offset);
+        ASSERT_EQ(scalar.words()[i].length, vectorized.words()[i].length);
+      }
+    }
+  }
+}
+
+}  // namespace hw4